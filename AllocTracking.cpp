@@ -0,0 +1,126 @@
+#include "AllocTracking.hpp"
+
+#if ALLOC_TRACKING
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+
+namespace {
+	using namespace AllocTracking;
+
+	//tag names (index 0 is for allocations outside any scope):
+	char const *names[MaxTags] = { "(untagged)" };
+	std::atomic< uint32_t > tag_count{1};
+	std::mutex tag_mutex; //guards registration
+
+	//current frame, counted by the hook (from any thread):
+	std::atomic< uint64_t > frame_allocs[MaxTags];
+	std::atomic< uint64_t > frame_bytes[MaxTags];
+
+	//totals over finished frames (game thread only, in end_frame):
+	struct Totals {
+		uint64_t allocs = 0, bytes = 0;
+		uint64_t worst_allocs = 0, worst_bytes = 0;
+		uint64_t steady_frames = 0; //frames after warm-up that allocated
+	};
+	Totals totals[MaxTags];
+	uint64_t frames = 0;
+	uint64_t last_frame = 0;
+
+	thread_local uint32_t current_tag = 0;
+
+	void record(size_t bytes) {
+		uint32_t t = current_tag;
+		frame_allocs[t].fetch_add(1, std::memory_order_relaxed);
+		frame_bytes[t].fetch_add(bytes, std::memory_order_relaxed);
+	}
+}
+
+uint32_t AllocTracking::tag(char const *name) {
+	std::unique_lock< std::mutex > lock(tag_mutex);
+	uint32_t count = tag_count.load();
+	for (uint32_t t = 0; t < count; ++t) {
+		if (std::strcmp(names[t], name) == 0) return t;
+	}
+	if (count == MaxTags) return 0;
+	names[count] = name;
+	tag_count.store(count + 1);
+	return count;
+}
+
+AllocTracking::Scope::Scope(uint32_t tag) : previous(current_tag) {
+	current_tag = tag;
+}
+
+AllocTracking::Scope::~Scope() {
+	current_tag = previous;
+}
+
+void AllocTracking::end_frame() {
+	uint32_t count = tag_count.load();
+	last_frame = 0;
+	for (uint32_t t = 0; t < count; ++t) {
+		uint64_t allocs = frame_allocs[t].exchange(0, std::memory_order_relaxed);
+		uint64_t bytes = frame_bytes[t].exchange(0, std::memory_order_relaxed);
+		Totals &total = totals[t];
+		total.allocs += allocs;
+		total.bytes += bytes;
+		if (frames >= WarmupFrames) {
+			//(worst cases are also steady-state only, so loading doesn't swamp them)
+			total.worst_allocs = std::max(total.worst_allocs, allocs);
+			total.worst_bytes = std::max(total.worst_bytes, bytes);
+			if (allocs) total.steady_frames += 1;
+		}
+		last_frame += allocs;
+	}
+	frames += 1;
+}
+
+uint64_t AllocTracking::last_frame_allocations() {
+	return last_frame;
+}
+
+void AllocTracking::write_report(std::ostream &out) {
+	char line[200];
+	std::snprintf(line, sizeof(line), "Heap allocations over %llu frames (worst / allocating frames are after the first %u):\n",
+		(unsigned long long)frames, WarmupFrames);
+	out << line;
+	std::snprintf(line, sizeof(line), "  %-20s %12s %12s %12s %12s %10s\n", "tag", "allocs/frame", "bytes/frame", "worst allocs", "worst bytes", "frames");
+	out << line;
+	double per = 1.0 / double(std::max< uint64_t >(frames, 1));
+	uint32_t count = tag_count.load();
+	for (uint32_t t = 0; t < count; ++t) {
+		Totals const &total = totals[t];
+		std::snprintf(line, sizeof(line), "  %-20s %12.1f %12.1f %12llu %12llu %10llu\n", names[t],
+			double(total.allocs) * per, double(total.bytes) * per,
+			(unsigned long long)total.worst_allocs, (unsigned long long)total.worst_bytes,
+			(unsigned long long)total.steady_frames);
+		out << line;
+	}
+}
+
+//------------------------------------------------
+//the hook -- replacements for the global allocation functions:
+// (the standard's default array and nothrow forms call these, so they are covered too)
+
+void *operator new(std::size_t bytes) {
+	record(bytes);
+	void *ptr = std::malloc(bytes == 0 ? 1 : bytes);
+	if (!ptr) throw std::bad_alloc();
+	return ptr;
+}
+
+void operator delete(void *ptr) noexcept {
+	std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept {
+	std::free(ptr);
+}
+
+#endif //ALLOC_TRACKING
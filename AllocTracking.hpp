@@ -0,0 +1,79 @@
+#pragma once
+
+/*
+ * AllocTracking -- counts heap allocations per frame, per tagged scope.
+ *
+ * Usage:
+ *   { ALLOC_SCOPE("draw"); mode->draw(drawable_size); } //allocations in here are counted under "draw"
+ *   AllocTracking::end_frame();                          //once per frame
+ *   AllocTracking::write_report(std::cout);              //at exit
+ *
+ * An instrumentation build (-DALLOC_TRACKING=1) replaces the global operator new / operator delete
+ *  with versions that count each allocation (and its size) against the innermost ALLOC_SCOPE active
+ *  on the allocating thread. Allocations outside any scope -- including everything on worker and
+ *  audio threads -- are counted as "(untagged)".
+ *
+ * The report lists, per tag: allocations and bytes per frame (mean and worst), and how many frames
+ *  after warm-up allocated at all, which should be zero for everything on the per-frame path.
+ *
+ * Notes:
+ *  - only plain operator new (and new[]) is counted; over-aligned allocations go around the hook
+ *  - the hook itself never allocates (tags live in fixed-size arrays)
+ *
+ * Default builds (ALLOC_TRACKING=0) compile all of this to nothing and keep the standard operator new.
+ */
+
+#ifndef ALLOC_TRACKING
+#define ALLOC_TRACKING 0
+#endif
+
+#if ALLOC_TRACKING
+
+#include <cstdint>
+#include <ostream>
+
+namespace AllocTracking {
+	constexpr uint32_t MaxTags = 64; //(tags past this are counted as "(untagged)")
+	constexpr uint32_t WarmupFrames = 120; //frames ignored when checking for steady-state allocations
+
+	//index of the tag named 'name' (registered on first use; 'name' must be a string literal or otherwise live forever):
+	uint32_t tag(char const *name);
+
+	//count allocations on this thread against 'tag' until destroyed (scopes nest):
+	struct Scope {
+		Scope(uint32_t tag);
+		~Scope();
+		uint32_t previous;
+	};
+
+	//fold this frame's counts into the totals:
+	void end_frame();
+
+	//allocations (all tags) during the last finished frame:
+	uint64_t last_frame_allocations();
+
+	//per-tag summary, as a table:
+	void write_report(std::ostream &out);
+}
+
+#define ALLOC_CONCAT2(a, b) a ## b
+#define ALLOC_CONCAT(a, b) ALLOC_CONCAT2(a, b)
+
+#define ALLOC_SCOPE(NAME) \
+	static uint32_t const ALLOC_CONCAT(alloc_tag_, __LINE__) = AllocTracking::tag(NAME); \
+	AllocTracking::Scope ALLOC_CONCAT(alloc_scope_, __LINE__)(ALLOC_CONCAT(alloc_tag_, __LINE__))
+
+#else //ALLOC_TRACKING
+
+#include <cstdint>
+#include <ostream>
+
+namespace AllocTracking {
+	inline void end_frame() { }
+	inline uint64_t last_frame_allocations() { return 0; }
+	inline void write_report(std::ostream &) { }
+}
+
+#define ALLOC_SCOPE(NAME) do { } while (0)
+
+#endif //ALLOC_TRACKING
@@ -0,0 +1,189 @@
+#pragma once
+
+/*
+ * An "Arena< T >" is a growable sequence of T with stable element addresses,
+ *  stored in a few contiguous chunks.
+ *
+ * It is meant as a drop-in replacement for the std::list< T > usage pattern
+ *  of "emplace_back() and keep a pointer to back()":
+ *  - elements never move once constructed, so pointers to them stay valid
+ *  - chunk sizes grow geometrically, so there are only O(log n) chunks
+ *    and iteration is (nearly) linear in memory
+ *  - index_of() maps an element pointer back to its position, which makes
+ *    pointer fix-up after copying one arena into another cheap
+ *
+ * Elements can only be added at the end; clear() destroys all elements
+ *  but keeps the chunks around for reuse.
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+template< typename T >
+struct Arena {
+	Arena() = default;
+	Arena(Arena const &other) { *this = other; }
+	Arena(Arena &&other) { *this = std::move(other); }
+	~Arena() { free_chunks(); }
+
+	Arena &operator=(Arena const &other) {
+		if (this == &other) return *this;
+		clear();
+		reserve(other.size());
+		for (auto const &v : other) {
+			emplace_back(v);
+		}
+		return *this;
+	}
+	Arena &operator=(Arena &&other) {
+		if (this == &other) return *this;
+		free_chunks();
+		chunks = std::move(other.chunks);
+		count = other.count;
+		other.chunks.clear();
+		other.count = 0;
+		return *this;
+	}
+
+	//construct a new element at the end:
+	template< typename... Args >
+	T &emplace_back(Args &&... args) {
+		if (count == capacity()) {
+			add_chunk(std::max< size_t >(MinChunk, capacity()));
+		}
+		T *at = slot(count);
+		new (at) T(std::forward< Args >(args)...);
+		count += 1;
+		return *at;
+	}
+
+	//make room for at least 'total' elements, in one new chunk if needed:
+	void reserve(size_t total) {
+		if (total > capacity()) {
+			add_chunk(std::max< size_t >(MinChunk, total - capacity()));
+		}
+	}
+
+	//destroy all elements (keeps allocated chunks):
+	void clear() {
+		for (auto &chunk : chunks) {
+			if (chunk.first >= count) break;
+			size_t used = std::min(chunk.capacity, count - chunk.first);
+			for (size_t i = 0; i < used; ++i) {
+				chunk.data[i].~T();
+			}
+		}
+		count = 0;
+	}
+
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+
+	T &operator[](size_t index) { return *slot(index); }
+	T const &operator[](size_t index) const { return *slot(index); }
+	T &front() { assert(count); return *slot(0); }
+	T const &front() const { assert(count); return *slot(0); }
+	T &back() { assert(count); return *slot(count - 1); }
+	T const &back() const { assert(count); return *slot(count - 1); }
+
+	//position of an element of this arena (or -1 if 'element' isn't in the arena):
+	size_t index_of(T const *element) const {
+		std::less< T const * > less;
+		for (auto const &chunk : chunks) {
+			if (!less(element, chunk.data) && less(element, chunk.data + chunk.capacity)) {
+				size_t index = chunk.first + size_t(element - chunk.data);
+				return (index < count ? index : size_t(-1));
+			}
+		}
+		return size_t(-1);
+	}
+
+	//forward iteration, chunk by chunk:
+	template< typename V >
+	struct Iterator {
+		typedef std::forward_iterator_tag iterator_category;
+		typedef V value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef V *pointer;
+		typedef V &reference;
+
+		Arena const *arena = nullptr;
+		size_t chunk = 0;
+		V *at = nullptr; //(nullptr at end)
+		V *stop = nullptr; //end of used part of chunk
+
+		Iterator() = default;
+		Iterator(Arena const *arena_, size_t chunk_) : arena(arena_), chunk(chunk_) { enter(); }
+
+		V &operator*() const { return *at; }
+		V *operator->() const { return at; }
+		Iterator &operator++() {
+			++at;
+			if (at == stop) {
+				++chunk;
+				enter();
+			}
+			return *this;
+		}
+		Iterator operator++(int) { Iterator ret = *this; ++(*this); return ret; }
+		bool operator==(Iterator const &o) const { return at == o.at; }
+		bool operator!=(Iterator const &o) const { return at != o.at; }
+
+		void enter() {
+			if (chunk < arena->chunks.size() && arena->chunks[chunk].first < arena->count) {
+				Chunk const &c = arena->chunks[chunk];
+				at = c.data;
+				stop = c.data + std::min(c.capacity, arena->count - c.first);
+			} else {
+				at = stop = nullptr;
+			}
+		}
+	};
+	typedef Iterator< T > iterator;
+	typedef Iterator< T const > const_iterator;
+
+	iterator begin() { return iterator(this, 0); }
+	iterator end() { return iterator(); }
+	const_iterator begin() const { return const_iterator(this, 0); }
+	const_iterator end() const { return const_iterator(); }
+
+	//-- internals ---
+	enum : size_t { MinChunk = 16 };
+	struct Chunk {
+		T *data;
+		size_t capacity;
+		size_t first; //index of data[0]
+	};
+	std::vector< Chunk > chunks;
+	size_t count = 0;
+
+	size_t capacity() const {
+		return chunks.empty() ? 0 : chunks.back().first + chunks.back().capacity;
+	}
+	void free_chunks() {
+		clear();
+		for (auto const &chunk : chunks) {
+			std::allocator< T >().deallocate(chunk.data, chunk.capacity);
+		}
+		chunks.clear();
+	}
+	void add_chunk(size_t size) {
+		chunks.emplace_back(Chunk{ std::allocator< T >().allocate(size), size, capacity() });
+	}
+	T *slot(size_t index) const {
+		assert(index < capacity());
+		auto c = std::upper_bound(chunks.begin(), chunks.end(), index, [](size_t i, Chunk const &chunk) {
+			return i < chunk.first;
+		});
+		assert(c != chunks.begin());
+		--c;
+		return c->data + (index - c->first);
+	}
+};
@@ -0,0 +1,58 @@
+#include "CameraPath.hpp"
+
+#include "read_write_chunk.hpp"
+
+#include <fstream>
+#include <stdexcept>
+
+//stored format (so the file doesn't depend on WalkPoint's layout):
+struct StoredSample {
+	glm::uvec3 indices;
+	glm::vec3 weights;
+	uint32_t triangle;
+	glm::vec4 rotation; //x,y,z,w
+	glm::vec4 camera_rotation;
+};
+static_assert(sizeof(StoredSample) == 4*3 + 4*3 + 4 + 4*4 + 4*4, "StoredSample is packed");
+
+static glm::vec4 to_stored(glm::quat const &q) { return glm::vec4(q.x, q.y, q.z, q.w); }
+static glm::quat from_stored(glm::vec4 const &v) { return glm::quat(v.w, v.x, v.y, v.z); }
+
+CameraPath::CameraPath(std::string const &filename) {
+	std::ifstream file(filename, std::ios::binary);
+	if (!file) throw std::runtime_error("Failed to open camera path '" + filename + "'.");
+
+	std::vector< float > header;
+	read_chunk(file, "cph0", &header);
+	if (header.size() != 1 || !(header[0] > 0.0f)) {
+		throw std::runtime_error("Camera path '" + filename + "' has an invalid header.");
+	}
+	tick = header[0];
+
+	std::vector< StoredSample > stored;
+	read_chunk(file, "cps0", &stored);
+	samples.reserve(stored.size());
+	for (auto const &s : stored) {
+		samples.emplace_back();
+		Sample &sample = samples.back();
+		sample.at = WalkPoint(s.indices, s.weights, s.triangle);
+		sample.rotation = from_stored(s.rotation);
+		sample.camera_rotation = from_stored(s.camera_rotation);
+	}
+}
+
+void CameraPath::save(std::string const &filename) const {
+	std::vector< StoredSample > stored;
+	stored.reserve(samples.size());
+	for (auto const &sample : samples) {
+		stored.emplace_back(StoredSample{
+			sample.at.indices, sample.at.weights, sample.at.triangle,
+			to_stored(sample.rotation), to_stored(sample.camera_rotation)
+		});
+	}
+
+	std::ofstream file(filename, std::ios::binary);
+	write_chunk("cph0", std::vector< float >{ tick }, &file);
+	write_chunk("cps0", stored, &file);
+	if (!file) throw std::runtime_error("Failed to write camera path '" + filename + "'.");
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+/*
+ * CameraPath -- the player's walk through a level, one sample per simulation tick.
+ *
+ * PlayMode records one with '--record-path file' and plays it back with '--replay-path file';
+ *  replays put the player (and so the camera) in exactly the recorded place every frame,
+ *  which makes frame times and draw counts from different builds comparable.
+ */
+
+#include "WalkMesh.hpp"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <string>
+#include <vector>
+
+struct CameraPath {
+	struct Sample {
+		WalkPoint at; //player's location on the walkmesh
+		glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f); //player transform's rotation
+		glm::quat camera_rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f); //camera's rotation (relative to player)
+	};
+	std::vector< Sample > samples;
+	float tick = 0.0f; //seconds per sample
+
+	CameraPath() = default;
+	explicit CameraPath(std::string const &filename); //load (throws on error)
+
+	void save(std::string const &filename) const; //throws on error
+};
@@ -0,0 +1,109 @@
+#include "DebugLines.hpp"
+
+#include "ColorProgram.hpp"
+#include "WalkMesh.hpp"
+#include "gl_errors.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+
+DebugLines::~DebugLines() {
+	if (vao != 0) {
+		glDeleteVertexArrays(1, &vao);
+		vao = 0;
+	}
+	if (buffer != 0) {
+		glDeleteBuffers(1, &buffer);
+		buffer = 0;
+	}
+}
+
+void DebugLines::clear() {
+	vertices.clear();
+	dirty = true;
+}
+
+void DebugLines::add(glm::vec3 const &a, glm::vec3 const &b, glm::u8vec4 const &color) {
+	vertices.emplace_back(a, color);
+	vertices.emplace_back(b, color);
+	dirty = true;
+}
+
+void DebugLines::add_box(glm::vec3 const &min, glm::vec3 const &max, glm::u8vec4 const &color, glm::mat4x3 const &xf) {
+	auto corner = [&](uint32_t i) {
+		return xf * glm::vec4(
+			(i & 1 ? max.x : min.x),
+			(i & 2 ? max.y : min.y),
+			(i & 4 ? max.z : min.z),
+			1.0f
+		);
+	};
+	//each edge joins two corners that differ in one axis bit:
+	for (uint32_t i = 0; i < 8; ++i) {
+		for (uint32_t bit : {1U, 2U, 4U}) {
+			if (!(i & bit)) add(corner(i), corner(i | bit), color);
+		}
+	}
+}
+
+void DebugLines::add_walkmesh(WalkMesh const &walkmesh, glm::u8vec4 const &color) {
+	vertices.reserve(vertices.size() + 2 * 3 * walkmesh.triangles.size());
+	bool have_twins = (walkmesh.twins.size() == 3 * walkmesh.triangles.size());
+	for (uint32_t t = 0; t < walkmesh.triangles.size(); ++t) {
+		glm::uvec3 const &tri = walkmesh.triangles[t];
+		for (uint32_t e = 0; e < 3; ++e) {
+			//shared edges are added by whichever side has the lower edge index:
+			if (have_twins && walkmesh.twins[3*t+e] != -1U && walkmesh.twins[3*t+e] < 3*t+e) continue;
+			add(walkmesh.vertices[tri[e]], walkmesh.vertices[tri[(e+1)%3]], color);
+		}
+	}
+}
+
+void DebugLines::draw(glm::mat4 const &world_to_clip) {
+	if (vao == 0) {
+		//same vertex layout as DrawLines:
+		glGenBuffers(1, &buffer);
+		glGenVertexArrays(1, &vao);
+		glBindVertexArray(vao);
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		glVertexAttribPointer(
+			color_program->Position_vec4, //attribute
+			3, //size
+			GL_FLOAT, //type
+			GL_FALSE, //normalized
+			sizeof(DrawLines::Vertex), //stride
+			(GLbyte *)0 + offsetof(DrawLines::Vertex, Position) //offset
+		);
+		glEnableVertexAttribArray(color_program->Position_vec4);
+		glVertexAttribPointer(
+			color_program->Color_vec4, //attribute
+			4, //size
+			GL_UNSIGNED_BYTE, //type
+			GL_TRUE, //normalized
+			sizeof(DrawLines::Vertex), //stride
+			(GLbyte *)0 + offsetof(DrawLines::Vertex, Color) //offset
+		);
+		glEnableVertexAttribArray(color_program->Color_vec4);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindVertexArray(0);
+		dirty = true;
+	}
+
+	if (dirty) {
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(vertices[0]), vertices.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		uploaded = GLsizei(vertices.size());
+		dirty = false;
+	}
+
+	if (uploaded == 0) return;
+
+	glUseProgram(color_program->program);
+	glUniformMatrix4fv(color_program->OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(world_to_clip));
+	glBindVertexArray(vao);
+	glDrawArrays(GL_LINES, 0, uploaded);
+	glBindVertexArray(0);
+	glUseProgram(0);
+
+	GL_ERRORS();
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+/*
+ * DebugLines -- retained version of DrawLines for debug geometry that rarely changes
+ *  (walkmesh wireframes, mesh bounds, ...).
+ *
+ * Lines are added once and kept on the GPU in their own vertex buffer;
+ *  the buffer is only re-uploaded when lines are added or cleared.
+ *
+ * Usage:
+ *   DebugLines walkmesh_lines;
+ *   walkmesh_lines.add_walkmesh(*walkmesh, glm::u8vec4(0x88, 0x00, 0xff, 0xff)); //once
+ *   ...
+ *   walkmesh_lines.draw(world_to_clip); //every frame
+ *
+ * Drawn with ColorProgram, just like DrawLines.
+ */
+
+#include "DrawLines.hpp"
+#include "GL.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+struct WalkMesh;
+
+struct DebugLines {
+	DebugLines() = default;
+	~DebugLines();
+
+	DebugLines(DebugLines const &) = delete;
+	DebugLines &operator=(DebugLines const &) = delete;
+
+	//remove all lines:
+	void clear();
+
+	//add a single line from a to b:
+	void add(glm::vec3 const &a, glm::vec3 const &b, glm::u8vec4 const &color = glm::u8vec4(0xff));
+	//add the edges of an axis-aligned box (e.g., Mesh::min / Mesh::max), optionally transformed by 'xf':
+	void add_box(glm::vec3 const &min, glm::vec3 const &max, glm::u8vec4 const &color = glm::u8vec4(0xff), glm::mat4x3 const &xf = glm::mat4x3(1.0f));
+	//add every edge of a walkmesh (edges shared by two triangles are only added once):
+	void add_walkmesh(WalkMesh const &walkmesh, glm::u8vec4 const &color = glm::u8vec4(0xff));
+
+	//draw all lines (uploading them first if they changed since the last draw):
+	void draw(glm::mat4 const &world_to_clip);
+
+	//internals:
+	std::vector< DrawLines::Vertex > vertices; //CPU copy of the lines (kept so that add() can append)
+	bool dirty = false; //vertices changed since last upload?
+	GLsizei uploaded = 0; //number of vertices in buffer
+	GLuint buffer = 0; //created on first draw
+	GLuint vao = 0;
+};
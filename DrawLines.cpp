@@ -3,15 +3,32 @@
 #include "ColorProgram.hpp"
 
 #include "gl_errors.hpp"
+#include "Arena.hpp"
+#include "AllocTracking.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
 //All DrawLines instances share a vertex array object and vertex buffer, initialized at load time:
 
 //n.b. declared static so they don't conflict with similarly named global variables elsewhere:
 static GLuint vertex_buffer = 0;
 static GLuint vertex_buffer_for_color_program = 0;
 
+//vertex_buffer is used as a stream: each DrawLines appends its vertices after the previous one's,
+// and the buffer is only orphaned (re-specified without data) once it fills up, so uploads
+// never overwrite vertices that an earlier, possibly still in-flight, draw is reading:
+static GLsizeiptr vertex_buffer_size = 0; //bytes allocated since the last orphan
+static GLsizeiptr vertex_buffer_used = 0; //bytes handed out since the last orphan
+static constexpr GLsizeiptr MinVertexBufferSize = 1 << 20; //(65536 vertices)
+
+//attribs vectors from finished DrawLines, reused so per-frame drawing doesn't reallocate:
+static std::vector< std::vector< DrawLines::Vertex > > spare_attribs;
+static constexpr size_t MaxSpareAttribs = 8;
+
 static Load< void > setup_buffers(LoadTagDefault, [](){
 	//you may recognize this init code from DrawSprites.cpp:
 
@@ -64,6 +81,10 @@ static Load< void > setup_buffers(LoadTagDefault, [](){
 
 
 DrawLines::DrawLines(glm::mat4 const &world_to_clip_) : world_to_clip(world_to_clip_) {
+	if (!spare_attribs.empty()) {
+		attribs = std::move(spare_attribs.back());
+		spare_attribs.pop_back();
+	}
 }
 
 void DrawLines::draw(glm::vec3 const &a, glm::vec3 const &b, glm::u8vec4 const &color) {
@@ -90,56 +111,99 @@ void DrawLines::draw_box(glm::mat4x3 const &mat, glm::u8vec4 const &color) {
 	draw(mat * glm::vec4( 1.0f, 1.0f,-1.0f, 1.0f), mat * glm::vec4( 1.0f, 1.0f, 1.0f, 1.0f), color);
 }
 
-void DrawLines::draw_text(std::string const &text, glm::vec3 const &anchor_in, glm::vec3 const &x, glm::vec3 const &y, glm::u8vec4 const &color, glm::vec3 *anchor_out) {
-
-	glm::vec3 anchor = anchor_in;
-
-	uint32_t start = 0;
-	while (start < text.size()) {
-		uint32_t end = start;
-		uint32_t glyph = -1U;
-		while (end < text.size()) {
-			end += 1;
-			auto f = PathFont::font.glyph_map.find(text.substr(start, end-start));
-			if (f == PathFont::font.glyph_map.end()) {
-				end -= 1;
-				break;
+//text runs: each string's glyph line endpoints in a unit frame (x along the text, y up), plus the total advance,
+// so redrawing the same text is just a transform and a copy:
+namespace {
+	struct TextRun {
+		std::vector< glm::vec2 > coords;
+		float advance = 0.0f;
+	};
+	//cached runs, keyed by views of their own copy of the text (so lookups don't need to build a std::string):
+	Arena< std::string > text_run_strings; //(stable addresses, so the keys stay valid)
+	std::unordered_map< std::string_view, TextRun > text_runs;
+	//once the cache is full it is cleared (keys and all), so text that changes every frame can't grow it without bound:
+	constexpr size_t MaxTextRuns = 256;
+
+	void build_text_run(std::string_view const &text, TextRun *run_) {
+		TextRun &run = *run_;
+		float at = 0.0f;
+		size_t start = 0;
+		while (start < text.size()) {
+			size_t length = 0;
+			uint32_t glyph = PathFont::font.match(text.data() + start, text.size() - start, &length);
+			if (glyph == -1U) {
+				//missing! draw a tofu:
+				for (const auto &pt : {
+					glm::vec2(0.1f, 0.1f), glm::vec2(0.6f, 0.1f),
+					glm::vec2(0.6f, 0.1f), glm::vec2(0.6f, 0.9f),
+					glm::vec2(0.9f, 0.6f), glm::vec2(0.1f, 0.9f),
+					glm::vec2(0.1f, 0.9f), glm::vec2(0.1f, 0.1f)
+				}) {
+					run.coords.emplace_back(at + pt.x, pt.y);
+				}
+				at += 0.6f;
+				length = 1;
+			} else {
+				for (uint32_t c = PathFont::font.glyph_coord_starts[glyph]; c + 1 < PathFont::font.glyph_coord_starts[glyph+1]; c += 2) {
+					run.coords.emplace_back(at + PathFont::font.coords[c], PathFont::font.coords[c+1]);
+				}
+				at += PathFont::font.glyph_widths[glyph];
 			}
-			glyph = f->second;
+			start += length;
 		}
-		if (glyph == -1U) {
-			assert(start == end);
-			end += 1;
-			//missing! draw a tofu:
-			for (const auto &pt : {
-				glm::vec2(0.1f, 0.1f), glm::vec2(0.6f, 0.1f),
-				glm::vec2(0.6f, 0.1f), glm::vec2(0.6f, 0.9f),
-				glm::vec2(0.9f, 0.6f), glm::vec2(0.1f, 0.9f),
-				glm::vec2(0.1f, 0.9f), glm::vec2(0.1f, 0.1f)
-			}) {
-				attribs.emplace_back(anchor + pt.x * x + pt.y * y, color);
-			}
-			anchor += x * 0.6f;
-		} else {
-			for (uint32_t c = PathFont::font.glyph_coord_starts[glyph]; c + 1 < PathFont::font.glyph_coord_starts[glyph+1]; c += 2) {
-				attribs.emplace_back(anchor + x * PathFont::font.coords[c] + y * PathFont::font.coords[c+1], color);
-			}
-			anchor += x * PathFont::font.glyph_widths[glyph];
+		run.advance = at;
+	}
+}
+
+void DrawLines::draw_text(std::string_view const &text, glm::vec3 const &anchor, glm::vec3 const &x, glm::vec3 const &y, glm::u8vec4 const &color, glm::vec3 *anchor_out) {
+	ALLOC_SCOPE("DrawLines");
+	auto f = text_runs.find(text);
+	if (f == text_runs.end()) {
+		if (text_runs.size() >= MaxTextRuns) {
+			text_runs.clear(); //(before the strings its keys view)
+			text_run_strings.clear(); //(keeps the arena's chunks for reuse)
 		}
-		start = end;
+		std::string const &key = text_run_strings.emplace_back(text);
+		f = text_runs.emplace(std::string_view(key), TextRun()).first;
+		build_text_run(key, &f->second);
+	}
+	TextRun const &run = f->second;
+
+	for (glm::vec2 const &c : run.coords) {
+		attribs.emplace_back(anchor + c.x * x + c.y * y, color);
 	}
 
-	if (anchor_out) *anchor_out = anchor;
+	if (anchor_out) *anchor_out = anchor + run.advance * x;
 }
 
 DrawLines::~DrawLines() {
-	if (attribs.empty()) return;
+	if (attribs.empty()) {
+		recycle_attribs();
+		return;
+	}
 
 	//based on DrawSprites.cpp :
 
-	//upload vertices to vertex_buffer:
+	//upload vertices to the next free part of vertex_buffer:
+	GLsizeiptr bytes = GLsizeiptr(attribs.size() * sizeof(attribs[0]));
 	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer); //set vertex_buffer as current
-	glBufferData(GL_ARRAY_BUFFER, attribs.size() * sizeof(attribs[0]), attribs.data(), GL_STREAM_DRAW); //upload attribs array
+	if (vertex_buffer_used + bytes > vertex_buffer_size) {
+		//out of room: orphan the buffer (growing it if these vertices wouldn't fit at all) and start again from the beginning:
+		vertex_buffer_size = std::max(vertex_buffer_size, MinVertexBufferSize);
+		while (vertex_buffer_size < bytes) vertex_buffer_size *= 2;
+		glBufferData(GL_ARRAY_BUFFER, vertex_buffer_size, nullptr, GL_STREAM_DRAW);
+		vertex_buffer_used = 0;
+	}
+	GLintptr offset = vertex_buffer_used;
+	vertex_buffer_used += bytes;
+	//(unsynchronized is safe: nothing has used this range since the buffer was last orphaned)
+	void *mapped = glMapBufferRange(GL_ARRAY_BUFFER, offset, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (mapped) {
+		std::memcpy(mapped, attribs.data(), size_t(bytes));
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+	} else {
+		glBufferSubData(GL_ARRAY_BUFFER, offset, bytes, attribs.data());
+	}
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
 	//set color_program as current program:
@@ -152,13 +216,22 @@ DrawLines::~DrawLines() {
 	glBindVertexArray(vertex_buffer_for_color_program);
 
 	//run the OpenGL pipeline:
-	glDrawArrays(GL_LINES, 0, GLsizei(attribs.size()));
+	glDrawArrays(GL_LINES, GLint(offset / GLintptr(sizeof(attribs[0]))), GLsizei(attribs.size()));
 
 	//reset vertex array to none:
 	glBindVertexArray(0);
 
 	//reset current program to none:
 	glUseProgram(0);
+
+	recycle_attribs();
+}
+
+void DrawLines::recycle_attribs() {
+	if (spare_attribs.size() < MaxSpareAttribs && attribs.capacity() > 0) {
+		attribs.clear();
+		spare_attribs.emplace_back(std::move(attribs));
+	}
 }
 
 
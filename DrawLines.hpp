@@ -6,12 +6,16 @@
  *
  * Similar usage pattern to DrawSprites.
  *
+ * All DrawLines share one streaming vertex buffer (each instance's vertices go
+ * after the previous instance's), and reuse each other's attribs storage, so
+ * drawing lots of them each frame doesn't reallocate anything.
  */
 
 
 #include <glm/glm.hpp>
 
 #include <string>
+#include <string_view>
 #include <vector>
 
 struct DrawLines {
@@ -26,7 +30,8 @@ struct DrawLines {
 
 	//draw wireframe text, start at anchor, move in x direction, mat gives x and y directions for text drawing:
 	// (default character box is 1 unit high)
-	void draw_text(std::string const &text,
+	// (takes a string_view, so drawing a literal or a char buffer doesn't build a std::string)
+	void draw_text(std::string_view const &text,
 		glm::vec3 const &anchor,
 		glm::vec3 const &x = glm::vec3(1.0f, 0.0f, 0.0f),
 		glm::vec3 const &y = glm::vec3(0.0f, 1.0f, 1.0f),
@@ -36,6 +41,9 @@ struct DrawLines {
 	//Finish drawing (push attribs to GPU):
 	~DrawLines();
 
+	DrawLines(DrawLines const &) = delete;
+	DrawLines &operator=(DrawLines const &) = delete;
+
 
 	glm::mat4 world_to_clip;
 	struct Vertex {
@@ -45,4 +53,7 @@ struct DrawLines {
 	};
 	std::vector< Vertex > attribs;
 
+	//hand attribs' storage back for a later DrawLines to use:
+	void recycle_attribs();
+
 };
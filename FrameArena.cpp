@@ -0,0 +1,114 @@
+#include "FrameArena.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+
+namespace {
+
+struct Block {
+	char *data = nullptr;
+	size_t size = 0;
+};
+
+constexpr size_t InitialSize = 1 << 20; //(1MB)
+constexpr uint32_t MaxExtra = 32; //extra blocks per frame (each at least doubles the space, so this is plenty)
+
+Block block; //main block
+Block extra[MaxExtra]; //blocks added since the last reset (fixed array, so tracking them doesn't allocate)
+uint32_t extra_count = 0;
+
+//allocations come from the end of the newest block:
+char *at = nullptr;
+char *end = nullptr;
+char *last = nullptr; //start of the most recent allocation (for deallocate)
+size_t used_bytes = 0;
+uint32_t added = 0;
+
+Block new_block(size_t size) {
+	Block b;
+	b.data = static_cast< char * >(std::malloc(size));
+	if (!b.data) throw std::bad_alloc();
+	b.size = size;
+	added += 1;
+	return b;
+}
+
+} //namespace
+
+void *FrameArena::allocate(size_t bytes, size_t align) {
+	assert(align != 0 && (align & (align - 1)) == 0);
+	if (bytes == 0) bytes = 1;
+
+	auto aligned = [align](char *ptr) {
+		return reinterpret_cast< char * >((reinterpret_cast< uintptr_t >(ptr) + (align - 1)) & ~uintptr_t(align - 1));
+	};
+
+	char *ptr = (at ? aligned(at) : nullptr);
+	if (!ptr || ptr + bytes > end) {
+		//out of space: start a new block (at least double the space so far, and big enough for this allocation):
+		size_t size = std::max(InitialSize, block.size);
+		for (uint32_t i = 0; i < extra_count; ++i) size += extra[i].size;
+		size = std::max(size, bytes + align);
+
+		if (!block.data) {
+			block = new_block(size);
+			at = block.data;
+			end = block.data + block.size;
+		} else {
+			if (extra_count == MaxExtra) throw std::bad_alloc();
+			extra[extra_count] = new_block(size);
+			at = extra[extra_count].data;
+			end = at + extra[extra_count].size;
+			extra_count += 1;
+		}
+		ptr = aligned(at);
+	}
+
+	at = ptr + bytes;
+	last = ptr;
+	used_bytes += bytes;
+	return ptr;
+}
+
+void FrameArena::deallocate(void *ptr, size_t bytes) {
+	if (ptr && ptr == last) {
+		//(only the most recent allocation can go back; alignment padding before it is not recovered)
+		at = last;
+		last = nullptr;
+		used_bytes -= std::min(used_bytes, bytes == 0 ? size_t(1) : bytes);
+	}
+}
+
+void FrameArena::reset() {
+	if (extra_count != 0) {
+		//the frame didn't fit, so replace everything with one block that holds all of it:
+		size_t size = block.size;
+		for (uint32_t i = 0; i < extra_count; ++i) {
+			size += extra[i].size;
+			std::free(extra[i].data);
+			extra[i] = Block();
+		}
+		extra_count = 0;
+		std::free(block.data);
+		block = new_block(size);
+	}
+	at = block.data;
+	end = block.data + block.size;
+	last = nullptr;
+	used_bytes = 0;
+}
+
+size_t FrameArena::used() {
+	return used_bytes;
+}
+
+size_t FrameArena::capacity() {
+	size_t size = block.size;
+	for (uint32_t i = 0; i < extra_count; ++i) size += extra[i].size;
+	return size;
+}
+
+uint32_t FrameArena::blocks_added() {
+	return added;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+/*
+ * FrameArena -- linear (bump-pointer) allocator for per-frame temporaries.
+ *
+ * Usage:
+ *   FrameArena::vector< Command > batch; //std::vector whose storage comes from the arena
+ *   batch.reserve(count);
+ *   ...
+ *   FrameArena::reset(); //once per main-loop iteration (main.cpp does this), after everything from the frame is gone
+ *
+ * allocate() just bumps a pointer, and deallocating is free (only the most recent allocation is actually
+ *  given back, which lets a growing vector reuse its old space). reset() makes all of the space free again.
+ *
+ * The arena starts with one block; when a frame needs more, it takes extra blocks from the heap, and the
+ *  next reset() replaces them all with one block big enough for the whole frame -- so after a few frames
+ *  the arena settles at the frame's peak use and stops touching the heap at all.
+ *
+ * Notes:
+ *  - game thread only (not for job/worker threads or the audio callback)
+ *  - nothing allocated from the arena may outlive the frame; reset() doesn't run destructors
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+namespace FrameArena {
+	//'bytes' of storage aligned to 'align' (a power of two), valid until the next reset():
+	void *allocate(size_t bytes, size_t align = alignof(std::max_align_t));
+
+	//give back the most recent allocation (any other pointer is ignored until reset()):
+	void deallocate(void *ptr, size_t bytes);
+
+	//free everything allocated since the last reset (and merge any extra blocks into one):
+	void reset();
+
+	//stats (since the last reset):
+	size_t used(); //bytes handed out
+	size_t capacity(); //bytes available without going to the heap
+	uint32_t blocks_added(); //total number of times the arena has had to go to the heap for more space
+
+	//standard allocator using the arena (for containers of per-frame temporaries):
+	template< typename T >
+	struct Allocator {
+		typedef T value_type;
+		Allocator() = default;
+		template< typename U >
+		Allocator(Allocator< U > const &) { }
+
+		T *allocate(size_t n) { return static_cast< T * >(FrameArena::allocate(n * sizeof(T), alignof(T))); }
+		void deallocate(T *ptr, size_t n) { FrameArena::deallocate(ptr, n * sizeof(T)); }
+
+		template< typename U >
+		bool operator==(Allocator< U > const &) const { return true; }
+		template< typename U >
+		bool operator!=(Allocator< U > const &) const { return false; }
+	};
+
+	template< typename T >
+	using vector = std::vector< T, Allocator< T > >;
+}
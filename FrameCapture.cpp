@@ -0,0 +1,166 @@
+#include "FrameCapture.hpp"
+
+#include "load_save_png.hpp"
+#include "gl_errors.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+FrameCapture::~FrameCapture() {
+	shutdown();
+}
+
+void FrameCapture::request(std::string const &filename) {
+	requested = filename;
+}
+
+void FrameCapture::start_recording(std::string const &prefix) {
+	record_prefix = prefix;
+	record_frame = 0;
+	dropped = 0;
+}
+
+void FrameCapture::stop_recording() {
+	if (recording()) {
+		std::cout << "Recorded " << record_frame << " frames to '" << record_prefix << "-*.png'";
+		if (dropped) std::cout << " (dropped " << dropped << ")";
+		std::cout << "." << std::endl;
+	}
+	record_prefix.clear();
+}
+
+void FrameCapture::capture(glm::uvec2 const &drawable_size) {
+	//collect finished readbacks, oldest first, without waiting:
+	for (uint32_t i = 0; i < Slots; ++i) {
+		Readback &slot = slots[(next_slot + i) % Slots];
+		if (slot.fence && !collect(slot, false)) break;
+	}
+
+	std::string filename;
+	if (!requested.empty()) {
+		filename = requested;
+		requested.clear();
+	} else if (recording()) {
+		bool behind;
+		{
+			std::lock_guard< std::mutex > lock(mutex);
+			behind = (jobs.size() >= MaxQueuedJobs);
+		}
+		if (behind) {
+			dropped += 1;
+			return;
+		}
+		char number[16];
+		std::snprintf(number, sizeof(number), "%06u", record_frame);
+		filename = record_prefix + "-" + number + ".png";
+		record_frame += 1;
+	}
+	if (filename.empty()) return;
+
+	//all slots in flight? finish the oldest (only happens if the GPU is several frames behind):
+	Readback &slot = slots[next_slot];
+	if (slot.fence) collect(slot, true);
+	next_slot = (next_slot + 1) % Slots;
+
+	GLsizeiptr bytes = GLsizeiptr(drawable_size.x) * GLsizeiptr(drawable_size.y) * 4;
+	if (slot.buffer == 0) glGenBuffers(1, &slot.buffer);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	if (slot.size != drawable_size) {
+		glBufferData(GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_READ);
+		slot.size = drawable_size;
+	}
+
+	//read the frame just drawn (into the buffer, so this returns right away):
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	glReadBuffer(GL_BACK);
+	glReadPixels(0, 0, GLsizei(drawable_size.x), GLsizei(drawable_size.y), GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot.filename = filename;
+
+	GL_ERRORS();
+}
+
+bool FrameCapture::collect(Readback &slot, bool wait) {
+	if (!slot.fence) return true;
+
+	GLenum status = glClientWaitSync(slot.fence, (wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0), (wait ? GLuint64(1000000000) : 0));
+	if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+		if (!wait) return false;
+		std::cerr << "WARNING: frame capture readback for '" << slot.filename << "' didn't finish; skipping it." << std::endl;
+	} else {
+		Job job;
+		job.filename = slot.filename;
+		job.size = slot.size;
+		job.pixels.resize(size_t(slot.size.x) * size_t(slot.size.y));
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+		void const *mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, GLsizeiptr(job.pixels.size() * sizeof(glm::u8vec4)), GL_MAP_READ_BIT);
+		if (mapped) {
+			std::memcpy(job.pixels.data(), mapped, job.pixels.size() * sizeof(glm::u8vec4));
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		if (mapped) {
+			//hand off to the encoder thread (started on first use):
+			{
+				std::lock_guard< std::mutex > lock(mutex);
+				jobs.emplace_back(std::move(job));
+			}
+			jobs_cv.notify_one();
+			if (!encoder.joinable()) {
+				encoder = std::thread([this]() {
+					std::unique_lock< std::mutex > lock(mutex);
+					while (true) {
+						jobs_cv.wait(lock, [this]() { return quit || !jobs.empty(); });
+						if (jobs.empty()) break; //(quit, and nothing left to do)
+						Job job = std::move(jobs.front());
+						jobs.pop_front();
+						lock.unlock();
+						for (auto &px : job.pixels) {
+							px.a = 0xff;
+						}
+						try {
+							save_png(job.filename, job.size, job.pixels.data(), LowerLeftOrigin);
+						} catch (std::exception &e) {
+							std::cerr << "WARNING: failed to save '" << job.filename << "': " << e.what() << std::endl;
+						}
+						lock.lock();
+					}
+				});
+			}
+		} else {
+			std::cerr << "WARNING: couldn't map frame capture readback for '" << slot.filename << "'; skipping it." << std::endl;
+		}
+	}
+
+	glDeleteSync(slot.fence);
+	slot.fence = 0;
+	return true;
+}
+
+void FrameCapture::shutdown() {
+	stop_recording();
+
+	for (uint32_t i = 0; i < Slots; ++i) {
+		Readback &slot = slots[(next_slot + i) % Slots];
+		if (slot.fence) collect(slot, true);
+		if (slot.buffer) {
+			glDeleteBuffers(1, &slot.buffer);
+			slot.buffer = 0;
+		}
+		slot.size = glm::uvec2(0);
+	}
+
+	if (encoder.joinable()) {
+		{
+			std::lock_guard< std::mutex > lock(mutex);
+			quit = true;
+		}
+		jobs_cv.notify_all();
+		encoder.join();
+		quit = false;
+	}
+}
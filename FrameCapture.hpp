@@ -0,0 +1,82 @@
+#pragma once
+
+/*
+ * FrameCapture -- screenshots (and continuous frame capture) without stalling.
+ *
+ * Pixels are read into a small ring of pixel buffer objects, and only mapped
+ *  once a fence says the GPU has finished writing them (a frame or two later);
+ *  PNG encoding happens on a background thread.
+ *
+ * Usage (see main.cpp):
+ *   frame_capture.request("screenshot.png");  //save the next frame
+ *   frame_capture.start_recording("capture"); //save every frame, as capture-000000.png, capture-000001.png, ...
+ *   frame_capture.capture(drawable_size);     //every frame, after drawing and before swap
+ *   frame_capture.shutdown();                 //before destroying the GL context (saves anything still in flight)
+ */
+
+#include "GL.hpp"
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct FrameCapture {
+	FrameCapture() = default;
+	~FrameCapture(); //(calls shutdown())
+
+	FrameCapture(FrameCapture const &) = delete;
+	FrameCapture &operator=(FrameCapture const &) = delete;
+
+	//save the next captured frame as a PNG:
+	void request(std::string const &filename);
+
+	//save every frame until stop_recording(), as '<prefix>-NNNNNN.png':
+	// (frames are skipped -- and counted in 'dropped' -- if the encoder falls too far behind)
+	void start_recording(std::string const &prefix);
+	void stop_recording();
+	bool recording() const { return !record_prefix.empty(); }
+	uint32_t dropped = 0;
+
+	//start reading back the current (back buffer) frame if it should be saved, and hand finished readbacks to the encoder:
+	void capture(glm::uvec2 const &drawable_size);
+
+	//finish all readbacks and encodes, and free GL objects:
+	void shutdown();
+
+	//internals:
+	struct Readback {
+		GLuint buffer = 0; //pixel pack buffer
+		GLsync fence = 0; //signaled once the read into 'buffer' is done (0 if slot is free)
+		glm::uvec2 size = glm::uvec2(0);
+		std::string filename;
+	};
+	static constexpr uint32_t Slots = 3;
+	std::array< Readback, Slots > slots;
+	uint32_t next_slot = 0; //next slot to read into (slots are collected in the same order)
+
+	std::string requested; //filename for next frame (if any)
+	std::string record_prefix; //prefix for recorded frames (if recording)
+	uint32_t record_frame = 0;
+
+	//finish the readback in 'slot' (waiting for it if 'wait' is set; otherwise only if its fence has signaled); returns true if done:
+	bool collect(Readback &slot, bool wait);
+
+	//encoder thread:
+	struct Job {
+		std::string filename;
+		glm::uvec2 size;
+		std::vector< glm::u8vec4 > pixels;
+	};
+	static constexpr uint32_t MaxQueuedJobs = 8; //(recorded frames are dropped beyond this; requested screenshots never are)
+	std::mutex mutex; //guards jobs, quit
+	std::condition_variable jobs_cv;
+	std::deque< Job > jobs;
+	bool quit = false;
+	std::thread encoder;
+};
@@ -0,0 +1,91 @@
+#include "FrameTimes.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+
+FrameTimes::FrameTimes() : frames(History) {
+}
+
+void FrameTimes::begin_frame() {
+	current = Frame();
+	frame_start = phase_start = std::chrono::steady_clock::now();
+}
+
+void FrameTimes::end_phase(Phase phase) {
+	assert(phase < PhaseCount);
+	auto now = std::chrono::steady_clock::now();
+	current.ms[phase] += std::chrono::duration< float, std::milli >(now - phase_start).count();
+	phase_start = now;
+}
+
+void FrameTimes::end_frame() {
+	current.total_ms = std::chrono::duration< float, std::milli >(std::chrono::steady_clock::now() - frame_start).count();
+	frames[recorded % History] = current;
+	recorded += 1;
+}
+
+uint32_t FrameTimes::size() const {
+	return uint32_t(std::min< uint64_t >(recorded, History));
+}
+
+FrameTimes::Frame const &FrameTimes::operator[](uint32_t i) const {
+	assert(i < size());
+	uint64_t first = recorded - size();
+	return frames[(first + i) % History];
+}
+
+float FrameTimes::percentile(uint32_t phase, float p) const {
+	assert(phase <= PhaseCount);
+	uint32_t count = size();
+	if (count == 0) return 0.0f;
+
+	std::vector< float > values(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		Frame const &frame = (*this)[i];
+		values[i] = (phase == PhaseCount ? frame.total_ms : frame.ms[phase]);
+	}
+	//nearest-rank percentile:
+	uint32_t rank = uint32_t(std::ceil(std::clamp(p, 0.0f, 100.0f) / 100.0f * float(count)));
+	uint32_t index = std::max(rank, 1U) - 1;
+	std::nth_element(values.begin(), values.begin() + index, values.end());
+	return values[index];
+}
+
+void FrameTimes::write_csv(std::string const &filename) const {
+	std::ofstream out(filename);
+	if (!out) throw std::runtime_error("Failed to open '" + filename + "' for writing frame times.");
+
+	//per-frame times:
+	out << "frame";
+	for (auto name : PhaseNames) out << ',' << name << "_ms";
+	out << ",total_ms\n";
+	uint64_t first = recorded - size();
+	for (uint32_t i = 0; i < size(); ++i) {
+		Frame const &frame = (*this)[i];
+		out << (first + i);
+		for (float ms : frame.ms) out << ',' << ms;
+		out << ',' << frame.total_ms << '\n';
+	}
+
+	//summary:
+	out << "\nphase,frames,mean_ms,p50_ms,p95_ms,p99_ms,max_ms\n";
+	for (uint32_t phase = 0; phase <= PhaseCount; ++phase) {
+		double sum = 0.0;
+		for (uint32_t i = 0; i < size(); ++i) {
+			Frame const &frame = (*this)[i];
+			sum += (phase == PhaseCount ? frame.total_ms : frame.ms[phase]);
+		}
+		out << (phase == PhaseCount ? "total" : PhaseNames[phase]) << ','
+			<< size() << ','
+			<< (size() ? sum / size() : 0.0) << ','
+			<< percentile(phase, 50.0f) << ','
+			<< percentile(phase, 95.0f) << ','
+			<< percentile(phase, 99.0f) << ','
+			<< percentile(phase, 100.0f) << '\n';
+	}
+
+	if (!out) throw std::runtime_error("Failed to write frame times to '" + filename + "'.");
+}
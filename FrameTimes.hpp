@@ -0,0 +1,66 @@
+#pragma once
+
+/*
+ * FrameTimes -- records how long each phase of every frame takes, for comparing builds and hardware.
+ *
+ * Unlike the Profiler overlay, this is always on and keeps a long history;
+ *  it costs one clock read per phase, into storage allocated up front.
+ *
+ * Usage (see main.cpp):
+ *   frame_times.begin_frame();
+ *   //...poll events...
+ *   frame_times.end_phase(FrameTimes::Events);
+ *   //...update, draw, swap, each followed by end_phase()...
+ *   frame_times.end_frame();
+ *
+ *   frame_times.write_csv("frame-times.csv"); //per-frame rows, then p50/p95/p99 per phase
+ */
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct FrameTimes {
+	enum Phase : uint32_t {
+		Events,
+		Update,
+		Draw,
+		Swap,
+		PhaseCount
+	};
+	static constexpr std::array< char const *, PhaseCount > PhaseNames{ "events", "update", "draw", "swap" };
+
+	//number of frames kept (older frames are overwritten):
+	static constexpr uint32_t History = 1 << 15; //(about nine minutes at 60fps)
+
+	FrameTimes();
+
+	void begin_frame();
+	void end_phase(Phase phase); //phase time is the time since begin_frame() or the previous end_phase()
+	void end_frame(); //record the frame (a frame without end_frame() -- e.g., quitting mid-frame -- is dropped)
+
+	struct Frame {
+		std::array< float, PhaseCount > ms{}; //per-phase time
+		float total_ms = 0.0f; //begin_frame() to end_frame()
+	};
+
+	//number of frames currently in history:
+	uint32_t size() const;
+	//frames in history, oldest first:
+	Frame const &operator[](uint32_t i) const;
+
+	//percentile (0-100) of one phase's time -- or of the whole frame, for phase == PhaseCount -- over history:
+	float percentile(uint32_t phase, float p) const;
+
+	//write every frame in history, followed by a summary (count, mean, p50, p95, p99, max) per phase:
+	// throws on error
+	void write_csv(std::string const &filename) const;
+
+	//internals:
+	std::vector< Frame > frames; //ring buffer, History entries
+	uint64_t recorded = 0; //total frames recorded
+	Frame current;
+	std::chrono::steady_clock::time_point frame_start, phase_start;
+};
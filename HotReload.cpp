@@ -0,0 +1,78 @@
+#include "HotReload.hpp"
+
+#include "Mesh.hpp"
+#include "Scene.hpp"
+
+#include <iostream>
+#include <stdexcept>
+#include <unordered_set>
+
+HotReload::Stamp HotReload::stamp(std::string const &filename) {
+	Stamp ret;
+	//(uses the error_code versions, since files are often briefly missing while being re-exported)
+	std::error_code ec;
+	ret.time = std::filesystem::last_write_time(filename, ec);
+	if (ec) return ret;
+	ret.size = std::filesystem::file_size(filename, ec);
+	if (ec) return ret;
+	ret.exists = true;
+	return ret;
+}
+
+void HotReload::watch(std::string const &filename, std::function< void() > const &on_change) {
+	Watched &w = watched.emplace_back();
+	w.filename = filename;
+	w.on_change = on_change;
+	w.seen = stamp(filename);
+	if (!w.seen.exists) {
+		std::cerr << "WARNING: watching '" << filename << "' for changes, but it doesn't exist (yet)." << std::endl;
+	}
+}
+
+void HotReload::update(float elapsed) {
+	since_check += elapsed;
+	if (since_check < interval) return;
+	since_check = 0.0f;
+
+	for (auto &w : watched) {
+		Stamp now = stamp(w.filename);
+		if (now != w.seen) {
+			//wait for the file to settle:
+			w.seen = now;
+			w.settling = now.exists;
+			continue;
+		}
+		if (!w.settling) continue;
+		w.settling = false;
+
+		try {
+			w.on_change();
+		} catch (std::exception const &e) {
+			std::cerr << "WARNING: reloading '" << w.filename << "' failed: " << e.what() << std::endl;
+		}
+	}
+}
+
+uint32_t HotReload::patch_drawables(Scene *scene, std::vector< Mesh const * > const &changed) {
+	assert(scene);
+	if (changed.empty()) return 0;
+
+	std::unordered_set< Mesh const * > lookup(changed.begin(), changed.end());
+	uint32_t patched = 0;
+	for (auto &drawable : scene->drawables) {
+		if (!lookup.count(drawable.lod_mesh)) continue;
+		Mesh const &mesh = *drawable.lod_mesh;
+
+		drawable.pipeline.type = mesh.type;
+		drawable.pipeline.start = mesh.start;
+		drawable.pipeline.count = mesh.count;
+		drawable.pipeline.index_type = mesh.index_type;
+		drawable.pipeline.base_vertex = mesh.base_vertex;
+
+		drawable.min = mesh.min;
+		drawable.max = mesh.max;
+
+		patched += 1;
+	}
+	return patched;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+/*
+ * HotReload -- watches files and calls back when they change, for iterating on content without restarting.
+ *
+ * Usage:
+ *   HotReload hot_reload;
+ *   hot_reload.watch("dist/level.pnct", [&]() {
+ *   	HotReload::patch_drawables(&scene, meshes->reload()); //(meshes constructed with MeshBuffer::Reloadable)
+ *   });
+ *   hot_reload.update(elapsed); //once per frame, on the thread with the OpenGL context; runs callbacks
+ *
+ * Files are polled: their modification times and sizes are checked every 'interval' seconds. A change is
+ *  reported only once a file has stayed the same for a whole interval, so files still being written are skipped.
+ *
+ * A callback that throws has its exception reported (as a warning) and its file is watched as before,
+ *  so a bad export doesn't end the session -- fix the file and it is reloaded again.
+ */
+
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+struct Mesh;
+struct Scene;
+
+struct HotReload {
+	//seconds between checks of the watched files:
+	float interval = 0.5f;
+
+	//call 'on_change' (from update()) whenever 'filename' changes:
+	void watch(std::string const &filename, std::function< void() > const &on_change);
+
+	//check files (if 'interval' has passed) and run callbacks for changed ones:
+	void update(float elapsed);
+
+	//point drawables using 'changed' meshes at those meshes' (new) data, as returned by MeshBuffer::reload():
+	// (drawables are matched to meshes through Drawable::lod_mesh; returns the number of drawables patched)
+	static uint32_t patch_drawables(Scene *scene, std::vector< Mesh const * > const &changed);
+
+	//-- internals --
+	struct Stamp {
+		std::filesystem::file_time_type time;
+		uintmax_t size = 0;
+		bool exists = false;
+		bool operator==(Stamp const &o) const { return exists == o.exists && (!exists || (time == o.time && size == o.size)); }
+		bool operator!=(Stamp const &o) const { return !(*this == o); }
+	};
+	static Stamp stamp(std::string const &filename);
+
+	struct Watched {
+		std::string filename;
+		std::function< void() > on_change;
+		Stamp seen; //as of the last check
+		bool settling = false; //changed at the last check (so report it if it stays the same through the next)
+	};
+	std::vector< Watched > watched;
+	float since_check = 0.0f;
+};
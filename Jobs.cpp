@@ -0,0 +1,210 @@
+#include "Jobs.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct Job {
+	Jobs::Function fn = nullptr;
+	void *data = nullptr;
+	size_t begin = 0, end = 0;
+	Jobs::Counter *counter = nullptr;
+};
+
+//double-ended ring of jobs; storage only ever grows, so steady-state use never allocates
+// (unlike std::deque, which frees and re-allocates its blocks as the ends move):
+struct Queue {
+	std::mutex mutex;
+	std::vector< Job > ring; //(size is zero or a power of two)
+	size_t head = 0; //index of the front job
+	size_t count = 0;
+
+	bool empty() const { return count == 0; }
+	void push_back(Job const &job) {
+		if (count == ring.size()) {
+			std::vector< Job > bigger(std::max< size_t >(16, 2 * ring.size()));
+			for (size_t i = 0; i < count; ++i) bigger[i] = ring[(head + i) & (ring.size() - 1)];
+			ring = std::move(bigger);
+			head = 0;
+		}
+		ring[(head + count) & (ring.size() - 1)] = job;
+		count += 1;
+	}
+	Job pop_back() {
+		count -= 1;
+		return ring[(head + count) & (ring.size() - 1)];
+	}
+	Job pop_front() {
+		Job job = ring[head];
+		head = (head + 1) & (ring.size() - 1);
+		count -= 1;
+		return job;
+	}
+};
+
+struct System {
+	std::vector< std::unique_ptr< Queue > > queues; //one per worker (never resized after init(), so run() can read it unlocked)
+	std::vector< std::thread > workers;
+	std::atomic< uint32_t > worker_count{0}; //workers still running (what thread_count() reports)
+	std::atomic< uint32_t > next_queue{0}; //where the next job from outside the workers goes
+
+	//sleeping workers -- and waiting threads with nothing to steal -- wait on 'wake':
+	// (it is notified when a job is queued, and when a job brings a counter to zero)
+	std::mutex sleep_mutex;
+	std::condition_variable wake;
+	std::atomic< uint32_t > queued{0}; //jobs in all queues
+	bool quit = false; //(guarded by sleep_mutex; once set, run() runs jobs inline)
+};
+
+std::atomic< System * > jobs_system{nullptr};
+std::mutex system_mutex; //guards init() / shutdown()
+thread_local int32_t worker_index = -1; //index of this thread's queue, or -1 if not a worker
+
+void finish(System &sys, Job const &job) {
+	job.fn(job.data, job.begin, job.end);
+	//(the counter may be gone as soon as it reaches zero, so only 'sys' is touched after the decrement)
+	if (job.counter && job.counter->pending.fetch_sub(1) == 1) {
+		{ //(lock, so a waiter can't miss the wake-up between checking its counter and sleeping)
+			std::unique_lock< std::mutex > lock(sys.sleep_mutex);
+		}
+		sys.wake.notify_all();
+	}
+}
+
+//take a job from the back of queue 'own' (if any), or else from the front of another queue:
+bool take(System &sys, int32_t own, Job *job) {
+	uint32_t count = uint32_t(sys.queues.size());
+	if (own >= 0) {
+		Queue &q = *sys.queues[own];
+		std::unique_lock< std::mutex > lock(q.mutex);
+		if (!q.empty()) {
+			*job = q.pop_back();
+			sys.queued.fetch_sub(1);
+			return true;
+		}
+	}
+	uint32_t start = (own >= 0 ? uint32_t(own) + 1 : sys.next_queue.load());
+	for (uint32_t i = 0; i < count; ++i) {
+		Queue &q = *sys.queues[(start + i) % count];
+		std::unique_lock< std::mutex > lock(q.mutex);
+		if (!q.empty()) {
+			*job = q.pop_front();
+			sys.queued.fetch_sub(1);
+			return true;
+		}
+	}
+	return false;
+}
+
+void work(System &sys, int32_t index) {
+	worker_index = index;
+	Job job;
+	while (true) {
+		if (take(sys, index, &job)) {
+			finish(sys, job);
+			continue;
+		}
+		std::unique_lock< std::mutex > lock(sys.sleep_mutex);
+		sys.wake.wait(lock, [&]() { return sys.quit || sys.queued.load() > 0; });
+		if (sys.quit && sys.queued.load() == 0) break;
+	}
+	worker_index = -1;
+}
+
+System &get_system() {
+	if (!jobs_system.load()) Jobs::init();
+	return *jobs_system.load();
+}
+
+} //namespace
+
+void Jobs::init(uint32_t threads) {
+	std::unique_lock< std::mutex > lock(system_mutex);
+	if (jobs_system.load()) return;
+
+	if (threads == 0) threads = std::max(1U, std::thread::hardware_concurrency()) - 1;
+
+	System *sys = new System;
+	for (uint32_t i = 0; i < threads; ++i) {
+		sys->queues.emplace_back(new Queue);
+	}
+	for (uint32_t i = 0; i < threads; ++i) {
+		sys->workers.emplace_back(work, std::ref(*sys), int32_t(i));
+	}
+	sys->worker_count = threads;
+	jobs_system = sys;
+}
+
+void Jobs::shutdown() {
+	std::unique_lock< std::mutex > lock(system_mutex);
+	System *sys = jobs_system.load();
+	if (!sys) return;
+	{
+		std::unique_lock< std::mutex > sleep_lock(sys->sleep_mutex);
+		sys->quit = true;
+	}
+	sys->wake.notify_all();
+	for (auto &w : sys->workers) w.join();
+	sys->worker_count = 0;
+	//(run() sees 'quit' and runs jobs inline from here on; 'sys' and its -- now empty -- queues stay allocated for any late callers)
+}
+
+uint32_t Jobs::thread_count() {
+	return get_system().worker_count.load() + 1;
+}
+
+void Jobs::run(Counter *counter, Function fn, void *data, size_t begin, size_t end) {
+	System &sys = get_system();
+	Job job;
+	job.fn = fn;
+	job.data = data;
+	job.begin = begin;
+	job.end = end;
+	job.counter = counter;
+	if (counter) counter->pending.fetch_add(1);
+
+	if (sys.queues.empty()) {
+		finish(sys, job);
+		return;
+	}
+
+	//queue under the sleep lock, so the job can't land after shutdown() has stopped the workers,
+	// and so a sleeping thread can't miss the wake-up between checking 'queued' and sleeping:
+	bool queued = false;
+	{
+		std::unique_lock< std::mutex > sleep_lock(sys.sleep_mutex);
+		if (!sys.quit) {
+			int32_t index = worker_index;
+			if (index < 0) index = int32_t(sys.next_queue.fetch_add(1) % sys.queues.size());
+			Queue &q = *sys.queues[index];
+			std::unique_lock< std::mutex > lock(q.mutex);
+			q.push_back(job);
+			sys.queued.fetch_add(1);
+			queued = true;
+		}
+	}
+	if (!queued) {
+		finish(sys, job); //(after shutdown(), jobs run inline)
+		return;
+	}
+	sys.wake.notify_one();
+}
+
+void Jobs::wait(Counter *counter) {
+	System &sys = get_system();
+	Job job;
+	while (counter->pending.load() > 0) {
+		if (take(sys, worker_index, &job)) {
+			finish(sys, job);
+			continue;
+		}
+		//the remaining jobs are running on other threads, so sleep until one finishes (or there's a job to steal):
+		std::unique_lock< std::mutex > lock(sys.sleep_mutex);
+		sys.wake.wait(lock, [&]() { return counter->pending.load() == 0 || sys.queued.load() > 0; });
+	}
+}
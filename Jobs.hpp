@@ -0,0 +1,59 @@
+#pragma once
+
+/*
+ * Jobs -- a small work-stealing job system.
+ *
+ * Each worker thread has its own queue of jobs:
+ *  - jobs started from a worker go on the back of its own queue, and it runs jobs from the back (newest first)
+ *  - jobs started from other threads (e.g., the main thread) are dealt out to the workers' queues in turn
+ *  - a worker whose queue is empty steals from the front (oldest first) of the others' queues
+ *  - wait() runs (or steals) jobs until the jobs it is waiting for are done, so waiting inside a job can't deadlock
+ *    (when there's nothing left to steal, it sleeps until a job finishes or is queued)
+ *
+ * Usage:
+ *   Jobs::Counter counter;
+ *   for (size_t i = 0; i < count; i += 64) {
+ *     Jobs::run(&counter, [](void *data, size_t begin, size_t end) { ... }, &stuff, i, std::min(i + 64, count));
+ *   }
+ *   Jobs::wait(&counter);
+ *
+ * Jobs are plain (function pointer, data pointer, range) records, so starting one doesn't allocate
+ *  (beyond growth of the queues the first time they get that deep). See parallel_for.hpp for a more convenient wrapper.
+ *
+ * Notes:
+ *  - jobs run in no particular order on no particular thread; code that needs deterministic results
+ *    should have each job write only its own outputs, and combine them in a fixed order after wait()
+ *  - exceptions thrown by jobs are not supported (std::terminate)
+ *  - if init() hasn't been called, the first run() calls it (with the default thread count)
+ */
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace Jobs {
+
+//starts worker threads (threads == 0 means hardware_concurrency() - 1; zero workers is allowed, and runs jobs inline):
+void init(uint32_t threads = 0);
+//finishes queued jobs and stops the workers (later jobs run inline, on the thread that starts them):
+// (safe to call while other threads are still starting jobs)
+void shutdown();
+
+//number of threads jobs run on (workers plus the thread waiting):
+uint32_t thread_count();
+
+//number of jobs started with a counter that haven't finished yet:
+struct Counter {
+	std::atomic< uint32_t > pending{0};
+};
+
+//a job calls fn(data, begin, end):
+typedef void (*Function)(void *data, size_t begin, size_t end);
+
+//start a job (counter may be null if nothing will wait for it):
+void run(Counter *counter, Function fn, void *data, size_t begin = 0, size_t end = 0);
+
+//run jobs until counter->pending reaches zero:
+void wait(Counter *counter);
+
+} //namespace Jobs
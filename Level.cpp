@@ -0,0 +1,84 @@
+#include "Level.hpp"
+
+#include "read_write_chunk.hpp"
+
+#include <stdexcept>
+
+Level::Level(std::string const &filename_) : filename(filename_) {
+	file = std::make_shared< MappedFile >(filename);
+	char *at = file->begin();
+	char *end = file->end();
+
+	struct TOCEntry {
+		char kind[4];
+		uint32_t offset;
+		uint32_t size;
+		uint32_t reserved;
+	};
+	static_assert(sizeof(TOCEntry) == 16, "TOCEntry is packed.");
+	std::vector< TOCEntry > toc;
+	read_chunk(&at, end, "lvl0", &toc);
+
+	Section mesh_refs_section, cells_section, cell_drawables_section;
+	for (auto const &entry : toc) {
+		if (!(entry.offset <= file->size && entry.size <= file->size - entry.offset)) {
+			throw std::runtime_error("Level '" + filename + "' has a section outside the file.");
+		}
+		if (entry.offset % 16 != 0) {
+			throw std::runtime_error("Level '" + filename + "' has a misaligned section.");
+		}
+		Section section;
+		section.begin = file->begin() + entry.offset;
+		section.end = section.begin + entry.size;
+
+		std::string kind(entry.kind, 4);
+		if (kind == "mesh") meshes = section;
+		else if (kind == "scen") scene = section;
+		else if (kind == "walk") walkmeshes = section;
+		else if (kind == "mref") mesh_refs_section = section;
+		else if (kind == "cell") cells_section = section;
+		else if (kind == "cdrw") cell_drawables_section = section;
+		else if (kind == "cmsh") cell_meshes = section;
+		//(other kinds are ignored, so later versions can add sections)
+	}
+
+	if (!scene.begin || !walkmeshes.begin) {
+		throw std::runtime_error("Level '" + filename + "' is missing a scene or walkmesh section.");
+	}
+
+	if (cells_section.begin) {
+		//streamed level:
+		if (!cell_drawables_section.begin || !cell_meshes.begin) {
+			throw std::runtime_error("Level '" + filename + "' is missing a cell drawable or cell mesh section.");
+		}
+		if ((cells_section.end - cells_section.begin) % sizeof(Cell) != 0
+		 || (cell_drawables_section.end - cell_drawables_section.begin) % sizeof(CellDrawable) != 0) {
+			throw std::runtime_error("Level '" + filename + "' has a mis-sized cell or cell drawable section.");
+		}
+		cells = reinterpret_cast< Cell const * >(cells_section.begin);
+		cells_count = (cells_section.end - cells_section.begin) / sizeof(Cell);
+		cell_drawables = reinterpret_cast< CellDrawable const * >(cell_drawables_section.begin);
+		cell_drawables_count = (cell_drawables_section.end - cell_drawables_section.begin) / sizeof(CellDrawable);
+
+		size_t cell_meshes_size = cell_meshes.end - cell_meshes.begin;
+		for (size_t c = 0; c < cells_count; ++c) {
+			Cell const &cell = cells[c];
+			if (!(cell.mesh_begin <= cell.mesh_end && cell.mesh_end <= cell_meshes_size) || cell.mesh_begin % 16 != 0) {
+				throw std::runtime_error("Level '" + filename + "' has a cell with an invalid mesh range.");
+			}
+			if (!(cell.drawable_begin <= cell.drawable_end && cell.drawable_end <= cell_drawables_count)) {
+				throw std::runtime_error("Level '" + filename + "' has a cell with an invalid drawable range.");
+			}
+		}
+		return;
+	}
+
+	if (!meshes.begin || !mesh_refs_section.begin) {
+		throw std::runtime_error("Level '" + filename + "' is missing a mesh or mesh reference section.");
+	}
+	if ((mesh_refs_section.end - mesh_refs_section.begin) % sizeof(uint32_t) != 0) {
+		throw std::runtime_error("Level '" + filename + "' has a mis-sized mesh reference section.");
+	}
+	mesh_refs = reinterpret_cast< uint32_t const * >(mesh_refs_section.begin);
+	mesh_refs_count = (mesh_refs_section.end - mesh_refs_section.begin) / sizeof(uint32_t);
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+/*
+ * Level -- a packed level file: mesh, scene, and walkmesh data in one mapped file.
+ *
+ * Built by scenes/pack-level.py from a level's .pnct, .scene, and .w files, which it stores
+ *  unchanged (at 16-byte aligned offsets, so their chunks can be used in place) behind a table
+ *  of contents, along with 'mesh_refs': the mesh index (in MeshBuffer::by_index order) for each
+ *  mesh entry of the scene, so drawables are resolved without name lookups.
+ *
+ * Streamed levels (pack-level.py --cell-size) instead split drawables into grid cells, each with its
+ *  own mesh data, and have no 'meshes' section or 'mesh_refs'; LevelStream loads their cells as needed.
+ *
+ * Usage:
+ *   auto level = std::make_shared< Level >(data_path("wood.level"));
+ *   MeshBuffer meshes(*level, MeshBuffer::Deferred);
+ *   WalkMeshes walkmeshes(*level);
+ *   Scene scene(*level, [&](Scene &scene, Scene::Transform *transform, uint32_t mesh_index) {
+ *       Mesh const &mesh = meshes.lookup(mesh_index);
+ *       //...
+ *   });
+ */
+
+#include "MappedFile.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+struct Level {
+	//NOTE: throws on error (including missing sections)
+	Level(std::string const &filename);
+
+	std::string filename; //(for error messages)
+	std::shared_ptr< MappedFile > file; //sections (and anything loaded from them in place) point into this
+
+	//a range of the mapped file:
+	struct Section {
+		char *begin = nullptr;
+		char *end = nullptr;
+	};
+	Section meshes; //.pnct contents
+	Section scene; //.scene contents
+	Section walkmeshes; //.w contents
+
+	//per scene mesh entry, index of its mesh in the 'meshes' section (or -1U if the scene names a mesh that isn't there):
+	uint32_t const *mesh_refs = nullptr;
+	size_t mesh_refs_count = 0;
+
+	//streamed levels only:
+	struct Cell {
+		glm::vec3 min, max; //world-space bounds of the cell's drawables
+		uint32_t mesh_begin, mesh_end; //the cell's meshes (.pnct contents), as offsets in 'cell_meshes' (begin is 16-byte aligned)
+		uint32_t drawable_begin, drawable_end; //the cell's range of 'cell_drawables'
+	};
+	static_assert(sizeof(Cell) == 4*3*2 + 4*4, "Cell is packed.");
+	struct CellDrawable {
+		uint32_t transform; //index of the drawable's transform in the scene's hierarchy
+		uint32_t mesh_index; //index of its mesh in the cell's meshes (MeshBuffer::by_index order)
+	};
+	static_assert(sizeof(CellDrawable) == 4*2, "CellDrawable is packed.");
+	Cell const *cells = nullptr;
+	size_t cells_count = 0;
+	CellDrawable const *cell_drawables = nullptr;
+	size_t cell_drawables_count = 0;
+	Section cell_meshes;
+
+	bool streamed() const { return cells != nullptr; }
+};
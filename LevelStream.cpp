@@ -0,0 +1,168 @@
+#include "LevelStream.hpp"
+
+#include "gl_errors.hpp"
+#include "FrameArena.hpp"
+#include "AllocTracking.hpp"
+
+#include <glm/gtx/norm.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+LevelStream::LevelStream(Level const &level_, Scene *scene_, MakeVAO const &make_vao_, SetDrawable const &set_drawable_)
+	: level(&level_), scene(scene_), make_vao(make_vao_), set_drawable(set_drawable_) {
+	assert(scene);
+	if (!level->streamed()) {
+		throw std::runtime_error("Level '" + level->filename + "' isn't streamed (pack it with pack-level.py --cell-size).");
+	}
+
+	transforms.reserve(scene->transforms.size());
+	for (auto &transform : scene->transforms) {
+		transforms.emplace_back(&transform);
+	}
+	for (size_t d = 0; d < level->cell_drawables_count; ++d) {
+		if (level->cell_drawables[d].transform >= transforms.size()) {
+			throw std::runtime_error("Level '" + level->filename + "' has a cell drawable with a transform index (" + std::to_string(level->cell_drawables[d].transform) + ") outside the scene.");
+		}
+	}
+
+	cells.resize(level->cells_count);
+}
+
+LevelStream::~LevelStream() {
+	Jobs::wait(&loading);
+
+	for (auto &cell : cells) {
+		evict(cell);
+	}
+}
+
+void LevelStream::load_cell(void *data, size_t c, size_t) {
+	LevelStream *stream = static_cast< LevelStream * >(data);
+	Level const *level = stream->level;
+
+	std::unique_ptr< MeshBuffer > meshes;
+	try {
+		Level::Cell const &cell = level->cells[c];
+		meshes.reset(new MeshBuffer(level->file, level->cell_meshes.begin + cell.mesh_begin, level->cell_meshes.begin + cell.mesh_end, level->filename + " (cell " + std::to_string(c) + ")", MeshBuffer::Deferred));
+	} catch (std::exception &e) {
+		std::cerr << "WARNING: failed to load cell " << c << " of '" << level->filename << "': " << e.what() << std::endl;
+	}
+
+	std::unique_lock< std::mutex > lock(stream->mutex);
+	stream->done.emplace_back(uint32_t(c), std::move(meshes));
+}
+
+//squared distance from pt to the axis-aligned box [min,max] (zero if inside):
+static float box_distance2(glm::vec3 const &min, glm::vec3 const &max, glm::vec3 const &pt) {
+	glm::vec3 outside = glm::max(min - pt, glm::max(glm::vec3(0.0f), pt - max));
+	return glm::length2(outside);
+}
+
+void LevelStream::evict(Cell &cell) {
+	for (Scene::Drawable *drawable : cell.drawables) {
+		drawable->pipeline.vao = 0; //(Scene::draw skips drawables without a vao)
+		drawable->lod_mesh = nullptr;
+	}
+	if (cell.vao != 0) {
+		glDeleteVertexArrays(1, &cell.vao);
+		cell.vao = 0;
+	}
+	if (cell.meshes) {
+		if (cell.meshes->buffer != 0) glDeleteBuffers(1, &cell.meshes->buffer);
+		if (cell.meshes->index_buffer != 0) glDeleteBuffers(1, &cell.meshes->index_buffer);
+		cell.meshes.reset();
+	}
+	if (cell.state != Cell::Failed) cell.state = Cell::Unloaded;
+}
+
+void LevelStream::update(glm::vec3 const &focus) {
+	ALLOC_SCOPE("LevelStream");
+
+	//collect cells whose jobs have finished preparing them:
+	std::vector< std::pair< uint32_t, std::unique_ptr< MeshBuffer > > > finished;
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		std::swap(finished, done);
+	}
+	for (auto &f : finished) {
+		Cell &cell = cells[f.first];
+		assert(cell.state == Cell::Loading);
+		if (!f.second) {
+			cell.state = Cell::Failed;
+		} else if (!cell.wanted) {
+			cell.state = Cell::Unloaded; //(moved away while it was loading)
+		} else {
+			cell.meshes = std::move(f.second);
+			cell.state = Cell::Uploading;
+		}
+	}
+
+	//decide which cells are wanted, and evict the rest:
+	float load2 = load_distance * load_distance;
+	float evict2 = std::max(evict_distance, load_distance) * std::max(evict_distance, load_distance);
+	FrameArena::vector< uint32_t > to_load, to_upload;
+	for (uint32_t c = 0; c < cells.size(); ++c) {
+		Cell &cell = cells[c];
+		Level::Cell const &info = level->cells[c];
+		cell.distance = box_distance2(info.min, info.max, focus);
+		cell.wanted = (cell.distance <= load2) || (cell.state != Cell::Unloaded && cell.distance <= evict2);
+
+		if (!cell.wanted) {
+			if (cell.state == Cell::Uploading || cell.state == Cell::Resident) evict(cell);
+		} else if (cell.state == Cell::Unloaded) {
+			to_load.emplace_back(c);
+		} else if (cell.state == Cell::Uploading) {
+			to_upload.emplace_back(c);
+		}
+	}
+
+	//nearest cells first:
+	auto nearer = [this](uint32_t a, uint32_t b) { return cells[a].distance < cells[b].distance; };
+	if (!to_load.empty()) {
+		std::sort(to_load.begin(), to_load.end(), nearer);
+		for (uint32_t c : to_load) {
+			cells[c].state = Cell::Loading;
+			//(with no job workers, this loads the cell right here; it shows up in 'done' next update)
+			Jobs::run(&loading, load_cell, this, c);
+		}
+	}
+
+	//upload, within budget:
+	std::sort(to_upload.begin(), to_upload.end(), nearer);
+	size_t budget = upload_budget;
+	for (uint32_t c : to_upload) {
+		if (budget == 0) break;
+		Cell &cell = cells[c];
+		if (!cell.meshes->upload_partial(&budget)) continue;
+
+		//uploaded, so start drawing:
+		cell.vao = make_vao(*cell.meshes);
+		Level::Cell const &info = level->cells[c];
+		if (cell.drawables.empty()) {
+			for (uint32_t d = info.drawable_begin; d < info.drawable_end; ++d) {
+				cell.drawables.emplace_back(&scene->drawables.emplace_back(transforms[level->cell_drawables[d].transform]));
+			}
+		}
+		for (uint32_t d = info.drawable_begin; d < info.drawable_end; ++d) {
+			Scene::Drawable &drawable = *cell.drawables[d - info.drawable_begin];
+			uint32_t mesh_index = level->cell_drawables[d].mesh_index;
+			if (mesh_index >= cell.meshes->by_index.size()) {
+				std::cerr << "WARNING: cell " << c << " of '" << level->filename << "' has a drawable with an invalid mesh index; skipping it." << std::endl;
+				continue;
+			}
+			set_drawable(drawable, cell.meshes->lookup(mesh_index), cell.vao);
+		}
+		cell.state = Cell::Resident;
+	}
+	uploaded = upload_budget - budget;
+
+	resident = pending = 0;
+	for (auto const &cell : cells) {
+		if (cell.state == Cell::Resident) ++resident;
+		else if (cell.state == Cell::Loading || cell.state == Cell::Uploading) ++pending;
+	}
+
+	GL_ERRORS();
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+/*
+ * LevelStream -- loads the cells of a streamed level (see Level.hpp) around a point as it moves.
+ *
+ * Each update():
+ *  - cells whose bounds are within load_distance of the focus point are queued for loading;
+ *    each is read and prepared (no OpenGL calls) as a job (see Jobs.hpp)
+ *  - prepared cells are uploaded, nearest first, at most upload_budget bytes per call
+ *    (so a burst of loads is spread over several frames instead of causing a spike);
+ *    once a cell is uploaded its drawables are set up and start drawing
+ *  - resident cells farther than evict_distance are evicted: their drawables stop drawing
+ *    (the Drawables themselves stay in the scene and are reused if the cell comes back)
+ *    and their buffers are freed
+ *
+ * Walkmeshes are not streamed (WalkPoints can't cross between walkmeshes), only drawables and meshes.
+ *
+ * Usage:
+ *   Scene scene(level, nullptr); //(streamed levels leave drawables to the LevelStream)
+ *   LevelStream stream(level, &scene, make_vao, set_drawable);
+ *   //every frame:
+ *   stream.update(walkmesh->to_world_point(player.at));
+ */
+
+#include "Level.hpp"
+#include "Mesh.hpp"
+#include "Scene.hpp"
+#include "Jobs.hpp"
+
+#include <glm/glm.hpp>
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+struct LevelStream {
+	//make a vertex array object for a newly uploaded cell's meshes:
+	using MakeVAO = std::function< GLuint(MeshBuffer const &) >;
+	//set up a drawable to draw a mesh (from a MeshBuffer whose vao was made by MakeVAO):
+	using SetDrawable = std::function< void(Scene::Drawable &, Mesh const &, GLuint vao) >;
+
+	//'scene' must have been loaded from 'level' alone, so its first transforms are the level's hierarchy:
+	// (throws if the level isn't streamed or references transforms the scene doesn't have)
+	// ('level' must outlive the stream)
+	LevelStream(Level const &level, Scene *scene, MakeVAO const &make_vao, SetDrawable const &set_drawable);
+	~LevelStream(); //(waits for in-flight cell jobs; frees cell buffers)
+
+	LevelStream(LevelStream const &) = delete;
+	LevelStream &operator=(LevelStream const &) = delete;
+
+	//tuning:
+	float load_distance = 12.0f; //cells closer than this are loaded
+	float evict_distance = 18.0f; //cells farther than this are evicted (keep > load_distance, so cells at the edge don't thrash)
+	size_t upload_budget = 512 * 1024; //bytes of mesh data uploaded per update()
+
+	//call once per frame (on the thread with the OpenGL context):
+	void update(glm::vec3 const &focus);
+
+	//counts, updated by update():
+	uint32_t resident = 0; //cells with drawables drawing
+	uint32_t pending = 0; //cells loading or uploading
+	size_t uploaded = 0; //bytes uploaded by the last update()
+
+	//internals:
+	Level const *level;
+	Scene *scene;
+	MakeVAO make_vao;
+	SetDrawable set_drawable;
+	std::vector< Scene::Transform * > transforms; //scene's transforms, by level transform index
+
+	struct Cell {
+		enum State {
+			Unloaded,
+			Loading, //queued for (or being prepared by) a job
+			Uploading, //prepared; uploading a piece per update()
+			Resident,
+			Failed, //mesh data didn't load (not retried)
+		} state = Unloaded;
+		bool wanted = false; //(a Loading cell that's no longer wanted is dropped when its job finishes)
+		float distance = 0.0f; //from the focus, as of the last update()
+		std::unique_ptr< MeshBuffer > meshes; //prepared meshes (Uploading and Resident cells)
+		GLuint vao = 0;
+		std::vector< Scene::Drawable * > drawables; //made the first time the cell is uploaded
+	};
+	std::vector< Cell > cells;
+
+	//release a cell's buffers and stop its drawables drawing:
+	void evict(Cell &cell);
+
+	//cell jobs, each preparing one cell into 'done' (null if loading failed):
+	Jobs::Counter loading; //cell jobs not yet finished
+	std::mutex mutex; //guards done
+	std::vector< std::pair< uint32_t, std::unique_ptr< MeshBuffer > > > done;
+	//job function (data is the LevelStream, begin is the cell index):
+	static void load_cell(void *data, size_t begin, size_t end);
+};
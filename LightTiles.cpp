@@ -0,0 +1,173 @@
+#include "LightTiles.hpp"
+
+#include "gl_errors.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+std::string LightTiles::glsl_block() {
+	return
+		"layout(std140) uniform Lights {\n"
+		"	vec4 LIGHTS[" + std::to_string(MaxLights * 3) + "];\n"
+		"	uvec4 TILES[" + std::to_string(TilesX * TilesY) + "];\n"
+		"	uvec4 INDICES[" + std::to_string(MaxIndices / 4) + "];\n"
+		"	vec4 TILE_SCALE;\n"
+		"};\n"
+		//(first entry, count) of the lights reaching this fragment's tile:
+		"uvec2 tile_lights() {\n"
+		"	ivec2 tile = clamp(ivec2(gl_FragCoord.xy * TILE_SCALE.xy), ivec2(0), ivec2(" + std::to_string(TilesX - 1) + ", " + std::to_string(TilesY - 1) + "));\n"
+		"	return TILES[tile.y * " + std::to_string(TilesX) + " + tile.x].xy;\n"
+		"}\n"
+		"uint tile_light_index(uint entry) {\n"
+		"	return INDICES[entry / 4u][entry % 4u];\n"
+		"}\n"
+	;
+}
+
+LightTiles::~LightTiles() {
+	if (buffer != 0) {
+		glDeleteBuffers(1, &buffer);
+		buffer = 0;
+	}
+}
+
+void LightTiles::update(Scene const &scene, Scene::Camera const &camera, glm::uvec2 const &drawable_size) {
+	glm::mat4x3 world_to_view = (scene.has_cached_world(*camera.transform) ? camera.transform->cached_world_to_local() : camera.transform->make_world_to_local());
+	glm::mat4 view_to_clip = camera.make_projection();
+
+	lights = 0;
+	rects.clear();
+	for (auto const &light : scene.lights) {
+		if (lights == MaxLights) {
+			static bool warned = false;
+			if (!warned) {
+				std::cerr << "WARNING: scene has more than " << MaxLights << " lights; ignoring the extras." << std::endl;
+				warned = true;
+			}
+			break;
+		}
+
+		glm::mat4x3 local_to_world = (scene.has_cached_world(*light.transform) ? light.transform->cached_local_to_world() : light.transform->make_local_to_world());
+		glm::vec3 position = local_to_world[3];
+		glm::vec3 direction = -glm::normalize(local_to_world[2]);
+
+		Type type = Point;
+		if (light.type == Scene::Light::Hemisphere) type = Hemisphere;
+		else if (light.type == Scene::Light::Spot) type = Spot;
+		else if (light.type == Scene::Light::Directional) type = Directional;
+
+		float distance = 0.0f;
+		Rect rect{ glm::ivec2(0), glm::ivec2(TilesX - 1, TilesY - 1) }; //(whole screen)
+		if (type == Point || type == Spot) {
+			distance = light.distance;
+			if (distance == 0.0f) {
+				//shading falls off as energy / distance^2, so this is where it drops below 1/256:
+				float energy = std::max(light.energy.x, std::max(light.energy.y, light.energy.z));
+				distance = std::sqrt(std::max(energy, 0.0f) * 256.0f);
+			}
+			if (!(distance > 0.0f)) continue; //(no energy)
+
+			//screen rectangle covered by the sphere of influence:
+			// (project the corners of its view-space bounding box; conservative, but cheap)
+			glm::vec3 center = world_to_view * glm::vec4(position, 1.0f);
+			if (center.z - distance >= -camera.near) continue; //entirely behind the near plane
+			if (center.z + distance < -camera.near) {
+				glm::vec2 min = glm::vec2( std::numeric_limits< float >::infinity());
+				glm::vec2 max = glm::vec2(-std::numeric_limits< float >::infinity());
+				for (uint32_t c = 0; c < 8; ++c) {
+					glm::vec3 corner = center + distance * glm::vec3((c & 1 ? 1.0f : -1.0f), (c & 2 ? 1.0f : -1.0f), (c & 4 ? 1.0f : -1.0f));
+					glm::vec4 clip = view_to_clip * glm::vec4(corner, 1.0f);
+					glm::vec2 ndc = glm::vec2(clip) / clip.w;
+					min = glm::min(min, ndc);
+					max = glm::max(max, ndc);
+				}
+				glm::vec2 tiles = glm::vec2(TilesX, TilesY);
+				rect.min = glm::ivec2(glm::floor((min * 0.5f + 0.5f) * tiles));
+				rect.max = glm::ivec2(glm::floor((max * 0.5f + 0.5f) * tiles));
+				if (rect.max.x < 0 || rect.max.y < 0 || rect.min.x >= int32_t(TilesX) || rect.min.y >= int32_t(TilesY)) continue; //off screen
+				rect.min = glm::max(rect.min, glm::ivec2(0));
+				rect.max = glm::min(rect.max, glm::ivec2(TilesX - 1, TilesY - 1));
+			} //else the sphere crosses the near plane, so (conservatively) covers the whole screen
+		}
+
+		block.lights[3 * lights + 0] = glm::vec4(position, float(type));
+		block.lights[3 * lights + 1] = glm::vec4(direction, std::cos(0.5f * light.spot_fov));
+		block.lights[3 * lights + 2] = glm::vec4(light.energy, distance);
+		rects.emplace_back(rect);
+		lights += 1;
+	}
+
+	//count lights per tile:
+	tile_counts.assign(TilesX * TilesY, 0);
+	for (auto const &rect : rects) {
+		for (int32_t y = rect.min.y; y <= rect.max.y; ++y) {
+			for (int32_t x = rect.min.x; x <= rect.max.x; ++x) {
+				tile_counts[y * TilesX + x] += 1;
+			}
+		}
+	}
+
+	//assign each tile a range of indices (clipping ranges once indices run out):
+	entries = 0;
+	dropped = 0;
+	for (uint32_t t = 0; t < TilesX * TilesY; ++t) {
+		uint32_t count = std::min(tile_counts[t], MaxIndices - entries);
+		dropped += tile_counts[t] - count;
+		block.tiles[t] = glm::uvec4(entries, count, 0, 0);
+		entries += count;
+		tile_counts[t] = 0; //(re-used as fill position below)
+	}
+	if (dropped) {
+		static bool warned = false;
+		if (!warned) {
+			std::cerr << "WARNING: more than " << MaxIndices << " light-in-tile entries; some lights will be missing from some tiles." << std::endl;
+			warned = true;
+		}
+	}
+
+	//fill in indices:
+	for (uint32_t l = 0; l < rects.size(); ++l) {
+		Rect const &rect = rects[l];
+		for (int32_t y = rect.min.y; y <= rect.max.y; ++y) {
+			for (int32_t x = rect.min.x; x <= rect.max.x; ++x) {
+				uint32_t t = y * TilesX + x;
+				if (tile_counts[t] == block.tiles[t].y) continue; //(dropped)
+				uint32_t entry = block.tiles[t].x + tile_counts[t];
+				block.indices[entry / 4][entry % 4] = l;
+				tile_counts[t] += 1;
+			}
+		}
+	}
+
+	block.tile_scale = glm::vec4(
+		float(TilesX) / float(std::max(drawable_size.x, 1U)),
+		float(TilesY) / float(std::max(drawable_size.y, 1U)),
+		float(lights), 0.0f
+	);
+
+	//upload (orphaning the previous frame's contents):
+	if (buffer == 0) glGenBuffers(1, &buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(Block), nullptr, GL_STREAM_DRAW);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(Block), &block);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	GL_ERRORS();
+}
+
+void LightTiles::bind() {
+	if (buffer == 0) {
+		//(zero lights in every tile)
+		std::fill(std::begin(block.lights), std::end(block.lights), glm::vec4(0.0f));
+		std::fill(std::begin(block.tiles), std::end(block.tiles), glm::uvec4(0));
+		std::fill(std::begin(block.indices), std::end(block.indices), glm::uvec4(0));
+		block.tile_scale = glm::vec4(0.0f);
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(Block), &block, GL_STATIC_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+	glBindBufferBase(GL_UNIFORM_BUFFER, Binding, buffer);
+}
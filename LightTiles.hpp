@@ -0,0 +1,80 @@
+#pragma once
+
+/*
+ * LightTiles -- a scene's lights in a uniform buffer, with a per screen tile list of the lights that reach it.
+ *
+ * Each frame, update() gathers Scene::lights, finds the screen tiles each point / spot light's
+ *  sphere of influence covers (hemisphere and directional lights cover every tile), and uploads
+ *  the lights and per-tile light lists to a uniform buffer. Shaders declare the block with
+ *  LightTiles::glsl_block() and loop over only their tile's lights (see LitColorTextureProgram).
+ *
+ * Usage:
+ *   light_tiles.update(scene, camera, drawable_size); //after scene.update_transforms()
+ *   light_tiles.bind();                               //before scene.draw()
+ */
+
+#include "GL.hpp"
+#include "Scene.hpp"
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+struct LightTiles {
+	//limits (the block is 13.5KB, inside the 16KB uniform block size every GL 3.3 implementation supports):
+	static constexpr uint32_t MaxLights = 64; //lights past this are ignored
+	static constexpr uint32_t TilesX = 16, TilesY = 9; //screen is divided into TilesX x TilesY tiles
+	static constexpr uint32_t MaxIndices = 2048; //total light-in-tile entries (extra entries are dropped)
+
+	//uniform buffer binding point the block is bound to:
+	static constexpr GLuint Binding = 0;
+
+	//light type codes, as stored in the block (same as LitColorTextureProgram's old LIGHT_TYPE):
+	enum Type : uint32_t { Point = 0, Hemisphere = 1, Spot = 2, Directional = 3 };
+
+	//the uniform block, as laid out by std140:
+	struct Block {
+		//per light, three vec4s:
+		// [3i+0] = (world position, type)
+		// [3i+1] = (world direction of the light's -z axis, cos(spot_fov / 2))
+		// [3i+2] = (energy, distance of influence [0 for hemisphere / directional])
+		glm::vec4 lights[MaxLights * 3];
+		//per tile (row-major from the lower left): (first entry in indices, count, -, -):
+		glm::uvec4 tiles[TilesX * TilesY];
+		//light indices, packed four per uvec4:
+		glm::uvec4 indices[MaxIndices / 4];
+		//(tiles per pixel in x and y, light count, -):
+		glm::vec4 tile_scale;
+	};
+	static_assert(sizeof(Block) == 16 * (MaxLights * 3 + TilesX * TilesY + MaxIndices / 4 + 1), "Block matches std140 layout.");
+
+	//GLSL declaration of the block (named 'Lights') plus a 'tile_lights' helper for fragment shaders:
+	static std::string glsl_block();
+
+	LightTiles() = default;
+	~LightTiles();
+	LightTiles(LightTiles const &) = delete;
+	LightTiles &operator=(LightTiles const &) = delete;
+
+	//rebuild light and tile lists for 'scene' seen through 'camera', and upload them:
+	// (uses the scene's cached world matrices when current, so call after scene.update_transforms())
+	void update(Scene const &scene, Scene::Camera const &camera, glm::uvec2 const &drawable_size);
+
+	//bind the uniform buffer to Binding:
+	// (if update() hasn't been called, binds a block with no lights, so shaders that declare the block are still backed by a buffer)
+	void bind();
+
+	//counts from the most recent update():
+	uint32_t lights = 0; //lights uploaded
+	uint32_t entries = 0; //light-in-tile entries (the shaders' lighting work is roughly proportional to this)
+	uint32_t dropped = 0; //entries that didn't fit in MaxIndices
+
+	//internals:
+	GLuint buffer = 0;
+	Block block; //CPU copy, filled by update()
+	//per-light tile rectangles (inclusive), used while building tile lists:
+	struct Rect { glm::ivec2 min, max; };
+	std::vector< Rect > rects;
+	std::vector< uint32_t > tile_counts;
+};
@@ -3,6 +3,8 @@
 #include "gl_compile_program.hpp"
 #include "gl_errors.hpp"
 
+#include <iostream>
+
 Scene::Drawable::Pipeline lit_color_texture_program_pipeline;
 
 Load< LitColorTextureProgram > lit_color_texture_program(LoadTagEarly, []() -> LitColorTextureProgram const * {
@@ -15,13 +17,7 @@ Load< LitColorTextureProgram > lit_color_texture_program(LoadTagEarly, []() -> L
 	lit_color_texture_program_pipeline.OBJECT_TO_LIGHT_mat4x3 = ret->OBJECT_TO_LIGHT_mat4x3;
 	lit_color_texture_program_pipeline.NORMAL_TO_LIGHT_mat3 = ret->NORMAL_TO_LIGHT_mat3;
 
-	/* This will be used later if/when we build a light loop into the Scene:
-	lit_color_texture_program_pipeline.LIGHT_TYPE_int = ret->LIGHT_TYPE_int;
-	lit_color_texture_program_pipeline.LIGHT_LOCATION_vec3 = ret->LIGHT_LOCATION_vec3;
-	lit_color_texture_program_pipeline.LIGHT_DIRECTION_vec3 = ret->LIGHT_DIRECTION_vec3;
-	lit_color_texture_program_pipeline.LIGHT_ENERGY_vec3 = ret->LIGHT_ENERGY_vec3;
-	lit_color_texture_program_pipeline.LIGHT_CUTOFF_float = ret->LIGHT_CUTOFF_float;
-	*/
+	//(lights come from the LightTiles uniform block, bound by the caller -- see LightTiles.hpp)
 
 	//make a 1-pixel white texture to bind by default:
 	GLuint tex;
@@ -43,14 +39,50 @@ Load< LitColorTextureProgram > lit_color_texture_program(LoadTagEarly, []() -> L
 	return ret;
 });
 
-LitColorTextureProgram::LitColorTextureProgram() {
+Load< LitColorTextureProgram > lit_color_texture_program_instanced(LoadTagEarly, []() -> LitColorTextureProgram const * {
+	LitColorTextureProgram *ret = new LitColorTextureProgram(true);
+
+	//instanced draws reuse VAOs made for the non-instanced program, so attribute locations must match:
+	// (loaded after lit_color_texture_program, since it is declared first in this file)
+	if (ret->Position_vec4 != lit_color_texture_program->Position_vec4
+	 || ret->Normal_vec3 != lit_color_texture_program->Normal_vec3
+	 || ret->Color_vec4 != lit_color_texture_program->Color_vec4
+	 || ret->TexCoord_vec2 != lit_color_texture_program->TexCoord_vec2) {
+		std::cerr << "WARNING: instanced LitColorTextureProgram has different attribute locations; instancing disabled." << std::endl;
+		return ret;
+	}
+
+	//let the pipeline template use this program for instanced draws:
+	lit_color_texture_program_pipeline.instanced.program = ret->program;
+	lit_color_texture_program_pipeline.instanced.INSTANCE_BASE_int = ret->INSTANCE_BASE_int;
+
+	return ret;
+});
+
+LitColorTextureProgram::LitColorTextureProgram(bool instanced) {
 	//Compile vertex and fragment shaders using the convenient 'gl_compile_program' helper function:
 	program = gl_compile_program(
 		//vertex shader:
-		"#version 330\n"
-		"uniform mat4 OBJECT_TO_CLIP;\n"
-		"uniform mat4x3 OBJECT_TO_LIGHT;\n"
-		"uniform mat3 NORMAL_TO_LIGHT;\n"
+		std::string("#version 330\n")
+		+ (instanced ?
+			//instanced: per-instance matrices are fetched from a texture buffer (layout in Scene::Drawable::Pipeline::Instanced):
+			"uniform samplerBuffer INSTANCES;\n"
+			"uniform int INSTANCE_BASE;\n"
+			"mat4 OBJECT_TO_CLIP;\n"
+			"mat4x3 OBJECT_TO_LIGHT;\n"
+			"mat3 NORMAL_TO_LIGHT;\n"
+			"void fetch_instance() {\n"
+			"	int i = (INSTANCE_BASE + gl_InstanceID) * 10;\n"
+			"	OBJECT_TO_CLIP = mat4(texelFetch(INSTANCES, i+0), texelFetch(INSTANCES, i+1), texelFetch(INSTANCES, i+2), texelFetch(INSTANCES, i+3));\n"
+			"	OBJECT_TO_LIGHT = transpose(mat3x4(texelFetch(INSTANCES, i+4), texelFetch(INSTANCES, i+5), texelFetch(INSTANCES, i+6)));\n"
+			"	NORMAL_TO_LIGHT = mat3(texelFetch(INSTANCES, i+7).xyz, texelFetch(INSTANCES, i+8).xyz, texelFetch(INSTANCES, i+9).xyz);\n"
+			"}\n"
+		:
+			"uniform mat4 OBJECT_TO_CLIP;\n"
+			"uniform mat4x3 OBJECT_TO_LIGHT;\n"
+			"uniform mat3 NORMAL_TO_LIGHT;\n"
+			"void fetch_instance() { }\n"
+		) +
 		"in vec4 Position;\n"
 		"in vec3 Normal;\n"
 		"in vec4 Color;\n"
@@ -60,6 +92,7 @@ LitColorTextureProgram::LitColorTextureProgram() {
 		"out vec4 color;\n"
 		"out vec2 texCoord;\n"
 		"void main() {\n"
+		"	fetch_instance();\n"
 		"	gl_Position = OBJECT_TO_CLIP * Position;\n"
 		"	position = OBJECT_TO_LIGHT * Position;\n"
 		"	normal = NORMAL_TO_LIGHT * Normal;\n"
@@ -68,43 +101,19 @@ LitColorTextureProgram::LitColorTextureProgram() {
 		"}\n"
 	,
 		//fragment shader:
-		"#version 330\n"
+		std::string("#version 330\n")
+		+ LightTiles::glsl_block() +
 		"uniform sampler2D TEX;\n"
-		"uniform int LIGHT_TYPE;\n"
-		"uniform vec3 LIGHT_LOCATION;\n"
-		"uniform vec3 LIGHT_DIRECTION;\n"
-		"uniform vec3 LIGHT_ENERGY;\n"
-		"uniform float LIGHT_CUTOFF;\n"
 		"uniform float TIME;\n"
 		"uniform float TIME_LAST;\n"
 		"uniform vec3 CAMERA_POS;"
+		"uniform bool SCENE_LIGHTS;\n"
 		"in vec3 position;\n"
 		"in vec3 normal;\n"
 		"in vec4 color;\n"
 		"in vec2 texCoord;\n"
 		"out vec4 fragColor;\n"
 		"void main() {\n"
-		"	vec3 n = normalize(normal);\n"
-		"	vec3 e;\n"
-		"	if (LIGHT_TYPE == 0) { //point light \n"
-		"		vec3 l = (LIGHT_LOCATION - position);\n"
-		"		float dis2 = dot(l,l);\n"
-		"		l = normalize(l);\n"
-		"		float nl = max(0.0, dot(n, l)) / max(1.0, dis2);\n"
-		"		e = nl * LIGHT_ENERGY;\n"
-		"	} else if (LIGHT_TYPE == 1) { //hemi light \n"
-		"		e = (dot(n,-LIGHT_DIRECTION) * 0.5 + 0.5) * LIGHT_ENERGY;\n"
-		"	} else if (LIGHT_TYPE == 2) { //spot light \n"
-		"		vec3 l = (LIGHT_LOCATION - position);\n"
-		"		float dis2 = dot(l,l);\n"
-		"		l = normalize(l);\n"
-		"		float nl = max(0.0, dot(n, l)) / max(1.0, dis2);\n"
-		"		float c = dot(l,-LIGHT_DIRECTION);\n"
-		"		nl *= smoothstep(LIGHT_CUTOFF,mix(LIGHT_CUTOFF,1.0,0.1), c);\n"
-		"		e = nl * LIGHT_ENERGY;\n"
-		"	} else { //(LIGHT_TYPE == 3) //directional light \n"
-		"		e = max(0.0, dot(n,-LIGHT_DIRECTION)) * LIGHT_ENERGY;\n"
-		"	}\n"
 		"	vec4 albedo = texture(TEX, texCoord) * color;\n"
 		"   \n"
 		"   float dist_x = CAMERA_POS.x - position.x;\n"
@@ -113,7 +122,42 @@ LitColorTextureProgram::LitColorTextureProgram() {
 		"   float x = TIME - TIME_LAST;\n"
 		"   float decay = -0.5 * x + 1.0;\n"
 		"   if (decay < 0.0) decay = 0.0;\n"
-		"	fragColor = vec4(vec3(1.0, 1.0, 1.0)*(-pow((0.7*(15.0*x-dist)),2)+1)*decay, albedo.a);\n"
+		"	vec3 wave = vec3(1.0, 1.0, 1.0)*(-pow((0.7*(15.0*x-dist)),2)+1)*decay;\n"
+		"	//echo only, unless lamps were asked for:\n"
+		"	if (!SCENE_LIGHTS) {\n"
+		"		fragColor = vec4(wave, albedo.a);\n"
+		"		return;\n"
+		"	}\n"
+		"	vec3 n = normalize(normal);\n"
+		"	vec3 e = vec3(0.0);\n"
+		"	//only the lights that reach this tile:\n"
+		"	uvec2 range = tile_lights();\n"
+		"	for (uint entry = range.x; entry < range.x + range.y; ++entry) {\n"
+		"		uint i = tile_light_index(entry);\n"
+		"		vec4 a = LIGHTS[3u*i+0u]; //position, type\n"
+		"		vec4 b = LIGHTS[3u*i+1u]; //direction, spot cutoff\n"
+		"		vec4 c = LIGHTS[3u*i+2u]; //energy, distance\n"
+		"		int type = int(a.w);\n"
+		"		if (type == 1) { //hemi light \n"
+		"			e += (dot(n,-b.xyz) * 0.5 + 0.5) * c.rgb;\n"
+		"		} else if (type == 3) { //directional light \n"
+		"			e += max(0.0, dot(n,-b.xyz)) * c.rgb;\n"
+		"		} else { //point (0) or spot (2) light \n"
+		"			vec3 l = (a.xyz - position);\n"
+		"			float dis2 = dot(l,l);\n"
+		"			l = normalize(l);\n"
+		"			float nl = max(0.0, dot(n, l)) / max(1.0, dis2);\n"
+		"			//fade to zero at the light's distance (where tile assignment stops):\n"
+		"			float f = clamp(1.0 - (dis2 * dis2) / (c.w * c.w * c.w * c.w), 0.0, 1.0);\n"
+		"			nl *= f * f;\n"
+		"			if (type == 2) {\n"
+		"				float s = dot(l,-b.xyz);\n"
+		"				nl *= smoothstep(b.w,mix(b.w,1.0,0.1), s);\n"
+		"			}\n"
+		"			e += nl * c.rgb;\n"
+		"		}\n"
+		"	}\n"
+		"	fragColor = vec4(max(vec3(0.0), wave) + e * albedo.rgb, albedo.a);\n"
 		"}\n"
 	);
 	//As you can see above, adjacent strings in C/C++ are concatenated.
@@ -132,12 +176,10 @@ LitColorTextureProgram::LitColorTextureProgram() {
 	TIME_float = glGetUniformLocation(program, "TIME");
 	TIME_LAST_float = glGetUniformLocation(program, "TIME_LAST");
 	CAMERA_POS_vec3 = glGetUniformLocation(program, "CAMERA_POS");
+	SCENE_LIGHTS_bool = glGetUniformLocation(program, "SCENE_LIGHTS");
 
-	LIGHT_TYPE_int = glGetUniformLocation(program, "LIGHT_TYPE");
-	LIGHT_LOCATION_vec3 = glGetUniformLocation(program, "LIGHT_LOCATION");
-	LIGHT_DIRECTION_vec3 = glGetUniformLocation(program, "LIGHT_DIRECTION");
-	LIGHT_ENERGY_vec3 = glGetUniformLocation(program, "LIGHT_ENERGY");
-	LIGHT_CUTOFF_float = glGetUniformLocation(program, "LIGHT_CUTOFF");
+	//lights come from whatever buffer is bound to LightTiles::Binding:
+	glUniformBlockBinding(program, glGetUniformBlockIndex(program, "Lights"), LightTiles::Binding);
 
 
 	GLuint TEX_sampler2D = glGetUniformLocation(program, "TEX");
@@ -146,6 +188,13 @@ LitColorTextureProgram::LitColorTextureProgram() {
 	glUseProgram(program); //bind program -- glUniform* calls refer to this program now
 
 	glUniform1i(TEX_sampler2D, 0); //set TEX to sample from GL_TEXTURE0
+	glUniform1i(SCENE_LIGHTS_bool, GL_FALSE); //(lamps are opt-in)
+
+	if (instanced) {
+		INSTANCE_BASE_int = glGetUniformLocation(program, "INSTANCE_BASE");
+		GLuint INSTANCES_samplerBuffer = glGetUniformLocation(program, "INSTANCES");
+		glUniform1i(INSTANCES_samplerBuffer, Scene::Drawable::Pipeline::InstanceTextureUnit);
+	}
 
 	glUseProgram(0); //unbind program -- glUniform* calls refer to ??? now
 }
@@ -3,10 +3,13 @@
 #include "GL.hpp"
 #include "Load.hpp"
 #include "Scene.hpp"
+#include "LightTiles.hpp"
 
 //Shader program that draws transformed, lit, textured vertices tinted with vertex colors:
 struct LitColorTextureProgram {
-	LitColorTextureProgram();
+	//instanced == true makes a variant that reads its transform matrices per-instance
+	// (see Scene::Drawable::Pipeline::Instanced) instead of from uniforms:
+	LitColorTextureProgram(bool instanced = false);
 	~LitColorTextureProgram();
 
 	GLuint program = 0;
@@ -25,19 +28,21 @@ struct LitColorTextureProgram {
 	GLuint TIME_float = -1U;
 	GLuint TIME_LAST_float = -1U;
 	GLuint CAMERA_POS_vec3 = -1U;
+	//true adds light from the 'Lights' block to the echo wave; false (the default) draws only the wave:
+	GLuint SCENE_LIGHTS_bool = -1U;
+	//instanced variant only:
+	GLuint INSTANCE_BASE_int = -1U;
+
+	//Uniform blocks:
+	//'Lights' (bound to LightTiles::Binding) - scene lights and per-tile light lists (see LightTiles.hpp; only read when SCENE_LIGHTS is set)
 
-	//lighting:
-	GLuint LIGHT_TYPE_int = -1U;
-	GLuint LIGHT_LOCATION_vec3 = -1U;
-	GLuint LIGHT_DIRECTION_vec3 = -1U;
-	GLuint LIGHT_ENERGY_vec3 = -1U;
-	GLuint LIGHT_CUTOFF_float = -1U;
-	
 	//Textures:
 	//TEXTURE0 - texture that is accessed by TexCoord
+	//TEXTURE4 (Scene::Drawable::Pipeline::InstanceTextureUnit) - instance data buffer (instanced variant only)
 };
 
 extern Load< LitColorTextureProgram > lit_color_texture_program;
+extern Load< LitColorTextureProgram > lit_color_texture_program_instanced;
 
 //For convenient scene-graph setup, copy this object:
 // NOTE: by default, has texture bound to 1-pixel white texture -- so it's okay to use with vertex-color-only meshes.
@@ -1,12 +1,23 @@
 #include "Load.hpp"
 
+#include "Jobs.hpp"
+
 #include <array>
+#include <atomic>
+#include <exception>
+#include <future>
 #include <list>
+#include <vector>
+#include <algorithm>
 #include <cassert>
 
 namespace {
-	std::array< std::list< std::function< void() > >, MaxLoadTag > &get_load_lists() {
-		static std::array< std::list< std::function< void() > >, MaxLoadTag > load_lists;
+	struct LoadFunction {
+		std::function< void() > prepare; //(empty if not a split function)
+		std::function< void() > finish;
+	};
+	std::array< std::list< LoadFunction >, MaxLoadTag > &get_load_lists() {
+		static std::array< std::list< LoadFunction >, MaxLoadTag > load_lists;
 		return load_lists;
 	}
 }
@@ -14,7 +25,13 @@ namespace {
 void add_load_function(LoadTag tag, std::function< void() > const &fn) {
 	auto &load_lists = get_load_lists();
 	assert(tag < load_lists.size());
-	load_lists[tag].emplace_back(fn);
+	load_lists[tag].emplace_back(LoadFunction{ nullptr, fn });
+}
+
+void add_load_function(LoadTag tag, std::function< void() > const &prepare, std::function< void() > const &finish) {
+	auto &load_lists = get_load_lists();
+	assert(tag < load_lists.size());
+	load_lists[tag].emplace_back(LoadFunction{ prepare, finish });
 }
 
 void call_load_functions() {
@@ -24,8 +41,55 @@ void call_load_functions() {
 
 	auto &load_lists = get_load_lists();
 	for (auto &fn_list : load_lists) {
+		//start all of this tag's 'prepare' stages as jobs (see Jobs.hpp):
+		struct Preparing {
+			std::vector< LoadFunction * > functions;
+			std::vector< std::promise< void > > prepared; //(carries any exception back to the main thread)
+			std::atomic< bool > cancel{false}; //set if the main thread stops early (because of an exception)
+		} preparing;
+		for (auto &fn : fn_list) {
+			if (fn.prepare) preparing.functions.emplace_back(&fn);
+		}
+		preparing.prepared.resize(preparing.functions.size());
+		std::vector< Jobs::Counter > done(preparing.functions.size()); //one per 'prepare', so the main thread can wait for them in order
+
+		//(wait for every started job before leaving -- even by exception -- since they reference 'preparing')
+		struct WaitForJobs {
+			std::vector< Jobs::Counter > &done;
+			std::atomic< bool > &cancel;
+			~WaitForJobs() {
+				cancel = true;
+				for (auto &counter : done) Jobs::wait(&counter);
+			}
+		} wait_for_jobs{done, preparing.cancel};
+
+		for (size_t i = 0; i < preparing.functions.size(); ++i) {
+			Jobs::run(&done[i], [](void *data, size_t i, size_t) {
+				Preparing &preparing = *static_cast< Preparing * >(data);
+				if (preparing.cancel) {
+					preparing.prepared[i].set_value();
+					return;
+				}
+				try {
+					preparing.functions[i]->prepare();
+					preparing.prepared[i].set_value();
+				} catch (...) {
+					preparing.prepared[i].set_exception(std::current_exception());
+				}
+			}, &preparing, i);
+		}
+
+		//run main-thread functions in order, waiting for 'prepare' stages as needed:
+		size_t waited = 0;
 		while (!fn_list.empty()) {
-			(*fn_list.begin())(); //call first function in the list
+			LoadFunction &fn = *fn_list.begin();
+			if (fn.prepare) {
+				assert(waited < preparing.functions.size() && preparing.functions[waited] == &fn);
+				Jobs::wait(&done[waited]); //(runs other jobs meanwhile)
+				preparing.prepared[waited].get_future().get(); //(re-throws exception from 'prepare', if any)
+				waited += 1;
+			}
+			fn.finish(); //call first function in the list
 			fn_list.pop_front(); //remove from list
 		}
 	}
@@ -20,9 +20,29 @@
  * These functions are grouped by 'tags', which allow some sequencing of calls.
  * (particularly, this is useful for loading large data blobs [e.g. Meshes] before looking up individual elements within them.)
  *
+ * A Load< T > may also be split into two stages, so that slow loading work can happen in parallel:
+ *
+ * Load< Meshes > meshes(LoadTagDefault, []() -> Meshes * {
+ *     //'prepare' runs on a worker thread: file reads, decoding, building data structures
+ *     // (it must not make OpenGL calls or use other Load<>'s with the same tag)
+ *     return new Meshes(data_path("meshes.pnct"), Meshes::Deferred);
+ * }, [](Meshes *meshes) -> Meshes const * {
+ *     //'finish' runs on the main thread: buffer and texture uploads, vao creation
+ *     meshes->upload();
+ *     return meshes;
+ * });
+ *
+ * 'prepare' stages run as jobs (see Jobs.hpp), so they share the job workers with everything else
+ *  (and may themselves use parallel_for or Sound::sample_cache, which run jobs while they wait).
+ *
+ * All of a tag's 'prepare' stages start together; everything that runs on the main thread
+ *  ('finish' stages and ordinary loading functions) still runs in the order it was added,
+ *  and every function with one tag finishes before any function with a later tag starts.
+ *
  */
 
 #include <functional>
+#include <memory>
 #include <stdexcept>
 #include <cstdint>
 
@@ -37,6 +57,11 @@ enum LoadTag : uint32_t {
 // (only call *before* "call_load_functions()")
 void add_load_function(LoadTag tag, std::function< void() > const &fn);
 
+//Add a split loading function:
+// 'prepare' will be called as a job (on a job worker, or on the main thread while it waits), then (once it returns) 'finish' on the main thread.
+// (if 'prepare' throws, the exception is re-thrown on the main thread in place of calling 'finish')
+void add_load_function(LoadTag tag, std::function< void() > const &prepare, std::function< void() > const &finish);
+
 //Call all loading functions:
 // (loading functions may throw exceptions if they fail.)
 // (only call *once*)
@@ -59,6 +84,21 @@ struct Load {
 		});
 	}
 
+	//Split loading (see top of file): 'prepare' returns a pointer that is passed to 'finish':
+	template< typename Prepare, typename Finish >
+	Load(LoadTag tag, Prepare const &prepare, Finish const &finish) : value(nullptr) {
+		typedef decltype(prepare()) Prepared;
+		auto prepared = std::make_shared< Prepared >();
+		add_load_function(tag, [prepared,prepare](){
+			*prepared = prepare();
+		}, [this,prepared,finish](){
+			this->value = finish(std::move(*prepared));
+			if (!(this->value)) {
+				throw std::runtime_error("Loading failed.");
+			}
+		});
+	}
+
 	//Make a "Load< T >" behave like a "T const *":
 	explicit operator bool() { return value != nullptr; }
 	operator T const *() { return value; }
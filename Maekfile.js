@@ -130,28 +130,47 @@ if (maek.OS === 'windows') {
 //returns objFile: objFileBase + a platform-dependant suffix ('.o' or '.obj')
 const game_names = [
 	maek.CPP('WalkMesh.cpp'),
+	maek.CPP('WalkMeshNavigator.cpp'),
+	maek.CPP('WalkAgents.cpp'),
 	maek.CPP('PlayMode.cpp'),
+	maek.CPP('CameraPath.cpp'),
+	maek.CPP('LevelStream.cpp'),
 	maek.CPP('main.cpp'),
 	maek.CPP('LitColorTextureProgram.cpp'),
+	maek.CPP('LightTiles.cpp'),
 	//maek.CPP('ColorTextureProgram.cpp'),  //not used right now, but you might want it
 	maek.CPP('Sound.cpp'),
+	maek.CPP('mix_mono.cpp'),
 	maek.CPP('load_wav.cpp'),
-	maek.CPP('load_opus.cpp')
+	maek.CPP('resample.cpp'),
+	maek.CPP('load_opus.cpp'),
+	maek.CPP('OpusStream.cpp'),
+	maek.CPP('SampleCache.cpp')
 ];
 
 const common_names = [
 	maek.CPP('data_path.cpp'),
-	maek.CPP('PathFont.cpp'),
+	maek.CPP('MappedFile.cpp'),
+	maek.CPP('Level.cpp'),
 	maek.CPP('PathFont-font.cpp'),
 	maek.CPP('DrawLines.cpp'),
+	maek.CPP('DebugLines.cpp'),
 	maek.CPP('ColorProgram.cpp'),
 	maek.CPP('Scene.cpp'),
 	maek.CPP('Mesh.cpp'),
 	maek.CPP('load_save_png.cpp'),
 	maek.CPP('gl_compile_program.cpp'),
+	maek.CPP('gl_errors.cpp'),
 	maek.CPP('Mode.cpp'),
 	maek.CPP('GL.cpp'),
-	maek.CPP('Load.cpp')
+	maek.CPP('Load.cpp'),
+	maek.CPP('Jobs.cpp'),
+	maek.CPP('parallel_for.cpp'),
+	maek.CPP('FrameArena.cpp'),
+	maek.CPP('AllocTracking.cpp'),
+	maek.CPP('FrameTimes.cpp'),
+	maek.CPP('FrameCapture.cpp'),
+	maek.CPP('Profiler.cpp')
 ];
 
 const show_meshes_names = [
@@ -163,7 +182,8 @@ const show_meshes_names = [
 const show_scene_names = [
 	maek.CPP('show-scene.cpp'),
 	maek.CPP('ShowSceneProgram.cpp'),
-	maek.CPP('ShowSceneMode.cpp')
+	maek.CPP('ShowSceneMode.cpp'),
+	maek.CPP('HotReload.cpp')
 ];
 
 //the '[exeFile =] LINK(objFiles, exeFileBase, [, options])' links an array of objects into an executable:
@@ -174,6 +194,36 @@ const game_exe = maek.LINK([...game_names, ...common_names], 'dist/game');
 const show_meshes_exe = maek.LINK([...show_meshes_names, ...common_names], 'scenes/show-meshes');
 const show_scene_exe = maek.LINK([...show_scene_names, ...common_names], 'scenes/show-scene');
 
+//offline asset cooker (run after exporting; see cook-assets.cpp):
+const cook_assets_names = [
+	maek.CPP('cook-assets.cpp'),
+	maek.CPP('WalkMesh.cpp', 'objs/cook/WalkMesh'), //(separate objects, since game_names already builds these)
+	maek.CPP('load_wav.cpp', 'objs/cook/load_wav'),
+	maek.CPP('resample.cpp', 'objs/cook/resample')
+];
+const cook_assets_exe = maek.LINK([...cook_assets_names, ...common_names], 'scenes/cook-assets');
+//(not a default target; build and run it with 'node Maekfile.js :cook-assets')
+maek.RUN(':cook-assets', [cook_assets_exe]);
+
+//benchmarks are headless (no SDL/GL); run them with, e.g., 'node Maekfile.js :bench-mix':
+const bench_mix_names = [
+	maek.CPP('bench-mix.cpp'),
+	maek.CPP('mix_mono.cpp', 'objs/bench/mix_mono') //(separate object, since game_names already builds objs/mix_mono)
+];
+const bench_mix_exe = maek.LINK(bench_mix_names, 'bench/bench-mix', { LINKLibs: [] });
+maek.RUN(':bench-mix', [bench_mix_exe]);
+
+const bench_walkmesh_names = [
+	maek.CPP('bench-walkmesh.cpp'),
+	maek.CPP('WalkMesh.cpp', 'objs/bench/WalkMesh'),
+	maek.CPP('WalkMeshNavigator.cpp', 'objs/bench/WalkMeshNavigator'), //(for the path corner line_of_sight check)
+	maek.CPP('data_path.cpp', 'objs/bench/data_path'),
+	maek.CPP('MappedFile.cpp', 'objs/bench/MappedFile'), //(WalkMeshes maps its file)
+	maek.CPP('Level.cpp', 'objs/bench/Level') //(...or a level's)
+];
+const bench_walkmesh_exe = maek.LINK(bench_walkmesh_names, 'bench/bench-walkmesh', { LINKLibs: [] });
+maek.RUN(':bench-walkmesh', [bench_walkmesh_exe]);
+
 //set the default target to the game (and copy the readme files):
 maek.TARGETS = [game_exe, show_meshes_exe, show_scene_exe, ...copies];
 
@@ -440,6 +490,31 @@ function init_maek() {
 	};
 
 
+	//maek.RUN adds an abstract target that runs a command (e.g., a benchmark) once its executable is built:
+	// target is the abstract target name (must start with ':')
+	// command is an array of strings; command[0] is the executable (and is built first)
+	// (abstract targets are never cached, so the command runs every time the target is requested)
+	maek.RUN = (target, command, localOptions = {}) => {
+		const options = combineOptions(localOptions);
+
+		if (target[0] !== ':') throw new Error(`RUN: target '${target}' should be abstract (start with ':').`);
+
+		const exeFile = command[0];
+		const task = async () => {
+			await run([require('path').resolve(exeFile), ...command.slice(1)], `${task.label}: run`);
+		};
+
+		task.depends = [exeFile, ...options.depends];
+		task.label = `RUN ${target}`;
+
+		if (target in maek.tasks) {
+			throw new Error(`Task ${task.label} purports to create ${target}, but ${maek.tasks[target].label} already creates that target.`);
+		}
+		maek.tasks[target] = task;
+
+		return target;
+	};
+
 	//says something went wrong in building -- should fail loudly:
 	class BuildError extends Error {
 		constructor(message) {
@@ -0,0 +1,83 @@
+#include "MappedFile.hpp"
+
+#include <fstream>
+#include <stdexcept>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(std::string const &filename) {
+	#if defined(_WIN32)
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error("Failed to open '" + filename + "'");
+	}
+	LARGE_INTEGER file_size;
+	if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0) {
+		HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+		if (mapping != NULL) {
+			void *view = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+			if (view != NULL) {
+				data = reinterpret_cast< char * >(view);
+				size = size_t(file_size.QuadPart);
+				mapped = true;
+				file_handle = file;
+				mapping_handle = mapping;
+				return;
+			}
+			CloseHandle(mapping);
+		}
+	}
+	CloseHandle(file);
+	#else
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd == -1) {
+		throw std::runtime_error("Failed to open '" + filename + "'");
+	}
+	struct stat info;
+	if (fstat(fd, &info) == 0 && info.st_size > 0) {
+		//private + writable gives copy-on-write pages:
+		void *map = mmap(nullptr, size_t(info.st_size), PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+		if (map != MAP_FAILED) {
+			data = reinterpret_cast< char * >(map);
+			size = size_t(info.st_size);
+			mapped = true;
+		}
+	}
+	close(fd); //(mapping stays valid after the descriptor is closed)
+	if (mapped) return;
+	#endif
+
+	//couldn't map; read the file instead:
+	std::ifstream file_stream(filename, std::ios::binary);
+	if (!file_stream) {
+		throw std::runtime_error("Failed to open '" + filename + "'");
+	}
+	file_stream.seekg(0, std::ios::end);
+	fallback.resize(size_t(file_stream.tellg()));
+	file_stream.seekg(0, std::ios::beg);
+	if (!file_stream.read(fallback.data(), fallback.size())) {
+		throw std::runtime_error("Failed to read '" + filename + "'");
+	}
+	data = fallback.data();
+	size = fallback.size();
+}
+
+MappedFile::~MappedFile() {
+	if (!mapped) return;
+	#if defined(_WIN32)
+	UnmapViewOfFile(data);
+	CloseHandle(reinterpret_cast< HANDLE >(mapping_handle));
+	CloseHandle(reinterpret_cast< HANDLE >(file_handle));
+	#else
+	munmap(data, size);
+	#endif
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+/*
+ * MappedFile maps a whole file into memory, so that loaders can use chunks
+ *  in place (see view_chunk in read_write_chunk.hpp) instead of reading them
+ *  into intermediate buffers.
+ *
+ * The mapping is copy-on-write: the data may be modified (e.g., to fix up
+ *  indices after loading) without changing the file on disk.
+ *
+ * If the file can't be mapped (e.g., it is empty, or the platform refuses),
+ *  its contents are read into a heap buffer instead.
+ */
+
+struct MappedFile {
+	//NOTE: throws on error
+	MappedFile(std::string const &filename);
+	~MappedFile();
+
+	MappedFile(MappedFile const &) = delete;
+	MappedFile &operator=(MappedFile const &) = delete;
+
+	char *data = nullptr;
+	size_t size = 0;
+
+	char *begin() { return data; }
+	char *end() { return data + size; }
+
+	//-- internals ---
+	bool mapped = false; //true if data points into a mapping (rather than into 'fallback')
+	std::vector< char > fallback;
+	#if defined(_WIN32)
+	void *file_handle = nullptr;
+	void *mapping_handle = nullptr;
+	#endif
+};
@@ -1,54 +1,317 @@
 #include "Mesh.hpp"
 #include "read_write_chunk.hpp"
+#include "MappedFile.hpp"
+#include "Level.hpp"
 
 #include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
 
 #include <stdexcept>
-#include <fstream>
 #include <iostream>
+#include <ostream>
 #include <vector>
 #include <string>
 #include <set>
+#include <map>
+#include <queue>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
 #include <cstddef>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <cassert>
 
-MeshBuffer::MeshBuffer(std::string const &filename) {
-	glGenBuffers(1, &buffer);
+//Reorder triangles to make good use of the post-transform vertex cache:
+// (Tom Forsyth's "Linear-Speed Vertex Cache Optimisation" -- greedily emit the best-scoring triangle,
+//  where vertices score higher when recently used and when they have few remaining triangles)
+static void optimize_vertex_cache(std::vector< uint32_t > *indices_, uint32_t vertex_count) {
+	assert(indices_);
+	auto &indices = *indices_;
+	assert(indices.size() % 3 == 0);
 
-	std::ifstream file(filename, std::ios::binary);
+	constexpr int32_t CacheSize = 32; //simulated cache size
+	uint32_t triangle_count = uint32_t(indices.size() / 3);
 
-	GLuint total = 0;
+	//vertex -> triangles (packed, with the first 'remaining' entries for each vertex being not-yet-emitted triangles):
+	std::vector< uint32_t > first(vertex_count + 1, 0);
+	for (uint32_t i : indices) first[i + 1] += 1;
+	for (uint32_t v = 0; v < vertex_count; ++v) first[v + 1] += first[v];
+	std::vector< uint32_t > vertex_triangles(indices.size());
+	std::vector< uint32_t > remaining(vertex_count, 0);
+	for (uint32_t t = 0; t < triangle_count; ++t) {
+		for (uint32_t k = 0; k < 3; ++k) {
+			uint32_t v = indices[3*t+k];
+			vertex_triangles[first[v] + remaining[v]] = t;
+			remaining[v] += 1;
+		}
+	}
 
-	struct Vertex {
-		glm::vec3 Position;
-		glm::vec3 Normal;
-		glm::u8vec4 Color;
-		glm::vec2 TexCoord;
+	std::vector< int32_t > cache_position(vertex_count, -1);
+	auto vertex_score = [&](uint32_t v) -> float {
+		if (remaining[v] == 0) return -1.0f;
+		float score = 0.0f;
+		int32_t position = cache_position[v];
+		if (position >= 0) {
+			if (position < 3) score = 0.75f; //vertices of the last triangle get a fixed score, so the next triangle isn't too eager to reuse them
+			else score = std::pow(1.0f - float(position - 3) / float(CacheSize - 3), 1.5f);
+		}
+		return score + 2.0f / std::sqrt(float(remaining[v])); //boost vertices with few triangles left, so none get stranded
 	};
-	static_assert(sizeof(Vertex) == 3*4+3*4+4*1+2*4, "Vertex is packed.");
-	std::vector< Vertex > data;
 
-	//read + upload data chunk:
-	if (filename.size() >= 5 && filename.substr(filename.size()-5) == ".pnct") {
-		read_chunk(file, "pnct", &data);
+	std::vector< float > vscore(vertex_count);
+	for (uint32_t v = 0; v < vertex_count; ++v) vscore[v] = vertex_score(v);
+	std::vector< float > tscore(triangle_count);
+	std::vector< bool > emitted(triangle_count, false);
+	for (uint32_t t = 0; t < triangle_count; ++t) {
+		tscore[t] = vscore[indices[3*t+0]] + vscore[indices[3*t+1]] + vscore[indices[3*t+2]];
+	}
 
-		//upload data:
-		glBindBuffer(GL_ARRAY_BUFFER, buffer);
-		glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(Vertex), data.data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	//triangles with no cached vertices, best score first, for when the cache has no candidates:
+	// (a lazy max-heap -- a triangle is pushed again whenever it is rescored while none of its vertices are cached,
+	//  and stale or emitted entries are skipped when popped; entries are (score, ~triangle) so ties go to the lowest index)
+	std::priority_queue< std::pair< float, uint32_t > > uncached;
+	for (uint32_t t = 0; t < triangle_count; ++t) {
+		uncached.emplace(tscore[t], ~t);
+	}
+
+	std::vector< uint32_t > cache; cache.reserve(CacheSize + 3);
+	std::vector< uint32_t > new_cache; new_cache.reserve(CacheSize + 3);
+	std::vector< uint32_t > out; out.reserve(indices.size());
+
+	uint32_t best = -1U;
+	while (out.size() < indices.size()) {
+		while (best == -1U) {
+			//nothing in the cache; start with the best remaining triangle:
+			// (every remaining triangle has an entry with its current score, since scores only change when rescored below)
+			assert(!uncached.empty());
+			auto [score, not_t] = uncached.top();
+			uncached.pop();
+			uint32_t t = ~not_t;
+			if (!emitted[t] && score == tscore[t]) best = t;
+		}
+
+		//emit triangle:
+		emitted[best] = true;
+		new_cache.clear();
+		for (uint32_t k = 0; k < 3; ++k) {
+			uint32_t v = indices[3*best+k];
+			out.emplace_back(v);
+			new_cache.emplace_back(v);
+			//remove from vertex's remaining triangles:
+			uint32_t *tris = &vertex_triangles[first[v]];
+			for (uint32_t i = 0; i < remaining[v]; ++i) {
+				if (tris[i] == best) {
+					std::swap(tris[i], tris[remaining[v] - 1]);
+					break;
+				}
+			}
+			remaining[v] -= 1;
+		}
+
+		//update simulated cache (most recent first):
+		for (uint32_t v : cache) {
+			if (v != new_cache[0] && v != new_cache[1] && v != new_cache[2]) new_cache.emplace_back(v);
+		}
+		for (uint32_t i = 0; i < new_cache.size(); ++i) {
+			uint32_t v = new_cache[i];
+			cache_position[v] = (int32_t(i) < CacheSize ? int32_t(i) : -1);
+			vscore[v] = vertex_score(v);
+		}
+
+		//rescore affected triangles and pick the best one that uses a cached vertex:
+		best = -1U;
+		float best_score = -1.0f;
+		for (uint32_t v : new_cache) {
+			for (uint32_t i = 0; i < remaining[v]; ++i) {
+				uint32_t t = vertex_triangles[first[v] + i];
+				tscore[t] = vscore[indices[3*t+0]] + vscore[indices[3*t+1]] + vscore[indices[3*t+2]];
+				if (cache_position[v] >= 0 && tscore[t] > best_score) {
+					best_score = tscore[t];
+					best = t;
+				}
+				//(a vertex just pushed out of the cache may leave the triangle with no cached vertices)
+				if (cache_position[indices[3*t+0]] < 0 && cache_position[indices[3*t+1]] < 0 && cache_position[indices[3*t+2]] < 0) {
+					uncached.emplace(tscore[t], ~t);
+				}
+			}
+		}
+
+		if (int32_t(new_cache.size()) > CacheSize) new_cache.resize(CacheSize);
+		std::swap(cache, new_cache);
+	}
+
+	indices = std::move(out);
+}
+
+//Vertex formats stored in mesh files:
 
-		total = GLuint(data.size()); //store total for later checks on index
+//'pnct' chunk -- full-precision vertices:
+struct PNCTVertex {
+	glm::vec3 Position;
+	glm::vec3 Normal;
+	glm::u8vec4 Color;
+	glm::vec2 TexCoord;
+};
+static_assert(sizeof(PNCTVertex) == 3*4+3*4+4*1+2*4, "PNCTVertex is packed.");
 
-		//store attrib locations:
-		Position = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Position));
-		Normal = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Normal));
-		Color = Attrib(4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), offsetof(Vertex, Color));
-		TexCoord = Attrib(2, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, TexCoord));
+//'pnch' chunk -- compact vertices (20 bytes instead of 36):
+// all fields are in formats that glVertexAttribPointer can expand, so shaders see the same attributes either way
+struct PNCHVertex {
+	glm::u16vec4 Position; //half-float x,y,z and 1.0
+	uint32_t Normal; //signed normalized 2_10_10_10 (x in the low bits; w unused)
+	glm::u8vec4 Color;
+	glm::u16vec2 TexCoord; //half-float s,t
+};
+static_assert(sizeof(PNCHVertex) == 4*2+4+4*1+2*2, "PNCHVertex is packed.");
+
+static glm::vec3 get_position(PNCTVertex const &v) {
+	return v.Position;
+}
+static glm::vec3 get_position(PNCHVertex const &v) {
+	return glm::vec3(
+		glm::unpackHalf1x16(v.Position.x),
+		glm::unpackHalf1x16(v.Position.y),
+		glm::unpackHalf1x16(v.Position.z)
+	);
+}
+
+//Hash of some bytes, for noticing when a mesh's data changes (see MeshBuffer::reload):
+// (FNV-1a, a word at a time -- each step is invertible, so a change to any one word always changes the result)
+static uint64_t hash_bytes(void const *data_, size_t size, uint64_t hash = 14695981039346656037ULL) {
+	uint8_t const *data = reinterpret_cast< uint8_t const * >(data_);
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8) {
+		uint64_t word;
+		std::memcpy(&word, data + i, 8);
+		hash = (hash ^ word) * 1099511628211ULL;
+	}
+	for (; i < size; ++i) {
+		hash = (hash ^ data[i]) * 1099511628211ULL;
+	}
+	return hash;
+}
+
+//Where a mesh's data is, in bytes, within vertex data of 'vertices_size' bytes and index data [indices, indices + indices_size):
+// (an indexed mesh uses vertices from its base_vertex up to its largest index)
+static MeshBuffer::Reload::Slot mesh_slot(Mesh const &mesh, size_t stride, size_t vertices_size, uint8_t const *indices, size_t indices_size) {
+	MeshBuffer::Reload::Slot slot;
+	if (mesh.index_type == GL_NONE) {
+		slot.vertex_begin = size_t(mesh.start) * stride;
+		slot.vertex_end = slot.vertex_begin + size_t(mesh.count) * stride;
 	} else {
-		throw std::runtime_error("Unknown file type '" + filename + "'");
+		size_t size = (mesh.index_type == GL_UNSIGNED_SHORT ? 2 : 4);
+		slot.index_begin = size_t(mesh.start) * size;
+		slot.index_end = slot.index_begin + size_t(mesh.count) * size;
+		if (slot.index_end > indices_size) {
+			throw std::runtime_error("mesh uses indices past the end of the index data");
+		}
+		uint64_t used = 0;
+		for (size_t i = slot.index_begin; i < slot.index_end; i += size) {
+			uint32_t index = 0;
+			if (size == 2) {
+				uint16_t index16;
+				std::memcpy(&index16, indices + i, 2);
+				index = index16;
+			} else {
+				std::memcpy(&index, indices + i, 4);
+			}
+			used = std::max< uint64_t >(used, uint64_t(index) + 1);
+		}
+		slot.vertex_begin = size_t(mesh.base_vertex) * stride;
+		slot.vertex_end = slot.vertex_begin + size_t(used) * stride;
 	}
+	if (slot.vertex_end > vertices_size) {
+		throw std::runtime_error("mesh uses vertices past the end of the vertex data");
+	}
+	return slot;
+}
 
-	std::vector< char > strings;
-	read_chunk(file, "str0", &strings);
+//Read the rest of a mesh file [*at_,end) (after the vertex chunk), build meshes, and prepare vertex/index data for upload:
+// ('file' owns the memory that 'data' points into)
+template< typename Vertex >
+static void load_meshes(std::shared_ptr< MappedFile > const &file, char **at_, char *end, std::string const &filename, ChunkView< Vertex const > data, bool indexed, MeshBuffer::KeepMesh const &keep, MeshBuffer *buffer_) {
+	assert(at_);
+	auto &at = *at_;
+	assert(buffer_);
+	auto &buffer = *buffer_;
+
+	GLuint total = GLuint(data.size()); //store total for later checks on index
+
+	//if indexed, de-duplicated copies of each mesh's vertices (otherwise, 'data' is uploaded directly):
+	auto vertices_storage = std::make_shared< std::vector< Vertex > >();
+	auto &vertices = *vertices_storage;
+	std::vector< uint8_t > &index_data = buffer.pending_indices;
+	index_data.clear();
+
+	//make an indexed version of the triangles in data[begin,end):
+	// (vertices are compared bitwise, so only exact duplicates merge)
+	struct VertexHash {
+		size_t operator()(Vertex const &v) const {
+			//FNV-1a over the packed vertex bytes:
+			uint8_t const *bytes = reinterpret_cast< uint8_t const * >(&v);
+			size_t hash = size_t(14695981039346656037ULL);
+			for (size_t i = 0; i < sizeof(Vertex); ++i) {
+				hash = (hash ^ bytes[i]) * size_t(1099511628211ULL);
+			}
+			return hash;
+		}
+	};
+	struct VertexEqual {
+		bool operator()(Vertex const &a, Vertex const &b) const {
+			return std::memcmp(&a, &b, sizeof(Vertex)) == 0;
+		}
+	};
+	auto make_indexed = [&](uint32_t begin, uint32_t end, Mesh *mesh_) {
+		auto &mesh = *mesh_;
+
+		std::unordered_map< Vertex, uint32_t, VertexHash, VertexEqual > lookup;
+		lookup.reserve(end - begin);
+		std::vector< Vertex > unique;
+		std::vector< uint32_t > indices;
+		indices.reserve(end - begin);
+		for (uint32_t v = begin; v < end; ++v) {
+			auto ret = lookup.emplace(data[v], uint32_t(unique.size()));
+			if (ret.second) unique.emplace_back(data[v]);
+			indices.emplace_back(ret.first->second);
+		}
+
+		optimize_vertex_cache(&indices, uint32_t(unique.size()));
+
+		//store vertices in order of first use (helps the pre-transform cache):
+		std::vector< uint32_t > remap(unique.size(), -1U);
+		mesh.base_vertex = GLint(vertices.size());
+		for (uint32_t &i : indices) {
+			if (remap[i] == -1U) {
+				remap[i] = uint32_t(vertices.size() - mesh.base_vertex);
+				vertices.emplace_back(unique[i]);
+			}
+			i = remap[i];
+		}
+
+		//append indices (as 16-bit values when they fit):
+		auto append = [&](auto type_tag) {
+			typedef decltype(type_tag) Index;
+			while (index_data.size() % sizeof(Index) != 0) index_data.emplace_back(0);
+			mesh.start = GLuint(index_data.size() / sizeof(Index));
+			for (uint32_t i : indices) {
+				Index index = Index(i);
+				uint8_t const *bytes = reinterpret_cast< uint8_t const * >(&index);
+				index_data.insert(index_data.end(), bytes, bytes + sizeof(Index));
+			}
+		};
+		if (unique.size() <= 0x10000) {
+			mesh.index_type = GL_UNSIGNED_SHORT;
+			append(uint16_t());
+		} else {
+			mesh.index_type = GL_UNSIGNED_INT;
+			append(uint32_t());
+		}
+		mesh.count = GLuint(indices.size());
+	};
+
+	ChunkView< char > strings = view_chunk< char >(&at, end, "str0");
 
 	{ //read index chunk, add to meshes:
 		struct IndexEntry {
@@ -58,7 +321,10 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 		static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
 
 		std::vector< IndexEntry > index;
-		read_chunk(file, "idx0", &index);
+		read_chunk(&at, end, "idx0", &index);
+
+		//meshes built so far, by vertex range (so that meshes sharing a range share data):
+		std::map< std::pair< uint32_t, uint32_t >, Mesh > built;
 
 		for (auto const &entry : index) {
 			if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
@@ -68,36 +334,532 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 				throw std::runtime_error("index entry has out-of-range vertex start/count");
 			}
 			std::string name(&strings[0] + entry.name_begin, &strings[0] + entry.name_end);
-			Mesh mesh;
-			mesh.type = GL_TRIANGLES;
-			mesh.start = entry.vertex_begin;
-			mesh.count = entry.vertex_end - entry.vertex_begin;
-			for (uint32_t v = entry.vertex_begin; v < entry.vertex_end; ++v) {
-				mesh.min = glm::min(mesh.min, data[v].Position);
-				mesh.max = glm::max(mesh.max, data[v].Position);
+
+			//(a mesh's data in the file is just its vertices)
+			if (keep && !keep(name, hash_bytes(data.data + entry.vertex_begin, (entry.vertex_end - entry.vertex_begin) * sizeof(Vertex)))) continue;
+
+			auto f = built.find(std::make_pair(entry.vertex_begin, entry.vertex_end));
+			if (f == built.end()) {
+				Mesh mesh;
+				mesh.type = GL_TRIANGLES;
+				for (uint32_t v = entry.vertex_begin; v < entry.vertex_end; ++v) {
+					glm::vec3 position = get_position(data[v]);
+					mesh.min = glm::min(mesh.min, position);
+					mesh.max = glm::max(mesh.max, position);
+				}
+				if (!indexed) {
+					mesh.start = entry.vertex_begin;
+					mesh.count = entry.vertex_end - entry.vertex_begin;
+				} else if ((entry.vertex_end - entry.vertex_begin) % 3 != 0) {
+					//not a triangle list; keep as plain vertices:
+					mesh.start = GLuint(vertices.size());
+					mesh.count = entry.vertex_end - entry.vertex_begin;
+					vertices.insert(vertices.end(), data.begin() + entry.vertex_begin, data.begin() + entry.vertex_end);
+				} else {
+					make_indexed(entry.vertex_begin, entry.vertex_end, &mesh);
+				}
+				f = built.emplace(std::make_pair(entry.vertex_begin, entry.vertex_end), mesh).first;
 			}
-			bool inserted = meshes.insert(std::make_pair(name, mesh)).second;
-			if (!inserted) {
+
+			auto ret = buffer.meshes.insert(std::make_pair(name, f->second));
+			if (!ret.second) {
 				std::cerr << "WARNING: mesh name '" + name + "' in filename '" + filename + "' collides with existing mesh." << std::endl;
 			}
+			buffer.by_index.emplace_back(&ret.first->second);
 		}
 	}
 
-	if (file.peek() != EOF) {
+	if (at != end) {
 		std::cerr << "WARNING: trailing data in mesh file '" << filename << "'" << std::endl;
 	}
 
+	//hold on to data for upload() (without copying it):
+	if (indexed) {
+		buffer.pending_vertices = std::shared_ptr< void const >(vertices_storage, vertices.data());
+		buffer.pending_vertices_size = vertices.size() * sizeof(Vertex);
+	} else {
+		buffer.pending_vertices = std::shared_ptr< void const >(file, data.data);
+		buffer.pending_vertices_size = data.size() * sizeof(Vertex);
+	}
+
 	/* //DEBUG:
 	std::cout << "File '" << filename << "' contained meshes";
-	for (auto const &m : meshes) {
-		if (&m.second == &meshes.rbegin()->second && meshes.size() > 1) std::cout << " and";
+	for (auto const &m : buffer.meshes) {
+		if (&m.second == &buffer.meshes.rbegin()->second && buffer.meshes.size() > 1) std::cout << " and";
 		std::cout << " '" << m.first << "'";
-		if (&m.second != &meshes.rbegin()->second) std::cout << ",";
+		if (&m.second != &buffer.meshes.rbegin()->second) std::cout << ",";
 	}
 	std::cout << std::endl;
+	std::cout << "  (" << data.size() << " vertices stored as " << vertices.size() << " vertices of " << sizeof(Vertex) << " bytes + " << index_data.size() << " bytes of indices)" << std::endl;
 	*/
 }
 
+//Cooked mesh files (written by MeshBuffer::write_cooked) store meshes already indexed:
+// vertex chunk ('pnct' or 'pnch'), 'ind0' (index data, as uploaded), 'str0' (names), 'idx1' (CookedEntry per mesh)
+struct CookedEntry {
+	uint32_t name_begin, name_end;
+	uint32_t type; //GLenum
+	uint32_t start, count;
+	uint32_t index_type; //GLenum (GL_NONE if not indexed)
+	int32_t base_vertex;
+	glm::vec3 min, max;
+};
+static_assert(sizeof(CookedEntry) == 7*4 + 2*3*4, "CookedEntry is packed.");
+
+//Read the rest of a cooked mesh file [*at_,end) (after the vertex chunk):
+// (no processing needed -- vertices are uploaded straight from the mapped file)
+template< typename Vertex >
+static void load_cooked_meshes(std::shared_ptr< MappedFile > const &file, char **at_, char *end, std::string const &filename, ChunkView< Vertex const > data, MeshBuffer::KeepMesh const &keep, MeshBuffer *buffer_) {
+	assert(at_);
+	auto &at = *at_;
+	assert(buffer_);
+	auto &buffer = *buffer_;
+
+	ChunkView< uint8_t const > indices = view_chunk< uint8_t const >(&at, end, "ind0");
+	ChunkView< char > strings = view_chunk< char >(&at, end, "str0");
+	std::vector< CookedEntry > index;
+	read_chunk(&at, end, "idx1", &index);
+
+	for (auto const &entry : index) {
+		if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
+			throw std::runtime_error("cooked index entry has out-of-range name begin/end");
+		}
+		Mesh mesh;
+		mesh.type = GLenum(entry.type);
+		mesh.start = entry.start;
+		mesh.count = entry.count;
+		mesh.index_type = GLenum(entry.index_type);
+		mesh.base_vertex = entry.base_vertex;
+		mesh.min = entry.min;
+		mesh.max = entry.max;
+
+		//check ranges, so bad files fail here rather than in the driver:
+		if (mesh.index_type == GL_NONE) {
+			if (!(uint64_t(mesh.start) + mesh.count <= data.size())) {
+				throw std::runtime_error("cooked index entry has out-of-range vertex start/count");
+			}
+		} else {
+			uint64_t size = (mesh.index_type == GL_UNSIGNED_SHORT ? 2 : (mesh.index_type == GL_UNSIGNED_INT ? 4 : 0));
+			if (size == 0) {
+				throw std::runtime_error("cooked index entry has unknown index type");
+			}
+			if (!((uint64_t(mesh.start) + mesh.count) * size <= indices.size()) || mesh.base_vertex < 0 || uint64_t(mesh.base_vertex) > data.size()) {
+				throw std::runtime_error("cooked index entry has out-of-range index start/count");
+			}
+		}
+
+		std::string name(&strings[0] + entry.name_begin, &strings[0] + entry.name_end);
+
+		if (keep) {
+			//(a mesh's data is its vertices, indices, and entry -- less its start and base_vertex, which change when other meshes change size)
+			MeshBuffer::Reload::Slot slot = mesh_slot(mesh, sizeof(Vertex), data.size() * sizeof(Vertex), indices.data, indices.size());
+			uint64_t hash = hash_bytes(&entry.type, sizeof(entry.type));
+			hash = hash_bytes(&entry.count, sizeof(entry.count), hash);
+			hash = hash_bytes(&entry.index_type, sizeof(entry.index_type), hash);
+			hash = hash_bytes(&entry.min, sizeof(entry.min) + sizeof(entry.max), hash);
+			hash = hash_bytes(reinterpret_cast< uint8_t const * >(data.data) + slot.vertex_begin, slot.vertex_end - slot.vertex_begin, hash);
+			hash = hash_bytes(indices.data + slot.index_begin, slot.index_end - slot.index_begin, hash);
+			if (!keep(name, hash)) continue;
+		}
+
+		auto ret = buffer.meshes.insert(std::make_pair(name, mesh));
+		if (!ret.second) {
+			std::cerr << "WARNING: mesh name '" + name + "' in filename '" + filename + "' collides with existing mesh." << std::endl;
+		}
+		buffer.by_index.emplace_back(&ret.first->second);
+	}
+
+	if (at != end) {
+		std::cerr << "WARNING: trailing data in mesh file '" << filename << "'" << std::endl;
+	}
+
+	buffer.pending_vertices = std::shared_ptr< void const >(file, data.data);
+	buffer.pending_vertices_size = data.size() * sizeof(Vertex);
+	buffer.pending_indices.assign(indices.begin(), indices.end());
+}
+
+//pick the loader for the rest of the file based on the chunk after the vertex data:
+template< typename Vertex >
+static void load_rest(std::shared_ptr< MappedFile > const &file, char **at_, char *end, std::string const &filename, ChunkView< Vertex const > data, bool indexed, MeshBuffer::KeepMesh const &keep, MeshBuffer *buffer) {
+	char *at = *at_;
+	if (end - at >= 4 && std::string(at, 4) == "ind0") {
+		load_cooked_meshes(file, at_, end, filename, data, keep, buffer); //(cooked meshes are always indexed)
+	} else {
+		load_meshes(file, at_, end, filename, data, indexed, keep, buffer);
+	}
+}
+
+//map a mesh file (throws if it isn't a type of file MeshBuffer reads):
+static std::shared_ptr< MappedFile > map_mesh_file(std::string const &filename) {
+	if (!(filename.size() >= 5 && filename.substr(filename.size()-5) == ".pnct")) {
+		throw std::runtime_error("Unknown file type '" + filename + "'");
+	}
+	return std::make_shared< MappedFile >(filename);
+}
+
+MeshBuffer::MeshBuffer(std::string const &filename, bool indexed) : MeshBuffer(filename, Deferred, indexed) {
+	upload();
+}
+
+MeshBuffer::MeshBuffer(std::string const &filename, DeferredTag, bool indexed) {
+	//vertex data is used directly from the mapped file (the chunk follows an 8-byte header, so it is aligned):
+	auto file = map_mesh_file(filename);
+	load(file, file->begin(), file->end(), filename, indexed);
+}
+
+MeshBuffer::MeshBuffer(Level const &level, DeferredTag, bool indexed) {
+	if (level.streamed()) {
+		throw std::runtime_error("Level '" + level.filename + "' is streamed, so has no level-wide meshes (see LevelStream).");
+	}
+	load(level.file, level.meshes.begin, level.meshes.end, level.filename, indexed);
+}
+
+MeshBuffer::MeshBuffer(std::shared_ptr< MappedFile > const &file, char *begin, char *end, std::string const &filename, DeferredTag, bool indexed) {
+	load(file, begin, end, filename, indexed);
+}
+
+MeshBuffer::MeshBuffer(Level const &level, bool indexed) : MeshBuffer(level, Deferred, indexed) {
+	upload();
+}
+
+void MeshBuffer::load(std::shared_ptr< MappedFile > const &file, char *begin, char *end, std::string const &filename, bool indexed, KeepMesh const &keep) {
+	char *at = begin;
+
+	//read data chunk:
+	{
+		//peek at the first chunk's magic number to see which vertex format the file uses:
+		if (end - at < 4) {
+			throw std::runtime_error("Failed to read chunk header");
+		}
+
+		if (std::string(at, 4) == "pnch") {
+			ChunkView< PNCHVertex const > data = view_chunk< PNCHVertex const >(&at, end, "pnch");
+
+			//store attrib locations:
+			Position = Attrib(4, GL_HALF_FLOAT, GL_FALSE, sizeof(PNCHVertex), offsetof(PNCHVertex, Position));
+			Normal = Attrib(4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PNCHVertex), offsetof(PNCHVertex, Normal));
+			Color = Attrib(4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(PNCHVertex), offsetof(PNCHVertex, Color));
+			TexCoord = Attrib(2, GL_HALF_FLOAT, GL_FALSE, sizeof(PNCHVertex), offsetof(PNCHVertex, TexCoord));
+
+			load_rest(file, &at, end, filename, data, indexed, keep, this);
+		} else {
+			ChunkView< PNCTVertex const > data = view_chunk< PNCTVertex const >(&at, end, "pnct");
+
+			//store attrib locations:
+			Position = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(PNCTVertex), offsetof(PNCTVertex, Position));
+			Normal = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(PNCTVertex), offsetof(PNCTVertex, Normal));
+			Color = Attrib(4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(PNCTVertex), offsetof(PNCTVertex, Color));
+			TexCoord = Attrib(2, GL_FLOAT, GL_FALSE, sizeof(PNCTVertex), offsetof(PNCTVertex, TexCoord));
+
+			load_rest(file, &at, end, filename, data, indexed, keep, this);
+		}
+	}
+
+	if (!keep) attach_lods(filename);
+}
+
+void MeshBuffer::attach_lods(std::string const &filename) {
+	for (auto &entry : meshes) {
+		entry.second.lods.clear();
+	}
+
+	//attach "Name.lodN" meshes to "Name" as levels of detail:
+	for (auto &entry : meshes) {
+		std::string const &name = entry.first;
+		size_t dot = name.rfind(".lod");
+		if (dot == std::string::npos || dot + 4 == name.size() || dot + 6 < name.size()) continue;
+		if (name.find_first_not_of("0123456789", dot + 4) != std::string::npos) continue;
+		uint32_t level = uint32_t(std::stoul(name.substr(dot + 4)));
+		if (level == 0 || level > 16) continue;
+
+		auto base = meshes.find(name.substr(0, dot));
+		if (base == meshes.end()) {
+			std::cerr << "WARNING: level-of-detail mesh '" << name << "' in '" << filename << "' has no base mesh." << std::endl;
+			continue;
+		}
+		Mesh const &lod_mesh = entry.second;
+		if (lod_mesh.type != base->second.type) continue;
+
+		Mesh::LOD lod;
+		lod.start = lod_mesh.start;
+		lod.count = lod_mesh.count;
+		lod.index_type = lod_mesh.index_type;
+		lod.base_vertex = lod_mesh.base_vertex;
+		lod.max_screen_size = LODScreenSize / float(1U << (level - 1));
+		base->second.lods.emplace_back(lod);
+	}
+	for (auto &entry : meshes) {
+		std::stable_sort(entry.second.lods.begin(), entry.second.lods.end(), [](Mesh::LOD const &a, Mesh::LOD const &b) {
+			return a.max_screen_size > b.max_screen_size;
+		});
+	}
+}
+
+void MeshBuffer::upload() {
+	assert(buffer == 0 && "MeshBuffer should only be uploaded once.");
+
+	size_t budget = std::numeric_limits< size_t >::max();
+	bool done = upload_partial(&budget);
+	assert(done);
+	(void)done;
+}
+
+bool MeshBuffer::upload_partial(size_t *budget_) {
+	assert(budget_);
+	auto &budget = *budget_;
+
+	if (buffer == 0) {
+		//allocate both buffers up front, then fill them a piece at a time:
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		glBufferData(GL_ARRAY_BUFFER, pending_vertices_size, nullptr, GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		if (!pending_indices.empty()) {
+			glGenBuffers(1, &index_buffer);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, pending_indices.size(), nullptr, GL_STATIC_DRAW);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+		}
+		uploaded_vertices_size = uploaded_indices_size = 0;
+	}
+
+	if (uploaded_vertices_size < pending_vertices_size && budget > 0) {
+		size_t size = std::min(budget, pending_vertices_size - uploaded_vertices_size);
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		glBufferSubData(GL_ARRAY_BUFFER, uploaded_vertices_size, size, reinterpret_cast< uint8_t const * >(pending_vertices.get()) + uploaded_vertices_size);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		uploaded_vertices_size += size;
+		budget -= size;
+	}
+	if (uploaded_indices_size < pending_indices.size() && budget > 0) {
+		size_t size = std::min(budget, pending_indices.size() - uploaded_indices_size);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
+		glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, uploaded_indices_size, size, pending_indices.data() + uploaded_indices_size);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+		uploaded_indices_size += size;
+		budget -= size;
+	}
+
+	if (uploaded_vertices_size < pending_vertices_size || uploaded_indices_size < pending_indices.size()) {
+		return false;
+	}
+
+	//release data (and the mapped file, if it was used directly):
+	pending_vertices.reset();
+	pending_vertices_size = 0;
+	pending_indices = std::vector< uint8_t >();
+	uploaded_vertices_size = uploaded_indices_size = 0;
+	return true;
+}
+
+MeshBuffer::MeshBuffer(std::string const &filename, ReloadableTag, bool indexed) {
+	reloading = std::make_unique< Reload >();
+	Reload &info = *reloading;
+	info.filename = filename;
+	info.indexed = indexed;
+
+	auto file = map_mesh_file(filename);
+	load(file, file->begin(), file->end(), filename, indexed, [&info](std::string const &name, uint64_t hash) {
+		Reload::Slot slot;
+		slot.hash = hash;
+		info.slots.emplace(name, slot); //(as in 'meshes', the first mesh with a name wins)
+		return true;
+	});
+	attach_lods(filename);
+
+	//note where each mesh will be in the buffers:
+	for (auto &entry : info.slots) {
+		uint64_t hash = entry.second.hash;
+		entry.second = mesh_slot(meshes.at(entry.first), size_t(Position.stride), pending_vertices_size, pending_indices.data(), pending_indices.size());
+		entry.second.hash = hash;
+	}
+	info.vertices_size = info.vertices_capacity = pending_vertices_size;
+	info.indices_size = info.indices_capacity = pending_indices.size();
+
+	upload();
+}
+
+std::vector< Mesh const * > MeshBuffer::reload() {
+	if (!reloading) {
+		throw std::runtime_error("Only MeshBuffers constructed with 'Reloadable' can be reloaded.");
+	}
+	assert(buffer != 0 && "MeshBuffer should be uploaded before it is reloaded.");
+	Reload &info = *reloading;
+
+	//read (and process) only the meshes whose data in the file changed:
+	MeshBuffer fresh;
+	std::unordered_map< std::string, uint64_t > hashes; //new hashes of those meshes
+	std::unordered_set< std::string > seen;
+	auto file = map_mesh_file(info.filename);
+	fresh.load(file, file->begin(), file->end(), info.filename, info.indexed, [&](std::string const &name, uint64_t hash) {
+		if (!seen.emplace(name).second) return false; //(the first mesh with a name wins)
+		auto f = info.slots.find(name);
+		if (f != info.slots.end() && f->second.hash == hash) return false;
+		hashes.emplace(name, hash);
+		return true;
+	});
+
+	//vertex arrays made for this buffer describe its vertex format, so that can't change:
+	if (fresh.Position.type != Position.type || fresh.Position.stride != Position.stride) {
+		throw std::runtime_error("Mesh file '" + info.filename + "' changed vertex format; restart to load it.");
+	}
+	for (auto const &entry : fresh.meshes) {
+		if (entry.second.index_type != GL_NONE && index_buffer == 0) {
+			throw std::runtime_error("Mesh file '" + info.filename + "' now has indexed meshes; restart to load it.");
+		}
+	}
+
+	size_t stride = size_t(Position.stride);
+	uint8_t const *fresh_vertices = reinterpret_cast< uint8_t const * >(fresh.pending_vertices.get());
+
+	//meshes using each range of the vertex buffer (ranges shared by several meshes aren't overwritten):
+	std::unordered_map< size_t, uint32_t > users;
+	for (auto const &entry : info.slots) {
+		users[entry.second.vertex_begin] += 1;
+	}
+
+	//grow a buffer's storage to at least 'size' bytes, keeping the first 'used' bytes:
+	// (re-specifies the same buffer object, so vertex arrays that refer to it stay valid)
+	// (the copy targets are used throughout since the GL_ELEMENT_ARRAY_BUFFER binding belongs to the bound vertex array)
+	auto reserve = [](GLuint target, size_t *capacity_, size_t used, size_t size) {
+		assert(capacity_);
+		auto &capacity = *capacity_;
+		if (size <= capacity) return;
+		size_t new_capacity = std::max(size, capacity + capacity / 2);
+		GLuint temp = 0;
+		glGenBuffers(1, &temp);
+		glBindBuffer(GL_COPY_READ_BUFFER, target);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, temp);
+		glBufferData(GL_COPY_WRITE_BUFFER, used, nullptr, GL_STREAM_COPY);
+		if (used) glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, used);
+		glBufferData(GL_COPY_READ_BUFFER, new_capacity, nullptr, GL_STATIC_DRAW);
+		if (used) glCopyBufferSubData(GL_COPY_WRITE_BUFFER, GL_COPY_READ_BUFFER, 0, 0, used);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glDeleteBuffers(1, &temp);
+		capacity = new_capacity;
+	};
+	auto write = [](GLuint target, size_t offset, size_t size, void const *data) {
+		if (size == 0) return;
+		glBindBuffer(GL_COPY_WRITE_BUFFER, target);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	};
+
+	std::vector< Mesh const * > changed;
+	changed.reserve(fresh.meshes.size());
+	//where data that several changed meshes share was written, by (start, count, index_type, base_vertex) in 'fresh':
+	std::map< std::tuple< GLuint, GLuint, GLenum, GLint >, Reload::Slot > written;
+	for (auto const &entry : fresh.meshes) {
+		std::string const &name = entry.first;
+		Mesh mesh = entry.second;
+		Reload::Slot from = mesh_slot(mesh, stride, fresh.pending_vertices_size, fresh.pending_indices.data(), fresh.pending_indices.size());
+		size_t vertex_bytes = from.vertex_end - from.vertex_begin;
+		size_t index_bytes = from.index_end - from.index_begin;
+		size_t index_size = (mesh.index_type == GL_UNSIGNED_SHORT ? 2 : 4);
+
+		Reload::Slot to;
+		auto key = std::make_tuple(mesh.start, mesh.count, mesh.index_type, mesh.base_vertex);
+		auto w = written.find(key);
+		if (w != written.end()) {
+			to = w->second;
+		} else {
+			auto old = info.slots.find(name);
+			if (old != info.slots.end() && users[old->second.vertex_begin] == 1
+			 && vertex_bytes <= old->second.vertex_end - old->second.vertex_begin
+			 && index_bytes <= old->second.index_end - old->second.index_begin
+			 && old->second.index_begin % index_size == 0) {
+				//fits where the mesh was:
+				to = old->second;
+			} else {
+				//goes at the ends of the buffers:
+				to.vertex_begin = info.vertices_size;
+				to.vertex_end = to.vertex_begin + vertex_bytes;
+				reserve(buffer, &info.vertices_capacity, info.vertices_size, to.vertex_end);
+				info.vertices_size = to.vertex_end;
+				if (index_bytes) {
+					to.index_begin = (info.indices_size + 3) / 4 * 4; //(aligned for either index type)
+					to.index_end = to.index_begin + index_bytes;
+					reserve(index_buffer, &info.indices_capacity, info.indices_size, to.index_end);
+					info.indices_size = to.index_end;
+				}
+			}
+			write(buffer, to.vertex_begin, vertex_bytes, fresh_vertices + from.vertex_begin);
+			write(index_buffer, to.index_begin, index_bytes, fresh.pending_indices.data() + from.index_begin);
+			written.emplace(key, to);
+		}
+
+		//point the mesh at its new range:
+		if (mesh.index_type == GL_NONE) {
+			mesh.start = GLuint(to.vertex_begin / stride);
+		} else {
+			mesh.start = GLuint(to.index_begin / index_size);
+			mesh.base_vertex = GLint(to.vertex_begin / stride);
+		}
+		auto existing = meshes.find(name);
+		if (existing == meshes.end()) {
+			existing = meshes.emplace(name, mesh).first;
+			by_index.emplace_back(&existing->second);
+		} else {
+			existing->second = mesh;
+		}
+		to.hash = hashes.at(name);
+		info.slots[name] = to;
+		changed.emplace_back(&existing->second);
+	}
+
+	//levels of detail point at ranges too, so rebuild them all:
+	attach_lods(info.filename);
+
+	return changed;
+}
+
+void MeshBuffer::write_cooked(std::ostream *to) const {
+	assert(to);
+	if (!pending_vertices) {
+		throw std::runtime_error("Can only write a MeshBuffer's cooked form before upload().");
+	}
+
+	uint8_t const *vertex_bytes = reinterpret_cast< uint8_t const * >(pending_vertices.get());
+	std::vector< uint8_t > vertices(vertex_bytes, vertex_bytes + pending_vertices_size);
+	write_chunk((Position.type == GL_HALF_FLOAT ? "pnch" : "pnct"), vertices, to);
+	write_chunk("ind0", pending_indices, to);
+
+	//names for each index entry:
+	std::unordered_map< Mesh const *, std::string const * > names;
+	for (auto const &entry : meshes) {
+		names.emplace(&entry.second, &entry.first);
+	}
+
+	std::vector< char > strings;
+	std::vector< CookedEntry > index;
+	index.reserve(by_index.size());
+	for (Mesh const *mesh : by_index) {
+		std::string const &name = *names.at(mesh);
+		CookedEntry entry;
+		entry.name_begin = uint32_t(strings.size());
+		strings.insert(strings.end(), name.begin(), name.end());
+		entry.name_end = uint32_t(strings.size());
+		entry.type = uint32_t(mesh->type);
+		entry.start = mesh->start;
+		entry.count = mesh->count;
+		entry.index_type = uint32_t(mesh->index_type);
+		entry.base_vertex = mesh->base_vertex;
+		entry.min = mesh->min;
+		entry.max = mesh->max;
+		index.emplace_back(entry);
+	}
+	write_chunk("str0", strings, to);
+	write_chunk("idx1", index, to);
+}
+
+const Mesh &MeshBuffer::lookup(uint32_t index) const {
+	if (index >= by_index.size()) {
+		throw std::runtime_error("Looking up mesh index " + std::to_string(index) + " in a buffer with " + std::to_string(by_index.size()) + " meshes.");
+	}
+	return *by_index[index];
+}
+
 const Mesh &MeshBuffer::lookup(std::string const &name) const {
 	auto f = meshes.find(name);
 	if (f == meshes.end()) {
@@ -128,7 +890,10 @@ GLuint MeshBuffer::make_vao_for_program(GLuint program) const {
 	bind_attribute("Color", Color);
 	bind_attribute("TexCoord", TexCoord);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	//(element buffer binding is part of the vertex array state)
+	if (index_buffer != 0) glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
 	glBindVertexArray(0);
+	if (index_buffer != 0) glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
 	//Check that all active attributes were bound:
 	GLint active = 0;
@@ -11,32 +11,98 @@
 
 #include "GL.hpp"
 #include <glm/glm.hpp>
+#include <functional>
 #include <map>
+#include <iosfwd>
 #include <limits>
+#include <memory>
 #include <string>
+#include <vector>
+#include <cstdint>
 
+struct Level;
+struct MappedFile;
 
 struct Mesh {
 	//Meshes are vertex ranges (and primitive types) in their MeshBuffer:
 
 	GLenum type = GL_TRIANGLES; //type of primitives in mesh
-	GLuint start = 0; //index of first vertex
-	GLuint count = 0; //count of vertices
+	GLuint start = 0; //index of first vertex (or, if indexed, of first index)
+	GLuint count = 0; //count of vertices (or, if indexed, of indices)
+
+	//Indexed meshes are drawn with glDrawElementsBaseVertex from MeshBuffer::index_buffer:
+	GLenum index_type = GL_NONE; //GL_UNSIGNED_SHORT or GL_UNSIGNED_INT if indexed; GL_NONE if not
+	GLint base_vertex = 0; //added to each index
 
 	//Bounding box.
 	//useful for debug visualization and (perhaps, eventually) collision detection:
 	glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
 	glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+
+	//Lower levels of detail, from meshes named "Name.lod1", "Name.lod2", ... in the same file (most detailed first):
+	// a level is used when the mesh's projected size (bounding sphere diameter, as a fraction of viewport height)
+	// is below its max_screen_size (see Scene::Drawable::lod_mesh)
+	struct LOD {
+		GLuint start = 0;
+		GLuint count = 0;
+		GLenum index_type = GL_NONE;
+		GLint base_vertex = 0;
+		float max_screen_size = 0.0f;
+	};
+	std::vector< LOD > lods;
 };
 
 struct MeshBuffer {
 	//construct from a file:
 	// note: will throw if file fails to read.
-	MeshBuffer(std::string const &filename);
+	// note: vertex data may be full-precision ('pnct' chunk) or compact ('pnch' chunk; see export-meshes.py --compact).
+	// note: files written by write_cooked() are loaded as-is (the 'indexed' flag is ignored).
+	// note: meshes are de-duplicated into indexed form (with triangles reordered for the post-transform vertex cache) unless 'indexed' is false.
+	MeshBuffer(std::string const &filename, bool indexed = true);
+
+	//split construction (e.g., for loading on a worker thread -- see Load.hpp):
+	// - constructing with 'Deferred' reads and processes the file but makes no OpenGL calls
+	// - upload() then creates the OpenGL buffers (call it on the thread with the OpenGL context)
+	enum DeferredTag { Deferred };
+	MeshBuffer(std::string const &filename, DeferredTag, bool indexed = true);
+	void upload();
+
+	//upload in pieces (e.g., to spread a large buffer over several frames -- see LevelStream.hpp):
+	// uploads at most *budget bytes (and subtracts what it uploaded from *budget); returns true once everything is uploaded
+	bool upload_partial(size_t *budget);
+
+	//construct (and upload) so that the buffer can later be reload()'ed when the file changes (see HotReload.hpp):
+	// (also remembers a hash of each mesh's data in the file, and where each mesh lives in the OpenGL buffers)
+	enum ReloadableTag { Reloadable };
+	MeshBuffer(std::string const &filename, ReloadableTag, bool indexed = true);
+
+	//re-read the file (of a buffer constructed with 'Reloadable'), and update just the meshes whose data changed:
+	// - changed meshes are processed and re-uploaded (with glBufferSubData) over their old range of the buffers when
+	//   they fit there, otherwise at the ends of the buffers (which grow, by copying on the GPU, when full)
+	// - their Mesh entries are updated in place, so Mesh pointers stay valid; new meshes are added (and appended to by_index)
+	// - meshes missing from the file are left as they were
+	// returns the meshes that changed -- drawables using them need their pipelines patched (see HotReload::patch_drawables)
+	// n.b. throws (leaving the buffer as it was) if the file can't be read or has changed vertex format
+	// n.b. ranges that meshes move out of aren't reused, so the buffers only grow (restart to compact them)
+	std::vector< Mesh const * > reload();
+
+	//construct from the mesh section of a packed level (see Level.hpp):
+	MeshBuffer(Level const &level, bool indexed = true);
+	MeshBuffer(Level const &level, DeferredTag, bool indexed = true);
+	//...or from mesh file contents [begin,end) inside a mapped file (e.g., a streamed level's cell):
+	MeshBuffer(std::shared_ptr< MappedFile > const &file, char *begin, char *end, std::string const &filename, DeferredTag, bool indexed = true);
+
+	//write meshes in "cooked" form -- already indexed and vertex-cache ordered, so loading does no processing:
+	// (must be called before upload(); writes a .pnct file that any MeshBuffer constructor can read -- see cook-assets.cpp)
+	void write_cooked(std::ostream *to) const;
 
 	//look up a particular mesh by name:
 	// note: will throw if mesh not found.
 	const Mesh &lookup(std::string const &name) const;
+
+	//look up a mesh by its position in the file's index (e.g., from Level::mesh_refs):
+	// note: will throw if index is out of range.
+	const Mesh &lookup(uint32_t index) const;
 	
 	//build a vertex array object that links this vbo to attributes to a program:
 	// note: will throw if program defines attributes not contained in this buffer
@@ -44,11 +110,51 @@ struct MeshBuffer {
 
 	//This is the OpenGL vertex buffer object containing the mesh data:
 	GLuint buffer = 0;
+	//..and the element buffer object with indices for indexed meshes (0 if none):
+	GLuint index_buffer = 0;
 
 	//-- internals ---
 
-	//used by the lookup() function:
+	//used by the lookup() functions:
 	std::map< std::string, Mesh > meshes;
+	std::vector< Mesh const * > by_index; //file index order (points into 'meshes'; duplicate names point to the first mesh with that name)
+
+	//(used by constructors) read meshes from [begin,end), which is inside the mapped 'file':
+	// if 'keep' is given, it is asked (with the name of the mesh and a hash of its data in the file) whether to read each mesh;
+	// meshes it turns down are left out of 'meshes' and 'by_index', and levels of detail are not attached (see attach_lods)
+	typedef std::function< bool(std::string const &name, uint64_t hash) > KeepMesh;
+	void load(std::shared_ptr< MappedFile > const &file, char *begin, char *end, std::string const &filename, bool indexed, KeepMesh const &keep = nullptr);
+
+	//(re)build each mesh's 'lods' from the "Name.lodN" meshes in 'meshes':
+	void attach_lods(std::string const &filename);
+
+	//(used by reload()) empty buffer, to read changed meshes into:
+	MeshBuffer() = default;
+
+	//default Mesh::LOD::max_screen_size for level N is LODScreenSize / 2^(N-1):
+	static constexpr float LODScreenSize = 0.25f;
+
+	//data waiting for upload() (points into the mapped file or a processed copy):
+	std::shared_ptr< void const > pending_vertices;
+	size_t pending_vertices_size = 0;
+	std::vector< uint8_t > pending_indices;
+	size_t uploaded_vertices_size = 0, uploaded_indices_size = 0; //progress of upload_partial()
+
+	//bookkeeping for reload() (only for buffers constructed with 'Reloadable'):
+	struct Reload {
+		std::string filename;
+		bool indexed = true;
+		//where a mesh's data lives in the buffers (in bytes; index range empty if not indexed):
+		struct Slot {
+			uint64_t hash = 0; //of the mesh's data in the file
+			size_t vertex_begin = 0, vertex_end = 0;
+			size_t index_begin = 0, index_end = 0;
+		};
+		std::map< std::string, Slot > slots; //by mesh name
+		size_t vertices_size = 0, vertices_capacity = 0; //bytes of 'buffer' in use / allocated
+		size_t indices_size = 0, indices_capacity = 0; //bytes of 'index_buffer' in use / allocated
+	};
+	std::unique_ptr< Reload > reloading;
 
 	//These 'Attrib' structures describe the location of various attributes within the buffer (in exactly format wanted by glVertexAttribPointer). They are set when the file is loaded and are used by the "make_vao_for_program" call:
 	struct Attrib {
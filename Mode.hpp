@@ -15,8 +15,19 @@ struct Mode : std::enable_shared_from_this< Mode > {
 
 	//update is called at the start of a new frame, after events are handled:
 	// 'elapsed' is time in seconds since the last call to 'update'
+	// (main.cpp calls it through the default update_frame; modes with fixed-timestep simulation override update_fixed and update_frame instead)
 	virtual void update(float elapsed) { }
 
+	//update_fixed is called zero or more times per frame, before update_frame, to advance the simulation by exactly 'tick' seconds:
+	// (so simulation results don't depend on frame rate)
+	virtual void update_fixed(float tick) { }
+
+	//update_frame is called once per frame, after any update_fixed calls:
+	// 'elapsed' is time in seconds since the last frame;
+	// 'alpha' (in [0,1)) is how far time has moved past the last update_fixed, as a fraction of a tick,
+	//  for interpolating between the previous and latest simulation states when drawing
+	virtual void update_frame(float elapsed, float alpha) { update(elapsed); }
+
 	//draw is called after update:
 	virtual void draw(glm::uvec2 const &drawable_size) = 0;
 
@@ -0,0 +1,81 @@
+#include "OpusStream.hpp"
+
+#include <opusfile.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+OpusStream::OpusStream(std::string const &filename_, bool loop_) : filename(filename_), loop(loop_) {
+	int err = 0;
+	op = op_open_file(filename.c_str(), &err);
+	if (err != 0 || !op) {
+		if (op) op_free(op);
+		throw std::runtime_error("opusfile error " + std::to_string(err) + " opening \"" + filename + "\" for streaming.");
+	}
+	ring.assign(Capacity, 0.0f);
+	pcm.assign(2*5760, 0.0f); //opus packets are at most 120ms (5760 samples at 48kHz)
+}
+
+OpusStream::~OpusStream() {
+	if (op) op_free(op);
+}
+
+void OpusStream::check(std::string const &filename) {
+	int err = 0;
+	OggOpusFile *test = op_test_file(filename.c_str(), &err);
+	if (test) op_free(test);
+	if (err != 0 || !test) {
+		throw std::runtime_error("opusfile error " + std::to_string(err) + " opening \"" + filename + "\" for streaming.");
+	}
+}
+
+void OpusStream::fill(uint32_t target) {
+	target = std::min< uint32_t >(target, Capacity);
+	while (!finished.load(std::memory_order_relaxed)) {
+		uint64_t write = write_count.load(std::memory_order_relaxed);
+		uint64_t used = write - read_count.load(std::memory_order_acquire);
+		//stop once there's enough decoded, or not enough room for another packet:
+		if (used >= target || Capacity - used < pcm.size() / 2) break;
+
+		int ret = op_read_float_stereo(op, pcm.data(), int(pcm.size()));
+		if (ret < 0) {
+			throw std::runtime_error("opusfile read error " + std::to_string(ret) + " streaming \"" + filename + "\".");
+		}
+		if (ret == 0) {
+			//end of file:
+			if (loop && write != 0) {
+				int seek = op_pcm_seek(op, 0);
+				if (seek != 0) {
+					throw std::runtime_error("opusfile seek error " + std::to_string(seek) + " looping \"" + filename + "\".");
+				}
+				continue;
+			}
+			finished.store(true, std::memory_order_release);
+			break;
+		}
+
+		for (uint32_t i = 0; i < uint32_t(ret); ++i) {
+			ring[(write + i) & (Capacity - 1)] = (pcm[2*i] + pcm[2*i+1]) * 0.5f; //downmix to mono by averaging
+		}
+		write_count.store(write + uint32_t(ret), std::memory_order_release);
+	}
+}
+
+uint32_t OpusStream::peek(float const **run, uint32_t max) const {
+	uint64_t read = read_count.load(std::memory_order_relaxed);
+	uint64_t available = write_count.load(std::memory_order_acquire) - read;
+	uint32_t at = uint32_t(read & (Capacity - 1));
+	uint32_t count = uint32_t(std::min< uint64_t >({ available, max, Capacity - at }));
+	*run = ring.data() + at;
+	return count;
+}
+
+void OpusStream::consume(uint32_t count) {
+	read_count.store(read_count.load(std::memory_order_relaxed) + count, std::memory_order_release);
+}
+
+bool OpusStream::done() const {
+	//(check 'finished' first: once it is set, write_count is final)
+	return finished.load(std::memory_order_acquire)
+		&& read_count.load(std::memory_order_relaxed) == write_count.load(std::memory_order_acquire);
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+/*
+ * OpusStream decodes an opus file incrementally into a ring buffer of
+ *  48kHz mono floats, so long music/ambience tracks don't have to be fully
+ *  decoded (and held in memory) up front.
+ *
+ * It is single-producer/single-consumer:
+ *  - one thread (Sound's streaming thread) calls fill()
+ *  - one thread (the audio callback) calls peek()/consume()/done()
+ *
+ * Looping streams seek back to the start when the file runs out, so the
+ *  consumer just sees an endless run of samples.
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct OggOpusFile; //from opusfile.h
+
+struct OpusStream {
+	//opens the file; throws on error:
+	OpusStream(std::string const &filename, bool loop);
+	~OpusStream();
+
+	OpusStream(OpusStream const &) = delete;
+	OpusStream &operator=(OpusStream const &) = delete;
+
+	//check that 'filename' can be opened for streaming; throws on error:
+	static void check(std::string const &filename);
+
+	//--- producer side ---
+	//decode until the ring holds at least 'target' samples (or is full, or the file ends):
+	// throws on decode errors
+	void fill(uint32_t target = -1U);
+
+	//--- consumer side ---
+	//get a contiguous run of up to 'max' decoded samples; returns run length (may be zero):
+	uint32_t peek(float const **run, uint32_t max) const;
+	//mark 'count' samples (no more than peek() returned) as used:
+	void consume(uint32_t count);
+	//has the (non-looping) file ended and every decoded sample been consumed?
+	bool done() const;
+
+	//times the consumer wanted samples that hadn't been decoded yet (for diagnostics):
+	std::atomic< uint32_t > underruns{0};
+
+	//internals:
+	std::string filename;
+	bool loop = false;
+	OggOpusFile *op = nullptr;
+
+	enum : uint32_t { Capacity = 1 << 16 }; //ring size in samples (a bit over a second); power of two
+	std::vector< float > ring;
+	std::atomic< uint64_t > read_count{0}; //total samples consumed (written by consumer)
+	std::atomic< uint64_t > write_count{0}; //total samples decoded (written by producer)
+	std::atomic< bool > finished{false}; //producer has reached the end of a non-looping file
+	std::atomic< bool > released{false}; //consumer is done with the stream (so whoever owns it may free it)
+
+	std::vector< float > pcm; //decode scratch (stereo), producer only
+};
@@ -6,21 +6,30 @@
  * Based on code from Chesskoban (c) 2017-2019 Jim McCann;
  * this adapted-for-15-466 code is released into the public domain.
  *
+ * All of the font's tables -- including the prefix trie used to find glyphs -- are generated by
+ *  make-PathFont-font.py as constant data, so a PathFont is just a set of pointers: there is nothing
+ *  to build at startup, and nothing is allocated.
+ *
  */
 
-#include <glm/glm.hpp>
-
-#include <string>
-#include <vector>
-#include <map>
+#include <cstddef>
+#include <cstdint>
 
 struct PathFont {
 	//meant to be intitialized with some pointers to constant data:
-	PathFont(uint32_t glyphs,
-		const float *glyph_widths,
-		const uint32_t *glyph_char_starts, const uint8_t *chars,
-		const uint32_t *glyph_coord_starts, const float *coords
-		);
+	constexpr PathFont(uint32_t glyphs_,
+		const float *glyph_widths_,
+		const uint32_t *glyph_char_starts_, const uint8_t *chars_,
+		const uint32_t *glyph_coord_starts_, const float *coords_,
+		const uint32_t *root_children_,
+		const uint32_t *trie_glyphs_, const uint32_t *trie_child_starts_, const uint8_t *trie_child_bytes_, const uint32_t *trie_child_nodes_
+		) : glyphs(glyphs_),
+			glyph_widths(glyph_widths_),
+			glyph_char_starts(glyph_char_starts_), chars(chars_),
+			glyph_coord_starts(glyph_coord_starts_), coords(coords_),
+			root_children(root_children_),
+			trie_glyphs(trie_glyphs_), trie_child_starts(trie_child_starts_), trie_child_bytes(trie_child_bytes_), trie_child_nodes(trie_child_nodes_) {
+	}
 	const uint32_t glyphs = 0;
 	const float *glyph_widths = nullptr;
 
@@ -30,10 +39,46 @@ struct PathFont {
 	const uint32_t *glyph_coord_starts = nullptr; //indices into 'coords' table
 	const float *coords = nullptr;
 
-	//computed in constructor:
-	std::map< std::string, uint32_t > glyph_map;
+	//prefix trie over glyph strings, used by match():
+	// node 0 is the root; node n's children are trie_child_bytes / trie_child_nodes [trie_child_starts[n], trie_child_starts[n+1]), sorted by byte
+	const uint32_t *root_children = nullptr; //[256] the root's children by first byte (0 for none), so single-byte glyphs are one lookup
+	const uint32_t *trie_glyphs = nullptr; //glyph spelled by the path to each node, or -1U
+	const uint32_t *trie_child_starts = nullptr;
+	const uint8_t *trie_child_bytes = nullptr;
+	const uint32_t *trie_child_nodes = nullptr;
 
-	//the default font:
-	static PathFont font;
-};
+	//find the longest glyph that 'text' starts with (without allocating):
+	// returns the glyph index and sets *length to its length in bytes, or returns -1U (and sets *length to 0) if none
+	// (constexpr, so the generated tables can be checked at compile time; 'Byte' is char or uint8_t)
+	template< typename Byte >
+	constexpr uint32_t match(Byte const *text, size_t size, size_t *length) const {
+		uint32_t glyph = -1U;
+		*length = 0;
+		if (size == 0) return glyph;
 
+		uint32_t node = root_children[uint8_t(text[0])];
+		size_t at = 1;
+		while (node != 0) {
+			if (trie_glyphs[node] != -1U) {
+				glyph = trie_glyphs[node];
+				*length = at;
+			}
+			if (at == size) break;
+			//(nodes have very few children, so a linear scan beats a binary search)
+			uint8_t byte = uint8_t(text[at]);
+			uint32_t next = 0;
+			for (uint32_t c = trie_child_starts[node]; c < trie_child_starts[node+1]; ++c) {
+				if (trie_child_bytes[c] == byte) {
+					next = trie_child_nodes[c];
+					break;
+				}
+			}
+			node = next;
+			at += 1;
+		}
+		return glyph;
+	}
+
+	//the default font (defined, with its tables, in PathFont-font.cpp):
+	static const PathFont font;
+};
@@ -3,59 +3,110 @@
 #include "LitColorTextureProgram.hpp"
 
 #include "DrawLines.hpp"
+#include "Jobs.hpp"
 #include "Mesh.hpp"
+#include "Level.hpp"
+#include "LevelStream.hpp"
 #include "Load.hpp"
 #include "gl_errors.hpp"
 #include "data_path.hpp"
+#include "Profiler.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/quaternion.hpp>
 
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
 #include <random>
 #include <iostream>
 
 #include "Sound.hpp"
+#include "SampleCache.hpp"
 
-GLuint phonebank_meshes_for_lit_color_texture_program = 0;
-Load< MeshBuffer > phonebank_meshes(LoadTagDefault, []() -> MeshBuffer const * {
-	MeshBuffer const *ret = new MeshBuffer(data_path("wood.pnct"));
-	phonebank_meshes_for_lit_color_texture_program = ret->make_vao_for_program(lit_color_texture_program->program);
-	return ret;
+//scene, walkmeshes, and (per-cell) meshes all come from one mapped file (built by scenes/pack-level.py --cell-size):
+// (mapping is cheap, so startup doesn't depend on the level's size -- meshes stream in later; see PlayMode::level_stream)
+Load< Level > phonebank_level(LoadTagEarly, []() -> Level const * {
+	return new Level(cooked_path(data_path("wood.level"))); //(the cooked copy, if cook-assets has made one)
 });
 
 Load< Scene > phonebank_scene(LoadTagDefault, []() -> Scene const * {
-	return new Scene(data_path("wood.scene"), [&](Scene &scene, Scene::Transform *transform, std::string const &mesh_name){
-		Mesh const &mesh = phonebank_meshes->lookup(mesh_name);
+	return new Scene(*phonebank_level, nullptr); //(drawables are made by PlayMode::level_stream)
+});
 
-		scene.drawables.emplace_back(transform);
-		Scene::Drawable &drawable = scene.drawables.back();
+WalkMesh const *walkmesh = nullptr;
+Load< WalkMeshes > phonebank_walkmeshes(LoadTagDefault, []() -> WalkMeshes * {
+	return new WalkMeshes(*phonebank_level);
+}, [](WalkMeshes *ret) -> WalkMeshes const * {
+	walkmesh = &ret->lookup("WalkMesh");
+	return ret;
+});
+
+Load< Sound::Sample > footstep1_sample(LoadTagDefault, []() {
+	return Sound::sample_cache.get(data_path("footsteps/footstep1.wav"));
+}, [](std::shared_ptr< Sound::Sample const > sample) -> Sound::Sample const * {
+	return sample.get(); //(Permanent cache entries outlive the Load<>)
+});
 
+//sets wave uniforms for lit_color_texture_program (or its instanced variant):
+// (lights, if enabled, come from the scene through light_tiles)
+static void set_frame_uniforms(LitColorTextureProgram const &program, PlayMode::FrameUniforms const &frame) {
+	glUniform1i(program.SCENE_LIGHTS_bool, frame.scene_lights ? GL_TRUE : GL_FALSE);
+	glUniform1f(program.TIME_float, frame.time);
+	glUniform1f(program.TIME_LAST_float, frame.time_last_wave);
+	glUniform3fv(program.CAMERA_POS_vec3, 1, glm::value_ptr(frame.wave_camera_pos));
+}
+
+PlayMode::PlayMode() : scene(*phonebank_scene) {
+	//drawables are all opaque, so submit them grouped by GL state:
+	scene.sort_drawables = true;
+	//occlusion culling stays off unless toggled with F5 (it only pays off where walls hide many drawables):
+	scene.occlusion_culling = false;
+
+	//have scene.draw() set per-frame uniforms for lit_color_texture_program drawables:
+	auto uniforms = Scene::Drawable::Pipeline::Uniforms::make< LitColorTextureProgram, FrameUniforms, set_frame_uniforms >(
+		lit_color_texture_program, lit_color_texture_program_instanced, &frame_uniforms
+	);
+
+	//drawables come and go as the level's cells stream in and out around the player (see update_frame()):
+	level_stream.reset(new LevelStream(*phonebank_level, &scene, [](MeshBuffer const &meshes) -> GLuint {
+		return meshes.make_vao_for_program(lit_color_texture_program->program);
+	}, [uniforms](Scene::Drawable &drawable, Mesh const &mesh, GLuint vao) {
 		drawable.pipeline = lit_color_texture_program_pipeline;
+		drawable.pipeline.uniforms = uniforms;
 
-		drawable.pipeline.vao = phonebank_meshes_for_lit_color_texture_program;
+		drawable.pipeline.vao = vao;
 		drawable.pipeline.type = mesh.type;
 		drawable.pipeline.start = mesh.start;
 		drawable.pipeline.count = mesh.count;
+		drawable.pipeline.index_type = mesh.index_type;
+		drawable.pipeline.base_vertex = mesh.base_vertex;
 
-	});
-});
+		//bounds for culling:
+		drawable.min = mesh.min;
+		drawable.max = mesh.max;
 
-WalkMesh const *walkmesh = nullptr;
-Load< WalkMeshes > phonebank_walkmeshes(LoadTagDefault, []() -> WalkMeshes const * {
-	WalkMeshes *ret = new WalkMeshes(data_path("wood.w"));
-	walkmesh = &ret->lookup("WalkMesh");
-	return ret;
-});
+		//lower levels of detail (if the mesh file has any):
+		drawable.lod_mesh = &mesh;
 
-Load< Sound::Sample > footstep1_sample(LoadTagDefault, []() -> Sound::Sample const * {
-	return new Sound::Sample(data_path("footsteps/footstep1.wav"));
-});
+		//big meshes (walls, floors) are drawn first and hide the rest from occlusion culling:
+		// (measured as the size of the mesh's bounding box in world space, so ancestors' scales count too)
+		constexpr float OccluderSize = 4.0f;
+		glm::mat3 to_world = glm::mat3(drawable.transform->make_local_to_world());
+		glm::vec3 extent = mesh.max - mesh.min;
+		glm::vec3 size = glm::abs(to_world[0]) * extent.x + glm::abs(to_world[1]) * extent.y + glm::abs(to_world[2]) * extent.z;
+		drawable.occluder = std::max(size.x, std::max(size.y, size.z)) >= OccluderSize;
+	}));
+
+	agents.reset(new WalkAgents(*walkmesh));
 
-PlayMode::PlayMode() : scene(*phonebank_scene) {
 	//create a player transform:
 	scene.transforms.emplace_back();
 	player.transform = &scene.transforms.back();
 
+	walkmesh_lines.add_walkmesh(*walkmesh, glm::u8vec4(0x88, 0x00, 0xff, 0xff));
+
 	//create a player camera attached to a child of the player transform:
 	scene.transforms.emplace_back();
 	scene.cameras.emplace_back(&scene.transforms.back());
@@ -73,6 +124,7 @@ PlayMode::PlayMode() : scene(*phonebank_scene) {
 	//start player walking at nearest walk point:
 	player.transform->position = glm::vec3(-5.0f, -5.0f, 0.0f);
 	player.at = walkmesh->nearest_walk_point(player.transform->position);
+	player.position = player.previous_position = player.transform->position = walkmesh->to_world_point(player.at);
 	// std::cout << player.at.indices.x << ", "
 	//           << player.at.indices.y << ", "
 	// 		  << player.at.indices.y << "\n";
@@ -91,14 +143,113 @@ PlayMode::PlayMode() : scene(*phonebank_scene) {
 }
 
 PlayMode::~PlayMode() {
+	if (!recording.filename.empty()) {
+		std::cout << "Saving " << recording.path.samples.size() << " camera path samples to '" << recording.filename << "'." << std::endl;
+		try {
+			recording.path.save(recording.filename);
+		} catch (std::exception &e) {
+			std::cerr << "WARNING: " << e.what() << std::endl;
+		}
+	}
+}
+
+void PlayMode::record_path(std::string const &filename) {
+	recording.filename = filename;
+	recording.path = CameraPath();
+}
+
+void PlayMode::replay_path(std::string const &filename, std::string const &report_filename) {
+	replay.path = CameraPath(filename);
+	if (replay.path.samples.empty()) throw std::runtime_error("Camera path '" + filename + "' is empty.");
+	//samples are used as-is (by update_fixed), so check they are on this walkmesh:
+	// (a path recorded on another level -- or an older export of this one -- would otherwise index out of bounds)
+	for (size_t i = 0; i < replay.path.samples.size(); ++i) {
+		WalkPoint const &at = replay.path.samples[i].at;
+		bool valid = (at.triangle < walkmesh->triangles.size());
+		if (valid) {
+			glm::uvec3 const &tri = walkmesh->triangles[at.triangle];
+			uint32_t r = walkmesh->triangle_rotation(at, at.triangle);
+			valid = (at.indices == glm::uvec3(tri[r], tri[(r+1)%3], tri[(r+2)%3]));
+		}
+		if (valid) valid = std::isfinite(at.weights.x) && std::isfinite(at.weights.y) && std::isfinite(at.weights.z);
+		if (!valid) {
+			throw std::runtime_error("Camera path '" + filename + "' sample " + std::to_string(i) + " is not a point on this level's walkmesh (triangle " + std::to_string(at.triangle) + " of " + std::to_string(walkmesh->triangles.size()) + ").");
+		}
+	}
+	replay.active = true;
+	replay.finished = false;
+	replay.next = 0;
+	replay.report_filename = report_filename;
+	replay.frames.clear();
+	replay.frames.reserve(replay.path.samples.size());
+
+	//start at the first sample:
+	CameraPath::Sample const &first = replay.path.samples[0];
+	player.at = first.at;
+	player.position = player.previous_position = player.transform->position = walkmesh->to_world_point(player.at);
+	player.transform->rotation = first.rotation;
+	player.camera->transform->rotation = first.camera_rotation;
+}
+
+void PlayMode::write_replay_report() const {
+	std::ofstream out(replay.report_filename);
+	if (!out) throw std::runtime_error("Failed to open '" + replay.report_filename + "' for writing replay report.");
+
+	//per-frame rows:
+	out << "frame,frame_ms,draws,cull_tests,culled,lod_reduced,occlusion_queries,occluded\n";
+	for (uint32_t i = 0; i < replay.frames.size(); ++i) {
+		auto const &frame = replay.frames[i];
+		out << i << ',' << frame.ms << ','
+			<< frame.stats.draws << ',' << frame.stats.cull_tests << ',' << frame.stats.culled << ',' << frame.stats.lod_reduced << ','
+			<< frame.stats.occlusion_queries << ',' << frame.stats.occluded << '\n';
+	}
+
+	//summary (frame 0 has no previous frame, so isn't included in frame times):
+	std::vector< float > ms;
+	double draws = 0.0, culled = 0.0;
+	for (uint32_t i = 0; i < replay.frames.size(); ++i) {
+		if (i > 0) ms.emplace_back(replay.frames[i].ms);
+		draws += replay.frames[i].stats.draws;
+		culled += replay.frames[i].stats.culled;
+	}
+	std::sort(ms.begin(), ms.end());
+	auto percentile = [&ms](float p) {
+		if (ms.empty()) return 0.0f;
+		uint32_t rank = uint32_t(std::ceil(p / 100.0f * float(ms.size())));
+		return ms[std::max(rank, 1U) - 1];
+	};
+	double mean_ms = 0.0;
+	for (float m : ms) mean_ms += m;
+	if (!ms.empty()) mean_ms /= double(ms.size());
+	double frames = double(std::max< size_t >(replay.frames.size(), 1));
+
+	out << "\nframes,mean_ms,p50_ms,p95_ms,p99_ms,max_ms,mean_draws,mean_culled\n";
+	out << replay.frames.size() << ',' << mean_ms << ','
+		<< percentile(50.0f) << ',' << percentile(95.0f) << ',' << percentile(99.0f) << ',' << percentile(100.0f) << ','
+		<< draws / frames << ',' << culled / frames << '\n';
+
+	if (!out) throw std::runtime_error("Failed to write replay report to '" + replay.report_filename + "'.");
 }
 
 bool PlayMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size) {
+	//replays ignore input (so every run is the same):
+	if (replay.active) return false;
 
 	if (evt.type == SDL_KEYDOWN) {
 		if (evt.key.keysym.sym == SDLK_ESCAPE) {
 			SDL_SetRelativeMouseMode(SDL_FALSE);
 			return true;
+		} else if (evt.key.keysym.sym == SDLK_F4) {
+			show_walkmesh = !show_walkmesh;
+			return true;
+		} else if (evt.key.keysym.sym == SDLK_F5) {
+			scene.occlusion_culling = !scene.occlusion_culling;
+			std::cout << "Occlusion culling " << (scene.occlusion_culling ? "on" : "off") << "." << std::endl;
+			return true;
+		} else if (evt.key.keysym.sym == SDLK_F8) {
+			frame_uniforms.scene_lights = !frame_uniforms.scene_lights;
+			std::cout << "Scene lights " << (frame_uniforms.scene_lights ? "on" : "off") << "." << std::endl;
+			return true;
 		} else if (evt.key.keysym.sym == SDLK_a) {
 			left.downs += 1;
 			left.pressed = true;
@@ -158,8 +309,37 @@ bool PlayMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size)
 	return false;
 }
 
-void PlayMode::update(float elapsed) {
-	time_elapsed += elapsed;
+void PlayMode::spawn_agents(uint32_t count) {
+	size_t first = agents->agents.size();
+	agents->spawn(count, 0x5eed + uint32_t(first));
+	for (size_t i = first; i < agents->agents.size(); ++i) {
+		agents->agents[i].transform = &scene.transforms.emplace_back();
+	}
+	std::cout << "Spawned " << count << " agents (simulated on " << Jobs::thread_count() << " threads)." << std::endl;
+}
+
+void PlayMode::update_fixed(float tick) {
+	{ //agents wander (in parallel; results don't depend on thread count):
+		PROFILE_CPU("agents");
+		agents->update(tick);
+	}
+
+	//replay: take the player's state from the path instead of from input:
+	if (replay.active) {
+		if (replay.next >= replay.path.samples.size()) {
+			replay.finished = true;
+			return;
+		}
+		CameraPath::Sample const &sample = replay.path.samples[replay.next]; //(checked against the walkmesh by replay_path)
+		replay.next += 1;
+		player.at = sample.at;
+		player.previous_position = player.position;
+		player.position = walkmesh->to_world_point(player.at);
+		player.transform->rotation = sample.rotation;
+		player.camera->transform->rotation = sample.camera_rotation;
+		return;
+	}
+
 	//player walking:
 	{
 		//combine inputs into a move:
@@ -171,60 +351,21 @@ void PlayMode::update(float elapsed) {
 		if (!down.pressed && up.pressed) move.y = 1.0f;
 
 		//make it so that moving diagonally doesn't go faster:
-		if (move != glm::vec2(0.0f)) move = glm::normalize(move) * PlayerSpeed * elapsed;
+		if (move != glm::vec2(0.0f)) move = glm::normalize(move) * PlayerSpeed * tick;
 
 		//get move in world coordinate system:
 		glm::vec3 remain = player.transform->make_local_to_world() * glm::vec4(move.x, move.y, 0.0f, 0.0f);
 
-		//using a for() instead of a while() here so that if walkpoint gets stuck in
-		// some awkward case, code will not infinite loop:
-		for (uint32_t iter = 0; iter < 10; ++iter) {
-			if (remain == glm::vec3(0.0f)) break;
-			WalkPoint end;
-			float time;
-			walkmesh->walk_in_triangle(player.at, remain, &end, &time);
-			player.at = end;
-			if (time == 1.0f) {
-				//finished within triangle:
-				remain = glm::vec3(0.0f);
-				break;
-			}
-			//some step remains:
-			remain *= (1.0f - time);
-			//try to step over edge:
-			glm::quat rotation;
-			if (walkmesh->cross_edge(player.at, &end, &rotation)) {
-				//stepped to a new triangle:
-				player.at = end;
-				//rotate step to follow surface:
-				remain = rotation * remain;
-			} else {
-				//ran into a wall, bounce / slide along it:
-				glm::vec3 const &a = walkmesh->vertices[player.at.indices.x];
-				glm::vec3 const &b = walkmesh->vertices[player.at.indices.y];
-				glm::vec3 const &c = walkmesh->vertices[player.at.indices.z];
-				glm::vec3 along = glm::normalize(b-a);
-				glm::vec3 normal = glm::normalize(glm::cross(b-a, c-a));
-				glm::vec3 in = glm::cross(normal, along);
-
-				//check how much 'remain' is pointing out of the triangle:
-				float d = glm::dot(remain, in);
-				if (d < 0.0f) {
-					//bounce off of the wall:
-					remain += (-1.25f * d) * in;
-				} else {
-					//if it's just pointing along the edge, bend slightly away from wall:
-					remain += 0.01f * d * in;
-				}
-			}
-		}
+		//walk (crossing edges and sliding along walls):
+		remain = walkmesh->walk(&player.at, remain);
 
 		if (remain != glm::vec3(0.0f)) {
 			std::cout << "NOTE: code used full iteration budget for walking." << std::endl;
 		}
 
 		//update player's position to respect walking:
-		player.transform->position = walkmesh->to_world_point(player.at);
+		player.previous_position = player.position;
+		player.position = walkmesh->to_world_point(player.at);
 
 		{ //update player's rotation to respect local (smooth) up-vector:
 			
@@ -245,6 +386,29 @@ void PlayMode::update(float elapsed) {
 		*/
 	}
 
+	if (!recording.filename.empty()) {
+		recording.path.tick = tick;
+		recording.path.samples.emplace_back();
+		CameraPath::Sample &sample = recording.path.samples.back();
+		sample.at = player.at;
+		sample.rotation = player.transform->rotation;
+		sample.camera_rotation = player.camera->transform->rotation;
+	}
+}
+
+void PlayMode::update_frame(float elapsed, float alpha) {
+	time_elapsed += elapsed;
+
+	//draw player between its last two simulated positions:
+	player.transform->position = glm::mix(player.previous_position, player.position, alpha);
+	//...and agents, likewise:
+	agents->write_transforms(alpha);
+
+	{ //load cells near the player (and evict far ones):
+		PROFILE_CPU("level stream");
+		level_stream->update(player.position);
+	}
+
 	//reset button press counters:
 	left.downs = 0;
 	right.downs = 0;
@@ -256,19 +420,23 @@ void PlayMode::update(float elapsed) {
 		wave_cd -= elapsed;
 		if (wave_cd <= 0.0f) can_generate_wave = true;
 	}
+
+	//end of replay: report and quit:
+	if (replay.finished) {
+		std::cout << "Replayed " << replay.frames.size() << " frames; writing report to '" << replay.report_filename << "'." << std::endl;
+		try {
+			write_replay_report();
+		} catch (std::exception &e) {
+			std::cerr << "WARNING: " << e.what() << std::endl;
+		}
+		Mode::set_current(nullptr); //(may destroy this mode, so nothing should follow)
+	}
 }
 
 void PlayMode::draw(glm::uvec2 const &drawable_size) {
 	//update camera aspect ratio for drawable:
 	player.camera->aspect = float(drawable_size.x) / float(drawable_size.y);
 
-	//set up light type and position for lit_color_texture_program:
-	// TODO: consider using the Light(s) in the scene to do this
-	glUseProgram(lit_color_texture_program->program);
-	glUniform1i(lit_color_texture_program->LIGHT_TYPE_int, 1);
-	glUniform3fv(lit_color_texture_program->LIGHT_DIRECTION_vec3, 1, glm::value_ptr(glm::vec3(0.0f, 0.0f,-1.0f)));
-	glUniform3fv(lit_color_texture_program->LIGHT_ENERGY_vec3, 1, glm::value_ptr(glm::vec3(1.0f, 1.0f, 0.95f)));
-
 	//wave generation
 	if (can_generate_wave && player.transform->position != last_frame_pos) {
 		time_last_wave = time_elapsed;
@@ -277,12 +445,12 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 		wave_cd = WAVE_COOL_DOWN;
 		Sound::play(*footstep1_sample);
 	}
-	glUniform1f(lit_color_texture_program->TIME_float, time_elapsed);
-	glUniform1f(lit_color_texture_program->TIME_LAST_float, time_last_wave);
-	glUniform3fv(lit_color_texture_program->CAMERA_POS_vec3, 1, glm::value_ptr(last_wave_camera_pos));
 	last_frame_pos = player.transform->position;
 
-	glUseProgram(0);
+	//wave uniforms are set by scene.draw() (see set_frame_uniforms):
+	frame_uniforms.time = time_elapsed;
+	frame_uniforms.time_last_wave = time_last_wave;
+	frame_uniforms.wave_camera_pos = last_wave_camera_pos;
 
 	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 	glClearDepth(1.0f); //1.0 is actually the default value to clear the depth buffer to, but FYI you can change it.
@@ -291,21 +459,38 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 	glEnable(GL_DEPTH_TEST);
 	glDepthFunc(GL_LESS); //this is the default depth comparison function, but FYI you can change it.
 
+	//refresh cached world matrices (after all of this frame's updates and input), then draw using them:
+	scene.update_transforms();
+	if (frame_uniforms.scene_lights) light_tiles.update(scene, *player.camera, drawable_size);
+	light_tiles.bind();
 	scene.draw(*player.camera);
 
-	/* In case you are wondering if your walkmesh is lining up with your scene, try:
-	{
-		glDisable(GL_DEPTH_TEST);
+	if (replay.active) {
+		auto now = std::chrono::steady_clock::now();
+		replay.frames.emplace_back();
+		auto &frame = replay.frames.back();
+		if (replay.frames.size() > 1) frame.ms = std::chrono::duration< float, std::milli >(now - replay.last_draw).count();
+		frame.stats = scene.draw_stats;
+		replay.last_draw = now;
+	}
+
+	if (!agents->agents.empty()) { //agent markers (upright line, with a tick showing facing):
 		DrawLines lines(player.camera->make_projection() * glm::mat4(player.camera->transform->make_world_to_local()));
-		for (auto const &tri : walkmesh->triangles) {
-			lines.draw(walkmesh->vertices[tri.x], walkmesh->vertices[tri.y], glm::u8vec4(0x88, 0x00, 0xff, 0xff));
-			lines.draw(walkmesh->vertices[tri.y], walkmesh->vertices[tri.z], glm::u8vec4(0x88, 0x00, 0xff, 0xff));
-			lines.draw(walkmesh->vertices[tri.z], walkmesh->vertices[tri.x], glm::u8vec4(0x88, 0x00, 0xff, 0xff));
+		for (auto const &agent : agents->agents) {
+			glm::mat4x3 frame = agent.transform->make_local_to_world();
+			glm::vec3 head = frame * glm::vec4(0.0f, 0.0f, 1.6f, 1.0f);
+			lines.draw(frame[3], head, glm::u8vec4(0xff, 0xcc, 0x44, 0xff));
+			lines.draw(head, frame * glm::vec4(0.0f, 0.4f, 1.6f, 1.0f), glm::u8vec4(0xff, 0xcc, 0x44, 0xff));
 		}
 	}
-	*/
+
+	if (show_walkmesh) {
+		glDisable(GL_DEPTH_TEST);
+		walkmesh_lines.draw(player.camera->make_projection() * glm::mat4(player.camera->transform->make_world_to_local()));
+	}
 
 	{ //use DrawLines to overlay some text:
+		PROFILE_GPU("hud");
 		glDisable(GL_DEPTH_TEST);
 		float aspect = float(drawable_size.x) / float(drawable_size.y);
 		DrawLines lines(glm::mat4(
@@ -325,6 +510,30 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 			glm::vec3(-aspect + 0.1f * H + ofs, -1.0 + + 0.1f * H + ofs, 0.0),
 			glm::vec3(H, 0.0f, 0.0f), glm::vec3(0.0f, H, 0.0f),
 			glm::u8vec4(0xff, 0xff, 0xff, 0x00));
+
+		#if PROFILER
+		if (Profiler::enabled) {
+			//audio callback timing, shown along with the profiler overlay:
+			Sound::MixStats stats = Sound::get_mix_stats();
+			char buf[160];
+			std::snprintf(buf, sizeof(buf), "audio mix %.2fms (worst %.2f of %.1f) voices %u mixed %u virtual %u overruns %u late %u underruns %u",
+				stats.mix_ms, stats.worst_mix_ms, stats.budget_ms,
+				stats.active_voices, stats.mixed_voices, stats.virtual_voices,
+				stats.overruns, stats.late_callbacks, stats.stream_underruns);
+			constexpr float S = 0.05f;
+			float y = -1.0f + 1.5f * H;
+			lines.draw_text(buf,
+				glm::vec3(-aspect + 0.1f * H, y, 0.0f),
+				glm::vec3(S, 0.0f, 0.0f), glm::vec3(0.0f, S, 0.0f),
+				glm::u8vec4(0x00, 0x00, 0x00, 0x00));
+			//turn the text red once the worst case gets within a quarter of the deadline:
+			glm::u8vec4 color = (stats.worst_mix_ms > 0.75f * stats.budget_ms ? glm::u8vec4(0xff, 0x44, 0x44, 0x00) : glm::u8vec4(0xaa, 0xff, 0xaa, 0x00));
+			lines.draw_text(buf,
+				glm::vec3(-aspect + 0.1f * H + ofs, y + ofs, 0.0f),
+				glm::vec3(S, 0.0f, 0.0f), glm::vec3(0.0f, S, 0.0f),
+				color);
+		}
+		#endif
 	}
 	GL_ERRORS();
 }
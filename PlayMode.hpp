@@ -2,9 +2,16 @@
 
 #include "Scene.hpp"
 #include "WalkMesh.hpp"
+#include "DebugLines.hpp"
+#include "CameraPath.hpp"
+#include "LightTiles.hpp"
+#include "LevelStream.hpp"
+#include "WalkAgents.hpp"
 
 #include <glm/glm.hpp>
 
+#include <chrono>
+#include <memory>
 #include <vector>
 #include <deque>
 
@@ -12,9 +19,20 @@ struct PlayMode : Mode {
 	PlayMode();
 	virtual ~PlayMode();
 
+	//camera path recording and replay (main.cpp calls these based on the command line):
+	// record_path saves the player's path, one sample per tick, to 'filename' when the mode is destroyed;
+	// replay_path ignores movement input and follows a recorded path instead, one sample per tick,
+	//  then writes per-frame times and draw counts to 'report_filename' and quits (Mode::set_current(nullptr))
+	void record_path(std::string const &filename);
+	void replay_path(std::string const &filename, std::string const &report_filename);
+
+	//add 'count' wandering agents (main.cpp calls this for '--agents N'):
+	void spawn_agents(uint32_t count);
+
 	//functions called by main loop:
 	virtual bool handle_event(SDL_Event const &, glm::uvec2 const &window_size) override;
-	virtual void update(float elapsed) override;
+	virtual void update_fixed(float tick) override;
+	virtual void update_frame(float elapsed, float alpha) override;
 	virtual void draw(glm::uvec2 const &drawable_size) override;
 
 	//----- game state -----
@@ -35,6 +53,10 @@ struct PlayMode : Mode {
 		Scene::Transform *transform = nullptr;
 		//camera is at player's head and will be pitched by mouse up/down motion:
 		Scene::Camera *camera = nullptr;
+		//world position after the previous and latest simulation ticks:
+		// (update_frame interpolates between these into transform->position; rotation follows the mouse directly, so isn't interpolated)
+		glm::vec3 previous_position = glm::vec3(0.0f);
+		glm::vec3 position = glm::vec3(0.0f);
 	} player;
 
 	//for sound wave generation
@@ -46,4 +68,51 @@ struct PlayMode : Mode {
 	float time_last_wave = 0.0f;
 	glm::vec3 last_wave_camera_pos = glm::vec3(999999.0f);
 	glm::vec3 last_frame_pos = glm::vec3(999999.0f);
+
+	//per-frame uniforms for the scene's lit_color_texture_program drawables:
+	// (copied from the above in draw(); scene.draw() applies them through Pipeline::uniforms)
+	struct FrameUniforms {
+		float time = 0.0f;
+		float time_last_wave = 0.0f;
+		glm::vec3 wave_camera_pos = glm::vec3(0.0f);
+		//light surfaces with the scene's lamps as well as the echo? (toggle with F8, or start with --scene-lights)
+		// (off by default: the level is meant to be dark except for the echo, and wood.scene's lamp would light all of it)
+		bool scene_lights = false;
+	} frame_uniforms;
+
+	//the scene's lights, sorted into screen tiles every frame for lit_color_texture_program (when frame_uniforms.scene_lights is set):
+	LightTiles light_tiles;
+
+	//loads the level's cells (meshes and drawables) around the player:
+	std::unique_ptr< LevelStream > level_stream;
+
+	//agents wandering the walkmesh (simulated in parallel in update_fixed; drawn as markers):
+	std::unique_ptr< WalkAgents > agents;
+
+	//walkmesh wireframe, for checking that the walkmesh lines up with the scene (toggle with F4):
+	// (built once in the constructor; stays on the GPU)
+	DebugLines walkmesh_lines;
+	bool show_walkmesh = false;
+
+	//camera path recording:
+	struct {
+		std::string filename; //non-empty if recording
+		CameraPath path;
+	} recording;
+
+	//camera path replay:
+	struct {
+		bool active = false;
+		bool finished = false; //ran out of samples
+		CameraPath path;
+		uint32_t next = 0; //next sample to apply
+		std::string report_filename;
+		struct Frame {
+			float ms = 0.0f; //time since the previous frame's draw
+			Scene::DrawStats stats;
+		};
+		std::vector< Frame > frames;
+		std::chrono::steady_clock::time_point last_draw;
+	} replay;
+	void write_replay_report() const; //throws on error
 };
@@ -0,0 +1,212 @@
+#include "Profiler.hpp"
+
+#if PROFILER
+
+#include "DrawLines.hpp"
+#include "AllocTracking.hpp"
+#include "gl_errors.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+namespace Profiler {
+
+bool enabled = false;
+
+namespace {
+	//all sections, in order of first use:
+	std::vector< std::unique_ptr< Section > > &sections() {
+		static std::vector< std::unique_ptr< Section > > list;
+		return list;
+	}
+	uint32_t frame = 0;
+	bool gpu_active = false; //GL_TIME_ELAPSED queries can't nest
+	Stats frame_stats; //time between end_frame() calls
+	std::chrono::high_resolution_clock::time_point frame_start;
+	bool frame_started = false;
+
+	//read back any finished queries for a section, oldest first, without waiting:
+	void poll(Section &s) {
+		for (uint32_t i = 0; i < Section::Queries; ++i) {
+			uint32_t q = (s.next_query + i) % Section::Queries;
+			if (!s.pending[q]) continue;
+			GLint available = GL_FALSE;
+			glGetQueryObjectiv(s.queries[q], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (available != GL_TRUE) break;
+			GLuint64 ns = 0;
+			glGetQueryObjectui64v(s.queries[q], GL_QUERY_RESULT, &ns);
+			s.gpu.push(float(double(ns) * 1e-6));
+			s.pending[q] = false;
+		}
+	}
+}
+
+void Stats::push(float ms) {
+	samples[next] = ms;
+	next = (next + 1) % History;
+	count = std::min(count + 1, History);
+}
+
+void Stats::summarize(float *min_, float *avg_, float *max_) const {
+	float min = 0.0f, sum = 0.0f, max = 0.0f;
+	for (uint32_t i = 0; i < count; ++i) {
+		float s = samples[i];
+		if (i == 0 || s < min) min = s;
+		if (i == 0 || s > max) max = s;
+		sum += s;
+	}
+	if (min_) *min_ = min;
+	if (avg_) *avg_ = (count ? sum / float(count) : 0.0f);
+	if (max_) *max_ = max;
+}
+
+Section::Section(std::string const &name_) : name(name_) {
+}
+
+Section &section(char const *name) {
+	for (auto const &s : sections()) {
+		if (s->name == name) return *s;
+	}
+	sections().emplace_back(std::make_unique< Section >(name));
+	return *sections().back();
+}
+
+CPUScope::CPUScope(Section &section_) : section(enabled ? &section_ : nullptr) {
+	if (section) start = std::chrono::high_resolution_clock::now();
+}
+
+CPUScope::~CPUScope() {
+	if (!section) return;
+	auto end = std::chrono::high_resolution_clock::now();
+	section->cpu_frame += std::chrono::duration< float, std::milli >(end - start).count();
+	section->cpu_used = true;
+}
+
+GPUScope::GPUScope(Section &section_) : section(&section_) {
+	if (!enabled || gpu_active || section->gpu_frame == frame) return;
+
+	uint32_t q = section->next_query;
+	if (section->pending[q]) {
+		poll(*section);
+		//oldest query still in flight? skip this frame rather than stall:
+		if (section->pending[q]) return;
+	}
+	if (section->queries[q] == 0) glGenQueries(1, &section->queries[q]);
+
+	glBeginQuery(GL_TIME_ELAPSED, section->queries[q]);
+	section->pending[q] = true;
+	section->next_query = (q + 1) % Section::Queries;
+	section->gpu_frame = frame;
+	section->gpu_used = true;
+	gpu_active = true;
+	active = true;
+}
+
+GPUScope::~GPUScope() {
+	if (!active) return;
+	glEndQuery(GL_TIME_ELAPSED);
+	gpu_active = false;
+}
+
+void end_frame() {
+	auto now = std::chrono::high_resolution_clock::now();
+	if (enabled && frame_started) {
+		frame_stats.push(std::chrono::duration< float, std::milli >(now - frame_start).count());
+	}
+	frame_start = now;
+	frame_started = enabled;
+
+	for (auto const &s : sections()) {
+		if (s->cpu_used) s->cpu.push(s->cpu_frame);
+		s->cpu_frame = 0.0f;
+		s->cpu_used = false;
+		if (enabled) poll(*s);
+	}
+	frame += 1;
+}
+
+void draw_overlay(glm::uvec2 const &drawable_size) {
+	if (!enabled) return;
+	ALLOC_SCOPE("Profiler");
+
+	glDisable(GL_DEPTH_TEST);
+	float aspect = float(drawable_size.x) / float(drawable_size.y);
+	DrawLines lines(glm::mat4(
+		1.0f / aspect, 0.0f, 0.0f, 0.0f,
+		0.0f, 1.0f, 0.0f, 0.0f,
+		0.0f, 0.0f, 1.0f, 0.0f,
+		0.0f, 0.0f, 0.0f, 1.0f
+	));
+
+	constexpr float H = 0.05f;
+	float ofs = 2.0f / drawable_size.y;
+	float left = -aspect + 0.5f * H;
+	float y = 1.0f - 1.5f * H;
+
+	//PathFont is proportional, so each column is drawn at its own anchor:
+	auto text = [&](std::string_view const &str, float x, glm::u8vec4 const &color) {
+		lines.draw_text(str,
+			glm::vec3(x, y, 0.0f),
+			glm::vec3(H, 0.0f, 0.0f), glm::vec3(0.0f, H, 0.0f),
+			glm::u8vec4(0x00, 0x00, 0x00, 0x00));
+		lines.draw_text(str,
+			glm::vec3(x + ofs, y + ofs, 0.0f),
+			glm::vec3(H, 0.0f, 0.0f), glm::vec3(0.0f, H, 0.0f),
+			color);
+	};
+	auto row = [&](std::string const &name, Stats const *cpu, Stats const *gpu) {
+		glm::u8vec4 color(0xff, 0xff, 0xff, 0x00);
+		text(name, left, color);
+		float x = left + 7.0f * H;
+		for (Stats const *stats : {cpu, gpu}) {
+			if (stats && stats->count) {
+				float v[3];
+				stats->summarize(&v[0], &v[1], &v[2]);
+				for (float ms : v) {
+					char buf[32];
+					std::snprintf(buf, sizeof(buf), "%.2f", ms);
+					text(buf, x, color);
+					x += 3.0f * H;
+				}
+			} else {
+				x += 9.0f * H;
+			}
+			x += 1.0f * H;
+		}
+		y -= 1.2f * H;
+	};
+
+	{ //header:
+		glm::u8vec4 color(0xff, 0xdd, 0x88, 0x00);
+		text("cpu ms", left + 7.0f * H, color);
+		text("gpu ms", left + 17.0f * H, color);
+		y -= 1.2f * H;
+		for (float x : {7.0f, 17.0f}) {
+			text("min", left + x * H, color);
+			text("avg", left + (x + 3.0f) * H, color);
+			text("max", left + (x + 6.0f) * H, color);
+		}
+		y -= 1.2f * H;
+	}
+	row("frame", &frame_stats, nullptr);
+	for (auto const &s : sections()) {
+		row(s->name, &s->cpu, s->gpu_used ? &s->gpu : nullptr);
+	}
+	GL_ERRORS();
+}
+
+void shutdown() {
+	for (auto const &s : sections()) {
+		for (uint32_t q = 0; q < Section::Queries; ++q) {
+			if (s->queries[q] != 0) glDeleteQueries(1, &s->queries[q]);
+			s->queries[q] = 0;
+			s->pending[q] = false;
+		}
+	}
+}
+
+} //namespace Profiler
+
+#endif //PROFILER
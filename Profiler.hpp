@@ -0,0 +1,125 @@
+#pragma once
+
+/*
+ * Profiler -- lightweight frame timing with an on-screen overlay.
+ *
+ * Usage:
+ *   { PROFILE_CPU("update"); mode->update(elapsed); }      //CPU time only
+ *   { PROFILE_GPU("scene"); scene.draw(camera); }          //CPU time + GL_TIME_ELAPSED
+ *   Profiler::end_frame();                                 //once per frame, after swap
+ *   Profiler::draw_overlay(drawable_size);                 //before swap
+ *
+ * GPU timings use a small ring of query objects per section and are only
+ *  read back once GL_QUERY_RESULT_AVAILABLE says so, so they never stall
+ *  the pipeline (results show up a frame or two late).
+ *
+ * GL_TIME_ELAPSED queries can't nest, so PROFILE_GPU scopes must not
+ *  overlap each other (PROFILE_CPU scopes can nest freely).
+ *
+ * Build with -DPROFILER=0 to compile all of this to nothing.
+ */
+
+#ifndef PROFILER
+#define PROFILER 1
+#endif
+
+#if PROFILER
+
+#include "GL.hpp"
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <chrono>
+#include <string>
+
+namespace Profiler {
+	//runtime toggle for timing + overlay (main.cpp binds this to F3):
+	extern bool enabled;
+	inline void toggle() { enabled = !enabled; }
+
+	//frames of history used for min/avg/max:
+	constexpr uint32_t History = 120;
+
+	struct Stats {
+		std::array< float, History > samples; //milliseconds, ring buffer
+		uint32_t next = 0;
+		uint32_t count = 0;
+		void push(float ms);
+		void summarize(float *min, float *avg, float *max) const;
+	};
+
+	struct Section {
+		Section(std::string const &name);
+		std::string name;
+
+		//CPU time, accumulated over the current frame:
+		float cpu_frame = 0.0f;
+		bool cpu_used = false;
+		Stats cpu;
+
+		//GPU time, via a ring of GL_TIME_ELAPSED queries:
+		// (only the first PROFILE_GPU use of a section in each frame is timed)
+		static constexpr uint32_t Queries = 3;
+		std::array< GLuint, Queries > queries{};
+		std::array< bool, Queries > pending{};
+		uint32_t next_query = 0;
+		uint32_t gpu_frame = -1U; //frame whose query was most recently started
+		bool gpu_used = false;
+		Stats gpu;
+	};
+
+	//sections are created once (via the macros) and live forever:
+	Section &section(char const *name);
+
+	struct CPUScope {
+		CPUScope(Section &section);
+		~CPUScope();
+		Section *section;
+		std::chrono::high_resolution_clock::time_point start;
+	};
+
+	struct GPUScope {
+		GPUScope(Section &section);
+		~GPUScope();
+		Section *section;
+		bool active = false;
+	};
+
+	//collect finished GPU queries and push this frame's CPU times into history:
+	void end_frame();
+
+	//draw timing table in the upper left (uses DrawLines; disables depth test):
+	void draw_overlay(glm::uvec2 const &drawable_size);
+
+	//free query objects (call before destroying the GL context):
+	void shutdown();
+}
+
+#define PROFILE_CONCAT2(a, b) a ## b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT2(a, b)
+
+#define PROFILE_CPU(NAME) \
+	static Profiler::Section &PROFILE_CONCAT(profile_section_, __LINE__) = Profiler::section(NAME); \
+	Profiler::CPUScope PROFILE_CONCAT(profile_cpu_, __LINE__)(PROFILE_CONCAT(profile_section_, __LINE__))
+
+#define PROFILE_GPU(NAME) \
+	static Profiler::Section &PROFILE_CONCAT(profile_section_, __LINE__) = Profiler::section(NAME); \
+	Profiler::CPUScope PROFILE_CONCAT(profile_cpu_, __LINE__)(PROFILE_CONCAT(profile_section_, __LINE__)); \
+	Profiler::GPUScope PROFILE_CONCAT(profile_gpu_, __LINE__)(PROFILE_CONCAT(profile_section_, __LINE__))
+
+#else //PROFILER
+
+#include <glm/glm.hpp>
+
+namespace Profiler {
+	inline void toggle() { }
+	inline void end_frame() { }
+	inline void draw_overlay(glm::uvec2 const &) { }
+	inline void shutdown() { }
+}
+
+#define PROFILE_CPU(NAME) do { } while (0)
+#define PROFILE_GPU(NAME) do { } while (0)
+
+#endif //PROFILER
@@ -0,0 +1,108 @@
+#include "SampleCache.hpp"
+
+#include <algorithm>
+#include <filesystem>
+
+Sound::SampleCache Sound::sample_cache;
+
+Sound::SampleCache::~SampleCache() {
+	std::lock_guard< std::mutex > lock(mutex);
+	for (auto &[k, entry] : entries) {
+		if (entry.decode->done.pending.load() > 0) Jobs::wait(&entry.decode->done);
+	}
+}
+
+std::string Sound::SampleCache::key(std::string const &filename, Sample::Storage storage) {
+	std::string canonical;
+	try {
+		canonical = std::filesystem::weakly_canonical(std::filesystem::path(filename)).string();
+	} catch (std::filesystem::filesystem_error &) {
+		canonical = filename;
+	}
+	return (storage == Sample::Streamed ? "stream:" : "resident:") + canonical;
+}
+
+Sound::SampleCache::Entry &Sound::SampleCache::lookup(std::string const &filename, Sample::Storage storage, Lifetime lifetime) {
+	std::string k = key(filename, storage);
+	auto f = entries.find(k);
+	if (f != entries.end()) {
+		if (lifetime == Permanent) f->second.lifetime = Permanent;
+		return f->second;
+	}
+
+	//miss: start a decode job:
+	Entry &entry = entries[k];
+	entry.decode = std::make_shared< Decode >();
+	entry.decode->task = std::packaged_task< std::shared_ptr< Sample const >() >([filename, storage]() {
+		return std::shared_ptr< Sample const >(std::make_shared< Sample >(filename, storage));
+	});
+	entry.sample = entry.decode->task.get_future().share();
+	entry.lifetime = lifetime;
+	//(with no job workers, this decodes right here, with 'mutex' held -- so other threads wait for it, as they would anyway)
+	Jobs::run(&entry.decode->done, [](void *data, size_t, size_t) {
+		static_cast< Decode * >(data)->task();
+	}, entry.decode.get());
+
+	return entry;
+}
+
+std::shared_ptr< Sound::Sample const > Sound::SampleCache::get(std::string const &filename, Sample::Storage storage, Lifetime lifetime) {
+	std::shared_future< std::shared_ptr< Sample const > > sample;
+	std::shared_ptr< Decode > decode;
+	{
+		std::lock_guard< std::mutex > lock(mutex);
+		Entry &entry = lookup(filename, storage, lifetime);
+		sample = entry.sample;
+		decode = entry.decode;
+	}
+
+	//run jobs until the decode is done (rather than blocking on the future, which could deadlock a job worker):
+	Jobs::wait(&decode->done);
+
+	try {
+		return sample.get();
+	} catch (...) {
+		//don't keep failed loads around (so a fixed file can be retried):
+		std::lock_guard< std::mutex > lock(mutex);
+		auto f = entries.find(key(filename, storage));
+		if (f != entries.end() && f->second.decode->done.pending.load() == 0) {
+			try {
+				f->second.sample.get();
+			} catch (...) {
+				entries.erase(f);
+			}
+		}
+		throw;
+	}
+}
+
+void Sound::SampleCache::prefetch(std::vector< std::string > const &filenames, Lifetime lifetime, Sample::Storage storage) {
+	std::lock_guard< std::mutex > lock(mutex);
+	for (auto const &filename : filenames) {
+		lookup(filename, storage, lifetime);
+	}
+}
+
+size_t Sound::SampleCache::evict_unused() {
+	std::lock_guard< std::mutex > lock(mutex);
+	size_t evicted = 0;
+	for (auto e = entries.begin(); e != entries.end(); /* later */) {
+		Entry &entry = e->second;
+		bool evict = false;
+		if (entry.lifetime == Evictable && entry.decode->done.pending.load() == 0) {
+			try {
+				//only the cache's own reference left?
+				evict = (entry.sample.get().use_count() == 1);
+			} catch (...) {
+				evict = true; //(failed loads can go too)
+			}
+		}
+		if (evict) {
+			e = entries.erase(e);
+			evicted += 1;
+		} else {
+			++e;
+		}
+	}
+	return evicted;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+/*
+ * Sound::SampleCache shares decoded Sound::Samples between everyone that
+ *  asks for the same file, and decodes cache misses in parallel as jobs
+ *  (see Jobs.hpp).
+ *
+ * //at global scope (prepare runs on a loader thread, so several samples decode at once):
+ * Load< Sound::Sample > footstep(LoadTagDefault, []() {
+ *     return Sound::sample_cache.get(data_path("footsteps/footstep1.wav"));
+ * }, [](std::shared_ptr< Sound::Sample const > const &sample) -> Sound::Sample const * {
+ *     return sample.get();
+ * });
+ *
+ * //when entering a level, start decoding its audio without waiting:
+ * Sound::sample_cache.prefetch({ data_path("level2/wind.opus"), ... }, Sound::SampleCache::Evictable);
+ *
+ * //...and after leaving it:
+ * Sound::sample_cache.evict_unused();
+ *
+ * Entries are keyed by canonical path (so "a/../b.wav" and "b.wav" share a
+ *  sample) and by storage mode. All member functions may be called from any thread,
+ *  including from inside jobs (get() runs other jobs while it waits for a decode).
+ */
+
+#include "Sound.hpp"
+#include "Jobs.hpp"
+
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Sound {
+
+struct SampleCache {
+	//how long cached samples are kept:
+	enum Lifetime {
+		Permanent, //until the cache is destroyed (safe to keep raw pointers, e.g., in Load<>)
+		Evictable, //until evict_unused() is called while nobody else holds the sample
+	};
+
+	SampleCache() = default;
+	~SampleCache(); //(waits for in-flight decodes)
+
+	SampleCache(SampleCache const &) = delete;
+	SampleCache &operator=(SampleCache const &) = delete;
+
+	//get a sample, decoding it (as a job) if it isn't already cached; waits until it is ready:
+	// throws (and doesn't cache) if the file fails to load
+	// (asking for a Permanent sample that is cached as Evictable makes it Permanent)
+	std::shared_ptr< Sample const > get(std::string const &filename, Sample::Storage storage = Sample::Resident, Lifetime lifetime = Permanent);
+
+	//start decoding samples that aren't cached yet, without waiting for them:
+	// (errors show up when the sample is later get()'d)
+	void prefetch(std::vector< std::string > const &filenames, Lifetime lifetime = Evictable, Sample::Storage storage = Sample::Resident);
+
+	//drop Evictable samples that are finished decoding and not referenced outside the cache:
+	// returns the number of samples dropped
+	size_t evict_unused();
+
+	//internals:
+	struct Decode {
+		std::packaged_task< std::shared_ptr< Sample const >() > task; //(captures any exception in the future)
+		Jobs::Counter done; //the decode job; kept alive (by an Entry or a waiter) until this reaches zero
+	};
+	struct Entry {
+		std::shared_future< std::shared_ptr< Sample const > > sample;
+		std::shared_ptr< Decode > decode;
+		Lifetime lifetime = Permanent;
+	};
+
+	std::mutex mutex; //guards everything below
+	std::unordered_map< std::string, Entry > entries;
+
+	//cache key for a filename + storage mode:
+	static std::string key(std::string const &filename, Sample::Storage storage);
+	//find or start decoding an entry (call with 'mutex' held):
+	Entry &lookup(std::string const &filename, Sample::Storage storage, Lifetime lifetime);
+};
+
+//the cache used by the game's Load<>'s:
+extern SampleCache sample_cache;
+
+} //namespace Sound
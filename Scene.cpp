@@ -1,11 +1,20 @@
 #include "Scene.hpp"
+#include "Mesh.hpp"
 
 #include "gl_errors.hpp"
+#include "gl_compile_program.hpp"
 #include "read_write_chunk.hpp"
+#include "MappedFile.hpp"
+#include "Level.hpp"
+#include "Profiler.hpp"
+#include "AllocTracking.hpp"
+#include "parallel_for.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 
-#include <fstream>
+#include <istream>
+#include <streambuf>
+#include <algorithm>
 
 //-------------------------
 
@@ -73,6 +82,49 @@ glm::mat4x3 Scene::Transform::make_world_to_local() const {
 
 //-------------------------
 
+//update a transform's cached matrices after its parent's (recursion depth is the hierarchy depth):
+static void update_transform(Scene::Transform &t, uint32_t stamp) {
+	if (t.cache.updated_stamp == stamp) return;
+	t.cache.updated_stamp = stamp;
+
+	if (t.parent) update_transform(*t.parent, stamp);
+
+	bool changed = t.cache.changed_stamp == 0 //never computed
+		|| t.cache.parent != t.parent
+		|| (t.parent && t.parent->cache.changed_stamp == stamp)
+		|| t.cache.position != t.position
+		|| t.cache.rotation != t.rotation
+		|| t.cache.scale != t.scale;
+	if (!changed) return;
+
+	t.cache.position = t.position;
+	t.cache.rotation = t.rotation;
+	t.cache.scale = t.scale;
+	t.cache.parent = t.parent;
+	t.cache.changed_stamp = stamp;
+
+	if (!t.parent) {
+		t.cache.local_to_world = t.make_local_to_parent();
+		t.cache.world_to_local = t.make_parent_to_local();
+	} else {
+		t.cache.local_to_world = t.parent->cache.local_to_world * glm::mat4(t.make_local_to_parent());
+		t.cache.world_to_local = t.make_parent_to_local() * glm::mat4(t.parent->cache.world_to_local);
+	}
+	//normals transform by the inverse transpose (which is just the transpose of world_to_local's 3x3 part):
+	t.cache.normal_to_world = glm::transpose(glm::mat3(t.cache.world_to_local));
+}
+
+void Scene::update_transforms() {
+	transforms_stamp += 1;
+	if (transforms_stamp == 0) transforms_stamp = 1; //(0 is reserved for 'never updated')
+
+	for (auto &t : transforms) {
+		update_transform(t, transforms_stamp);
+	}
+}
+
+//-------------------------
+
 glm::mat4 Scene::Camera::make_projection() const {
 	return glm::infinitePerspective( fovy, aspect, near );
 }
@@ -82,83 +134,607 @@ glm::mat4 Scene::Camera::make_projection() const {
 
 void Scene::draw(Camera const &camera) const {
 	assert(camera.transform);
-	glm::mat4 world_to_clip = camera.make_projection() * glm::mat4(camera.transform->make_world_to_local());
+	glm::mat4 world_to_clip = camera.make_projection() * glm::mat4(
+		has_cached_world(*camera.transform) ? camera.transform->cached_world_to_local() : camera.transform->make_world_to_local()
+	);
 	glm::mat4x3 world_to_light = glm::mat4x3(1.0f);
 	draw(world_to_clip, world_to_light);
 }
 
-void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light) const {
+//can two drawables be drawn with one instanced draw call?
+static bool can_instance_together(Scene::DrawItem const &a_, Scene::DrawItem const &b_) {
+	Scene::Drawable::Pipeline const &a = a_.drawable->pipeline;
+	Scene::Drawable::Pipeline const &b = b_.drawable->pipeline;
+	if (a.instanced.program == 0 || a.set_uniforms || b.set_uniforms) return false;
+	if (a.program != b.program || a.vao != b.vao) return false;
+	if (a.uniforms != b.uniforms) return false;
+	if (a.type != b.type || a_.start != b_.start || a_.count != b_.count) return false;
+	if (a_.index_type != b_.index_type || a_.base_vertex != b_.base_vertex) return false;
+	if (a.instanced.program != b.instanced.program || a.instanced.INSTANCE_BASE_int != b.instanced.INSTANCE_BASE_int) return false;
+	for (uint32_t i = 0; i < Scene::Drawable::Pipeline::TextureCount; ++i) {
+		if (a.textures[i].texture != b.textures[i].texture || a.textures[i].target != b.textures[i].target) return false;
+	}
+	return true;
+}
 
-	//Iterate through all drawables, sending each one to OpenGL:
-	for (auto const &drawable : drawables) {
-		//Reference to drawable's pipeline for convenience:
-		Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
+//texture buffer holding per-instance data for instanced draws (created on first use):
+struct InstanceBuffer {
+	GLuint buffer = 0;
+	GLuint texture = 0;
+	size_t max_texels = 0;
+	size_t capacity = 0; //bytes allocated for buffer
+};
+static InstanceBuffer &get_instance_buffer() {
+	static InstanceBuffer ib;
+	if (ib.buffer == 0) {
+		glGenBuffers(1, &ib.buffer);
+		glGenTextures(1, &ib.texture);
+		glBindTexture(GL_TEXTURE_BUFFER, ib.texture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, ib.buffer);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+		GLint max_texels = 0;
+		glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &max_texels);
+		ib.max_texels = size_t(std::max(0, max_texels));
+		GL_ERRORS();
+	}
+	return ib;
+}
 
-		//skip any drawables without a shader program set:
-		if (pipeline.program == 0) continue;
-		//skip any drawables that don't reference any vertex array:
-		if (pipeline.vao == 0) continue;
-		//skip any drawables that don't contain any vertices:
-		if (pipeline.count == 0) continue;
+//triangles drawn by 'count' vertices of primitive 'type':
+static uint32_t triangle_count(GLenum type, GLuint count) {
+	if (type == GL_TRIANGLES) return count / 3;
+	if (type == GL_TRIANGLE_STRIP || type == GL_TRIANGLE_FAN) return (count >= 3 ? count - 2 : 0);
+	return 0;
+}
 
+//conservative box-vs-frustum test: returns false only if all corners of the box are outside one clip plane:
+static bool box_in_frustum(glm::mat4 const &object_to_clip, glm::vec3 const &min, glm::vec3 const &max) {
+	//clip-space corners, built incrementally from one corner and the box's edge vectors:
+	glm::vec4 base = object_to_clip * glm::vec4(min, 1.0f);
+	glm::vec4 dx = object_to_clip[0] * (max.x - min.x);
+	glm::vec4 dy = object_to_clip[1] * (max.y - min.y);
+	glm::vec4 dz = object_to_clip[2] * (max.z - min.z);
+
+	//bit i of 'outside' is set if every corner is outside plane i (-x, +x, -y, +y, -z, +z):
+	uint32_t outside = 0x3f;
+	for (uint32_t c = 0; c < 8; ++c) {
+		glm::vec4 p = base;
+		if (c & 1) p += dx;
+		if (c & 2) p += dy;
+		if (c & 4) p += dz;
+		uint32_t bits = 0;
+		if (p.x < -p.w) bits |= 0x01;
+		if (p.x >  p.w) bits |= 0x02;
+		if (p.y < -p.w) bits |= 0x04;
+		if (p.y >  p.w) bits |= 0x08;
+		if (p.z < -p.w) bits |= 0x10;
+		if (p.z >  p.w) bits |= 0x20;
+		outside &= bits;
+		if (outside == 0) return true;
+	}
+	return false;
+}
 
-		//Set shader program:
-		glUseProgram(pipeline.program);
+//does any corner of the box lie in front of the near plane? (if so, its faces can't stand in for it in a depth test)
+static bool box_crosses_near(glm::mat4 const &object_to_clip, glm::vec3 const &min, glm::vec3 const &max) {
+	for (uint32_t c = 0; c < 8; ++c) {
+		glm::vec3 corner((c & 1) ? max.x : min.x, (c & 2) ? max.y : min.y, (c & 4) ? max.z : min.z);
+		glm::vec4 p = object_to_clip * glm::vec4(corner, 1.0f);
+		if (p.z < -p.w) return true;
+	}
+	return false;
+}
 
-		//Set attribute sources:
-		glBindVertexArray(pipeline.vao);
+//boxes for occlusion culling (created on first use):
+struct OcclusionBoxes {
+	GLuint program = 0;
+	GLuint OBJECT_TO_CLIP_mat4 = -1U;
+	GLuint buffer = 0;
+	GLuint vao = 0; //unit cube [0,1]^3 as a 14-vertex triangle strip (counter-clockwise seen from outside)
+};
+static OcclusionBoxes &get_occlusion_boxes() {
+	static OcclusionBoxes ob;
+	if (ob.program == 0) {
+		ob.program = gl_compile_program(
+			//vertex shader:
+			"#version 330\n"
+			"uniform mat4 OBJECT_TO_CLIP;\n"
+			"in vec4 Position;\n"
+			"void main() {\n"
+			"	gl_Position = OBJECT_TO_CLIP * Position;\n"
+			"}\n"
+		,
+			//fragment shader:
+			"#version 330\n"
+			"out vec4 fragColor;\n"
+			"void main() {\n"
+			"	fragColor = vec4(1.0);\n"
+			"}\n"
+		);
+		ob.OBJECT_TO_CLIP_mat4 = glGetUniformLocation(ob.program, "OBJECT_TO_CLIP");
+
+		static glm::vec3 const strip[14] = {
+			{1,1,1}, {0,1,1}, {1,0,1}, {0,0,1}, {0,0,0}, {0,1,1}, {0,1,0},
+			{1,1,1}, {1,1,0}, {1,0,1}, {1,0,0}, {0,0,0}, {1,1,0}, {0,1,0},
+		};
+		glGenBuffers(1, &ob.buffer);
+		glBindBuffer(GL_ARRAY_BUFFER, ob.buffer);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(strip), strip, GL_STATIC_DRAW);
+
+		glGenVertexArrays(1, &ob.vao);
+		glBindVertexArray(ob.vao);
+		GLint Position_vec4 = glGetAttribLocation(ob.program, "Position");
+		glVertexAttribPointer(Position_vec4, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (GLbyte *)0);
+		glEnableVertexAttribArray(Position_vec4);
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		GL_ERRORS();
+	}
+	return ob;
+}
 
-		//Configure program uniforms:
+//draw the box of each item in [begin,end) that has an occlusion state in its own occlusion query (without writing color or depth),
+// into the state's query for draw 'frame'; new query names come from 'free_queries' when possible; returns the number of queries issued:
+// (leaves ob.program and ob.vao bound, and color and depth writes enabled; face culling is left alone, since boxes
+//  are wound like meshes and drawables whose boxes the camera could be inside are never queried)
+static uint32_t issue_occlusion_queries(OcclusionBoxes &ob, Scene::DrawItem const *begin, Scene::DrawItem const *end, uint32_t frame, std::vector< GLuint > *free_queries) {
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glDepthMask(GL_FALSE);
+
+	glUseProgram(ob.program);
+	glBindVertexArray(ob.vao);
+
+	uint32_t issued = 0;
+	for (Scene::DrawItem const *item = begin; item != end; ++item) {
+		if (!item->occlusion) continue;
+		Scene::OcclusionState &state = *item->occlusion;
+		GLuint &query = state.queries[frame % 2];
+		if (query == 0) {
+			if (!free_queries->empty()) {
+				query = free_queries->back();
+				free_queries->pop_back();
+			} else {
+				glGenQueries(1, &query);
+			}
+		}
 
-		//the object-to-world matrix is used in all three of these uniforms:
-		assert(drawable.transform); //drawables *must* have a transform
-		glm::mat4x3 object_to_world = drawable.transform->make_local_to_world();
+		glm::vec3 const &min = item->drawable->min;
+		glm::vec3 size = item->drawable->max - min;
+		glm::mat4 box_to_clip = item->object_to_clip * glm::mat4(
+			glm::vec4(size.x, 0.0f, 0.0f, 0.0f),
+			glm::vec4(0.0f, size.y, 0.0f, 0.0f),
+			glm::vec4(0.0f, 0.0f, size.z, 0.0f),
+			glm::vec4(min, 1.0f)
+		);
+		glBeginQuery(GL_ANY_SAMPLES_PASSED, query);
+		glUniformMatrix4fv(ob.OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(box_to_clip));
+		glDrawArrays(GL_TRIANGLE_STRIP, 0, 14);
+		glEndQuery(GL_ANY_SAMPLES_PASSED);
+
+		state.queried = frame;
+		++issued;
+	}
+
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	glDepthMask(GL_TRUE);
+
+	return issued;
+}
 
-		//OBJECT_TO_CLIP takes vertices from object space to clip space:
-		if (pipeline.OBJECT_TO_CLIP_mat4 != -1U) {
+void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light) const {
+	PROFILE_GPU("scene");
+	ALLOC_SCOPE("Scene::draw");
+
+	draw_stats = DrawStats();
+
+	//projected size of a world-space sphere is radius * lod_size_factor / (clip w):
+	// (for world_to_clip = projection * rigid view, the length of the clip-y row is the projection's y scale)
+	float lod_size_factor = lod_scale * glm::length(glm::vec3(world_to_clip[0][1], world_to_clip[1][1], world_to_clip[2][1]));
+
+	//Gather drawables with something to draw, building their draw items on worker threads (see parallel_for.hpp):
+	// each range of drawables writes its items to the start of the same range of draw_order,
+	// then the ranges are packed together (so the order is the same as a serial loop's)
+	size_t grain = std::max< size_t >(draw_grain, 1);
+	draw_order.resize(drawables.size());
+	draw_ranges.assign((drawables.size() + grain - 1) / grain, DrawRange());
+	parallel_for(drawables.size(), grain, [&](size_t begin, size_t end) {
+		DrawRange &range = draw_ranges[begin / grain];
+		for (size_t d = begin; d < end; ++d) {
+			Drawable const &drawable = drawables[d];
+			Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
+
+			//skip any drawables without a shader program set:
+			if (pipeline.program == 0) continue;
+			//skip any drawables that don't reference any vertex array:
+			if (pipeline.vao == 0) continue;
+			//skip any drawables that don't contain any vertices:
+			if (pipeline.count == 0) continue;
+
+			//the object-to-world matrix is used for culling and in all three transform uniforms:
+			assert(drawable.transform); //drawables *must* have a transform
+			glm::mat4x3 object_to_world = has_cached_world(*drawable.transform) ? drawable.transform->cached_local_to_world() : drawable.transform->make_local_to_world();
 			glm::mat4 object_to_clip = world_to_clip * glm::mat4(object_to_world);
-			glUniformMatrix4fv(pipeline.OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(object_to_clip));
+
+			//skip any drawables whose bounds are entirely outside the view frustum:
+			if (drawable.min.x <= drawable.max.x) {
+				++range.cull_tests;
+				if (!box_in_frustum(object_to_clip, drawable.min, drawable.max)) {
+					++range.culled;
+					continue;
+				}
+			}
+
+			DrawItem &item = draw_order[begin + range.kept];
+			item = DrawItem{&drawable, object_to_world, object_to_clip, pipeline.start, pipeline.count, pipeline.index_type, pipeline.base_vertex};
+
+			//pick a level of detail from the projected size of the bounds:
+			if (drawable.lod_mesh && !drawable.lod_mesh->lods.empty() && drawable.min.x <= drawable.max.x) {
+				glm::vec3 center = object_to_world * glm::vec4(0.5f * (drawable.min + drawable.max), 1.0f);
+				glm::vec3 half = 0.5f * (drawable.max - drawable.min);
+				//(bound the world-space radius using the longest axis of the transform)
+				float scale = std::max(glm::length(object_to_world[0]), std::max(glm::length(object_to_world[1]), glm::length(object_to_world[2])));
+				float radius = glm::length(half) * scale;
+				float w = glm::dot(glm::vec4(center, 1.0f), glm::vec4(world_to_clip[0][3], world_to_clip[1][3], world_to_clip[2][3], world_to_clip[3][3]));
+				if (w > radius) {
+					float size = radius * lod_size_factor / w; //== diameter as a fraction of viewport height
+					Mesh::LOD const *use = nullptr;
+					for (Mesh::LOD const &lod : drawable.lod_mesh->lods) {
+						if (size < lod.max_screen_size) use = &lod;
+						else break;
+					}
+					if (use) {
+						item.start = use->start;
+						item.count = use->count;
+						item.index_type = use->index_type;
+						item.base_vertex = use->base_vertex;
+						++range.lod_reduced;
+					}
+				}
+			}
+
+			range.kept += 1;
+		}
+	});
+	{ //pack ranges:
+		size_t kept = 0;
+		for (size_t r = 0; r < draw_ranges.size(); ++r) {
+			DrawRange const &range = draw_ranges[r];
+			if (r * grain != kept) {
+				std::move(draw_order.begin() + r * grain, draw_order.begin() + r * grain + range.kept, draw_order.begin() + kept);
+			}
+			kept += range.kept;
+			draw_stats.cull_tests += range.cull_tests;
+			draw_stats.culled += range.culled;
+			draw_stats.lod_reduced += range.lod_reduced;
 		}
+		draw_order.resize(kept);
+	}
 
-		//the object-to-light matrix is used in the next two uniforms:
-		glm::mat4x3 object_to_light = world_to_light * glm::mat4(object_to_world);
+	//sort by state (if requested):
+	if (sort_drawables) {
+		std::stable_sort(draw_order.begin(), draw_order.end(), [](DrawItem const &a_, DrawItem const &b_) {
+			Scene::Drawable::Pipeline const &a = a_.drawable->pipeline;
+			Scene::Drawable::Pipeline const &b = b_.drawable->pipeline;
+			if (a.program != b.program) return a.program < b.program;
+			if (a.vao != b.vao) return a.vao < b.vao;
+			for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
+				if (a.textures[i].texture != b.textures[i].texture) return a.textures[i].texture < b.textures[i].texture;
+			}
+			if (a.uniforms.params != b.uniforms.params) return std::less< void const * >()(a.uniforms.params, b.uniforms.params);
+			if (a.uniforms.set != b.uniforms.set) return std::less< void (*)(void const *, void const *) >()(a.uniforms.set, b.uniforms.set);
+			//(mesh last, so that copies of the same mesh [at the same level of detail] end up adjacent for instancing)
+			if (a.type != b.type) return a.type < b.type;
+			if (a_.index_type != b_.index_type) return a_.index_type < b_.index_type;
+			if (a_.base_vertex != b_.base_vertex) return a_.base_vertex < b_.base_vertex;
+			if (a_.start != b_.start) return a_.start < b_.start;
+			return a_.count < b_.count;
+		});
+	}
+
+	//with occlusion culling, occluders (and drawables that can't be tested) go first, to fill in depth for the tests:
+	// (stable, so each part stays sorted by state)
+	uint32_t first_tested = uint32_t(draw_order.size());
+	if (occlusion_culling) {
+		auto untested = std::stable_partition(draw_order.begin(), draw_order.end(), [](DrawItem const &item) {
+			return item.drawable->occluder || !(item.drawable->min.x <= item.drawable->max.x);
+		});
+		first_tested = uint32_t(untested - draw_order.begin());
+	}
+
+	//with occlusion culling, read back each tested drawable's query from the previous draw(), then move the ones
+	// it found hidden to the end of draw_order, past 'first_hidden' (their boxes are still queried, but they aren't drawn):
+	// (the previous draw()'s queries have had a whole frame to finish, so this rarely finds a result not yet in)
+	uint32_t first_hidden = uint32_t(draw_order.size());
+	if (occlusion_culling) {
+		occlusion_frame += 1;
+		for (uint32_t i = first_tested; i < draw_order.size(); ++i) {
+			DrawItem &item = draw_order[i];
+			OcclusionState &state = occlusion_states[item.drawable];
+			state.tested = occlusion_frame;
+			state.hidden = false;
+			if (state.queried != 0 && state.queried + 1 == occlusion_frame) {
+				GLuint query = state.queries[(occlusion_frame - 1) % 2];
+				GLuint available = GL_FALSE;
+				glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+				if (available) {
+					GLuint passed = GL_TRUE;
+					glGetQueryObjectuiv(query, GL_QUERY_RESULT, &passed);
+					state.hidden = !passed;
+				}
+			}
+			//(a box crossing the near plane can't be tested, so the drawable is drawn):
+			if (box_crosses_near(item.object_to_clip, item.drawable->min, item.drawable->max)) {
+				state.hidden = false;
+				item.occlusion = nullptr;
+			} else {
+				item.occlusion = &state;
+			}
+		}
+		auto hidden = std::stable_partition(draw_order.begin() + first_tested, draw_order.end(), [](DrawItem const &item) {
+			return !(item.occlusion && item.occlusion->hidden);
+		});
+		first_hidden = uint32_t(hidden - draw_order.begin());
+		draw_stats.occluded = uint32_t(draw_order.size()) - first_hidden;
+	}
 
-		//OBJECT_TO_CLIP takes vertices from object space to light space:
-		if (pipeline.OBJECT_TO_LIGHT_mat4x3 != -1U) {
-			glUniformMatrix4x3fv(pipeline.OBJECT_TO_LIGHT_mat4x3, 1, GL_FALSE, glm::value_ptr(object_to_light));
+	//drop states of drawables that weren't tested (culled, removed, no longer tested, or culling is off), recycling their queries:
+	// (so results are only ever used by the very next draw())
+	for (auto s = occlusion_states.begin(); s != occlusion_states.end(); ) {
+		if (occlusion_culling && s->second.tested == occlusion_frame) {
+			++s;
+			continue;
+		}
+		for (GLuint query : s->second.queries) {
+			if (query != 0) free_occlusion_queries.emplace_back(query);
 		}
+		s = occlusion_states.erase(s);
+	}
 
-		//NORMAL_TO_CLIP takes normals from object space to light space:
-		if (pipeline.NORMAL_TO_LIGHT_mat3 != -1U) {
-			glm::mat3 normal_to_light = glm::inverse(glm::transpose(glm::mat3(object_to_light)));
-			glUniformMatrix3fv(pipeline.NORMAL_TO_LIGHT_mat3, 1, GL_FALSE, glm::value_ptr(normal_to_light));
+	//light-space matrices, also built on worker threads (so submission below only reads draw_order):
+	// object-to-world normal matrices are cached per transform (so static drawables never
+	// recompute them); only the world-to-light part is computed here, once:
+	bool identity_light = (world_to_light == glm::mat4x3(1.0f));
+	glm::mat3 world_to_light_normal = identity_light ? glm::mat3(1.0f) : glm::inverse(glm::transpose(glm::mat3(world_to_light)));
+	parallel_for(first_hidden, grain, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			DrawItem &item = draw_order[i];
+			item.object_to_light = world_to_light * glm::mat4(item.object_to_world);
+			Transform const &transform = *item.drawable->transform;
+			glm::mat3 normal_to_world = has_cached_world(transform) ? transform.cached_normal_to_world() : glm::inverse(glm::transpose(glm::mat3(item.object_to_world)));
+			item.normal_to_light = identity_light ? normal_to_world : world_to_light_normal * normal_to_world;
+		}
+	});
+
+	//group runs of identical pipelines into instanced batches (hidden drawables aren't drawn, so aren't batched):
+	draw_batches.clear();
+	uint32_t instances = 0;
+	for (uint32_t i = 0; i < first_hidden; ) {
+		//(batches don't straddle the start of the tested drawables)
+		uint32_t end = (i < first_tested ? first_tested : first_hidden);
+		uint32_t j = i + 1;
+		while (j < end && can_instance_together(draw_order[i], draw_order[j])) ++j;
+
+		//drawables with an instanced program variant always read their matrices from the instance buffer
+		// (even when alone in their batch), so that no per-drawable matrix uniforms are needed:
+		uint32_t count = 0;
+		Drawable::Pipeline const &pipeline = draw_order[i].drawable->pipeline;
+		if (pipeline.instanced.program != 0 && !pipeline.set_uniforms) {
+			//limit total instances to what fits in the instance buffer:
+			size_t max_instances = get_instance_buffer().max_texels / Drawable::Pipeline::InstanceTexels;
+			count = uint32_t(std::min< size_t >(j - i, max_instances - instances));
 		}
 
-		//set any requested custom uniforms:
-		if (pipeline.set_uniforms) pipeline.set_uniforms();
+		if (count >= 1) {
+			draw_batches.emplace_back(DrawBatch{i, count, instances});
+			instances += count;
+		} else {
+			count = 1;
+			draw_batches.emplace_back(DrawBatch{i, count, -1U});
+		}
+		i += count;
+	}
 
-		//set up textures:
-		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
-			if (pipeline.textures[i].texture != 0) {
-				glActiveTexture(GL_TEXTURE0 + i);
-				glBindTexture(pipeline.textures[i].target, pipeline.textures[i].texture);
+	//fill in per-instance data for instanced batches (in parallel, by batch):
+	instance_data.resize(size_t(instances) * Drawable::Pipeline::InstanceTexels);
+	parallel_for(draw_batches.size(), std::max< size_t >(grain / 4, 1), [&](size_t begin, size_t end) {
+		for (size_t b = begin; b < end; ++b) {
+			DrawBatch const &batch = draw_batches[b];
+			if (batch.instance_base == -1U) continue;
+			glm::vec4 *texel = instance_data.data() + size_t(batch.instance_base) * Drawable::Pipeline::InstanceTexels;
+			for (uint32_t k = batch.first; k < batch.first + batch.count; ++k) {
+				DrawItem const &item = draw_order[k];
+				glm::mat3x4 light_rows = glm::transpose(item.object_to_light);
+				*(texel++) = item.object_to_clip[0];
+				*(texel++) = item.object_to_clip[1];
+				*(texel++) = item.object_to_clip[2];
+				*(texel++) = item.object_to_clip[3];
+				*(texel++) = light_rows[0];
+				*(texel++) = light_rows[1];
+				*(texel++) = light_rows[2];
+				*(texel++) = glm::vec4(item.normal_to_light[0], 0.0f);
+				*(texel++) = glm::vec4(item.normal_to_light[1], 0.0f);
+				*(texel++) = glm::vec4(item.normal_to_light[2], 0.0f);
 			}
 		}
+	});
+
+	//upload all instance data for this draw at once:
+	if (!instance_data.empty()) {
+		InstanceBuffer &ib = get_instance_buffer();
+		size_t bytes = instance_data.size() * sizeof(glm::vec4);
+		glBindBuffer(GL_TEXTURE_BUFFER, ib.buffer);
+		if (bytes > ib.capacity) {
+			//grow (with some slack, so a slowly-growing scene doesn't reallocate every frame):
+			ib.capacity = std::max(bytes, ib.capacity + ib.capacity / 2);
+			glBufferData(GL_TEXTURE_BUFFER, ib.capacity, nullptr, GL_STREAM_DRAW);
+		}
+		glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, instance_data.data());
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+		glActiveTexture(GL_TEXTURE0 + Drawable::Pipeline::InstanceTextureUnit);
+		glBindTexture(GL_TEXTURE_BUFFER, ib.texture);
+		glActiveTexture(GL_TEXTURE0);
+	}
+
+	//batches from here on are tested drawables (drawn after their boxes are queried):
+	uint32_t first_tested_batch = uint32_t(draw_batches.size());
+	for (uint32_t b = 0; b < draw_batches.size(); ++b) {
+		if (draw_batches[b].first >= first_tested) {
+			first_tested_batch = b;
+			break;
+		}
+	}
+
+	//currently bound state:
+	GLuint bound_program = 0;
+	Drawable::Pipeline::Uniforms applied_uniforms; //last statically-typed uniforms set (in bound_program)
+	GLuint bound_vao = 0;
+	Drawable::Pipeline::TextureInfo bound_textures[Drawable::Pipeline::TextureCount];
+	uint32_t active_texture = 0;
+
+	//query the boxes of all tested drawables (visible or not), for the next draw() to use:
+	bool boxes_queried = false;
+	auto query_boxes = [&]() {
+		boxes_queried = true;
+		if (!occlusion_culling || first_tested == draw_order.size()) return;
+		OcclusionBoxes &ob = get_occlusion_boxes();
+		draw_stats.occlusion_queries = issue_occlusion_queries(ob, draw_order.data() + first_tested, draw_order.data() + draw_order.size(), occlusion_frame, &free_occlusion_queries);
+		bound_program = ob.program;
+		bound_vao = ob.vao;
+		++draw_stats.program_changes;
+		++draw_stats.vao_changes;
+	};
+
+	//Iterate through all batches, sending each one to OpenGL:
+	for (uint32_t b = 0; b < draw_batches.size(); ++b) {
+		//once the occluders are drawn, query the rest:
+		if (b == first_tested_batch) query_boxes();
+
+		DrawBatch const &batch = draw_batches[b];
+		DrawItem const &item = draw_order[batch.first];
+		Drawable const &drawable = *item.drawable;
+		//Reference to drawable's pipeline for convenience:
+		Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
+		bool instanced = (batch.instance_base != -1U);
+
+		//Set shader program:
+		GLuint program = (instanced ? pipeline.instanced.program : pipeline.program);
+		bool program_changed = (program != bound_program);
+		if (program_changed) {
+			glUseProgram(program);
+			bound_program = program;
+			++draw_stats.program_changes;
+		} else {
+			++draw_stats.program_skips;
+		}
 
-		//draw the object:
-		glDrawArrays(pipeline.type, pipeline.start, pipeline.count);
+		//set statically-typed uniforms, if they differ from the last ones set:
+		if (pipeline.uniforms.set && (program_changed || pipeline.uniforms != applied_uniforms)) {
+			pipeline.uniforms.set(instanced ? pipeline.uniforms.instanced_program : pipeline.uniforms.program, pipeline.uniforms.params);
+			applied_uniforms = pipeline.uniforms;
+			++draw_stats.uniforms_calls;
+		}
 
-		//un-bind textures:
+		//Set attribute sources:
+		if (pipeline.vao != bound_vao) {
+			glBindVertexArray(pipeline.vao);
+			bound_vao = pipeline.vao;
+			++draw_stats.vao_changes;
+		} else {
+			++draw_stats.vao_skips;
+		}
+
+		//Configure program uniforms:
+
+		if (instanced) {
+			//per-instance matrices come from the instance buffer:
+			glUniform1i(pipeline.instanced.INSTANCE_BASE_int, int32_t(batch.instance_base));
+		} else {
+			//OBJECT_TO_CLIP takes vertices from object space to clip space:
+			if (pipeline.OBJECT_TO_CLIP_mat4 != -1U) {
+				glUniformMatrix4fv(pipeline.OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(item.object_to_clip));
+			}
+
+			//OBJECT_TO_CLIP takes vertices from object space to light space:
+			if (pipeline.OBJECT_TO_LIGHT_mat4x3 != -1U) {
+				glUniformMatrix4x3fv(pipeline.OBJECT_TO_LIGHT_mat4x3, 1, GL_FALSE, glm::value_ptr(item.object_to_light));
+			}
+
+			//NORMAL_TO_CLIP takes normals from object space to light space:
+			if (pipeline.NORMAL_TO_LIGHT_mat3 != -1U) {
+				glUniformMatrix3fv(pipeline.NORMAL_TO_LIGHT_mat3, 1, GL_FALSE, glm::value_ptr(item.normal_to_light));
+			}
+
+			//set any requested custom uniforms:
+			// (these may overwrite anything, so statically-typed uniforms will be re-applied)
+			if (pipeline.set_uniforms) {
+				pipeline.set_uniforms();
+				applied_uniforms = Drawable::Pipeline::Uniforms();
+			}
+		}
+
+		//set up textures:
+		// (units the drawable doesn't use are left as-is, since its program won't sample them)
 		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
-			if (pipeline.textures[i].texture != 0) {
-				glActiveTexture(GL_TEXTURE0 + i);
-				glBindTexture(pipeline.textures[i].target, 0);
+			Drawable::Pipeline::TextureInfo const &info = pipeline.textures[i];
+			if (info.texture == 0) continue;
+			if (info.texture != bound_textures[i].texture || info.target != bound_textures[i].target) {
+				if (active_texture != i) {
+					glActiveTexture(GL_TEXTURE0 + i);
+					active_texture = i;
+				}
+				if (bound_textures[i].texture != 0 && bound_textures[i].target != info.target) {
+					glBindTexture(bound_textures[i].target, 0);
+				}
+				glBindTexture(info.target, info.texture);
+				bound_textures[i] = info;
+				++draw_stats.texture_changes;
+			} else {
+				++draw_stats.texture_skips;
 			}
 		}
-		glActiveTexture(GL_TEXTURE0);
 
+		//draw the object(s):
+		if (item.index_type != GL_NONE) {
+			GLbyte const *offset = (GLbyte const *)0 + item.start * (item.index_type == GL_UNSIGNED_SHORT ? 2 : 4);
+			if (instanced) {
+				glDrawElementsInstancedBaseVertex(pipeline.type, item.count, item.index_type, offset, batch.count, item.base_vertex);
+			} else {
+				glDrawElementsBaseVertex(pipeline.type, item.count, item.index_type, offset, item.base_vertex);
+			}
+		} else {
+			if (instanced) {
+				glDrawArraysInstanced(pipeline.type, item.start, item.count, batch.count);
+			} else {
+				glDrawArrays(pipeline.type, item.start, item.count);
+			}
+		}
+		if (instanced) {
+			++draw_stats.instanced_draws;
+			draw_stats.instances += batch.count;
+		}
+		draw_stats.draws += batch.count;
+		draw_stats.triangles += triangle_count(pipeline.type, item.count) * batch.count;
 	}
 
+	//(if every tested drawable is hidden, no batch started the tested part, but their boxes still need querying)
+	if (!boxes_queried) query_boxes();
+
+	if (!instance_data.empty()) {
+		glActiveTexture(GL_TEXTURE0 + Drawable::Pipeline::InstanceTextureUnit);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+	}
+
+	//un-bind textures:
+	for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
+		if (bound_textures[i].texture != 0) {
+			glActiveTexture(GL_TEXTURE0 + i);
+			glBindTexture(bound_textures[i].target, 0);
+		}
+	}
+	glActiveTexture(GL_TEXTURE0);
+
 	glUseProgram(0);
 	glBindVertexArray(0);
 
@@ -169,10 +745,20 @@ void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_lig
 void Scene::load(std::string const &filename,
 	std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable) {
 
-	std::ifstream file(filename, std::ios::binary);
+	MappedFile file(filename);
+	load(file.begin(), file.end(), filename, [&](Scene &scene, Transform *transform, std::string const &mesh_name, uint32_t) {
+		if (on_drawable) on_drawable(scene, transform, mesh_name);
+	});
+}
+
+void Scene::load(char *begin, char *end, std::string const &filename,
+	std::function< void(Scene &, Transform *, std::string const &, uint32_t) > const &on_drawable) {
 
+	char *at = begin;
+
+	//scene chunks are small and mostly follow the (arbitrary length) names, so are copied out:
 	std::vector< char > names;
-	read_chunk(file, "str0", &names);
+	read_chunk(&at, end, "str0", &names);
 
 	struct HierarchyEntry {
 		uint32_t parent;
@@ -184,7 +770,7 @@ void Scene::load(std::string const &filename,
 	};
 	static_assert(sizeof(HierarchyEntry) == 4 + 4 + 4 + 4*3 + 4*4 + 4*3, "HierarchyEntry is packed.");
 	std::vector< HierarchyEntry > hierarchy;
-	read_chunk(file, "xfh0", &hierarchy);
+	read_chunk(&at, end, "xfh0", &hierarchy);
 
 	struct MeshEntry {
 		uint32_t transform;
@@ -193,7 +779,7 @@ void Scene::load(std::string const &filename,
 	};
 	static_assert(sizeof(MeshEntry) == 4 + 4 + 4, "MeshEntry is packed.");
 	std::vector< MeshEntry > meshes;
-	read_chunk(file, "msh0", &meshes);
+	read_chunk(&at, end, "msh0", &meshes);
 
 	struct CameraEntry {
 		uint32_t transform;
@@ -203,7 +789,7 @@ void Scene::load(std::string const &filename,
 	};
 	static_assert(sizeof(CameraEntry) == 4 + 4 + 4 + 4 + 4, "CameraEntry is packed.");
 	std::vector< CameraEntry > loaded_cameras;
-	read_chunk(file, "cam0", &loaded_cameras);
+	read_chunk(&at, end, "cam0", &loaded_cameras);
 
 	struct LightEntry {
 		uint32_t transform;
@@ -215,7 +801,7 @@ void Scene::load(std::string const &filename,
 	};
 	static_assert(sizeof(LightEntry) == 4 + 1 + 3 + 4 + 4 + 4, "LightEntry is packed.");
 	std::vector< LightEntry > loaded_lights;
-	read_chunk(file, "lmp0", &loaded_lights);
+	read_chunk(&at, end, "lmp0", &loaded_lights);
 
 
 	//--------------------------------
@@ -248,7 +834,8 @@ void Scene::load(std::string const &filename,
 	}
 	assert(hierarchy_transforms.size() == hierarchy.size());
 
-	for (auto const &m : meshes) {
+	for (uint32_t i = 0; i < meshes.size(); ++i) {
+		MeshEntry const &m = meshes[i];
 		if (m.transform >= hierarchy_transforms.size()) {
 			throw std::runtime_error("scene file '" + filename + "' contains mesh entry with invalid transform index (" + std::to_string(m.transform) + ")");
 		}
@@ -258,7 +845,7 @@ void Scene::load(std::string const &filename,
 		std::string name = std::string(names.begin() + m.name_begin, names.begin() + m.name_end);
 
 		if (on_drawable) {
-			on_drawable(*this, hierarchy_transforms[m.transform], name);
+			on_drawable(*this, hierarchy_transforms[m.transform], name, i);
 		}
 
 	}
@@ -299,12 +886,18 @@ void Scene::load(std::string const &filename,
 		light->type = static_cast<Light::Type>(l.type);
 		light->energy = glm::vec3(l.color) / 255.0f * l.energy;
 		light->spot_fov = l.fov / 180.0f * 3.1415926f; //FOV is stored in degrees; convert to radians.
+		light->distance = std::max(0.0f, l.distance);
 	}
 
 	//load any extra that a subclass wants:
-	load_extra(file, names, hierarchy_transforms);
-
-	if (file.peek() != EOF) {
+	// (reading from the rest of the mapped file)
+	struct MemoryBuffer : std::streambuf {
+		MemoryBuffer(char *begin, char *end) { setg(begin, begin, end); }
+	} rest(at, end);
+	std::istream from(&rest);
+	load_extra(from, names, hierarchy_transforms);
+
+	if (from.peek() != EOF) {
 		std::cerr << "WARNING: trailing data in scene file '" << filename << "'" << std::endl;
 	}
 
@@ -318,6 +911,34 @@ Scene::Scene(std::string const &filename, std::function< void(Scene &, Transform
 	load(filename, on_drawable);
 }
 
+Scene::Scene(Level const &level, std::function< void(Scene &, Transform *, uint32_t) > const &on_drawable) {
+	load(level.scene.begin, level.scene.end, level.filename, [&](Scene &scene, Transform *transform, std::string const &mesh_name, uint32_t i) {
+		if (level.streamed()) return; //(streamed levels' drawables are made by LevelStream)
+		if (i >= level.mesh_refs_count) {
+			throw std::runtime_error("level '" + level.filename + "' has no mesh reference for scene mesh entry " + std::to_string(i) + ".");
+		}
+		uint32_t mesh_index = level.mesh_refs[i];
+		if (mesh_index == -1U) {
+			std::cerr << "WARNING: level '" << level.filename << "' has no mesh named '" << mesh_name << "'; skipping drawable." << std::endl;
+			return;
+		}
+		if (on_drawable) on_drawable(scene, transform, mesh_index);
+	});
+}
+
+Scene::~Scene() {
+	for (auto const &[drawable, state] : occlusion_states) {
+		for (GLuint query : state.queries) {
+			if (query != 0) free_occlusion_queries.emplace_back(query);
+		}
+	}
+	occlusion_states.clear();
+	if (!free_occlusion_queries.empty()) {
+		glDeleteQueries(GLsizei(free_occlusion_queries.size()), free_occlusion_queries.data());
+		free_occlusion_queries.clear();
+	}
+}
+
 Scene::Scene(Scene const &other) {
 	set(other);
 }
@@ -327,51 +948,74 @@ Scene &Scene::operator=(Scene const &other) {
 	return *this;
 }
 
-void Scene::set(Scene const &other, std::unordered_map< Transform const *, Transform * > *transform_map_) {
-
-	std::unordered_map< Transform const *, Transform * > t2t_temp;
-	std::unordered_map< Transform const *, Transform * > &transform_to_transform = *(transform_map_ ? transform_map_ : &t2t_temp);
-
-	transform_to_transform.clear();
+void Scene::set(Scene const &other, std::unordered_map< Transform const *, Transform * > *transform_map) {
 
-	//null transform maps to itself:
-	transform_to_transform.insert(std::make_pair(nullptr, nullptr));
-
-	//Copy transforms and store mapping:
+	//Copy transforms:
+	// (the copies land at the same positions in 'transforms' as the originals in 'other.transforms')
 	transforms.clear();
+	transforms.reserve(other.transforms.size());
 	for (auto const &t : other.transforms) {
-		transforms.emplace_back();
-		transforms.back().name = t.name;
-		transforms.back().position = t.position;
-		transforms.back().rotation = t.rotation;
-		transforms.back().scale = t.scale;
-		transforms.back().parent = t.parent; //will update later
-
-		//store mapping between transforms old and new:
-		auto ret = transform_to_transform.insert(std::make_pair(&t, &transforms.back()));
-		assert(ret.second);
+		Transform &copy = transforms.emplace_back();
+		copy.name = t.name;
+		copy.position = t.position;
+		copy.rotation = t.rotation;
+		copy.scale = t.scale;
 	}
 
+	//map a transform in other to the corresponding transform in this scene:
+	auto map_transform = [&](Transform const *t) -> Transform * {
+		if (t == nullptr) return nullptr; //null transform maps to itself
+		size_t index = other.transforms.index_of(t);
+		if (index == size_t(-1)) {
+			throw std::runtime_error("Scene::set: object references a transform not in the scene being copied.");
+		}
+		return &transforms[index];
+	};
+
 	//update transform parents:
-	for (auto &t : transforms) {
-		t.parent = transform_to_transform.at(t.parent);
+	{
+		auto copy = transforms.begin();
+		for (auto const &t : other.transforms) {
+			copy->parent = map_transform(t.parent);
+			++copy;
+		}
+	}
+
+	//occlusion history belongs to this scene's (old) drawables, so start over (keeping the query names for reuse):
+	for (auto const &[drawable, state] : occlusion_states) {
+		for (GLuint query : state.queries) {
+			if (query != 0) free_occlusion_queries.emplace_back(query);
+		}
 	}
+	occlusion_states.clear();
 
 	//copy other's drawables, updating transform pointers:
 	drawables = other.drawables;
 	for (auto &d : drawables) {
-		d.transform = transform_to_transform.at(d.transform);
+		d.transform = map_transform(d.transform);
 	}
 
 	//copy other's cameras, updating transform pointers:
 	cameras = other.cameras;
 	for (auto &c : cameras) {
-		c.transform = transform_to_transform.at(c.transform);
+		c.transform = map_transform(c.transform);
 	}
 
 	//copy other's lights, updating transform pointers:
 	lights = other.lights;
 	for (auto &l : lights) {
-		l.transform = transform_to_transform.at(l.transform);
+		l.transform = map_transform(l.transform);
+	}
+
+	//store mapping between transforms old and new, if requested:
+	if (transform_map) {
+		transform_map->clear();
+		transform_map->reserve(other.transforms.size() + 1);
+		transform_map->insert(std::make_pair(nullptr, nullptr));
+		auto copy = transforms.begin();
+		for (auto const &t : other.transforms) {
+			transform_map->insert(std::make_pair(&t, &*copy));
+			++copy;
+		}
 	}
 }
@@ -11,17 +11,21 @@
  */
 
 #include "GL.hpp"
+#include "Arena.hpp"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 
-#include <list>
+#include <limits>
 #include <memory>
 #include <functional>
 #include <string>
 #include <vector>
 #include <unordered_map>
 
+struct Mesh;
+struct Level;
+
 struct Scene {
 	struct Transform {
 		//Transform names are useful for debugging and looking up locations in a loaded scene:
@@ -43,6 +47,25 @@ struct Scene {
 		glm::mat4x3 make_local_to_world() const;
 		glm::mat4x3 make_world_to_local() const;
 
+		//(opt-in) cached world matrices, filled in by Scene::update_transforms():
+		// these reflect position/rotation/scale/parent as of the last update_transforms() call
+		// (see has_cached_world() to check if the cache is from the current update of a given scene)
+		glm::mat4x3 const &cached_local_to_world() const { return cache.local_to_world; }
+		glm::mat4x3 const &cached_world_to_local() const { return cache.world_to_local; }
+		glm::mat3 const &cached_normal_to_world() const { return cache.normal_to_world; }
+		struct {
+			glm::mat4x3 local_to_world = glm::mat4x3(1.0f);
+			glm::mat4x3 world_to_local = glm::mat4x3(1.0f);
+			glm::mat3 normal_to_world = glm::mat3(1.0f); //inverse transpose of local_to_world's 3x3 part
+			//copy of local transform the matrices were computed from (used to detect changes):
+			glm::vec3 position = glm::vec3(0.0f);
+			glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+			glm::vec3 scale = glm::vec3(1.0f);
+			Transform const *parent = nullptr;
+			uint32_t updated_stamp = 0; //Scene::transforms_stamp at last visit by update_transforms() (0 == never)
+			uint32_t changed_stamp = 0; //Scene::transforms_stamp when matrices last changed (children must recompute)
+		} cache;
+
 		//since hierarchy is tracked through pointers, copy-constructing a transform  is not advised:
 		Transform(Transform const &) = delete;
 		//if we delete some constructors, we need to let the compiler know that the default constructor is still okay:
@@ -54,6 +77,20 @@ struct Scene {
 		Drawable(Transform *transform_) : transform(transform_) { assert(transform); }
 		Transform * transform;
 
+		//Object-space bounding box, used for view frustum culling:
+		// (the default, empty box means "never cull")
+		glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+		glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+
+		//(optional) mesh whose Mesh::lods draw() may substitute for pipeline.start/count/index_type/base_vertex,
+		// based on the projected size of the bounds above (scaled by Scene::lod_scale):
+		// n.b. the lods must come from the same MeshBuffer as pipeline.vao
+		Mesh const *lod_mesh = nullptr;
+
+		//(optional) mark large drawables that hide others (walls, floors) as occluders:
+		// with Scene::occlusion_culling, occluders are drawn first and other drawables are tested against their depth
+		bool occluder = false;
+
 		//Contains all the data needed to run the OpenGL pipeline:
 		struct Pipeline {
 			GLuint program = 0; //shader program; passed to glUseProgram
@@ -65,6 +102,11 @@ struct Scene {
 			GLuint start = 0; //first vertex to draw; passed to glDrawArrays
 			GLuint count = 0; //number of vertices to draw; passed to glDrawArrays
 
+			//indexed drawing (from the element buffer bound in vao):
+			// if index_type is not GL_NONE, start/count are an index range, passed to glDrawElementsBaseVertex
+			GLenum index_type = GL_NONE; //GL_UNSIGNED_SHORT or GL_UNSIGNED_INT for indexed meshes
+			GLint base_vertex = 0; //added to each index
+
 			//uniforms:
 			GLuint OBJECT_TO_CLIP_mat4 = -1U; //uniform location for object to clip space matrix
 			GLuint OBJECT_TO_LIGHT_mat4x3 = -1U; //uniform location for object to light space (== world space) matrix
@@ -72,12 +114,54 @@ struct Scene {
 
 			std::function< void() > set_uniforms; //(optional) function to set any other useful uniforms
 
+			//(optional) statically-typed alternative to set_uniforms:
+			// Uniforms::make< Program, Params, Set >(...) wraps a compile-time Set(program, params) call;
+			// copying it copies a few pointers, draw() calls it once per run of drawables with equal
+			// 'uniforms' (not once per drawable), and such drawables may still be instanced together.
+			// Set is passed whichever of 'program' / 'instanced_program' matches the GL program in use.
+			struct Uniforms {
+				void (*set)(void const *program, void const *params) = nullptr;
+				void const *program = nullptr; //Program for Pipeline::program
+				void const *instanced_program = nullptr; //Program for Pipeline::instanced.program
+				void const *params = nullptr;
+
+				template< typename Program, typename Params, void (*Set)(Program const &, Params const &) >
+				static Uniforms make(Program const *program, Program const *instanced_program, Params const *params) {
+					Uniforms ret;
+					ret.set = [](void const *program_, void const *params_) {
+						Set(*static_cast< Program const * >(program_), *static_cast< Params const * >(params_));
+					};
+					ret.program = program;
+					ret.instanced_program = instanced_program;
+					ret.params = params;
+					return ret;
+				}
+
+				bool operator==(Uniforms const &o) const {
+					return set == o.set && program == o.program && instanced_program == o.instanced_program && params == o.params;
+				}
+				bool operator!=(Uniforms const &o) const { return !(*this == o); }
+			} uniforms;
+
 			//texture objects to bind for the first TextureCount textures:
 			enum : uint32_t { TextureCount = 4 };
 			struct TextureInfo {
 				GLuint texture = 0;
 				GLenum target = GL_TEXTURE_2D;
 			} textures[TextureCount];
+
+			//(optional) instanced variant of 'program':
+			// when several drawables have identical pipelines (and no set_uniforms), Scene::draw groups them into one glDrawArraysInstanced call.
+			// the instanced program reads per-instance matrices from a texture buffer bound to texture unit InstanceTextureUnit,
+			// InstanceTexels RGBA32F texels per instance, starting at texel InstanceTexels * (INSTANCE_BASE + gl_InstanceID):
+			//  texels 0-3: OBJECT_TO_CLIP columns
+			//  texels 4-6: OBJECT_TO_LIGHT rows
+			//  texels 7-9: NORMAL_TO_LIGHT columns (.xyz)
+			enum : uint32_t { InstanceTextureUnit = TextureCount, InstanceTexels = 10 };
+			struct Instanced {
+				GLuint program = 0; //instanced shader program (0 == never instance this pipeline)
+				GLuint INSTANCE_BASE_int = -1U; //uniform location for index of first instance of the draw call
+			} instanced;
 		} pipeline;
 	};
 
@@ -114,13 +198,28 @@ struct Scene {
 
 		//Spotlight specific:
 		float spot_fov = glm::radians(45.0f); //spot cone fov (in radians)
+
+		//Point and spot lights: distance past which the light has no effect (0 => estimate from energy):
+		float distance = 0.0f;
 	};
 
 	//Scenes, of course, may have many of the above objects:
-	std::list< Transform > transforms;
-	std::list< Drawable > drawables;
-	std::list< Camera > cameras;
-	std::list< Light > lights;
+	// (kept in Arenas, so pointers to them stay valid as more are added and iteration is linear in memory)
+	Arena< Transform > transforms;
+	Arena< Drawable > drawables;
+	Arena< Camera > cameras;
+	Arena< Light > lights;
+
+	//Update each transform's cached world matrices, top-down, recomputing only those that
+	// (or whose ancestors) changed since the last call; call once per frame after gameplay updates:
+	// (while the cache is current, draw() uses it instead of walking parent chains)
+	void update_transforms();
+	uint32_t transforms_stamp = 0; //incremented by every update_transforms() call
+
+	//is transform's cache from the most recent update_transforms() of this scene?
+	bool has_cached_world(Transform const &transform) const {
+		return transforms_stamp != 0 && transform.cache.updated_stamp == transforms_stamp;
+	}
 
 	//The "draw" function provides a convenient way to pass all the things in a scene to OpenGL:
 	void draw(Camera const &camera) const;
@@ -128,12 +227,96 @@ struct Scene {
 	//..sometimes, you want to draw with a custom projection matrix and/or light space:
 	void draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light = glm::mat4x3(1.0f)) const;
 
+	//draw() only changes program / vertex array / texture bindings when they differ from what is bound;
+	// if sort_drawables is set, drawables are also submitted sorted by (program, vao, textures) so that
+	// drawables sharing state are drawn together (order among drawables with equal state is preserved).
+	// n.b. leave this off if your drawables depend on list order (e.g., for blending)
+	// n.b. Pipeline::set_uniforms functions should not change these bindings
+	bool sort_drawables = false;
+
+	//multiplies projected sizes when picking levels of detail (see Drawable::lod_mesh); larger means more detail:
+	float lod_scale = 1.0f;
+
+	//if set, draw() draws occluders (see Drawable::occluder) and drawables without bounds first; then draws the
+	// bounding box of each remaining drawable (without writing color or depth) in an occlusion query:
+	// - a drawable is skipped if its box was hidden in the previous draw()'s query -- results are a frame old, so
+	//   reading them never stalls, but a drawable that comes into view appears one frame late
+	// - a result that isn't in yet, or a drawable that wasn't queried in the previous draw(), counts as visible
+	// - drawables whose boxes cross the near plane (e.g., the camera is inside one) are always drawn
+	// n.b. pays off when occluders hide many drawables with expensive shading (e.g., indoor levels)
+	// n.b. expects color and depth writes enabled (the default), and leaves them that way
+	bool occlusion_culling = false;
+
+	//counts from the most recent draw() call:
+	struct DrawStats {
+		uint32_t draws = 0; //drawables actually submitted
+		uint32_t triangles = 0; //triangles submitted (each instance counted)
+		uint32_t cull_tests = 0, culled = 0; //drawables with bounds tested against / rejected by the view frustum
+		uint32_t program_changes = 0, program_skips = 0; //glUseProgram calls made / avoided
+		uint32_t vao_changes = 0, vao_skips = 0; //glBindVertexArray calls made / avoided
+		uint32_t texture_changes = 0, texture_skips = 0; //glBindTexture calls made / avoided
+		uint32_t instanced_draws = 0, instances = 0; //glDrawArraysInstanced calls made / drawables drawn by them
+		uint32_t uniforms_calls = 0; //Pipeline::uniforms setters called
+		uint32_t lod_reduced = 0; //drawables drawn with one of their Mesh::lods
+		uint32_t occlusion_queries = 0; //drawables whose boxes were queried (see occlusion_culling)
+		uint32_t occluded = 0; //drawables skipped because their boxes were hidden in the previous draw()'s queries
+	};
+	mutable DrawStats draw_stats;
+	//draw() prepares its work in parallel (see parallel_for.hpp), 'draw_grain' drawables per task, building
+	// draw_order (with all matrices each drawable needs), draw_batches, and instance_data;
+	// then a serial loop submits the batches to OpenGL, reading only those arrays:
+	// n.b. so drawables, transforms, and lod meshes must not change during draw()
+	size_t draw_grain = 256;
+
+	//occlusion culling history, per drawable tested by the previous draw() (see occlusion_culling):
+	struct OcclusionState {
+		GLuint queries[2] = {0, 0}; //box queries, alternating between draw()s (so one can be read while the other is issued)
+		uint32_t queried = 0; //occlusion_frame its box was last queried in (0 if never; occlusion_frame starts at 1)
+		uint32_t tested = 0; //occlusion_frame it was last tested in (states not tested by a draw() are dropped)
+		bool hidden = false; //the previous draw()'s query found its box hidden
+	};
+	mutable std::unordered_map< Drawable const *, OcclusionState > occlusion_states;
+	mutable std::vector< GLuint > free_occlusion_queries; //query names of dropped states, for reuse
+	mutable uint32_t occlusion_frame = 0; //draw()s with occlusion_culling so far
+
+	//scratch space for culling and sorting (kept to avoid re-allocating):
+	struct DrawItem {
+		Drawable const *drawable;
+		glm::mat4x3 object_to_world;
+		glm::mat4 object_to_clip;
+		//range to draw (pipeline's, or from a level of detail):
+		GLuint start, count;
+		GLenum index_type;
+		GLint base_vertex;
+		//matrices for the light-space uniforms:
+		glm::mat4x3 object_to_light;
+		glm::mat3 normal_to_light;
+		//(occlusion_culling) state of a drawable whose box is queried in this draw():
+		OcclusionState *occlusion = nullptr;
+	};
+	mutable std::vector< DrawItem > draw_order;
+	struct DrawRange { //per-task counts while gathering draw_order
+		uint32_t kept = 0; //items written to the start of the task's range of draw_order
+		uint32_t cull_tests = 0, culled = 0, lod_reduced = 0;
+	};
+	mutable std::vector< DrawRange > draw_ranges;
+	struct DrawBatch {
+		uint32_t first, count; //range in draw_order
+		uint32_t instance_base; //first instance in instance_data, or -1U if not instanced
+	};
+	mutable std::vector< DrawBatch > draw_batches;
+	mutable std::vector< glm::vec4 > instance_data;
+
 	//add transforms/objects/cameras from a scene file to this scene:
 	// the 'on_drawable' callback gives your code a chance to look up mesh data and make Drawables:
 	// throws on file format errors
 	void load(std::string const &filename,
 		std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable = nullptr
 	);
+	//...from scene file data in memory (the callback also gets the index of the mesh entry in the file):
+	void load(char *begin, char *end, std::string const &filename,
+		std::function< void(Scene &, Transform *, std::string const &, uint32_t) > const &on_drawable
+	);
 
 	//this function is called to read extra chunks from the scene file after the main chunks are read:
 	// this is useful if you, e.g., subclassing scene to represent a game level/area
@@ -145,6 +328,15 @@ struct Scene {
 	//load a scene:
 	Scene(std::string const &filename, std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable);
 
+	//load the scene section of a packed level (see Level.hpp):
+	// the callback gets the index of each drawable's mesh in the level's mesh section (see MeshBuffer::lookup(uint32_t));
+	// drawables whose mesh isn't in the level are skipped with a warning
+	// (for streamed levels, the callback is never called -- see LevelStream.hpp)
+	Scene(Level const &level, std::function< void(Scene &, Transform *, uint32_t mesh_index) > const &on_drawable);
+
+	//deletes the occlusion queries draw() made (if it made any, the OpenGL context must still be current):
+	virtual ~Scene();
+
 	//copy a scene (with proper pointer fixup):
 	Scene(Scene const &); //...as a constructor
 	Scene &operator=(Scene const &); //...as scene = scene
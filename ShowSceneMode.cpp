@@ -1,9 +1,13 @@
 #include "ShowSceneMode.hpp"
 #include "DrawLines.hpp"
 
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
 #include <iostream>
+#include <unordered_map>
 
-ShowSceneMode::ShowSceneMode(Scene const &scene_) : scene(scene_) {
+ShowSceneMode::ShowSceneMode(Scene const &scene_, MeshBuffer const *meshes_) : scene(scene_), meshes(meshes_) {
 
 	//Set up camera-only scene:
 	{ //create a single camera:
@@ -14,6 +18,61 @@ ShowSceneMode::ShowSceneMode(Scene const &scene_) : scene(scene_) {
 		scene_camera->near = 0.01f;
 		//scene_camera->transform and scene_camera->aspect will be set in draw()
 	}
+
+	update_mesh_stats();
+}
+
+void ShowSceneMode::update_mesh_stats() {
+	mesh_stats.clear();
+	total_indices = 0;
+
+	if (meshes) { //per-mesh statistics:
+		std::unordered_map< Mesh const *, size_t > by_mesh; //-> index in mesh_stats
+		mesh_stats.reserve(meshes->meshes.size());
+		for (auto const &entry : meshes->meshes) {
+			//(skip "Name.lodN" meshes, which are counted as part of "Name")
+			size_t dot = entry.first.rfind(".lod");
+			if (dot != std::string::npos && dot + 4 < entry.first.size()
+			 && std::all_of(entry.first.begin() + dot + 4, entry.first.end(), [](char c) { return std::isdigit(uint8_t(c)); })) continue;
+
+			by_mesh[&entry.second] = mesh_stats.size();
+			MeshStats &stats = mesh_stats.emplace_back();
+			stats.name = entry.first;
+			stats.indices = entry.second.count;
+			stats.has_lods = !entry.second.lods.empty();
+		}
+
+		for (auto const &drawable : scene.drawables) {
+			auto f = by_mesh.find(drawable.lod_mesh);
+			if (f == by_mesh.end()) continue;
+			MeshStats &stats = mesh_stats[f->second];
+			stats.instances += 1;
+			if (drawable.pipeline.instanced.program != 0) stats.instanced = true;
+			total_indices += stats.indices;
+		}
+
+		std::stable_sort(mesh_stats.begin(), mesh_stats.end(), [](MeshStats const &a, MeshStats const &b) {
+			return a.total() > b.total();
+		});
+
+		//report, for checking budgets without running the viewer:
+		std::cout << "Meshes (" << mesh_stats.size() << ", " << total_indices << " indices over " << scene.drawables.size() << " drawables):\n";
+		for (auto const &stats : mesh_stats) {
+			std::cout << "  '" << stats.name << "' " << stats.indices << " indices x " << stats.instances << " = " << stats.total() << mesh_flags(stats) << '\n';
+		}
+		std::cout.flush();
+	}
+}
+
+std::string ShowSceneMode::mesh_flags(MeshStats const &stats) {
+	std::string flags;
+	if (stats.instances >= InstancingCandidateCopies && !stats.instanced) {
+		flags += " [instancing candidate: " + std::to_string(stats.instances) + " copies]";
+	}
+	if (stats.instances > 0 && stats.indices >= LODCandidateIndices && !stats.has_lods) {
+		flags += " [LOD candidate: no .lodN meshes]";
+	}
+	return flags;
 }
 
 ShowSceneMode::~ShowSceneMode() {
@@ -21,6 +80,10 @@ ShowSceneMode::~ShowSceneMode() {
 
 bool ShowSceneMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size) {
 	//----- trackball-style camera controls -----
+	if (evt.type == SDL_KEYDOWN && evt.key.keysym.sym == SDLK_TAB) {
+		show_stats = !show_stats;
+		return true;
+	}
 	if (evt.type == SDL_MOUSEBUTTONDOWN) {
 		if (evt.button.button == SDL_BUTTON_LEFT) {
 			//when camera is upside-down at rotation start, azimuth rotation should be reversed:
@@ -92,6 +155,7 @@ void ShowSceneMode::draw(glm::uvec2 const &drawable_size) {
 	glDepthFunc(GL_LEQUAL);
 
 	scene.draw(*scene_camera);
+	Scene::DrawStats stats = scene.draw_stats; //(before anything else draws)
 
 	{ //decorate with some lines:
 		DrawLines draw_lines(scene_camera->make_projection() * glm::mat4(scene_camera->transform->make_world_to_local()));
@@ -136,4 +200,57 @@ void ShowSceneMode::draw(glm::uvec2 const &drawable_size) {
 		*/
 	}
 
+	if (show_stats) { //statistics panel:
+		glDisable(GL_DEPTH_TEST);
+		float aspect = float(drawable_size.x) / float(drawable_size.y);
+		DrawLines lines(glm::mat4(
+			1.0f / aspect, 0.0f, 0.0f, 0.0f,
+			0.0f, 1.0f, 0.0f, 0.0f,
+			0.0f, 0.0f, 1.0f, 0.0f,
+			0.0f, 0.0f, 0.0f, 1.0f
+		));
+
+		constexpr float H = 0.045f;
+		float ofs = 2.0f / drawable_size.y;
+		float y = 1.0f - 1.5f * H;
+		auto line = [&](std::string const &text, glm::u8vec4 color) {
+			lines.draw_text(text, glm::vec3(-aspect + 0.5f * H, y, 0.0f), glm::vec3(H, 0.0f, 0.0f), glm::vec3(0.0f, H, 0.0f), glm::u8vec4(0x00, 0x00, 0x00, 0x00));
+			lines.draw_text(text, glm::vec3(-aspect + 0.5f * H + ofs, y + ofs, 0.0f), glm::vec3(H, 0.0f, 0.0f), glm::vec3(0.0f, H, 0.0f), color);
+			y -= 1.2f * H;
+		};
+		glm::u8vec4 const white(0xff, 0xff, 0xff, 0x00);
+		glm::u8vec4 const warn(0xff, 0xaa, 0x44, 0x00);
+
+		char buf[200];
+		std::snprintf(buf, sizeof(buf), "drawables %u: drawn %u (%u instanced in %u draws), culled %u of %u tested, %u at lower LOD",
+			uint32_t(scene.drawables.size()), stats.draws, stats.instances, stats.instanced_draws, stats.culled, stats.cull_tests, stats.lod_reduced);
+		line(buf, white);
+		std::snprintf(buf, sizeof(buf), "triangles %u", stats.triangles);
+		line(buf, white);
+		std::snprintf(buf, sizeof(buf), "switches: program %u (%u skipped), vao %u (%u skipped), texture %u (%u skipped)",
+			stats.program_changes, stats.program_skips, stats.vao_changes, stats.vao_skips, stats.texture_changes, stats.texture_skips);
+		line(buf, white);
+
+		if (!mesh_stats.empty()) {
+			std::snprintf(buf, sizeof(buf), "meshes %u, %llu indices over all drawables; most indices:", uint32_t(mesh_stats.size()), (unsigned long long)total_indices);
+			line(buf, white);
+			constexpr uint32_t MaxMeshLines = 12;
+			for (uint32_t m = 0; m < mesh_stats.size() && m < MaxMeshLines; ++m) {
+				MeshStats const &ms = mesh_stats[m];
+				std::string flags = mesh_flags(ms);
+				std::snprintf(buf, sizeof(buf), "  '%s' %u x %u = %llu", ms.name.c_str(), ms.indices, ms.instances, (unsigned long long)ms.total());
+				line(buf + flags, flags.empty() ? white : warn);
+			}
+			//flagged meshes that didn't make the list:
+			uint32_t more = 0;
+			for (uint32_t m = MaxMeshLines; m < mesh_stats.size(); ++m) {
+				if (!mesh_flags(mesh_stats[m]).empty()) more += 1;
+			}
+			if (more) {
+				std::snprintf(buf, sizeof(buf), "  (+%u more flagged meshes; see console)", more);
+				line(buf, warn);
+			}
+		}
+	}
+
 }
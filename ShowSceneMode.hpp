@@ -5,14 +5,23 @@
  * ShowSceneMode exists to show the contents of a Scene; this can be useful
  * if, e.g., you aren't sure if things are being exported properly.
  *
+ * It also shows what the scene costs to draw (toggle with tab): draw counts and
+ *  state changes from Scene::draw_stats, and per-mesh vertex totals, flagging
+ *  meshes that look like candidates for instancing or levels of detail.
+ *
  */
 
 #include "Mode.hpp"
 #include "Scene.hpp"
 #include "Mesh.hpp"
 
+#include <string>
+#include <vector>
+
 struct ShowSceneMode : Mode {
-	ShowSceneMode(Scene const &scene);
+	//'meshes' (optional) is where the scene's drawables get their meshes (for per-mesh statistics):
+	// (drawables are matched to meshes through Drawable::lod_mesh)
+	ShowSceneMode(Scene const &scene, MeshBuffer const *meshes = nullptr);
 	virtual ~ShowSceneMode();
 
 	virtual bool handle_event(SDL_Event const &, glm::uvec2 const &window_size) override;
@@ -27,10 +36,33 @@ struct ShowSceneMode : Mode {
 		bool flip_x = false; //flip x inputs when moving? (used to handle situations where camera is upside-down)
 	} camera;
 
-	//Scene being viewed:
+	//Scene being viewed (and where its meshes come from, if known):
 	Scene const &scene;
+	MeshBuffer const *meshes = nullptr;
 
 	//mode uses a secondary Scene to hold a camera:
 	Scene camera_scene;
 	Scene::Camera *scene_camera = nullptr;
+
+	//statistics panel:
+	bool show_stats = true;
+	struct MeshStats {
+		std::string name;
+		uint32_t indices = 0; //indices (or vertices, if not indexed) per draw at full detail
+		uint32_t instances = 0; //drawables using the mesh
+		bool has_lods = false;
+		bool instanced = false; //are its drawables' pipelines able to draw instanced?
+		uint64_t total() const { return uint64_t(indices) * instances; }
+	};
+	std::vector< MeshStats > mesh_stats; //most total indices first
+	uint64_t total_indices = 0; //over all drawables, at full detail
+	//(re)compute the above from 'scene' and 'meshes' (e.g., after they are reloaded) and print them:
+	void update_mesh_stats();
+
+	//meshes with at least this many copies that can't be drawn instanced are flagged:
+	static constexpr uint32_t InstancingCandidateCopies = 4;
+	//meshes with at least this many indices and no lower levels of detail are flagged:
+	static constexpr uint32_t LODCandidateIndices = 5000;
+	//what could make a mesh cheaper (empty if nothing):
+	static std::string mesh_flags(MeshStats const &stats);
 };
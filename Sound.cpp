@@ -1,10 +1,19 @@
 #include "Sound.hpp"
 #include "load_wav.hpp"
 #include "load_opus.hpp"
+#include "mix_mono.hpp"
+#include "OpusStream.hpp"
+#include "FrameArena.hpp"
+#include "AllocTracking.hpp"
 
 #include <SDL.h>
 
-#include <list>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 #include <cassert>
 #include <exception>
 #include <iostream>
@@ -15,13 +24,247 @@ namespace {
 
 	//handy constants:
 	constexpr uint32_t const AUDIO_RATE = 48000; //sampling rate
-	constexpr uint32_t const MIX_SAMPLES = 1024; //number of samples to mix per call of mix_audio callback; n.b. SDL requires this to be a power of two
+	constexpr uint32_t const MIX_SAMPLES = 256; //number of samples mixed at once; the device buffer is filled from a sequence of these blocks, so ramps step at the same rate whatever buffer size the device uses
 
 	//The audio device:
 	SDL_AudioDeviceID device = 0;
+	uint32_t device_samples = 0; //samples per callback, as granted by the device (written before playback starts)
+
+	//voice ownership, shared between the game thread and the audio thread:
+	// - the game thread claims a free voice in play() (sets 'busy', bumps 'generation')
+	// - the audio thread clears 'busy' once the voice has finished playing
+	struct VoiceSlot {
+		std::atomic< bool > busy{false};
+		std::atomic< uint32_t > generation{0};
+	};
+	std::array< VoiceSlot, Sound::MaxVoices > voice_slots;
+	uint32_t next_slot = 0; //where the game thread starts looking for a free voice
+
+	//playback state of each voice (audio thread only, or while the audio device is locked):
+	struct Voice {
+		bool active = false;
+		uint32_t generation = 0; //generation of the sample now playing
+		std::vector< float > const *data = nullptr; //sample data being played (Resident samples)
+		uint32_t i = 0; //next data value to read
+		OpusStream *stream = nullptr; //decoder feeding playback (Streamed samples; owned by the streaming thread)
+		bool loop = false; //should playback loop after data runs out?
+		bool is_3D = false; //was sample played in "3D" mode?
+		bool stopping = false; //is playing stopping?
+		int32_t priority = 0; //from Sample::priority
+
+		Sound::Ramp< float > volume = Sound::Ramp< float >(1.0f);
+		Sound::Ramp< float > pan = Sound::Ramp< float >(0.0f); //2D playback panning control
+		Sound::Ramp< glm::vec3 > position = Sound::Ramp< glm::vec3 >(0.0f); //3D playback panning control
+		Sound::Ramp< float > half_volume_radius = Sound::Ramp< float >(1.0f);
+	};
+	std::array< Voice, Sound::MaxVoices > voices;
+
+	//voice budget (see Sound::set_max_mixed_voices):
+	uint32_t max_mixed_voices = 32;
+	constexpr float const AUDIBLE_GAIN = 1e-3f; //voices whose gain stays below this (-60dB) for a whole block aren't mixed
+
+	//callback instrumentation (written by mix_audio, read by Sound::get_mix_stats):
+	struct {
+		std::atomic< uint64_t > callbacks{0};
+		std::atomic< float > mix_ms{0.0f};
+		std::atomic< float > worst_mix_ms{0.0f};
+		std::atomic< uint32_t > active_voices{0};
+		std::atomic< uint32_t > mixed_voices{0};
+		std::atomic< uint32_t > virtual_voices{0};
+		std::atomic< uint32_t > overruns{0};
+		std::atomic< uint32_t > late_callbacks{0};
+		std::atomic< uint32_t > stream_underruns{0};
+	} mix_stats;
+	float callback_ms = 0.0f; //time one device buffer takes to play (written before playback starts)
+
+	//indices of active voices (in no particular order), so mix_audio doesn't scan idle ones:
+	std::array< uint32_t, Sound::MaxVoices > active_voices;
+	uint32_t active_count = 0;
+
+	//streaming thread, which keeps the OpusStreams of playing Streamed samples topped up:
+	// (streams are created by the game thread and freed here, after the audio thread releases them)
+	std::thread stream_thread;
+	std::mutex stream_mutex; //guards the members below
+	std::condition_variable stream_cv;
+	bool stream_quit = false;
+	std::vector< std::shared_ptr< OpusStream > > streams;
+
+	void stream_main() {
+		std::unique_lock< std::mutex > lock(stream_mutex);
+		while (!stream_quit) {
+			streams.erase(std::remove_if(streams.begin(), streams.end(), [](std::shared_ptr< OpusStream > const &stream) {
+				return stream->released.load(std::memory_order_acquire);
+			}), streams.end());
+			std::vector< std::shared_ptr< OpusStream > > active = streams;
+
+			//decode without holding the lock, so play() doesn't wait on it:
+			lock.unlock();
+			for (auto &stream : active) {
+				if (stream->finished) continue;
+				try {
+					stream->fill();
+				} catch (std::exception &e) {
+					std::cerr << "WARNING: " << e.what() << " (stopping stream)" << std::endl;
+					stream->finished = true;
+				}
+			}
+			active.clear();
+			lock.lock();
+
+			//the ring holds over a second of audio, so waking up every few ms is plenty:
+			stream_cv.wait_for(lock, std::chrono::milliseconds(10));
+		}
+	}
+
+	//changes requested by the game thread, applied by mix_audio:
+	// (plain data, so neither queueing nor applying a command allocates or frees anything)
+	struct Command {
+		enum Type : uint8_t {
+			Play,
+			SetVolume,
+			SetPan,
+			SetPosition,
+			SetHalfVolumeRadius,
+			SetEmitter, //position ('a') and half-volume radius ('value') together
+			Stop,
+			StopAll,
+			SetListener,
+			SetGlobalVolume,
+			SetMaxMixedVoices,
+		} type = Play;
+		uint32_t voice = -1U; //voice the command applies to (if any)...
+		uint32_t generation = 0; //...as long as it is still playing this generation
+		float ramp = 0.0f;
+		float value = 0.0f;
+		glm::vec3 a = glm::vec3(0.0f);
+		glm::vec3 b = glm::vec3(0.0f);
+
+		//Play only:
+		std::vector< float > const *data = nullptr;
+		OpusStream *stream = nullptr;
+		bool loop = false;
+		bool is_3D = false;
+		int32_t priority = 0;
+		float pan = 0.0f;
+		float half_volume_radius = 1.0f;
+
+		void apply();
+	};
+
+	//single-producer (game thread) / single-consumer (mix_audio) ring of commands:
+	// the producer owns 'command_tail', the consumer owns 'command_head';
+	// one slot is always left empty so that head == tail means "empty"
+	constexpr uint32_t const CommandCapacity = 1024;
+	std::array< Command, CommandCapacity > commands;
+	std::atomic< uint32_t > command_head{0};
+	std::atomic< uint32_t > command_tail{0};
+
+	//queue commands (game thread only); mix_audio applies all of them before the same block:
+	void submit(Command const *batch, uint32_t count);
+	void submit(Command const &command) {
+		submit(&command, 1);
+	}
+
+	//helper for the common "command for a playing sample" case:
+	void submit(Command::Type type, Sound::PlayingSample const &sample, float ramp, float value = 0.0f, glm::vec3 const &a = glm::vec3(0.0f)) {
+		if (sample.voice == -1U) return;
+		Command command;
+		command.type = type;
+		command.voice = sample.voice;
+		command.generation = sample.generation;
+		command.ramp = ramp;
+		command.value = value;
+		command.a = a;
+		submit(command);
+	}
+
+	//apply all queued commands (audio thread, or with the audio device locked):
+	void drain_commands();
+
+	//claim a voice, set up decoding (for Streamed samples), and queue the new sample:
+	Sound::PlayingSample start_playing(Sound::Sample const &sample, bool loop, bool is_3D, float volume, float pan, glm::vec3 const &position, float half_volume_radius) {
+		ALLOC_SCOPE("Sound");
+		Sound::PlayingSample ret;
+		if (device == 0) return ret; //no audio, so nothing to play
+		if (sample.storage == Sound::Sample::Resident && sample.data.empty()) return ret; //nothing to play
+
+		for (uint32_t n = 0; n < Sound::MaxVoices; ++n) {
+			uint32_t v = (next_slot + n) % Sound::MaxVoices;
+			if (!voice_slots[v].busy.load(std::memory_order_acquire)) {
+				voice_slots[v].busy.store(true, std::memory_order_relaxed);
+				ret.voice = v;
+				ret.generation = voice_slots[v].generation.load(std::memory_order_relaxed) + 1;
+				voice_slots[v].generation.store(ret.generation, std::memory_order_release);
+				next_slot = (v + 1) % Sound::MaxVoices;
+				break;
+			}
+		}
+		if (ret.voice == -1U) {
+			static bool warned = false;
+			if (!warned) {
+				std::cerr << "WARNING: all " << Sound::MaxVoices << " voices are busy; dropping new samples." << std::endl;
+				warned = true;
+			}
+			return ret;
+		}
+
+		Command command;
+		command.type = Command::Play;
+		command.voice = ret.voice;
+		command.generation = ret.generation;
+		command.data = &sample.data;
+		command.loop = loop;
+		command.is_3D = is_3D;
+		command.priority = sample.priority;
+		command.value = volume;
+		command.pan = pan;
+		command.a = position;
+		command.half_volume_radius = half_volume_radius;
+
+		if (sample.storage == Sound::Sample::Streamed) {
+			std::shared_ptr< OpusStream > stream;
+			try {
+				stream = std::make_shared< OpusStream >(sample.filename, loop);
+				//decode the first few blocks right away so playback doesn't start with an underrun:
+				stream->fill(4 * MIX_SAMPLES);
+			} catch (...) {
+				voice_slots[ret.voice].busy.store(false, std::memory_order_release);
+				throw;
+			}
+			command.stream = stream.get();
+			{
+				std::lock_guard< std::mutex > lock(stream_mutex);
+				streams.emplace_back(std::move(stream));
+			}
+			stream_cv.notify_one();
+		}
+
+		submit(command);
+		return ret;
+	}
 
-	//list of all currently playing samples:
-	std::list< std::shared_ptr< Sound::PlayingSample > > playing_samples;
+	//fade out a playing voice:
+	void stop_voice(Voice &voice, float ramp) {
+		if (!voice.stopping) {
+			voice.stopping = true;
+			voice.volume.target = 0.0f;
+			voice.volume.ramp = ramp;
+		} else {
+			voice.volume.ramp = std::min(voice.volume.ramp, ramp);
+		}
+	}
+
+	//hand a finished voice back to the game thread (audio thread only):
+	void finish_voice(uint32_t index) {
+		Voice &voice = voices[index];
+		voice.active = false;
+		if (voice.stream) {
+			voice.stream->released.store(true, std::memory_order_release);
+			voice.stream = nullptr;
+		}
+		voice.data = nullptr;
+		voice_slots[index].busy.store(false, std::memory_order_release);
+	}
 
 }
 
@@ -38,7 +281,15 @@ void mix_audio(void *, Uint8 *buffer_, int len);
 
 //------------------------ public-facing --------------------------------
 
-Sound::Sample::Sample(std::string const &filename) {
+Sound::Sample::Sample(std::string const &filename, Storage storage_) : storage(storage_) {
+	if (storage == Streamed) {
+		if (!(filename.size() >= 5 && filename.substr(filename.size()-5) == ".opus")) {
+			throw std::runtime_error("Sample '" + filename + "' can't be streamed -- only \".opus\" files support streaming.");
+		}
+		OpusStream::check(filename);
+		this->filename = filename;
+		return;
+	}
 	if (filename.size() >= 4 && filename.substr(filename.size()-4) == ".wav") {
 		load_wav(filename, &data);
 	} else if (filename.size() >= 5 && filename.substr(filename.size()-5) == ".opus") {
@@ -53,7 +304,7 @@ Sound::Sample::Sample(std::vector< float > const &data_) : data(data_) {
 
 
 
-void Sound::init() {
+void Sound::init(Latency latency) {
 	if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
 		std::cerr << "Failed to initialize SDL audio subsytem:\n" << SDL_GetError() << std::endl;
 		std::cerr << "  (Will continue without audio.)\n" << std::endl;
@@ -66,14 +317,25 @@ void Sound::init() {
 	want.freq = AUDIO_RATE;
 	want.format = AUDIO_F32SYS;
 	want.channels = 2;
-	want.samples = MIX_SAMPLES;
+	want.samples = Uint16(latency);
 	want.callback = mix_audio;
 
-	device = SDL_OpenAudioDevice(nullptr, 0, &want, &have, 0);
+	//take whatever buffer size the device prefers (mix_audio handles any size):
+	device = SDL_OpenAudioDevice(nullptr, 0, &want, &have, SDL_AUDIO_ALLOW_SAMPLES_CHANGE);
 	if (device == 0) {
 		std::cerr << "Failed to open audio device:\n" << SDL_GetError() << std::endl;
 		std::cerr << "  (Will continue without audio.)\n" << std::endl;
 	} else {
+		device_samples = have.samples;
+		callback_ms = 1000.0f * float(device_samples) / float(AUDIO_RATE);
+		if (device_samples != want.samples) {
+			std::cout << "Audio device uses " << device_samples << " samples per buffer (asked for " << want.samples << ")." << std::endl;
+		}
+
+		//start decoding thread for Streamed samples:
+		stream_quit = false;
+		stream_thread = std::thread(stream_main);
+
 		//start audio playback:
 		SDL_PauseAudioDevice(device, 0);
 		std::cout << "Audio output initialized." << std::endl;
@@ -88,6 +350,14 @@ void Sound::shutdown() {
 		SDL_CloseAudioDevice(device);
 		device = 0;
 	}
+	if (stream_thread.joinable()) {
+		{
+			std::lock_guard< std::mutex > lock(stream_mutex);
+			stream_quit = true;
+		}
+		stream_cv.notify_one();
+		stream_thread.join();
+	}
 }
 
 
@@ -99,112 +369,257 @@ void Sound::unlock() {
 	if (device) SDL_UnlockAudioDevice(device);
 }
 
-std::shared_ptr< Sound::PlayingSample > Sound::play(Sample const &sample, float play_volume, float pan) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, play_volume, pan, false);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+Sound::PlayingSample Sound::play(Sample const &sample, float play_volume, float pan) {
+	return start_playing(sample, false, false, play_volume, pan, glm::vec3(0.0f), 1.0f);
 }
 
-std::shared_ptr< Sound::PlayingSample > Sound::play_3D(Sample const &sample, float play_volume, glm::vec3 const &position, float half_volume_radius) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, play_volume, position, half_volume_radius, false);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+Sound::PlayingSample Sound::play_3D(Sample const &sample, float play_volume, glm::vec3 const &position, float half_volume_radius) {
+	return start_playing(sample, false, true, play_volume, 0.0f, position, half_volume_radius);
 }
 
-std::shared_ptr< Sound::PlayingSample > Sound::loop(Sample const &sample, float play_volume, float pan) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, play_volume, pan, true);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+Sound::PlayingSample Sound::loop(Sample const &sample, float play_volume, float pan) {
+	return start_playing(sample, true, false, play_volume, pan, glm::vec3(0.0f), 1.0f);
 }
 
 
 
-std::shared_ptr< Sound::PlayingSample > Sound::loop_3D(Sample const &sample, float play_volume, glm::vec3 const &position, float half_volume_radius) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, play_volume, position, half_volume_radius, true);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+Sound::PlayingSample Sound::loop_3D(Sample const &sample, float play_volume, glm::vec3 const &position, float half_volume_radius) {
+	return start_playing(sample, true, true, play_volume, 0.0f, position, half_volume_radius);
 }
 
 
 void Sound::stop_all_samples() {
-	lock();
-	for (auto &s : playing_samples) {
-		s->stop();
-	}
-	unlock();
+	Command command;
+	command.type = Command::StopAll;
+	command.ramp = 1.0f / 60.0f;
+	submit(command);
 }
 
 void Sound::set_volume(float new_volume, float ramp) {
-	lock();
-	volume.set(new_volume, ramp);
-	unlock();
+	Command command;
+	command.type = Command::SetGlobalVolume;
+	command.ramp = ramp;
+	command.value = new_volume;
+	submit(command);
+}
+
+void Sound::set_max_mixed_voices(uint32_t count) {
+	Command command;
+	command.type = Command::SetMaxMixedVoices;
+	command.value = float(count);
+	submit(command);
 }
 
 //------------------
 
+Sound::MixStats Sound::get_mix_stats() {
+	MixStats stats;
+	stats.callbacks = mix_stats.callbacks.load(std::memory_order_relaxed);
+	stats.budget_ms = callback_ms;
+	stats.mix_ms = mix_stats.mix_ms.load(std::memory_order_relaxed);
+	stats.worst_mix_ms = mix_stats.worst_mix_ms.load(std::memory_order_relaxed);
+	stats.active_voices = mix_stats.active_voices.load(std::memory_order_relaxed);
+	stats.mixed_voices = mix_stats.mixed_voices.load(std::memory_order_relaxed);
+	stats.virtual_voices = mix_stats.virtual_voices.load(std::memory_order_relaxed);
+	stats.overruns = mix_stats.overruns.load(std::memory_order_relaxed);
+	stats.late_callbacks = mix_stats.late_callbacks.load(std::memory_order_relaxed);
+	stats.stream_underruns = mix_stats.stream_underruns.load(std::memory_order_relaxed);
+	return stats;
+}
+
 void Sound::PlayingSample::set_volume(float new_volume, float ramp) {
-	Sound::lock();
-	if (!stopping) {
-		volume.set(new_volume, ramp);
-	}
-	Sound::unlock();
+	submit(Command::SetVolume, *this, ramp, new_volume);
 }
 
 void Sound::PlayingSample::set_pan(float new_pan, float ramp) {
-	if (!(pan.value == pan.value)) return; //ignore if not in '2D' mode
-	Sound::lock();
-	pan.set(new_pan, ramp);
-	Sound::unlock();
+	submit(Command::SetPan, *this, ramp, new_pan);
 }
 
 void Sound::PlayingSample::set_position(glm::vec3 const &new_position, float ramp) {
-	if (pan.value == pan.value) return; //ignore if not in '3D' mode
-	Sound::lock();
-	position.set(new_position, ramp);
-	Sound::unlock();
+	submit(Command::SetPosition, *this, ramp, 0.0f, new_position);
 }
 
 void Sound::PlayingSample::set_half_volume_radius(float new_radius, float ramp) {
-	if (pan.value == pan.value) return; //ignore if not in '3D' mode
-	Sound::lock();
-	half_volume_radius.set(new_radius, ramp);
-	Sound::unlock();
+	submit(Command::SetHalfVolumeRadius, *this, ramp, new_radius);
 }
 
 void Sound::PlayingSample::stop(float ramp) {
-	Sound::lock();
-	if (!(stopping || stopped)) {
-		stopping = true;
-		volume.target = 0.0f;
-		volume.ramp = ramp;
-	} else {
-		volume.ramp = std::min(volume.ramp, ramp);
-	}
-	Sound::unlock();
+	submit(Command::Stop, *this, ramp);
+}
+
+bool Sound::PlayingSample::stopped() const {
+	if (voice == -1U) return true;
+	VoiceSlot const &slot = voice_slots[voice];
+	return !slot.busy.load(std::memory_order_acquire) || slot.generation.load(std::memory_order_relaxed) != generation;
 }
 
 //------------------
 
-void Sound::Listener::set_position_right(glm::vec3 const &new_position, glm::vec3 const &new_right, float ramp) {
-	Sound::lock();
-	position.set(new_position, ramp);
+//helper: command that moves the listener:
+static Command listener_command(glm::vec3 const &new_position, glm::vec3 const &new_right, float ramp) {
+	Command command;
+	command.type = Command::SetListener;
+	command.ramp = ramp;
+	command.a = new_position;
 	//some extra code to make sure right is always a unit vector:
 	if (new_right == glm::vec3(0.0f)) {
-		right.set(glm::vec3(1.0f, 0.0f, 0.0f), ramp);
+		command.b = glm::vec3(1.0f, 0.0f, 0.0f);
 	} else {
-		right.set(glm::normalize(new_right), ramp);
+		command.b = glm::normalize(new_right);
 	}
-	Sound::unlock();
+	return command;
 }
 
+void Sound::Listener::set_position_right(glm::vec3 const &new_position, glm::vec3 const &new_right, float ramp) {
+	submit(listener_command(new_position, new_right, ramp));
+}
+
+void Sound::update_emitters(EmitterUpdate const *emitters, size_t count, ListenerUpdate const *listener_update, float ramp) {
+	ALLOC_SCOPE("Sound");
+	FrameArena::vector< Command > batch; //(game thread only, so per-frame updates can use the frame arena)
+	batch.reserve(count + 1);
+	for (size_t i = 0; i < count; ++i) {
+		PlayingSample const &sample = emitters[i].sample;
+		if (sample.voice == -1U) continue;
+		Command command;
+		command.type = Command::SetEmitter;
+		command.voice = sample.voice;
+		command.generation = sample.generation;
+		command.ramp = ramp;
+		command.a = emitters[i].position;
+		command.value = emitters[i].half_volume_radius;
+		batch.emplace_back(command);
+	}
+	if (listener_update) {
+		batch.emplace_back(listener_command(listener_update->position, listener_update->right, ramp));
+	}
+	if (!batch.empty()) submit(batch.data(), uint32_t(batch.size()));
+}
+
+//------------------------ command queue --------------------------------
+
+namespace {
+
+//runs on the audio thread (or with the audio device locked):
+void Command::apply() {
+	if (type == Play) {
+		assert(voice < Sound::MaxVoices);
+		Voice &v = voices[voice];
+		assert(!v.active);
+		v = Voice();
+		v.active = true;
+		v.generation = generation;
+		v.data = data;
+		v.stream = stream;
+		v.loop = loop;
+		v.is_3D = is_3D;
+		v.priority = priority;
+		v.volume = Sound::Ramp< float >(value);
+		v.pan = Sound::Ramp< float >(pan);
+		v.position = Sound::Ramp< glm::vec3 >(a);
+		v.half_volume_radius = Sound::Ramp< float >(half_volume_radius);
+		active_voices[active_count++] = voice;
+		return;
+	}
+
+	//commands for a specific voice are dropped if that voice has moved on to another sample:
+	Voice *v = nullptr;
+	if (voice != -1U) {
+		if (!(voices[voice].active && voices[voice].generation == generation)) return;
+		v = &voices[voice];
+	}
+
+	switch (type) {
+		case Play:
+			break;
+		case SetVolume:
+			if (!v->stopping) {
+				v->volume.set(value, ramp);
+			}
+			break;
+		case SetPan:
+			if (!v->is_3D) v->pan.set(value, ramp); //ignore if not in '2D' mode
+			break;
+		case SetPosition:
+			if (v->is_3D) v->position.set(a, ramp); //ignore if not in '3D' mode
+			break;
+		case SetHalfVolumeRadius:
+			if (v->is_3D) v->half_volume_radius.set(value, ramp); //ignore if not in '3D' mode
+			break;
+		case SetEmitter:
+			if (v->is_3D) { //ignore if not in '3D' mode
+				v->position.set(a, ramp);
+				v->half_volume_radius.set(value, ramp);
+			}
+			break;
+		case Stop:
+			stop_voice(*v, ramp);
+			break;
+		case StopAll:
+			for (uint32_t i = 0; i < active_count; ++i) {
+				stop_voice(voices[active_voices[i]], ramp);
+			}
+			break;
+		case SetListener:
+			Sound::listener.position.set(a, ramp);
+			Sound::listener.right.set(b, ramp);
+			break;
+		case SetGlobalVolume:
+			Sound::volume.set(value, ramp);
+			break;
+		case SetMaxMixedVoices:
+			max_mixed_voices = uint32_t(value);
+			break;
+	}
+}
+
+void submit(Command const *batch, uint32_t count) {
+	if (device == 0) {
+		//no audio thread; nothing to race with:
+		for (uint32_t i = 0; i < count; ++i) {
+			Command(batch[i]).apply();
+		}
+		return;
+	}
+
+	if (count >= CommandCapacity) {
+		//batch would never fit in the queue; apply it here, with the callback locked out:
+		Sound::lock();
+		drain_commands();
+		for (uint32_t i = 0; i < count; ++i) {
+			Command(batch[i]).apply();
+		}
+		Sound::unlock();
+		return;
+	}
+
+	uint32_t tail = command_tail.load(std::memory_order_relaxed);
+	uint32_t used = (tail + CommandCapacity - command_head.load(std::memory_order_acquire)) % CommandCapacity;
+	if (used + count > CommandCapacity - 1) {
+		//not enough room (audio thread stalled?): drain it here, with the callback locked out:
+		Sound::lock();
+		drain_commands();
+		Sound::unlock();
+	}
+	for (uint32_t i = 0; i < count; ++i) {
+		commands[(tail + i) % CommandCapacity] = batch[i];
+	}
+	//publishing the tail once means drain_commands sees the whole batch or none of it:
+	command_tail.store((tail + count) % CommandCapacity, std::memory_order_release);
+}
+
+void drain_commands() {
+	uint32_t head = command_head.load(std::memory_order_relaxed);
+	uint32_t tail = command_tail.load(std::memory_order_acquire);
+	while (head != tail) {
+		commands[head].apply();
+		head = (head + 1) % CommandCapacity;
+	}
+	command_head.store(head, std::memory_order_release);
+}
+
+} //namespace
+
 //------------------------ internals --------------------------------
 
 
@@ -310,18 +725,119 @@ void step_direction_ramp(Sound::Ramp< glm::vec3 > &ramp) {
 }
 
 
-//The audio callback -- invoked by SDL when it needs more sound to play:
-void mix_audio(void *, Uint8 *buffer_, int len) {
-	assert(buffer_); //should always have some audio buffer
+//helper: mix one block of a voice into the (interleaved stereo) buffer; returns true if the voice ran out of data:
+bool mix_voice(Voice &voice, float *buffer, float pan_l, float pan_r, float step_l, float step_r) {
+	if (voice.stream) {
+		//mix whatever the streaming thread has decoded (in at most two runs, since the ring may wrap):
+		OpusStream &stream = *voice.stream;
+		uint32_t mixed = 0;
+		while (mixed < MIX_SAMPLES) {
+			float const *run = nullptr;
+			uint32_t count = stream.peek(&run, MIX_SAMPLES - mixed);
+			if (count == 0) break;
+			mix_mono(buffer + 2 * mixed, run, count,
+				pan_l + mixed * step_l, pan_r + mixed * step_r,
+				step_l, step_r);
+			stream.consume(count);
+			mixed += count;
+		}
+		bool finished = stream.done();
+		if (mixed < MIX_SAMPLES && !finished) {
+			//decoder fell behind; rest of block is silent:
+			stream.underruns.fetch_add(1, std::memory_order_relaxed);
+			mix_stats.stream_underruns.fetch_add(1, std::memory_order_relaxed);
+		}
+		return finished;
+	} else {
+		assert(voice.i < voice.data->size());
 
-	struct LR {
-		float l;
-		float r;
-	};
-	static_assert(sizeof(LR) == 8, "Sample is packed");
-	assert(len == MIX_SAMPLES * sizeof(LR)); //should always have the expected number of samples
-	LR *buffer = reinterpret_cast< LR * >(buffer_);
+		//mix in runs that stop where the sample data ends (and playback loops or finishes):
+		uint32_t mixed = 0;
+		while (mixed < MIX_SAMPLES) {
+			uint32_t count = std::min(MIX_SAMPLES - mixed, uint32_t(voice.data->size()) - voice.i);
+			mix_mono(buffer + 2 * mixed, voice.data->data() + voice.i, count,
+				pan_l + mixed * step_l, pan_r + mixed * step_r,
+				step_l, step_r);
+			mixed += count;
+
+			//update position in sample:
+			voice.i += count;
+			if (voice.i == voice.data->size()) {
+				if (voice.loop) {
+					voice.i = 0;
+				} else {
+					break;
+				}
+			}
+		}
+		return voice.i >= voice.data->size();
+	}
+}
+
+//helper: advance a virtual voice by one block without mixing it; returns true if the voice ran out of data:
+bool skip_voice(Voice &voice) {
+	if (voice.stream) {
+		OpusStream &stream = *voice.stream;
+		uint32_t skipped = 0;
+		while (skipped < MIX_SAMPLES) {
+			float const *run = nullptr;
+			uint32_t count = stream.peek(&run, MIX_SAMPLES - skipped);
+			if (count == 0) break;
+			stream.consume(count);
+			skipped += count;
+		}
+		return stream.done();
+	} else {
+		uint32_t size = uint32_t(voice.data->size());
+		if (voice.loop) {
+			voice.i = uint32_t((uint64_t(voice.i) + MIX_SAMPLES) % size);
+		} else {
+			voice.i = std::min(size, voice.i + MIX_SAMPLES);
+		}
+		return voice.i >= size;
+	}
+}
+
+//helper: publish timing and voice counts for one call of mix_audio:
+void record_mix_stats(std::chrono::steady_clock::time_point start, uint32_t mixed, uint32_t virtualized) {
+	using ms = std::chrono::duration< float, std::milli >;
 
+	//recent call durations (audio thread only):
+	static std::array< float, Sound::MixStatsWindow > window{};
+	static uint32_t window_next = 0;
+	static std::chrono::steady_clock::time_point previous_start;
+
+	float mix_ms = ms(std::chrono::steady_clock::now() - start).count();
+	window[window_next] = mix_ms;
+	window_next = (window_next + 1) % Sound::MixStatsWindow;
+	float worst = 0.0f;
+	for (float w : window) worst = std::max(worst, w);
+
+	uint64_t callbacks = mix_stats.callbacks.load(std::memory_order_relaxed);
+	if (callbacks != 0 && ms(start - previous_start).count() > 1.5f * callback_ms) {
+		mix_stats.late_callbacks.fetch_add(1, std::memory_order_relaxed);
+	}
+	previous_start = start;
+	if (mix_ms > callback_ms) {
+		mix_stats.overruns.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	mix_stats.mix_ms.store(mix_ms, std::memory_order_relaxed);
+	mix_stats.worst_mix_ms.store(worst, std::memory_order_relaxed);
+	mix_stats.active_voices.store(active_count, std::memory_order_relaxed);
+	mix_stats.mixed_voices.store(mixed, std::memory_order_relaxed);
+	mix_stats.virtual_voices.store(virtualized, std::memory_order_relaxed);
+	mix_stats.callbacks.store(callbacks + 1, std::memory_order_relaxed);
+}
+
+struct LR {
+	float l;
+	float r;
+};
+static_assert(sizeof(LR) == 8, "Sample is packed");
+
+//mix the next MIX_SAMPLES samples of every active voice into 'buffer'; reports how many voices were mixed and virtualized:
+void mix_block(LR *buffer, uint32_t *mixed, uint32_t *virtualized) {
 	//zero the output buffer:
 	for (uint32_t s = 0; s < MIX_SAMPLES; ++s) {
 		buffer[s].l = 0.0f;
@@ -341,98 +857,158 @@ void mix_audio(void *, Uint8 *buffer_, int len) {
 	glm::vec3 end_position =  Sound::listener.position.value;
 	glm::vec3 end_right =  Sound::listener.right.value;
 
-	//add audio from each playing sample into the buffer:
-	for (auto si = playing_samples.begin(); si != playing_samples.end(); /* later */) {
-		Sound::PlayingSample &playing_sample = **si; //much more convenient than writing ** everywhere.
+	//figure out each voice's gains over this block (and step its ramps):
+	struct Gains {
+		uint32_t index; //voice index
+		LR start_pan;
+		LR pan_step; //added at each sample so that pan moves smoothly from start to end
+		float loudness; //largest gain during the block
+	};
+	static std::array< Gains, Sound::MaxVoices > gains; //(static so it's not on the callback's stack)
+	for (uint32_t active = 0; active < active_count; ++active) {
+		uint32_t index = active_voices[active];
+		Voice &voice = voices[index];
 
 		//Figure out sample panning/volume at start...
 		LR start_pan;
-		if (!(playing_sample.pan.value == playing_sample.pan.value)) {
+		if (voice.is_3D) {
 			//3D panning
 			compute_pan_from_listener_and_position(
 				start_position, start_right,
-				playing_sample.position.value,
-				playing_sample.half_volume_radius.value,
+				voice.position.value,
+				voice.half_volume_radius.value,
 				&start_pan.l, &start_pan.r);
 
-			step_position_ramp(playing_sample.position);
-			step_value_ramp(playing_sample.half_volume_radius);
+			step_position_ramp(voice.position);
+			step_value_ramp(voice.half_volume_radius);
 		} else {
 			//2D panning
-			compute_pan_weights(playing_sample.pan.value, &start_pan.l, &start_pan.r);
+			compute_pan_weights(voice.pan.value, &start_pan.l, &start_pan.r);
 
-			step_value_ramp(playing_sample.pan);
+			step_value_ramp(voice.pan);
 		}
-		start_pan.l *= start_volume * playing_sample.volume.value;
-		start_pan.r *= start_volume * playing_sample.volume.value;
+		start_pan.l *= start_volume * voice.volume.value;
+		start_pan.r *= start_volume * voice.volume.value;
 
-		step_value_ramp(playing_sample.volume);
+		step_value_ramp(voice.volume);
 
 		//..and end of the mix period:
 		LR end_pan;
-		if (!(playing_sample.pan.value == playing_sample.pan.value)) {
+		if (voice.is_3D) {
 			//3D panning
 			compute_pan_from_listener_and_position(
 				end_position, end_right,
-				playing_sample.position.value,
-				playing_sample.half_volume_radius.value,
+				voice.position.value,
+				voice.half_volume_radius.value,
 				&end_pan.l, &end_pan.r);
 		} else {
 			//2D panning
-			compute_pan_weights(playing_sample.pan.value, &end_pan.l, &end_pan.r);
+			compute_pan_weights(voice.pan.value, &end_pan.l, &end_pan.r);
 		}
 
-		end_pan.l *= end_volume * playing_sample.volume.value;
-		end_pan.r *= end_volume * playing_sample.volume.value;
+		end_pan.l *= end_volume * voice.volume.value;
+		end_pan.r *= end_volume * voice.volume.value;
 
-		//figure out a step to add at each sample so that pan will move smoothly from start to end:
-		LR pan = start_pan;
-		LR pan_step;
-		pan_step.l = (end_pan.l - start_pan.l) / MIX_SAMPLES;
-		pan_step.r = (end_pan.r - start_pan.r) / MIX_SAMPLES;
-
-		assert(playing_sample.i < playing_sample.data.size());
-
-		for (uint32_t i = 0; i < MIX_SAMPLES; ++i) {
-			//mix one sample based on current pan values:
-			buffer[i].l += pan.l * playing_sample.data[playing_sample.i];
-			buffer[i].r += pan.r * playing_sample.data[playing_sample.i];
-
-			//update position in sample:
-			playing_sample.i += 1;
-			if (playing_sample.i == playing_sample.data.size()) {
-				if (playing_sample.loop) {
-					playing_sample.i = 0;
-				} else {
-					break;
-				}
-			}
+		Gains &g = gains[active];
+		g.index = index;
+		g.start_pan = start_pan;
+		g.pan_step.l = (end_pan.l - start_pan.l) / MIX_SAMPLES;
+		g.pan_step.r = (end_pan.r - start_pan.r) / MIX_SAMPLES;
+		g.loudness = std::max(std::max(std::abs(start_pan.l), std::abs(start_pan.r)), std::max(std::abs(end_pan.l), std::abs(end_pan.r)));
+	}
 
-			//update pan values:
-			pan.l += pan_step.l;
-			pan.r += pan_step.r;
+	//pick which voices to actually mix: audible ones, highest priority then loudest, up to the budget:
+	// (gains[0 .. mix_count) are mixed; the rest are virtual)
+	auto audible_first = [](Gains const &a, Gains const &b) {
+		bool a_audible = (a.loudness >= AUDIBLE_GAIN);
+		bool b_audible = (b.loudness >= AUDIBLE_GAIN);
+		if (a_audible != b_audible) return a_audible;
+		int32_t a_priority = voices[a.index].priority;
+		int32_t b_priority = voices[b.index].priority;
+		if (a_priority != b_priority) return a_priority > b_priority;
+		return a.loudness > b.loudness;
+	};
+	uint32_t mix_count = std::min(active_count, max_mixed_voices);
+	if (mix_count < active_count) {
+		std::nth_element(gains.begin(), gains.begin() + mix_count, gains.begin() + active_count, audible_first);
+	}
+	//(if there weren't enough audible voices to fill the budget, drop the inaudible ones that made it in)
+	for (uint32_t g = 0; g < mix_count; /* later */) {
+		if (gains[g].loudness < AUDIBLE_GAIN) {
+			mix_count -= 1;
+			std::swap(gains[g], gains[mix_count]);
+		} else {
+			++g;
 		}
+	}
 
-		if (playing_sample.i >= playing_sample.data.size()
-		 || (playing_sample.stopping && playing_sample.volume.value == 0.0f)) { //sample has finished
-		 	playing_sample.stopped = true;
-			//erase from list:
-			auto old = si;
-			++si;
-			playing_samples.erase(old);
+	//add audio from each mixed voice into the buffer, and just advance virtual voices:
+	for (uint32_t g = 0; g < active_count; ++g) {
+		Voice &voice = voices[gains[g].index];
+		bool finished;
+		if (g < mix_count) {
+			finished = mix_voice(voice, reinterpret_cast< float * >(buffer), gains[g].start_pan.l, gains[g].start_pan.r, gains[g].pan_step.l, gains[g].pan_step.r);
 		} else {
-			++si;
+			finished = skip_voice(voice);
 		}
+
+		if (finished
+		 || (voice.stopping && voice.volume.value == 0.0f)) { //sample has finished
+			finish_voice(gains[g].index);
+			gains[g].index = -1U;
+		}
+	}
+
+	//rebuild the active list without the voices that finished:
+	uint32_t active_count_before = active_count;
+	uint32_t still_active = 0;
+	for (uint32_t g = 0; g < active_count; ++g) {
+		if (gains[g].index != -1U) active_voices[still_active++] = gains[g].index;
 	}
+	active_count = still_active;
+
+	*mixed = mix_count;
+	*virtualized = active_count_before - mix_count;
 
 	/*//DEBUG: report output power:
 	float max_power = 0.0f;
 	for (uint32_t s = 0; s < MIX_SAMPLES; ++s) {
 		max_power = std::max(max_power, (buffer[s].l * buffer[s].l + buffer[s].r * buffer[s].r));
 	}
-	std::cout << "Max Power: " << std::sqrt(max_power) << "; playing samples: " << playing_samples.size() << std::endl; //DEBUG
+	std::cout << "Max Power: " << std::sqrt(max_power) << "; playing samples: " << active_count << std::endl; //DEBUG
 	*/
 
 }
 
+//The audio callback -- invoked by SDL when it needs more sound to play:
+void mix_audio(void *, Uint8 *buffer_, int len) {
+	auto start = std::chrono::steady_clock::now();
+	assert(buffer_); //should always have some audio buffer
+	assert(len % sizeof(LR) == 0); //should always be whole stereo samples
+	LR *buffer = reinterpret_cast< LR * >(buffer_);
+	uint32_t samples = uint32_t(len) / sizeof(LR);
+
+	//apply changes queued by the game thread since the last mix:
+	drain_commands();
+
+	//fill the device buffer from fixed-size blocks:
+	// (if the device buffer isn't a multiple of MIX_SAMPLES, the end of a block carries over to the next call)
+	static std::array< LR, MIX_SAMPLES > block;
+	static uint32_t block_used = MIX_SAMPLES; //samples of 'block' already copied out
+	static uint32_t mixed = 0, virtualized = 0; //(from the most recent block)
+	while (samples > 0) {
+		if (block_used == MIX_SAMPLES) {
+			mix_block(block.data(), &mixed, &virtualized);
+			block_used = 0;
+		}
+		uint32_t count = std::min(samples, MIX_SAMPLES - block_used);
+		std::copy(block.begin() + block_used, block.begin() + block_used + count, buffer);
+		block_used += count;
+		buffer += count;
+		samples -= count;
+	}
+
+	record_mix_stats(start, mixed, virtualized);
+}
+
 
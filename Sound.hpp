@@ -2,27 +2,48 @@
 
 #include <glm/glm.hpp>
 
+#include <cstdint>
 #include <memory>
 #include <vector>
 #include <string>
 #include <cmath>
+#include <limits>
 
 //Game audio system. Simplified from f18-base3.
 //Uses 48kHz sampling rate.
+//
+//The play/loop/set_*/stop functions don't block: they push commands onto a
+// single-producer/single-consumer queue that the audio callback drains at
+// the start of every mix. Call them from one thread (the game thread).
 
 namespace Sound {
 
 //Sample objects hold mono (one-channel) audio.
 struct Sample {
+	//how sample data is kept in memory:
+	enum Storage {
+		Resident, //decoded into 'data' up front (best for short effects)
+		Streamed, //decoded a bit at a time during playback, on a background thread (best for long music/ambience; '.opus' only)
+	};
+
 	//Load from a '.wav' or '.opus' file.
 	//  will warn and convert if sound is not already 48kHz mono:
-	Sample(std::string const &filename);
+	Sample(std::string const &filename, Storage storage = Resident);
 	
 	//Directly supply an audio buffer:
 	Sample(std::vector< float > const &data);
 
 	//sample data is stored as 48kHz, mono, floating-point:
+	// (empty for Streamed samples)
 	std::vector< float > data;
+
+	Storage storage = Resident;
+	std::string filename; //file to stream from (Streamed samples only)
+
+	//when more voices are playing than the mix budget allows (see set_max_mixed_voices),
+	// higher priority voices are mixed first, then louder ones; the rest play "virtually"
+	// (their playback position advances, but they aren't heard):
+	int32_t priority = 0;
 };
 
 //Ramp<> manages values that should be smoothly interpolated
@@ -48,9 +69,15 @@ struct Ramp {
 	float ramp = 0.0f;
 };
 
-// 'PlayingSample' objects book-keep samples that are currently playing:
+//maximum number of samples that can play at once:
+constexpr uint32_t MaxVoices = 256;
+
+// 'PlayingSample' is a handle to a sample that is currently playing:
+//  - handles are small values, so copy and keep them freely
+//  - once playback finishes, its voice may be reused by a later play(); older handles notice
+//    this (via the voice's generation count) and quietly ignore further calls
 struct PlayingSample {
-	//change the panning or volume of a playing sample (and do proper locking);
+	//change the panning or volume of a playing sample (queued for the audio thread);
 	// value will change over 'ramp' seconds to avoid creating audible artifacts:
 	void set_volume(float new_volume, float ramp = 1.0f / 60.0f);
 	//set the panning of a sample (use only on samples in "2D" mode; no effect on "3D" samples):
@@ -63,45 +90,44 @@ struct PlayingSample {
 	//'stop' will fade sample out over 'ramp' seconds and then remove it from the active samples:
 	void stop(float ramp = 1.0f / 60.0f);
 
+	//was playback stopped (either by running out of sample, or by stop())?
+	// (also true for empty handles)
+	bool stopped() const;
+
+	//does this handle refer to a voice at all?
+	// (play() returns an empty handle if all MaxVoices voices are busy, or if there is no audio device)
+	explicit operator bool() const { return voice != -1U; }
+
 	//internals:
-	//NOTE: PlayingSample is used in a separate thread; so setting these values directly
-	// may result in bad results. Instead, use the functions above, which perform locking!
-	std::vector< float > const &data; //reference to sample data being played
-	uint32_t i = 0; //next data value to read
-	bool loop = false; //should playback loop after data runs out?
-	bool stopping = false; //is playing stopping?
-	bool stopped = false; //was playback stopped (either by running out of sample, or by stop())?
-
-	Ramp< float > volume = Ramp< float >(1.0f);
-
-	//2D playback panning control: ('NaN' if sound played in 3D mode)
-	Ramp< float > pan = Ramp< float >(std::numeric_limits< float >::quiet_NaN());
-
-	//3D playback panning control: ('NaN' if sound played in 2D mode)
-	Ramp< glm::vec3 > position = Ramp< glm::vec3 >(std::numeric_limits< float >::quiet_NaN());
-	Ramp< float > half_volume_radius = std::numeric_limits< float >::quiet_NaN();
-
-	PlayingSample(Sample const &sample_, float volume_, float pan_, bool loop_)
-		: data(sample_.data), loop(loop_), volume(volume_), pan(pan_) { }
-	PlayingSample(Sample const &sample_, float volume_, glm::vec3 const &position_, float half_volume_radius_, bool loop_)
-		: data(sample_.data), loop(loop_), volume(volume_), position(position_), half_volume_radius(half_volume_radius_) { }
+	uint32_t voice = -1U; //index into the voice pool
+	uint32_t generation = 0; //the voice's generation when this sample started playing
 };
 
 // ------- global functions -------
 
-void init(); //call Sound::init() from main.cpp before using any member functions
+//audio buffer size to ask the device for, in samples; smaller buffers mean sound is heard
+// sooner after play() (256 samples is about 5ms) but the callback runs more often:
+enum Latency : uint32_t {
+	LowLatency = 256,
+	MediumLatency = 512,
+	HighLatency = 1024,
+};
+
+//call Sound::init() from main.cpp before using any member functions:
+// (the device may pick a different buffer size; Sound::get_mix_stats().budget_ms reports the actual one)
+void init(Latency latency = HighLatency);
 
 void shutdown(); //call Sound::shutdown() from main.cpp to gracefully(-ish) exit
 
 //Call 'Sound::play' to play a sample once.
 //  if you hang on to the return value, you can change the panning, volume, or stop playback early.
-std::shared_ptr< PlayingSample > play(
+PlayingSample play(
 	Sample const &sample,
 	float volume = 1.0f,
 	float pan = 0.0f //-1.0f == hard left, 1.0f == hard right
 );
 //The play_3D version will play a sample in '3D' mode (that is, panning determined by listener position):
-std::shared_ptr< PlayingSample > play_3D(
+PlayingSample play_3D(
 	Sample const &sample,
 	float volume,
 	glm::vec3 const &position,
@@ -110,13 +136,13 @@ std::shared_ptr< PlayingSample > play_3D(
 
 //Call 'Sound::loop' to play a sample ~forever~.
 //  if you hang on to the return value, you can change the panning, volume, or stop playback.
-std::shared_ptr< PlayingSample > loop(
+PlayingSample loop(
 	Sample const &sample,
 	float volume = 1.0f,
 	float pan = 0.0f //-1.0f == hard left, 1.0f == hard right
 );
 //The loop_3D version will loop a sample in '3D' mode (that is, panning determined by listener position):
-std::shared_ptr< PlayingSample > loop_3D(
+PlayingSample loop_3D(
 	Sample const &sample,
 	float volume,
 	glm::vec3 const &position,
@@ -133,6 +159,24 @@ struct Listener {
 };
 extern struct Listener listener;
 
+//Many "3D" samples (and the listener) can be moved at once with update_emitters:
+// the whole update goes to the mixer as one message, so every emitter and the listener
+// move together in the same block (rather than being split between two)
+struct EmitterUpdate {
+	PlayingSample sample; //(empty or finished handles are skipped)
+	glm::vec3 position = glm::vec3(0.0f);
+	float half_volume_radius = std::numeric_limits< float >::infinity();
+};
+struct ListenerUpdate {
+	glm::vec3 position = glm::vec3(0.0f);
+	glm::vec3 right = glm::vec3(1.0f, 0.0f, 0.0f);
+};
+//(pass listener_update = nullptr to leave the listener alone)
+void update_emitters(EmitterUpdate const *emitters, size_t count, ListenerUpdate const *listener_update = nullptr, float ramp = 1.0f / 60.0f);
+inline void update_emitters(std::vector< EmitterUpdate > const &emitters, ListenerUpdate const *listener_update = nullptr, float ramp = 1.0f / 60.0f) {
+	update_emitters(emitters.data(), emitters.size(), listener_update, ramp);
+}
+
 //"panic button" to shut off all currently playing sounds:
 void stop_all_samples();
 
@@ -140,9 +184,31 @@ void stop_all_samples();
 void set_volume(float new_volume, float ramp = 1.0f / 60.0f);
 extern Ramp< float > volume;
 
+//voice budget: at most this many voices are actually mixed in each block (default 32);
+// voices beyond the budget -- and any voice quieter than about -60dB -- are virtualized:
+void set_max_mixed_voices(uint32_t count);
+
+//audio callback instrumentation, for tuning voice budgets against real timings:
+// (mix_audio publishes these with atomics, so polling never blocks the callback;
+//  fields are read one at a time, so a snapshot may straddle two callbacks)
+struct MixStats {
+	uint64_t callbacks = 0; //mix_audio calls so far
+	float budget_ms = 0.0f; //how long one block takes to play; each call must finish well within this
+	float mix_ms = 0.0f; //time spent in the most recent call
+	float worst_mix_ms = 0.0f; //longest call over the last MixStatsWindow calls
+	uint32_t active_voices = 0; //voices playing after the most recent call...
+	uint32_t mixed_voices = 0; //...of which this many were mixed in it...
+	uint32_t virtual_voices = 0; //...and this many were only advanced
+	uint32_t overruns = 0; //calls that took longer than budget_ms (the output certainly glitched)
+	uint32_t late_callbacks = 0; //calls that started over half a block later than expected (the device probably ran dry)
+	uint32_t stream_underruns = 0; //blocks in which a Streamed sample's decoder fell behind
+};
+constexpr uint32_t MixStatsWindow = 64; //calls (about 1.4 seconds with HighLatency)
+MixStats get_mix_stats();
+
 //the audio callback doesn't run between Sound::lock() and Sound::unlock()
-// the set_*/stop/play/... functions already use these helpers, so you shouldn't need
-// to call them unless your code is modifying values directly:
+// the set_*/stop/play/... functions don't need these (they go through the command queue);
+// they are only kept for legacy code that modifies values directly:
 void lock();
 void unlock();
 
@@ -0,0 +1,109 @@
+#include "WalkAgents.hpp"
+
+#include "parallel_for.hpp"
+
+#include <glm/gtx/quaternion.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <stdexcept>
+
+//xorshift32, returning a float in [0,1):
+static float random_unit(uint32_t *state) {
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return float(x >> 8) / float(1U << 24);
+}
+
+//make 'forward' perpendicular to 'up' (keeping it unit length):
+static glm::vec3 flatten(glm::vec3 const &forward, glm::vec3 const &up) {
+	glm::vec3 flat = forward - glm::dot(forward, up) * up;
+	float len = glm::length(flat);
+	if (len < 1e-6f) {
+		//(forward was along up; pick any direction perpendicular to up)
+		flat = glm::cross(up, (std::abs(up.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f)));
+		len = glm::length(flat);
+	}
+	return flat / len;
+}
+
+WalkAgents::WalkAgents(WalkMesh const &walkmesh_) : walkmesh(walkmesh_) {
+}
+
+void WalkAgents::spawn(uint32_t count, uint32_t seed) {
+	if (walkmesh.triangles.empty()) throw std::runtime_error("Can't spawn agents on an empty walkmesh.");
+
+	uint32_t random = (seed == 0 ? 1 : seed);
+	agents.reserve(agents.size() + count);
+	for (uint32_t i = 0; i < count; ++i) {
+		Agent &agent = agents.emplace_back();
+
+		//uniformly random point on a random triangle:
+		uint32_t t = std::min(uint32_t(random_unit(&random) * float(walkmesh.triangles.size())), uint32_t(walkmesh.triangles.size()) - 1);
+		float u = random_unit(&random), v = random_unit(&random);
+		if (u + v > 1.0f) {
+			u = 1.0f - u;
+			v = 1.0f - v;
+		}
+		agent.at = WalkPoint(walkmesh.triangles[t], glm::vec3(1.0f - u - v, u, v), t);
+		agent.position = agent.previous_position = walkmesh.to_world_point(agent.at);
+
+		agent.up = walkmesh.to_world_smooth_normal(agent.at);
+		float angle = random_unit(&random) * 2.0f * 3.1415926f;
+		agent.forward = flatten(glm::vec3(std::cos(angle), std::sin(angle), 0.0f), agent.up);
+		agent.speed = 0.8f + 0.8f * random_unit(&random);
+
+		//each agent gets its own random stream:
+		agent.random = random ^ (0x9e3779b9U * (uint32_t(agents.size()) + 1));
+		if (agent.random == 0) agent.random = 1;
+	}
+}
+
+void WalkAgents::update(float tick) {
+	std::atomic< uint32_t > exhausted_count{0};
+
+	parallel_for(agents.size(), grain, [&](size_t begin, size_t end) {
+		uint32_t range_exhausted = 0;
+		for (size_t i = begin; i < end; ++i) {
+			Agent &agent = agents[i];
+
+			//wander -- turn a random amount about the local up direction:
+			float turn = (2.0f * random_unit(&agent.random) - 1.0f) * turn_rate * tick;
+			agent.forward = glm::angleAxis(turn, agent.up) * agent.forward;
+
+			//walk (crossing edges and sliding along walls):
+			glm::vec3 step = agent.forward * (agent.speed * tick);
+			glm::vec3 remain = walkmesh.walk(&agent.at, step);
+			if (remain != glm::vec3(0.0f)) range_exhausted += 1;
+
+			agent.previous_position = agent.position;
+			agent.position = walkmesh.to_world_point(agent.at);
+
+			//walked into a wall (so sliding used up most of the step)? turn away:
+			if (glm::length(agent.position - agent.previous_position) < 0.5f * glm::length(step)) {
+				float away = (0.5f + random_unit(&agent.random)) * 3.1415926f; //(90 to 270 degrees)
+				agent.forward = glm::angleAxis(away, agent.up) * agent.forward;
+			}
+
+			//keep walking along the (new) local surface:
+			agent.up = walkmesh.to_world_smooth_normal(agent.at);
+			agent.forward = flatten(agent.forward, agent.up);
+		}
+		if (range_exhausted) exhausted_count.fetch_add(range_exhausted);
+	});
+
+	exhausted = exhausted_count.load();
+}
+
+void WalkAgents::write_transforms(float alpha) const {
+	for (auto const &agent : agents) {
+		if (!agent.transform) continue;
+		agent.transform->position = glm::mix(agent.previous_position, agent.position, alpha);
+		glm::vec3 right = glm::cross(agent.forward, agent.up);
+		agent.transform->rotation = glm::quat_cast(glm::mat3(right, agent.forward, agent.up));
+	}
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+/*
+ * WalkAgents -- many agents (e.g., NPCs) wandering over a WalkMesh, simulated in parallel.
+ *
+ * update() moves every agent with the same walk / cross-edge / slide loop as the player (WalkMesh::walk),
+ *  running ranges of agents as jobs (see Jobs.hpp, parallel_for.hpp) against the const WalkMesh.
+ *
+ * Results are deterministic:
+ *  - each agent's step depends only on its own state (including its own random number state) and the WalkMesh,
+ *    so it doesn't matter how agents are split between threads or in what order the jobs run
+ *  - jobs only write their own agents; write_transforms() copies the results into Scene::Transforms
+ *    afterward, on the calling thread, in agent order
+ */
+
+#include "WalkMesh.hpp"
+#include "Scene.hpp"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstdint>
+#include <vector>
+
+struct WalkAgents {
+	//'walkmesh' must outlive the agents:
+	WalkAgents(WalkMesh const &walkmesh);
+
+	WalkMesh const &walkmesh;
+
+	struct Agent {
+		WalkPoint at;
+		//world position after the previous and latest update():
+		glm::vec3 previous_position = glm::vec3(0.0f);
+		glm::vec3 position = glm::vec3(0.0f);
+		glm::vec3 forward = glm::vec3(0.0f, 1.0f, 0.0f); //walking direction (unit, perpendicular to 'up')
+		glm::vec3 up = glm::vec3(0.0f, 0.0f, 1.0f); //smoothed walkmesh normal at 'at'
+		float speed = 1.0f; //units per second
+		uint32_t random = 1; //xorshift32 state (never zero)
+		//(optional) gets the agent's position and orientation from write_transforms():
+		// (+y is forward, +z is up, like the player's transform)
+		Scene::Transform *transform = nullptr;
+	};
+	std::vector< Agent > agents;
+
+	//add 'count' agents at random points on the walkmesh, walking in random directions:
+	// (the same seed gives the same agents)
+	void spawn(uint32_t count, uint32_t seed);
+
+	//move all agents by one tick (in parallel):
+	void update(float tick);
+
+	//set agents' transforms, with positions between the last two updates ('alpha' in [0,1], as from Mode::update_frame):
+	void write_transforms(float alpha) const;
+
+	//tuning:
+	size_t grain = 64; //agents per job
+	float turn_rate = 2.0f; //most an agent turns while wandering, in radians per second
+
+	//from the last update(): agents that used their whole WalkMesh::walk iteration budget:
+	uint32_t exhausted = 0;
+};
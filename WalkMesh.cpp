@@ -1,28 +1,66 @@
 #include "WalkMesh.hpp"
 
 #include "read_write_chunk.hpp"
+#include "Level.hpp"
 
 #include <glm/gtx/norm.hpp>
 #include <glm/gtx/string_cast.hpp>
 
 #include <iostream>
-#include <fstream>
 #include <algorithm>
+#include <array>
+#include <limits>
 #include <string>
+#include <cstring>
 
-WalkMesh::WalkMesh(std::vector< glm::vec3 > const &vertices_, std::vector< glm::vec3 > const &normals_, std::vector< glm::uvec3 > const &triangles_)
-	: vertices(vertices_), normals(normals_), triangles(triangles_) {
-
-	//construct next_vertex map (maps each edge to the next vertex in the triangle):
-	next_vertex.reserve(triangles.size()*3);
-	auto do_next = [this](uint32_t a, uint32_t b, uint32_t c) {
-		auto ret = next_vertex.insert(std::make_pair(glm::uvec2(a,b), c));
-		assert(ret.second);
+WalkMesh::WalkMesh(std::vector< glm::vec3 > const &vertices_, std::vector< glm::vec3 > const &normals_, std::vector< glm::uvec3 > const &triangles_, std::vector< uint32_t > const &twins_, bool cache_geometry) {
+	//copy data into storage owned by this mesh:
+	struct Owned {
+		std::vector< glm::vec3 > vertices;
+		std::vector< glm::vec3 > normals;
+		std::vector< glm::uvec3 > triangles;
 	};
-	for (auto const &tri : triangles) {
-		do_next(tri.x, tri.y, tri.z);
-		do_next(tri.y, tri.z, tri.x);
-		do_next(tri.z, tri.x, tri.y);
+	auto owned = std::make_shared< Owned >(Owned{vertices_, normals_, triangles_});
+	vertices = owned->vertices;
+	normals = owned->normals;
+	triangles = owned->triangles;
+	storage = owned;
+
+	build(twins_, cache_geometry);
+}
+
+WalkMesh::WalkMesh(std::shared_ptr< void const > storage_, ChunkView< glm::vec3 const > vertices_, ChunkView< glm::vec3 const > normals_, ChunkView< glm::uvec3 const > triangles_, std::vector< uint32_t > const &twins_, bool cache_geometry)
+	: vertices(vertices_), normals(normals_), triangles(triangles_), storage(std::move(storage_)) {
+	build(twins_, cache_geometry);
+}
+
+void WalkMesh::build(std::vector< uint32_t > const &twins_, bool cache_geometry) {
+	twins = twins_;
+
+	if (vertices.size() != normals.size()) {
+		throw std::runtime_error("WalkMesh has " + std::to_string(vertices.size()) + " vertices but " + std::to_string(normals.size()) + " normals.");
+	}
+
+	if (twins.empty()) {
+		//construct adjacency (maps each edge to the matching reversed edge in a neighboring triangle):
+		twins = build_twins(triangles);
+	} else {
+		//check supplied adjacency:
+		if (twins.size() != triangles.size() * 3) {
+			throw std::runtime_error("WalkMesh adjacency has " + std::to_string(twins.size()) + " entries for " + std::to_string(triangles.size()) + " triangles.");
+		}
+		for (uint32_t h = 0; h < twins.size(); ++h) {
+			if (twins[h] == -1U) continue;
+			uint32_t o = twins[h];
+			if (o >= twins.size() || twins[o] != h) {
+				throw std::runtime_error("WalkMesh adjacency is not symmetric.");
+			}
+			glm::uvec3 const &tri = triangles[h / 3];
+			glm::uvec3 const &other = triangles[o / 3];
+			if (tri[h % 3] != other[(o % 3 + 1) % 3] || tri[(h % 3 + 1) % 3] != other[o % 3]) {
+				throw std::runtime_error("WalkMesh adjacency does not match triangle edges.");
+			}
+		}
 	}
 
 	//DEBUG: are vertex normals consistent with geometric normals?
@@ -42,6 +80,189 @@ WalkMesh::WalkMesh(std::vector< glm::vec3 > const &vertices_, std::vector< glm::
 
 		assert(da > 0.0f && db > 0.0f && dc > 0.0f);
 	}
+
+	//build bounding volume hierarchy over triangles:
+	// (top-down, splitting each node at the median centroid along its longest axis)
+	if (!triangles.empty()) {
+		constexpr uint32_t LeafSize = 4; //max triangles per leaf
+
+		std::vector< glm::vec3 > centroids;
+		centroids.reserve(triangles.size());
+		bvh_triangles.reserve(triangles.size());
+		for (auto const &tri : triangles) {
+			centroids.emplace_back((vertices[tri.x] + vertices[tri.y] + vertices[tri.z]) / 3.0f);
+			bvh_triangles.emplace_back(uint32_t(bvh_triangles.size()));
+		}
+
+		bvh_nodes.reserve(2 * (triangles.size() / LeafSize + 1));
+		bvh_nodes.emplace_back();
+		bvh_nodes[0].first = 0;
+		bvh_nodes[0].count = uint32_t(triangles.size());
+
+		//nodes are split in the order they are created (so children are always after their parents):
+		for (uint32_t n = 0; n < bvh_nodes.size(); ++n) {
+			uint32_t first = bvh_nodes[n].first;
+			uint32_t count = bvh_nodes[n].count;
+
+			//compute node bounds (and bounds of triangle centroids, used to pick a split axis):
+			glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+			glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+			glm::vec3 centroid_min = min;
+			glm::vec3 centroid_max = max;
+			for (uint32_t i = first; i < first + count; ++i) {
+				glm::uvec3 const &tri = triangles[bvh_triangles[i]];
+				min = glm::min(min, glm::min(vertices[tri.x], glm::min(vertices[tri.y], vertices[tri.z])));
+				max = glm::max(max, glm::max(vertices[tri.x], glm::max(vertices[tri.y], vertices[tri.z])));
+				centroid_min = glm::min(centroid_min, centroids[bvh_triangles[i]]);
+				centroid_max = glm::max(centroid_max, centroids[bvh_triangles[i]]);
+			}
+			bvh_nodes[n].min = min;
+			bvh_nodes[n].max = max;
+
+			if (count <= LeafSize) continue; //small enough to be a leaf
+
+			glm::vec3 extent = centroid_max - centroid_min;
+			uint32_t axis = 0;
+			if (extent.y > extent[axis]) axis = 1;
+			if (extent.z > extent[axis]) axis = 2;
+
+			//partition triangles around the median centroid:
+			uint32_t half = count / 2;
+			std::nth_element(bvh_triangles.begin() + first, bvh_triangles.begin() + first + half, bvh_triangles.begin() + first + count,
+				[&centroids, axis](uint32_t a, uint32_t b) {
+					return centroids[a][axis] < centroids[b][axis];
+				}
+			);
+
+			//make this node interior, pointing to two new children:
+			bvh_nodes[n].first = uint32_t(bvh_nodes.size());
+			bvh_nodes[n].count = 0;
+
+			bvh_nodes.emplace_back();
+			bvh_nodes.back().first = first;
+			bvh_nodes.back().count = half;
+
+			bvh_nodes.emplace_back();
+			bvh_nodes.back().first = first + half;
+			bvh_nodes.back().count = count - half;
+		}
+	}
+
+	if (cache_geometry) {
+		//precompute per-triangle values used when walking:
+		cache.v0.reserve(triangles.size());
+		cache.v1.reserve(triangles.size());
+		cache.gram.reserve(triangles.size());
+		cache.inv_denom.reserve(triangles.size());
+		cache.normal.reserve(triangles.size());
+		cache.edge_inward.reserve(3 * triangles.size());
+		for (auto const &tri : triangles) {
+			glm::vec3 const &a = vertices[tri.x];
+			glm::vec3 const &b = vertices[tri.y];
+			glm::vec3 const &c = vertices[tri.z];
+			glm::vec3 v0 = b - a;
+			glm::vec3 v1 = c - a;
+			glm::vec3 gram = glm::vec3(glm::dot(v0, v0), glm::dot(v0, v1), glm::dot(v1, v1));
+			glm::vec3 normal = glm::normalize(glm::cross(v0, v1));
+			cache.v0.emplace_back(v0);
+			cache.v1.emplace_back(v1);
+			cache.gram.emplace_back(gram);
+			cache.inv_denom.emplace_back(1.0f / (gram.x * gram.z - gram.y * gram.y));
+			cache.normal.emplace_back(normal);
+			for (uint32_t e = 0; e < 3; ++e) {
+				glm::vec3 along = glm::normalize(vertices[tri[(e+1)%3]] - vertices[tri[e]]);
+				cache.edge_inward.emplace_back(glm::cross(normal, along));
+			}
+		}
+
+		//rotations between neighboring triangles (needs all normals, so done in a second pass):
+		cache.twin_rotation.reserve(twins.size());
+		for (uint32_t h = 0; h < twins.size(); ++h) {
+			if (twins[h] == -1U) {
+				cache.twin_rotation.emplace_back(1.0f, 0.0f, 0.0f, 0.0f);
+			} else {
+				cache.twin_rotation.emplace_back(glm::rotation(cache.normal[h / 3], cache.normal[twins[h] / 3]));
+			}
+		}
+	}
+}
+
+std::vector< uint32_t > WalkMesh::build_twins(ChunkView< glm::uvec3 const > triangles) {
+	std::vector< uint32_t > twins(triangles.size() * 3, -1U);
+
+	//sort all edges by (smaller vertex, larger vertex) so that an edge and its twin end up next to each other:
+	struct Edge {
+		uint32_t lo, hi;
+		uint32_t index; //3*t+e
+	};
+	std::vector< Edge > edges;
+	edges.reserve(triangles.size() * 3);
+	for (uint32_t t = 0; t < triangles.size(); ++t) {
+		for (uint32_t e = 0; e < 3; ++e) {
+			uint32_t a = triangles[t][e];
+			uint32_t b = triangles[t][(e+1)%3];
+			edges.emplace_back(Edge{std::min(a,b), std::max(a,b), 3*t+e});
+		}
+	}
+	std::sort(edges.begin(), edges.end(), [](Edge const &a, Edge const &b) {
+		if (a.lo != b.lo) return a.lo < b.lo;
+		if (a.hi != b.hi) return a.hi < b.hi;
+		return a.index < b.index;
+	});
+
+	for (uint32_t i = 0; i + 1 < edges.size(); ++i) {
+		Edge const &a = edges[i];
+		Edge const &b = edges[i+1];
+		if (a.lo != b.lo || a.hi != b.hi) continue;
+		//walkmeshes are manifold, so each edge has at most one (oppositely oriented) twin:
+		assert((i + 2 >= edges.size() || edges[i+2].lo != a.lo || edges[i+2].hi != a.hi) && "walkmesh edge is shared by more than two triangles");
+		assert(triangles[a.index / 3][a.index % 3] == triangles[b.index / 3][(b.index % 3 + 1) % 3] && "walkmesh triangles are not consistently oriented");
+		twins[a.index] = b.index;
+		twins[b.index] = a.index;
+		++i;
+	}
+
+	return twins;
+}
+
+uint32_t WalkMesh::triangle_index(WalkPoint const &wp) const {
+	if (wp.triangle != -1U) {
+		assert(wp.triangle < triangles.size());
+		return wp.triangle;
+	}
+
+	//is triangle t (some rotation of) wp.indices?
+	auto matches = [this, &wp](uint32_t t) {
+		glm::uvec3 const &tri = triangles[t];
+		return (tri == wp.indices)
+		    || (tri == glm::uvec3(wp.indices.z, wp.indices.x, wp.indices.y))
+		    || (tri == glm::uvec3(wp.indices.y, wp.indices.z, wp.indices.x));
+	};
+
+	//the triangle's centroid is inside its bounding box, so only visit bvh nodes containing it:
+	glm::vec3 centroid = (vertices[wp.indices.x] + vertices[wp.indices.y] + vertices[wp.indices.z]) / 3.0f;
+	uint32_t stack[64];
+	uint32_t stack_size = 0;
+	if (!bvh_nodes.empty()) stack[stack_size++] = 0;
+	while (stack_size > 0) {
+		BVHNode const &node = bvh_nodes[stack[--stack_size]];
+		if (glm::any(glm::lessThan(centroid, node.min)) || glm::any(glm::greaterThan(centroid, node.max))) continue;
+		if (node.count != 0) {
+			for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+				if (matches(bvh_triangles[i])) return bvh_triangles[i];
+			}
+		} else {
+			assert(stack_size + 2 <= sizeof(stack) / sizeof(stack[0]));
+			stack[stack_size++] = node.first;
+			stack[stack_size++] = node.first + 1;
+		}
+	}
+
+	//(fall back to a linear search, just in case rounding put the centroid outside a box)
+	for (uint32_t t = 0; t < triangles.size(); ++t) {
+		if (matches(t)) return t;
+	}
+	throw std::runtime_error("WalkPoint is not on a triangle of this WalkMesh.");
 }
 
 //project pt to the plane of triangle a,b,c and return the barycentric weights of the projected point:
@@ -61,14 +282,23 @@ glm::vec3 barycentric_weights(glm::vec3 const &a, glm::vec3 const &b, glm::vec3
 	return glm::vec3(u, v, w);
 }
 
+//squared distance from pt to the axis-aligned box [min,max] (zero if inside):
+static float box_distance2(glm::vec3 const &min, glm::vec3 const &max, glm::vec3 const &pt) {
+	glm::vec3 outside = glm::max(min - pt, glm::max(glm::vec3(0.0f), pt - max));
+	return glm::length2(outside);
+}
+
 WalkPoint WalkMesh::nearest_walk_point(glm::vec3 const &world_point) const {
 	assert(!triangles.empty() && "Cannot start on an empty walkmesh");
+	assert(!bvh_nodes.empty());
 
 	WalkPoint closest;
 	float closest_dis2 = std::numeric_limits< float >::infinity();
 
-	for (auto const &tri : triangles) {
+	//check a single triangle, updating closest if any point on it is closer:
+	auto check_triangle = [&world_point, &closest, &closest_dis2, this](uint32_t ti) {
 		//find closest point on triangle:
+		glm::uvec3 const &tri = triangles[ti];
 
 		glm::vec3 const &a = vertices[tri.x];
 		glm::vec3 const &b = vertices[tri.y];
@@ -85,10 +315,11 @@ WalkPoint WalkMesh::nearest_walk_point(glm::vec3 const &world_point) const {
 				closest_dis2 = dis2;
 				closest.indices = tri;
 				closest.weights = coords;
+				closest.triangle = ti;
 			}
 		} else {
 			//check triangle vertices and edges:
-			auto check_edge = [&world_point, &closest, &closest_dis2, this](uint32_t ai, uint32_t bi, uint32_t ci) {
+			auto check_edge = [&world_point, &closest, &closest_dis2, ti, this](uint32_t ai, uint32_t bi, uint32_t ci) {
 				glm::vec3 const &a = vertices[ai];
 				glm::vec3 const &b = vertices[bi];
 
@@ -114,13 +345,44 @@ WalkPoint WalkMesh::nearest_walk_point(glm::vec3 const &world_point) const {
 					closest_dis2 = dis2;
 					closest.indices = glm::uvec3(ai, bi, ci);
 					closest.weights = coords;
+					closest.triangle = ti;
 				}
 			};
 			check_edge(tri.x, tri.y, tri.z);
 			check_edge(tri.y, tri.z, tri.x);
 			check_edge(tri.z, tri.x, tri.y);
 		}
+	};
+
+	//walk the bvh, nearest child first, skipping any node that can't contain a closer point:
+	// (depth is O(log n), so a small fixed-size stack suffices)
+	uint32_t stack[64];
+	uint32_t stack_size = 0;
+	stack[stack_size++] = 0;
+	while (stack_size > 0) {
+		BVHNode const &node = bvh_nodes[stack[--stack_size]];
+		if (box_distance2(node.min, node.max, world_point) >= closest_dis2) continue;
+
+		if (node.count != 0) {
+			//leaf: check contained triangles
+			for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+				check_triangle(bvh_triangles[i]);
+			}
+		} else {
+			//interior: push farther child first so nearer child is visited first
+			BVHNode const &a = bvh_nodes[node.first];
+			BVHNode const &b = bvh_nodes[node.first + 1];
+			assert(stack_size + 2 <= sizeof(stack) / sizeof(stack[0]));
+			if (box_distance2(a.min, a.max, world_point) < box_distance2(b.min, b.max, world_point)) {
+				stack[stack_size++] = node.first + 1;
+				stack[stack_size++] = node.first;
+			} else {
+				stack[stack_size++] = node.first;
+				stack[stack_size++] = node.first + 1;
+			}
+		}
 	}
+
 	assert(closest.indices.x < vertices.size());
 	assert(closest.indices.y < vertices.size());
 	assert(closest.indices.z < vertices.size());
@@ -128,42 +390,13 @@ WalkPoint WalkMesh::nearest_walk_point(glm::vec3 const &world_point) const {
 }
 
 
-void WalkMesh::walk_in_triangle(WalkPoint const &start, glm::vec3 const &step, WalkPoint *end_, float *time_) const {
-	// adopted from @stroucki's code in class demo
-	assert(end_);
+//(used by walk_in_triangle and walk_batch) store a step's end point, keeping the convention that points on edges have weights.z == 0:
+// (min_coord is the coordinate that reached zero, or -1U if the step ended inside the triangle)
+static inline void arrange_end(WalkPoint const &start, uint32_t triangle, glm::vec3 const &weights, uint32_t min_coord, WalkPoint *end_) {
 	auto &end = *end_;
 
-	assert(time_);
-	auto &time = *time_;
-
-	glm::vec3 const &a = vertices[start.indices.x];
-	glm::vec3 const &b = vertices[start.indices.y];
-	glm::vec3 const &c = vertices[start.indices.z];
-
-	// project destination point onto barycentric coordinate
-	glm::vec3 dest = to_world_point(start) + step;
-	glm::vec3 dest_bary = barycentric_weights(a, b, c, dest);
-	float min_time = std::numeric_limits<float>::infinity();
-	unsigned int min_coord = -1U;
-	
-	// check if any edge is crossed, and keep track of the first cross
-	auto cross_on_edge = [&min_time, &min_coord](const unsigned int coord, const float dest_w, const float start_w) {
-		if (dest_w > 0.0f) return;
-		float time = -start_w / (dest_w - start_w);
-		if (time < min_time) {
-			min_time = time;
-			min_coord = coord;
-		}
-	};
-
-	cross_on_edge(0, dest_bary.x, start.weights.x);
-	cross_on_edge(1, dest_bary.y, start.weights.y);
-	cross_on_edge(2, dest_bary.z, start.weights.z);
-
-	time = std::min(1.0f, min_time);
-	// std::cout << time << "\n";
-	assert(time > 0.0f);
-	glm::vec3 weights = start.weights + time * (dest_bary - start.weights);
+	//stays on the same triangle (only the rotation of the indices may change):
+	end.triangle = triangle;
 
 	// keep convention
 	switch(min_coord) {
@@ -195,6 +428,65 @@ void WalkMesh::walk_in_triangle(WalkPoint const &start, glm::vec3 const &step, W
 	}
 }
 
+void WalkMesh::walk_in_triangle(WalkPoint const &start, glm::vec3 const &step, WalkPoint *end_, float *time_) const {
+	// adopted from @stroucki's code in class demo
+	assert(end_);
+	auto &end = *end_;
+
+	assert(time_);
+	auto &time = *time_;
+
+	uint32_t triangle = triangle_index(start);
+
+	glm::vec3 dest_bary;
+	if (!cache.inv_denom.empty()) {
+		//barycentric weights are affine in position, so the step can be converted directly into a change in weights
+		// using the cached Gram matrix of the triangle's stored (canonical) vertex order:
+		glm::vec3 const &gram = cache.gram[triangle];
+		float inv_denom = cache.inv_denom[triangle];
+		float d20 = glm::dot(step, cache.v0[triangle]);
+		float d21 = glm::dot(step, cache.v1[triangle]);
+		float dv = (gram.z * d20 - gram.y * d21) * inv_denom;
+		float dw = (gram.x * d21 - gram.y * d20) * inv_denom;
+		glm::vec3 delta = glm::vec3(-dv - dw, dv, dw);
+
+		//rotate from canonical order to start.indices order:
+		uint32_t r = triangle_rotation(start, triangle);
+		dest_bary = start.weights + glm::vec3(delta[r], delta[(r+1)%3], delta[(r+2)%3]);
+	} else {
+		glm::vec3 const &a = vertices[start.indices.x];
+		glm::vec3 const &b = vertices[start.indices.y];
+		glm::vec3 const &c = vertices[start.indices.z];
+
+		// project destination point onto barycentric coordinate
+		glm::vec3 dest = to_world_point(start) + step;
+		dest_bary = barycentric_weights(a, b, c, dest);
+	}
+	float min_time = std::numeric_limits<float>::infinity();
+	unsigned int min_coord = -1U;
+	
+	// check if any edge is crossed, and keep track of the first cross
+	auto cross_on_edge = [&min_time, &min_coord](const unsigned int coord, const float dest_w, const float start_w) {
+		if (dest_w > 0.0f) return;
+		float time = -start_w / (dest_w - start_w);
+		if (time < min_time) {
+			min_time = time;
+			min_coord = coord;
+		}
+	};
+
+	cross_on_edge(0, dest_bary.x, start.weights.x);
+	cross_on_edge(1, dest_bary.y, start.weights.y);
+	cross_on_edge(2, dest_bary.z, start.weights.z);
+
+	time = std::min(1.0f, min_time);
+	// std::cout << time << "\n";
+	assert(time > 0.0f);
+	glm::vec3 weights = start.weights + time * (dest_bary - start.weights);
+
+	arrange_end(start, triangle, weights, min_coord, &end);
+}
+
 bool WalkMesh::cross_edge(WalkPoint const &start, WalkPoint *end_, glm::quat *rotation_) const {
 	assert(end_);
 	auto &end = *end_;
@@ -205,57 +497,722 @@ bool WalkMesh::cross_edge(WalkPoint const &start, WalkPoint *end_, glm::quat *ro
 	assert(start.weights.z == 0.0f); //*must* be on an edge.
 
 	// try to find the twin triangle
-	glm::uvec3 twin_triangle;
-	auto f = next_vertex.find(glm::uvec2(start.indices.y, start.indices.x));
-	if (f != next_vertex.end()) {
-		twin_triangle = glm::uvec3(start.indices.y, start.indices.x, f->second);
-	} else {
-		twin_triangle = glm::uvec3(-1U);
-	}
+	uint32_t triangle = triangle_index(start);
+	glm::uvec3 const &tri = triangles[triangle];
+	//which edge of the triangle is start.indices.xy on?
+	uint32_t edge = triangle_rotation(start, triangle);
+	assert(tri[edge] == start.indices.x && tri[(edge+1)%3] == start.indices.y);
+
+	uint32_t twin = twins[3*triangle + edge];
 
 	//check if 'edge' is a non-boundary edge:
-	if (twin_triangle.x != -1U) {
+	if (twin != -1U) {
 		//it is!
 
-		//make 'end' represent the same (world) point, but on triangle (edge.y, edge.x, [other point]):
-		end.indices = twin_triangle;
-		glm::vec3 const &a = vertices[twin_triangle[0]]; 
-		glm::vec3 const &b = vertices[twin_triangle[1]]; 
-		glm::vec3 const &c = vertices[twin_triangle[2]]; 
-		end.weights = barycentric_weights(a, b, c, to_world_point(start));
+		//rotate twin so that it starts with edge (start.indices.y, start.indices.x):
+		glm::uvec3 const &other = triangles[twin / 3];
+		uint32_t e = twin % 3;
+		glm::uvec3 twin_triangle = glm::uvec3(other[e], other[(e+1)%3], other[(e+2)%3]);
+		assert(twin_triangle.x == start.indices.y && twin_triangle.y == start.indices.x);
 
 		//make 'rotation' the rotation that takes (start.indices)'s normal to (end.indices)'s normal:
-		// compute normal from new triangle
-		glm::vec3 new_norm = glm::normalize(glm::cross(b-a, c-a));
-		// normal from old triangle
-		glm::vec3 const &a0 = vertices[start.indices[0]]; 
-		glm::vec3 const &b0 = vertices[start.indices[1]]; 
-		glm::vec3 const &c0 = vertices[start.indices[2]];
-		glm::vec3 old_norm = glm::normalize(glm::cross(b0-a0, c0-a0));
-		rotation = glm::rotation(old_norm, new_norm);
+		if (!cache.twin_rotation.empty()) {
+			rotation = cache.twin_rotation[3*triangle + edge];
+		} else {
+			// compute normal from new triangle
+			glm::vec3 const &a = vertices[twin_triangle[0]];
+			glm::vec3 const &b = vertices[twin_triangle[1]];
+			glm::vec3 const &c = vertices[twin_triangle[2]];
+			glm::vec3 new_norm = glm::normalize(glm::cross(b-a, c-a));
+			// normal from old triangle
+			glm::vec3 const &a0 = vertices[start.indices[0]];
+			glm::vec3 const &b0 = vertices[start.indices[1]];
+			glm::vec3 const &c0 = vertices[start.indices[2]];
+			glm::vec3 old_norm = glm::normalize(glm::cross(b0-a0, c0-a0));
+			rotation = glm::rotation(old_norm, new_norm);
+		}
+
+		//make 'end' represent the same (world) point, but on triangle (edge.y, edge.x, [other point]):
+		// (the point is on the shared edge, so its weights are just the edge weights swapped)
+		glm::vec3 weights = glm::vec3(start.weights.y, start.weights.x, 0.0f);
+		end.indices = twin_triangle;
+		end.weights = weights;
+		end.triangle = twin / 3;
 		return true;
 	} else {
 		end = start;
+		end.triangle = triangle;
 		rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
 		return false;
 	}
 }
 
+glm::vec3 WalkMesh::edge_inward(WalkPoint const &wp) const {
+	uint32_t triangle = triangle_index(wp);
+	if (!cache.edge_inward.empty()) {
+		return cache.edge_inward[3*triangle + triangle_rotation(wp, triangle)];
+	}
+	glm::vec3 const &a = vertices[wp.indices.x];
+	glm::vec3 const &b = vertices[wp.indices.y];
+	glm::vec3 const &c = vertices[wp.indices.z];
+	glm::vec3 along = glm::normalize(b-a);
+	glm::vec3 normal = glm::normalize(glm::cross(b-a, c-a));
+	return glm::cross(normal, along);
+}
+
+
+//(used by walk and walk_batch) after a step stopped on edge at.indices.xy with 'remain' left, cross the edge or bounce off it:
+static void leave_edge(WalkMesh const &mesh, WalkPoint *at_, glm::vec3 *remain_) {
+	auto &at = *at_;
+	auto &remain = *remain_;
+
+	//try to step over edge:
+	WalkPoint end;
+	glm::quat rotation;
+	if (mesh.cross_edge(at, &end, &rotation)) {
+		//stepped to a new triangle:
+		at = end;
+		//rotate step to follow surface:
+		remain = rotation * remain;
+	} else {
+		//ran into a wall, bounce / slide along it:
+		glm::vec3 in = mesh.edge_inward(at);
+
+		//check how much 'remain' is pointing out of the triangle:
+		float d = glm::dot(remain, in);
+		if (d < 0.0f) {
+			//bounce off of the wall:
+			remain += (-1.25f * d) * in;
+		} else {
+			//if it's just pointing along the edge, bend slightly away from wall:
+			remain += 0.01f * d * in;
+		}
+	}
+}
+
+//(used by walk_batch and line_of_sight_batch) in-triangle steps for a packet of walkpoints, taken in lock-step:
+// gather() packs a walkpoint's cached triangle geometry into a lane, step() then runs walk_in_triangle's arithmetic,
+// in the same order (so results match it exactly), over the first 'count' lanes in one branch-free pass:
+struct StepPacket {
+	static constexpr uint32_t Size = 32;
+
+	uint32_t triangle[Size], rotation[Size];
+	float wx[Size], wy[Size], wz[Size]; //start weights
+	float d20[Size], d21[Size]; //step dotted with the triangle's edge vectors
+	float gx[Size], gy[Size], gz[Size], inv_denom[Size]; //the triangle's Gram matrix
+	float time[Size];
+	uint32_t coord[Size]; //coordinate that reached zero (-1U if none)
+	float ex[Size], ey[Size], ez[Size]; //end weights
+
+	void gather(WalkMesh const &mesh, uint32_t k, WalkPoint const &at, glm::vec3 const &step) {
+		assert(k < Size);
+		assert(!mesh.cache.inv_denom.empty());
+		uint32_t t = mesh.triangle_index(at);
+		triangle[k] = t;
+		rotation[k] = mesh.triangle_rotation(at, t);
+		wx[k] = at.weights.x;
+		wy[k] = at.weights.y;
+		wz[k] = at.weights.z;
+		d20[k] = glm::dot(step, mesh.cache.v0[t]);
+		d21[k] = glm::dot(step, mesh.cache.v1[t]);
+		gx[k] = mesh.cache.gram[t].x;
+		gy[k] = mesh.cache.gram[t].y;
+		gz[k] = mesh.cache.gram[t].z;
+		inv_denom[k] = mesh.cache.inv_denom[t];
+	}
+
+	void step(uint32_t count) {
+		constexpr float Infinity = std::numeric_limits< float >::infinity();
+		for (uint32_t k = 0; k < count; ++k) {
+			float dv = (gz[k] * d20[k] - gy[k] * d21[k]) * inv_denom[k];
+			float dw = (gx[k] * d21[k] - gy[k] * d20[k]) * inv_denom[k];
+			float du = -dv - dw;
+			//rotate from canonical order to the walkpoint's:
+			uint32_t r = rotation[k];
+			float bx = wx[k] + (r == 0 ? du : (r == 1 ? dv : dw));
+			float by = wy[k] + (r == 0 ? dv : (r == 1 ? dw : du));
+			float bz = wz[k] + (r == 0 ? dw : (r == 1 ? du : dv));
+			//first coordinate to reach zero (ties go to the lower coordinate, as in walk_in_triangle):
+			float tx = (bx > 0.0f ? Infinity : -wx[k] / (bx - wx[k]));
+			float ty = (by > 0.0f ? Infinity : -wy[k] / (by - wy[k]));
+			float tz = (bz > 0.0f ? Infinity : -wz[k] / (bz - wz[k]));
+			float min_time = Infinity;
+			uint32_t min_coord = -1U;
+			min_coord = (tx < min_time ? 0 : min_coord);
+			min_time = (tx < min_time ? tx : min_time);
+			min_coord = (ty < min_time ? 1 : min_coord);
+			min_time = (ty < min_time ? ty : min_time);
+			min_coord = (tz < min_time ? 2 : min_coord);
+			min_time = (tz < min_time ? tz : min_time);
+			float t = std::min(1.0f, min_time);
+			time[k] = t;
+			coord[k] = min_coord;
+			ex[k] = wx[k] + t * (bx - wx[k]);
+			ey[k] = wy[k] + t * (by - wy[k]);
+			ez[k] = wz[k] + t * (bz - wz[k]);
+		}
+	}
+
+	//where lane k's step (from 'start', as gathered) ended, as walk_in_triangle's *end:
+	void end(uint32_t k, WalkPoint const &start, WalkPoint *end_) const {
+		assert(time[k] > 0.0f);
+		arrange_end(start, triangle[k], glm::vec3(ex[k], ey[k], ez[k]), coord[k], end_);
+	}
+};
+
+glm::vec3 WalkMesh::walk(WalkPoint *at_, glm::vec3 remain, uint32_t max_iterations) const {
+	assert(at_);
+	auto &at = *at_;
+
+	for (uint32_t iter = 0; iter < max_iterations; ++iter) {
+		if (remain == glm::vec3(0.0f)) break;
+		WalkPoint end;
+		float time;
+		walk_in_triangle(at, remain, &end, &time);
+		at = end;
+		if (time == 1.0f) {
+			//finished within triangle:
+			return glm::vec3(0.0f);
+		}
+		//some step remains:
+		remain *= (1.0f - time);
+		leave_edge(*this, &at, &remain);
+	}
+
+	return remain;
+}
+
+size_t WalkMesh::walk_batch(size_t count, WalkPoint *ats, glm::vec3 const *steps, glm::vec3 *remains, uint32_t max_iterations) const {
+	assert(count == 0 || (ats && steps));
+
+	//the lock-step pass below needs the cached per-triangle geometry; without it, walk agents one at a time:
+	if (cache.inv_denom.empty()) {
+		size_t unfinished = 0;
+		for (size_t i = 0; i < count; ++i) {
+			glm::vec3 remain = walk(&ats[i], steps[i], max_iterations);
+			if (remain != glm::vec3(0.0f)) ++unfinished;
+			if (remains) remains[i] = remain;
+		}
+		return unfinished;
+	}
+
+	//agents are walked in packets of up to 32. Each iteration, every agent still walking in the packet:
+	// - gathers its triangle's cached geometry into the packet's per-lane arrays,
+	// - takes its in-triangle step in lock-step with the others (see StepPacket; results match walk() exactly),
+	// - then, on its own, stops, or crosses or bounces off the edge it reached (as walk() does):
+	constexpr uint32_t PacketSize = StepPacket::Size;
+	StepPacket packet;
+
+	size_t unfinished = 0;
+	for (size_t first = 0; first < count; first += PacketSize) {
+		uint32_t size = uint32_t(std::min< size_t >(PacketSize, count - first));
+		WalkPoint *at = ats + first;
+
+		glm::vec3 remain[PacketSize];
+		uint32_t lanes[PacketSize]; //agents (in this packet) still walking
+		uint32_t lane_count = 0;
+		for (uint32_t a = 0; a < size; ++a) {
+			remain[a] = steps[first + a];
+			lanes[lane_count++] = a;
+		}
+
+		for (uint32_t iter = 0; iter < max_iterations && lane_count > 0; ++iter) {
+			//gather (agents with nothing left to walk are done, as in walk()):
+			uint32_t n = 0;
+			for (uint32_t k = 0; k < lane_count; ++k) {
+				uint32_t a = lanes[k];
+				if (remain[a] == glm::vec3(0.0f)) continue;
+				lanes[n] = a;
+				packet.gather(*this, n, at[a], remain[a]);
+				n += 1;
+			}
+			lane_count = n;
+
+			packet.step(lane_count);
+
+			//finish, or cross / bounce (agents diverge here, so one at a time):
+			n = 0;
+			for (uint32_t k = 0; k < lane_count; ++k) {
+				uint32_t a = lanes[k];
+				WalkPoint end;
+				packet.end(k, at[a], &end);
+				at[a] = end;
+				if (packet.time[k] == 1.0f) {
+					remain[a] = glm::vec3(0.0f);
+					continue;
+				}
+				remain[a] *= (1.0f - packet.time[k]);
+				leave_edge(*this, &at[a], &remain[a]);
+				lanes[n++] = a;
+			}
+			lane_count = n;
+		}
+
+		for (uint32_t a = 0; a < size; ++a) {
+			if (remain[a] != glm::vec3(0.0f)) ++unfinished;
+			if (remains) remains[first + a] = remain[a];
+		}
+	}
+	return unfinished;
+}
+
+//(used by line_of_sight and line_of_sight_batch) get 'at' ready for a step along 'remain':
+// walk_in_triangle can't step out of (or along) the boundary of the triangle it starts in, so:
+// - if 'at' is on a vertex, move it to the triangle around that vertex whose corner the line heads into
+//   (starts on vertices are common -- e.g., WalkMeshNavigator's path corners)
+// - if 'at' is on an edge that the line leaves through, cross it
+// - then, if 'at' is still on an edge or vertex, nudge it very slightly into its triangle
+// returns false if the line is blocked (it heads off the mesh)
+static bool enter_triangle(WalkMesh const &mesh, WalkPoint *at_, glm::vec3 *remain_) {
+	auto &at = *at_;
+	auto &remain = *remain_;
+
+	uint32_t zeros = (at.weights.x == 0.0f) + (at.weights.y == 0.0f) + (at.weights.z == 0.0f);
+	if (zeros == 2) {
+		uint32_t vertex = at.indices[at.weights.x != 0.0f ? 0 : (at.weights.y != 0.0f ? 1 : 2)];
+		glm::vec3 dir = glm::normalize(remain);
+		//corner 'c' of triangle 't' leaves through edges c and c+2; score corners by how far inside both the line is:
+		auto inward = [&](uint32_t t, uint32_t e) {
+			glm::uvec3 const &tri = mesh.triangles[t];
+			return mesh.edge_inward(WalkPoint(glm::uvec3(tri[e], tri[(e+1)%3], tri[(e+2)%3]), glm::vec3(1.0f, 0.0f, 0.0f), t));
+		};
+		constexpr uint32_t MaxFan = 32; //(more triangles than this around one vertex would be odd)
+		std::array< uint32_t, MaxFan > fan;
+		uint32_t fan_size = 0;
+		fan[fan_size++] = mesh.triangle_index(at);
+		uint32_t best = -1U, best_corner = 0;
+		float best_score = -std::numeric_limits< float >::infinity();
+		for (uint32_t f = 0; f < fan_size; ++f) {
+			uint32_t t = fan[f];
+			glm::uvec3 const &tri = mesh.triangles[t];
+			uint32_t c = (tri.x == vertex ? 0 : (tri.y == vertex ? 1 : 2));
+			float score = std::min(glm::dot(dir, inward(t, c)), glm::dot(dir, inward(t, (c+2)%3)));
+			if (score > best_score) {
+				best_score = score;
+				best = t;
+				best_corner = c;
+			}
+			for (uint32_t e : { c, (c+2)%3 }) {
+				uint32_t twin = mesh.twins[3*t + e];
+				if (twin == -1U) continue;
+				if (std::find(fan.begin(), fan.begin() + fan_size, twin / 3) != fan.begin() + fan_size) continue;
+				if (fan_size < MaxFan) fan[fan_size++] = twin / 3;
+			}
+		}
+		//heading out of every corner means heading off the mesh:
+		// (a little slack, since the fan usually isn't flat)
+		constexpr float Slack = 1e-3f;
+		if (best_score < -Slack) {
+			return false;
+		}
+		at.indices = mesh.triangles[best];
+		at.weights = glm::vec3(0.0f);
+		at.weights[best_corner] = 1.0f;
+		at.triangle = best;
+	} else if (zeros == 1) {
+		//rotate so that the edge is indices.xy:
+		uint32_t k = (at.weights.x == 0.0f ? 0 : (at.weights.y == 0.0f ? 1 : 2));
+		WalkPoint edge = at;
+		for (uint32_t i = 0; i < 3; ++i) {
+			edge.indices[i] = at.indices[(k + 1 + i) % 3];
+			edge.weights[i] = at.weights[(k + 1 + i) % 3];
+		}
+		if (glm::dot(remain, mesh.edge_inward(edge)) < 0.0f) {
+			WalkPoint next;
+			glm::quat rotation;
+			if (!mesh.cross_edge(edge, &next, &rotation)) {
+				return false;
+			}
+			at = next;
+			remain = rotation * remain;
+		}
+	}
+	if (at.weights.x == 0.0f || at.weights.y == 0.0f || at.weights.z == 0.0f) {
+		constexpr float Nudge = 1e-5f;
+		at.weights = (1.0f - Nudge) * at.weights + glm::vec3(Nudge / 3.0f);
+	}
+	return true;
+}
+
+//(used by line_of_sight and line_of_sight_batch) did a line from 'from' that stopped at 'at' reach 'to'?
+// (nudging off vertices -- and lines that end on a boundary vertex, which stop at its edge -- leave 'at' a hair from 'to', so accept that too)
+static bool line_reached(WalkMesh const &mesh, WalkPoint const &at, WalkPoint const &to, glm::vec3 const &target, glm::vec3 const &line, bool finished) {
+	bool close = glm::length2(mesh.to_world_point(at) - target) <= 1e-6f * glm::length2(line);
+	if (!finished) return close;
+	return mesh.triangle_index(at) == mesh.triangle_index(to) || close;
+}
+
+bool WalkMesh::line_of_sight(WalkPoint const &from, WalkPoint const &to, WalkPoint *end_, uint32_t max_iterations) const {
+	WalkPoint at = from;
+	glm::vec3 target = to_world_point(to);
+	glm::vec3 line = target - to_world_point(from);
+	glm::vec3 remain = line;
+
+	bool finished = (remain == glm::vec3(0.0f));
+
+	//same loop as walk(), except that the step is re-aimed at 'to' after each edge (so the line follows bends in
+	// the mesh rather than drifting off them) and that a boundary edge ends the line instead of deflecting it:
+	for (uint32_t iter = 0; iter < max_iterations && !finished; ++iter) {
+		if (!enter_triangle(*this, &at, &remain)) break;
+		WalkPoint next;
+		float time;
+		walk_in_triangle(at, remain, &next, &time);
+		at = next;
+		if (time == 1.0f) {
+			finished = true;
+			break;
+		}
+		glm::quat rotation;
+		if (!cross_edge(at, &next, &rotation)) break;
+		at = next;
+		remain = target - to_world_point(at);
+	}
+
+	if (end_) *end_ = at;
+	return line_reached(*this, at, to, target, line, finished);
+}
+
+//(used by lookup_triangles) index of the lowest set bit of 'bits' (which must not be zero), via a de Bruijn sequence:
+static uint32_t lowest_bit(uint32_t bits) {
+	assert(bits != 0);
+	static constexpr uint32_t Index[32] = {
+		0, 1, 28, 2, 29, 14, 24, 3, 30, 22, 20, 15, 25, 17, 4, 8,
+		31, 27, 13, 23, 21, 19, 16, 7, 26, 12, 18, 6, 11, 5, 10, 9
+	};
+	return Index[((bits & (~bits + 1U)) * 0x077CB531U) >> 27];
+}
+
+//(used by line_of_sight_batch) fill in the triangle of each of up to 32 walkpoints, with one bvh traversal for all of them:
+// (visits nodes in the same order as triangle_index, which handles any point the traversal misses)
+static void lookup_triangles(WalkMesh const &mesh, uint32_t count, WalkPoint *points) {
+	assert(count <= 32);
+	glm::vec3 centroid[32];
+	uint32_t missing = 0; //points with no triangle yet
+	for (uint32_t i = 0; i < count; ++i) {
+		if (points[i].triangle != -1U) continue;
+		glm::uvec3 const &ind = points[i].indices;
+		centroid[i] = (mesh.vertices[ind.x] + mesh.vertices[ind.y] + mesh.vertices[ind.z]) / 3.0f;
+		missing |= (1U << i);
+	}
+
+	struct Entry {
+		uint32_t node;
+		uint32_t points; //points whose centroids are inside this node's parent
+	};
+	Entry stack[64];
+	uint32_t stack_size = 0;
+	if (missing && !mesh.bvh_nodes.empty()) stack[stack_size++] = Entry{0, missing};
+	while (stack_size > 0) {
+		Entry entry = stack[--stack_size];
+		WalkMesh::BVHNode const &node = mesh.bvh_nodes[entry.node];
+		uint32_t inside = 0;
+		for (uint32_t bits = entry.points & missing; bits != 0; bits &= bits - 1U) {
+			uint32_t i = lowest_bit(bits);
+			if (glm::any(glm::lessThan(centroid[i], node.min)) || glm::any(glm::greaterThan(centroid[i], node.max))) continue;
+			inside |= (1U << i);
+		}
+		if (inside == 0) continue;
+		if (node.count != 0) {
+			for (uint32_t b = node.first; b < node.first + node.count; ++b) {
+				glm::uvec3 const &tri = mesh.triangles[mesh.bvh_triangles[b]];
+				for (uint32_t bits = inside & missing; bits != 0; bits &= bits - 1U) {
+					uint32_t i = lowest_bit(bits);
+					glm::uvec3 const &ind = points[i].indices;
+					if (tri == ind || tri == glm::uvec3(ind.z, ind.x, ind.y) || tri == glm::uvec3(ind.y, ind.z, ind.x)) {
+						points[i].triangle = mesh.bvh_triangles[b];
+						missing &= ~(1U << i);
+					}
+				}
+			}
+		} else {
+			assert(stack_size + 2 <= sizeof(stack) / sizeof(stack[0]));
+			stack[stack_size++] = Entry{node.first, inside};
+			stack[stack_size++] = Entry{node.first + 1, inside};
+		}
+	}
+
+	for (uint32_t i = 0; i < count; ++i) {
+		if (missing & (1U << i)) points[i].triangle = mesh.triangle_index(points[i]);
+	}
+}
+
+size_t WalkMesh::line_of_sight_batch(size_t count, WalkPoint const *froms, WalkPoint const *tos, uint8_t *visible, WalkPoint *ends, uint32_t max_iterations) const {
+	assert(count == 0 || (froms && tos && visible));
+
+	//the lock-step pass below needs the cached per-triangle geometry; without it, check lines one at a time:
+	if (cache.inv_denom.empty()) {
+		size_t visible_count = 0;
+		for (size_t i = 0; i < count; ++i) {
+			bool seen = line_of_sight(froms[i], tos[i], (ends ? &ends[i] : nullptr), max_iterations);
+			visible[i] = (seen ? 1 : 0);
+			if (seen) ++visible_count;
+		}
+		return visible_count;
+	}
+
+	//lines are stepped in a packet of up to 32, as walk_batch walks agents. But lines run for very different numbers of
+	// steps, so lines that end are replaced by new ones (whenever half the packet is free) to keep the packet full.
+	// Lines joining the packet have their start and end triangles looked up together (see lookup_triangles). Then,
+	// each pass, every line in the packet:
+	// - on its own, turns through the fan of the vertex it is on, or crosses the edge it leaves through (see enter_triangle),
+	// - takes its in-triangle step in lock-step with the others (see StepPacket; results match line_of_sight exactly),
+	// - then, on its own, finishes, is blocked by a boundary edge, or crosses the edge it reached and re-aims at 'to':
+	constexpr uint32_t PacketSize = StepPacket::Size;
+	StepPacket packet;
+
+	//per-slot line state:
+	size_t index[PacketSize]; //which line is in the slot
+	WalkPoint at[PacketSize], to[PacketSize];
+	glm::vec3 target[PacketSize], line[PacketSize], remain[PacketSize];
+	uint32_t iterations[PacketSize];
+
+	uint32_t lanes[PacketSize]; //slots of lines in the packet
+	uint32_t lane_count = 0;
+	uint32_t free_slots[PacketSize];
+	uint32_t free_count = 0;
+	for (uint32_t slot = 0; slot < PacketSize; ++slot) {
+		free_slots[free_count++] = PacketSize - 1 - slot;
+	}
+
+	size_t visible_count = 0;
+	auto retire = [&](uint32_t slot, bool finished) {
+		size_t i = index[slot];
+		if (ends) ends[i] = at[slot];
+		bool seen = line_reached(*this, at[slot], to[slot], target[slot], line[slot], finished);
+		visible[i] = (seen ? 1 : 0);
+		if (seen) ++visible_count;
+		free_slots[free_count++] = slot;
+	};
+
+	size_t next_line = 0;
+	while (next_line < count || lane_count > 0) {
+		//refill:
+		if (next_line < count && free_count >= PacketSize / 2) {
+			uint32_t joining = uint32_t(std::min< size_t >(free_count, count - next_line));
+			WalkPoint starts[PacketSize], stops[PacketSize];
+			for (uint32_t j = 0; j < joining; ++j) {
+				starts[j] = froms[next_line + j];
+				stops[j] = tos[next_line + j];
+			}
+			lookup_triangles(*this, joining, starts);
+			lookup_triangles(*this, joining, stops);
+			for (uint32_t j = 0; j < joining; ++j) {
+				uint32_t slot = free_slots[--free_count];
+				index[slot] = next_line + j;
+				at[slot] = starts[j];
+				to[slot] = stops[j];
+				target[slot] = to_world_point(to[slot]);
+				line[slot] = target[slot] - to_world_point(at[slot]);
+				remain[slot] = line[slot];
+				iterations[slot] = 0;
+				bool finished = (remain[slot] == glm::vec3(0.0f));
+				if (finished || max_iterations == 0) retire(slot, finished);
+				else lanes[lane_count++] = slot;
+			}
+			next_line += joining;
+		}
+
+		//enter triangles (lines diverge here, so one at a time; blocked lines are done), then gather:
+		uint32_t n = 0;
+		for (uint32_t k = 0; k < lane_count; ++k) {
+			uint32_t slot = lanes[k];
+			if (!enter_triangle(*this, &at[slot], &remain[slot])) {
+				retire(slot, false);
+				continue;
+			}
+			lanes[n] = slot;
+			packet.gather(*this, n, at[slot], remain[slot]);
+			n += 1;
+		}
+		lane_count = n;
+
+		packet.step(lane_count);
+
+		//finish, or cross and re-aim (lines diverge here too):
+		n = 0;
+		for (uint32_t k = 0; k < lane_count; ++k) {
+			uint32_t slot = lanes[k];
+			WalkPoint next;
+			packet.end(k, at[slot], &next);
+			at[slot] = next;
+			if (packet.time[k] == 1.0f) {
+				retire(slot, true);
+				continue;
+			}
+			glm::quat rotation;
+			if (!cross_edge(at[slot], &next, &rotation)) {
+				retire(slot, false);
+				continue;
+			}
+			at[slot] = next;
+			remain[slot] = target[slot] - to_world_point(at[slot]);
+			iterations[slot] += 1;
+			if (iterations[slot] == max_iterations) {
+				retire(slot, false);
+				continue;
+			}
+			lanes[n++] = slot;
+		}
+		lane_count = n;
+	}
+	return visible_count;
+}
+
+bool WalkMesh::raycast(glm::vec3 const &origin, glm::vec3 const &direction, float max_t, WalkPoint *hit_, float *t_) const {
+	WalkPoint hit;
+	float t;
+	if (raycast_batch(1, &origin, &direction, max_t, &hit, &t) == 0) return false;
+	if (hit_) *hit_ = hit;
+	if (t_) *t_ = t;
+	return true;
+}
+
+size_t WalkMesh::raycast_batch(size_t count, glm::vec3 const *origins, glm::vec3 const *directions, float max_t, WalkPoint *hits, float *ts) const {
+	assert(count == 0 || (origins && directions));
+	if (bvh_nodes.empty()) {
+		for (size_t i = 0; i < count; ++i) {
+			if (hits) hits[i] = WalkPoint();
+			if (ts) ts[i] = std::numeric_limits< float >::infinity();
+		}
+		return 0;
+	}
+
+	//rays are traced in packets of up to 32, with a bitmask of the packet's rays that may still hit inside each node:
+	constexpr uint32_t PacketSize = 32;
+
+	size_t hit_count = 0;
+	for (size_t first = 0; first < count; first += PacketSize) {
+		uint32_t size = uint32_t(std::min< size_t >(PacketSize, count - first));
+		glm::vec3 const *origin = origins + first;
+		glm::vec3 const *direction = directions + first;
+
+		glm::vec3 inv_direction[PacketSize];
+		float best_t[PacketSize];
+		uint32_t best_triangle[PacketSize];
+		glm::vec2 best_uv[PacketSize];
+		for (uint32_t r = 0; r < size; ++r) {
+			inv_direction[r] = 1.0f / direction[r];
+			best_t[r] = max_t;
+			best_triangle[r] = -1U;
+		}
+
+		//slab test; entry distance of ray r into the box, or infinity if it misses (or enters after its best hit):
+		auto box_entry = [&](BVHNode const &node, uint32_t r) {
+			glm::vec3 t0 = (node.min - origin[r]) * inv_direction[r];
+			glm::vec3 t1 = (node.max - origin[r]) * inv_direction[r];
+			glm::vec3 t_near = glm::min(t0, t1);
+			glm::vec3 t_far = glm::max(t0, t1);
+			float enter = std::max(std::max(t_near.x, t_near.y), std::max(t_near.z, 0.0f));
+			float exit = std::min(std::min(t_far.x, t_far.y), std::min(t_far.z, best_t[r]));
+			return (enter <= exit ? enter : std::numeric_limits< float >::infinity());
+		};
+
+		//Moller-Trumbore, accepting either side of the triangle:
+		auto check_triangle = [&](uint32_t ti, uint32_t r) {
+			glm::uvec3 const &tri = triangles[ti];
+			glm::vec3 const &a = vertices[tri.x];
+			glm::vec3 e1 = (cache.v0.empty() ? vertices[tri.y] - a : cache.v0[ti]);
+			glm::vec3 e2 = (cache.v1.empty() ? vertices[tri.z] - a : cache.v1[ti]);
+			glm::vec3 p = glm::cross(direction[r], e2);
+			float det = glm::dot(e1, p);
+			if (det == 0.0f) return; //(ray parallel to triangle)
+			float inv_det = 1.0f / det;
+			glm::vec3 s = origin[r] - a;
+			float u = glm::dot(s, p) * inv_det;
+			if (u < 0.0f || u > 1.0f) return;
+			glm::vec3 q = glm::cross(s, e1);
+			float v = glm::dot(direction[r], q) * inv_det;
+			if (v < 0.0f || u + v > 1.0f) return;
+			float t = glm::dot(e2, q) * inv_det;
+			if (t < 0.0f || t >= best_t[r]) return;
+			best_t[r] = t;
+			best_triangle[r] = ti;
+			best_uv[r] = glm::vec2(u, v);
+		};
+
+		struct Entry {
+			uint32_t node;
+			uint32_t rays; //rays that reached this node's parent
+		};
+		Entry stack[64];
+		uint32_t stack_size = 0;
+		stack[stack_size++] = Entry{0, (size == 32 ? ~0U : (1U << size) - 1U)};
+		while (stack_size > 0) {
+			Entry entry = stack[--stack_size];
+			BVHNode const &node = bvh_nodes[entry.node];
+
+			//which rays (still) reach this node? (best_t may have shrunk since it was pushed)
+			uint32_t rays = 0;
+			uint32_t lead = -1U; //first ray that reaches this node
+			for (uint32_t r = 0; r < size; ++r) {
+				if (!(entry.rays & (1U << r))) continue;
+				if (box_entry(node, r) == std::numeric_limits< float >::infinity()) continue;
+				rays |= (1U << r);
+				if (lead == -1U) lead = r;
+			}
+			if (rays == 0) continue;
+
+			if (node.count != 0) {
+				//leaf: check contained triangles against every ray that reached it
+				for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+					for (uint32_t r = lead; r < size; ++r) {
+						if (rays & (1U << r)) check_triangle(bvh_triangles[i], r);
+					}
+				}
+			} else {
+				//interior: push farther child (for the lead ray) first so nearer child is visited first
+				float a = box_entry(bvh_nodes[node.first], lead);
+				float b = box_entry(bvh_nodes[node.first + 1], lead);
+				assert(stack_size + 2 <= sizeof(stack) / sizeof(stack[0]));
+				if (a < b) {
+					stack[stack_size++] = Entry{node.first + 1, rays};
+					stack[stack_size++] = Entry{node.first, rays};
+				} else {
+					stack[stack_size++] = Entry{node.first, rays};
+					stack[stack_size++] = Entry{node.first + 1, rays};
+				}
+			}
+		}
+
+		for (uint32_t r = 0; r < size; ++r) {
+			if (best_triangle[r] == -1U) {
+				if (hits) hits[first + r] = WalkPoint();
+				if (ts) ts[first + r] = std::numeric_limits< float >::infinity();
+				continue;
+			}
+			++hit_count;
+			glm::vec2 const &uv = best_uv[r];
+			if (hits) hits[first + r] = WalkPoint(triangles[best_triangle[r]], glm::vec3(1.0f - uv.x - uv.y, uv.x, uv.y), best_triangle[r]);
+			if (ts) ts[first + r] = best_t[r];
+		}
+	}
+	return hit_count;
+}
 
 WalkMeshes::WalkMeshes(std::string const &filename) {
-	std::ifstream file(filename, std::ios::binary);
+	//map the whole file, which the loaded meshes will reference directly:
+	storage = std::make_shared< MappedFile >(filename);
+	load(storage->begin(), storage->end(), filename, true);
+}
 
-	std::vector< glm::vec3 > vertices;
-	read_chunk(file, "p...", &vertices);
+WalkMeshes::WalkMeshes(Level const &level) {
+	//the walkmesh section is a whole walkmesh file, at an aligned offset in the mapped level:
+	// (the mapping is shared -- with the Level and anything else loaded from it -- so triangles are remapped in a copy)
+	storage = level.file;
+	load(level.walkmeshes.begin, level.walkmeshes.end, level.filename, false);
+}
 
-	std::vector< glm::vec3 > normals;
-	read_chunk(file, "n...", &normals);
+void WalkMeshes::load(char *begin, char *end, std::string const &filename, bool in_place) {
+	char *at = begin;
 
-	std::vector< glm::uvec3 > triangles;
-	read_chunk(file, "tri0", &triangles);
+	//positions, normals, and triangles are at the start of the file (so aligned) and are used in place:
+	ChunkView< glm::vec3 > vertices = view_chunk< glm::vec3 >(&at, end, "p...");
+	ChunkView< glm::vec3 > normals = view_chunk< glm::vec3 >(&at, end, "n...");
+	ChunkView< glm::uvec3 > triangles = view_chunk< glm::uvec3 >(&at, end, "tri0");
 
+	//the remaining chunks are small and follow the (arbitrary length) names, so are copied out:
 	std::vector< char > names;
-	read_chunk(file, "str0", &names);
+	read_chunk(&at, end, "str0", &names);
 
 	struct IndexEntry {
 		uint32_t name_begin, name_end;
@@ -264,9 +1221,18 @@ WalkMeshes::WalkMeshes(std::string const &filename) {
 	};
 
 	std::vector< IndexEntry > index;
-	read_chunk(file, "idxA", &index);
+	read_chunk(&at, end, "idxA", &index);
 
-	if (file.peek() != EOF) {
+	//(optional) precomputed adjacency, same format as WalkMesh::twins but indexing all triangles in the file:
+	std::vector< uint32_t > twins;
+	if (at != end) {
+		read_chunk(&at, end, "adj0", &twins);
+		if (twins.size() != triangles.size() * 3) {
+			throw std::runtime_error("Mis-matched adjacency and triangle sizes in '" + filename + "'");
+		}
+	}
+
+	if (at != end) {
 		std::cerr << "WARNING: trailing data in walkmesh file '" << filename << "'" << std::endl;
 	}
 
@@ -276,6 +1242,28 @@ WalkMeshes::WalkMeshes(std::string const &filename) {
 		throw std::runtime_error("Mis-matched position and normal sizes in '" + filename + "'");
 	}
 
+	//where remapped triangles go -- in place, in the mapping itself (so each triangle may only belong to one mesh),
+	// or else into per-mesh copies (so meshes may share triangles) that live as long as the meshes:
+	struct RemappedTriangles {
+		std::shared_ptr< MappedFile > file; //(vertices and normals still point into the mapping)
+		std::vector< glm::uvec3 > triangles; //each mesh's triangles, one mesh after another
+	};
+	std::shared_ptr< void const > mesh_storage = storage;
+	std::shared_ptr< RemappedTriangles > copy;
+	std::vector< bool > remapped; //(in place only) triangles already remapped
+	if (in_place) {
+		remapped.assign(triangles.size(), false);
+	} else {
+		copy = std::make_shared< RemappedTriangles >();
+		copy->file = storage;
+		size_t total = 0;
+		for (auto const &e : index) {
+			if (e.triangle_begin <= e.triangle_end && e.triangle_end <= triangles.size()) total += e.triangle_end - e.triangle_begin;
+		}
+		copy->triangles.reserve(total); //(so meshes' views into it stay valid as later meshes are added)
+		mesh_storage = copy;
+	}
+
 	for (auto const &e : index) {
 		if (!(e.name_begin <= e.name_end && e.name_end <= names.size())) {
 			throw std::runtime_error("Invalid name indices in index of '" + filename + "'");
@@ -287,28 +1275,50 @@ WalkMeshes::WalkMeshes(std::string const &filename) {
 			throw std::runtime_error("Invalid triangle indices in index of '" + filename + "'");
 		}
 
-		//copy vertices/normals:
-		std::vector< glm::vec3 > wm_vertices(vertices.begin() + e.vertex_begin, vertices.begin() + e.vertex_end);
-		std::vector< glm::vec3 > wm_normals(normals.begin() + e.vertex_begin, normals.begin() + e.vertex_end);
-
-		//remap triangles:
-		std::vector< glm::uvec3 > wm_triangles; wm_triangles.reserve(e.triangle_end - e.triangle_begin);
+		//remap triangles to be relative to the mesh's first vertex:
+		glm::uvec3 *mesh_triangles = triangles.data + e.triangle_begin;
+		if (!in_place) {
+			mesh_triangles = copy->triangles.data() + copy->triangles.size();
+			copy->triangles.resize(copy->triangles.size() + (e.triangle_end - e.triangle_begin));
+		}
 		for (uint32_t ti = e.triangle_begin; ti != e.triangle_end; ++ti) {
+			if (in_place) {
+				if (remapped[ti]) {
+					throw std::runtime_error("Triangle shared between meshes in '" + filename + "'");
+				}
+				remapped[ti] = true;
+			}
 			if (!( (e.vertex_begin <= triangles[ti].x && triangles[ti].x < e.vertex_end)
 			    && (e.vertex_begin <= triangles[ti].y && triangles[ti].y < e.vertex_end)
 			    && (e.vertex_begin <= triangles[ti].z && triangles[ti].z < e.vertex_end) )) {
 				throw std::runtime_error("Invalid triangle in '" + filename + "'");
 			}
-			wm_triangles.emplace_back(
-				triangles[ti].x - e.vertex_begin,
-				triangles[ti].y - e.vertex_begin,
-				triangles[ti].z - e.vertex_begin
-			);
+			mesh_triangles[ti - e.triangle_begin] = triangles[ti] - glm::uvec3(e.vertex_begin);
 		}
 		
+		//remap adjacency (if present):
+		std::vector< uint32_t > wm_twins;
+		if (!twins.empty()) {
+			wm_twins.reserve(3 * (e.triangle_end - e.triangle_begin));
+			for (uint32_t h = 3 * e.triangle_begin; h != 3 * e.triangle_end; ++h) {
+				if (twins[h] == -1U) {
+					wm_twins.emplace_back(-1U);
+				} else if (3 * e.triangle_begin <= twins[h] && twins[h] < 3 * e.triangle_end) {
+					wm_twins.emplace_back(twins[h] - 3 * e.triangle_begin);
+				} else {
+					throw std::runtime_error("Invalid adjacency in '" + filename + "'");
+				}
+			}
+		}
+
 		std::string name(names.begin() + e.name_begin, names.begin() + e.name_end);
 
-		auto ret = meshes.emplace(name, WalkMesh(wm_vertices, wm_normals, wm_triangles));
+		auto ret = meshes.emplace(name, WalkMesh(mesh_storage,
+			ChunkView< glm::vec3 const >(vertices.data + e.vertex_begin, e.vertex_end - e.vertex_begin),
+			ChunkView< glm::vec3 const >(normals.data + e.vertex_begin, e.vertex_end - e.vertex_begin),
+			ChunkView< glm::uvec3 const >(mesh_triangles, e.triangle_end - e.triangle_begin),
+			wm_twins
+		));
 		if (!ret.second) {
 			throw std::runtime_error("WalkMesh with duplicated name '" + name + "' in '" + filename + "'");
 		}
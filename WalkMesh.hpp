@@ -1,12 +1,18 @@
 #pragma once
 
+#include "MappedFile.hpp"
+#include "read_write_chunk.hpp"
+
 #include <glm/glm.hpp>
-#include <glm/gtx/hash.hpp> //allows the use of 'uvec2' as an unordered_map key
+#include <glm/gtc/quaternion.hpp>
 
 #include <vector>
 #include <string>
+#include <memory>
 #include <unordered_map>
 
+struct Level;
+
 //"WalkPoint" represents location on the WalkMesh as barycentric coordinates on a triangle:
 struct WalkPoint {
 	//indices of current triangle (in CCW order):
@@ -14,21 +20,74 @@ struct WalkPoint {
 	//barycentric coordinates for current point:
 	glm::vec3 weights = glm::vec3(std::numeric_limits< float >::quiet_NaN());
 	//NOTE: by convention, if WalkPoint is on an edge, indices/weights will be arranged so that weights.z will be 0.0.
-	WalkPoint(glm::uvec3 const &indices_, glm::vec3 const &weights_) : indices(indices_), weights(weights_) { }
+	//index of current triangle in WalkMesh::triangles (indices above are a rotation of that triangle's indices):
+	// (-1U if unknown; WalkMesh functions will look it up when needed)
+	uint32_t triangle = -1U;
+	WalkPoint(glm::uvec3 const &indices_, glm::vec3 const &weights_, uint32_t triangle_ = -1U) : indices(indices_), weights(weights_), triangle(triangle_) { }
 	WalkPoint() = default;
 };
 
+//Thread safety: WalkMesh's const functions only read the mesh -- there are no mutable members, lazily built caches,
+// or static scratch buffers -- so any number of threads may query one WalkMesh at the same time (e.g., WalkAgents::update),
+// as long as nothing modifies it meanwhile. Keep it that way: per-query scratch belongs on the stack or with the caller.
 struct WalkMesh {
 	//Walk mesh will keep track of triangles, vertices:
-	std::vector< glm::vec3 > vertices;
-	std::vector< glm::vec3 > normals; //normals for interpolated 'up' direction
-	std::vector< glm::uvec3 > triangles; //CCW-oriented
-
-	//This "next vertex" map includes [a,b]->c, [b,c]->a, and [c,a]->b for each triangle (a,b,c), and is useful for checking what's over an edge from a given point:
-	std::unordered_map< glm::uvec2, uint32_t > next_vertex;
-
-	//Construct new WalkMesh and build next_vertex structure:
-	WalkMesh(std::vector< glm::vec3 > const &vertices_, std::vector< glm::vec3 > const &normals_, std::vector< glm::uvec3 > const &triangles_);
+	// (these are views into 'storage', which may be shared by several WalkMesh objects -- e.g., all meshes from one file)
+	ChunkView< glm::vec3 const > vertices;
+	ChunkView< glm::vec3 const > normals; //normals for interpolated 'up' direction
+	ChunkView< glm::uvec3 const > triangles; //CCW-oriented
+	std::shared_ptr< void const > storage; //keeps the memory referenced by vertices, normals, and triangles alive
+
+	//Triangle adjacency, one entry per triangle edge:
+	// twins[3*t+e] is the edge (stored as 3*t'+e') on the other side of edge e of triangle t, or -1U for boundary edges.
+	// (edge e of triangle t runs from triangles[t][e] to triangles[t][(e+1)%3])
+	std::vector< uint32_t > twins;
+
+	//Bounding volume hierarchy over triangles, used to accelerate nearest_walk_point and raycasts:
+	struct BVHNode {
+		glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity()); //bounds of all triangles under this node
+		glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+		uint32_t first = 0; //leaf: index of first entry in bvh_triangles; interior: index of first child (second child is first+1)
+		uint32_t count = 0; //leaf: number of triangles; interior: 0
+	};
+	std::vector< BVHNode > bvh_nodes; //bvh_nodes[0] is the root
+	std::vector< uint32_t > bvh_triangles; //triangle indices, ordered so that each leaf covers a contiguous range
+
+	//Per-triangle geometry cache, stored structure-of-arrays style, indexed by triangle (or by edge, 3*t+e):
+	// (built by the constructor when cache_geometry is set; empty otherwise, in which case everything is computed on the fly)
+	// all values are relative to the triangle's stored vertex order (a,b,c) = triangles[t]
+	struct {
+		std::vector< glm::vec3 > v0; //b-a
+		std::vector< glm::vec3 > v1; //c-a
+		std::vector< glm::vec3 > gram; //(dot(v0,v0), dot(v0,v1), dot(v1,v1))
+		std::vector< float > inv_denom; //1 / (gram.x * gram.z - gram.y * gram.y)
+		std::vector< glm::vec3 > normal; //unit face normal
+		std::vector< glm::vec3 > edge_inward; //[per edge] unit vector in the triangle plane, perpendicular to the edge, pointing into the triangle
+		std::vector< glm::quat > twin_rotation; //[per edge] rotation from this triangle's plane to its twin's plane (identity on boundary edges)
+	} cache;
+
+	//Construct new WalkMesh and build twins, bvh, and (optionally) cache structures:
+	// (if twins_ is supplied -- e.g., from a file -- it is checked and used instead of being rebuilt)
+	WalkMesh(std::vector< glm::vec3 > const &vertices_, std::vector< glm::vec3 > const &normals_, std::vector< glm::uvec3 > const &triangles_, std::vector< uint32_t > const &twins_ = {}, bool cache_geometry = true);
+
+	//Construct a WalkMesh that references existing data instead of copying it:
+	// (storage_ must keep the memory behind vertices_, normals_, and triangles_ alive)
+	WalkMesh(std::shared_ptr< void const > storage_, ChunkView< glm::vec3 const > vertices_, ChunkView< glm::vec3 const > normals_, ChunkView< glm::uvec3 const > triangles_, std::vector< uint32_t > const &twins_ = {}, bool cache_geometry = true);
+
+	//(used by constructors) validate data, then build twins, bvh, and (optionally) cache structures:
+	void build(std::vector< uint32_t > const &twins_, bool cache_geometry);
+
+	//compute twins for a triangle list (by sorting edges, no hashing):
+	static std::vector< uint32_t > build_twins(ChunkView< glm::uvec3 const > triangles);
+
+	//find the index of the triangle a walkpoint is on (uses wp.triangle if set, otherwise looks it up via the bvh):
+	uint32_t triangle_index(WalkPoint const &wp) const;
+
+	//which rotation of triangles[t] is wp.indices? (i.e., wp.indices[i] == triangles[t][(r+i)%3]):
+	uint32_t triangle_rotation(WalkPoint const &wp, uint32_t t) const {
+		glm::uvec3 const &tri = triangles[t];
+		return (tri.x == wp.indices.x ? 0 : (tri.y == wp.indices.x ? 1 : 2));
+	}
 
 	//used to initialize walking -- finds the closest point on the walk mesh:
 	// (should only need to call this at the start of a level)
@@ -64,6 +123,87 @@ struct WalkMesh {
 		glm::quat *rotation     //[out] rotation over edge
 	) const;
 
+	//walk a full step, crossing edges and sliding along boundary edges:
+	// (this is the walk_in_triangle / cross_edge loop, with a simple bounce / slide off walls)
+	//  - *at is updated in place
+	//  - at most max_iterations triangle steps are taken, so awkward cases can't loop forever
+	//  - returns the amount of step that was not used (glm::vec3(0.0f) if the whole step was taken)
+	glm::vec3 walk(
+		WalkPoint *at,                //[in,out] walkpoint to move
+		glm::vec3 step,               //[in] step to take (in world space)
+		uint32_t max_iterations = 10  //[in] iteration budget
+	) const;
+
+	//walk many agents at once (parallel arrays, one entry per agent):
+	//  - ats[i] is walked by steps[i], as per walk()
+	//  - if remains is not null, remains[i] gets the unused step for agent i
+	//  - returns the number of agents that ran out of iteration budget
+	//  - results are exactly those of walk(); agents take their in-triangle steps in lock-step, in packets of 32
+	size_t walk_batch(
+		size_t count,
+		WalkPoint *ats,
+		glm::vec3 const *steps,
+		glm::vec3 *remains = nullptr,
+		uint32_t max_iterations = 10
+	) const;
+
+	//straight-line reachability along the surface:
+	// steps from 'from' toward 'to' with the walk_in_triangle / cross_edge loop (re-aiming at 'to' after each edge crossed)
+	// but without sliding -- reaching a boundary edge blocks the line
+	//  - returns true if the whole step is taken and ends on to's triangle (or within 0.1% of the line's length of 'to')
+	//  - if end is not null, *end gets where the line stopped
+	//  - 'from' may be anywhere on the mesh, including on an edge or a vertex (e.g., a WalkMeshNavigator path corner)
+	bool line_of_sight(
+		WalkPoint const &from,         //[in] start of line
+		WalkPoint const &to,           //[in] end of line
+		WalkPoint *end = nullptr,      //[out] (optional) where the line stopped
+		uint32_t max_iterations = 256  //[in] most triangles to cross before giving up (counts as blocked)
+	) const;
+
+	//check many lines at once (parallel arrays, one entry per line):
+	//  - visible[i] gets 1 if line_of_sight(froms[i], tos[i]), 0 otherwise
+	//  - if ends is not null, ends[i] gets where line i stopped
+	//  - returns the number of visible lines
+	//  - results are exactly those of line_of_sight(); lines take their in-triangle steps in lock-step, in packets of 32
+	size_t line_of_sight_batch(
+		size_t count,
+		WalkPoint const *froms,
+		WalkPoint const *tos,
+		uint8_t *visible,
+		WalkPoint *ends = nullptr,
+		uint32_t max_iterations = 256
+	) const;
+
+	//first intersection of the ray origin + t * direction, 0 <= t <= max_t, with the walkmesh (either side of a triangle):
+	//  - returns true on a hit; *hit gets the walkpoint hit and *t the ray parameter of the hit
+	//  - on a miss, *hit and *t are left unchanged
+	bool raycast(
+		glm::vec3 const &origin,
+		glm::vec3 const &direction,
+		float max_t,
+		WalkPoint *hit,
+		float *t
+	) const;
+
+	//cast many rays at once (parallel arrays, one entry per ray):
+	// rays are traced through the bvh in packets, so each node is fetched once for a whole packet instead of
+	// once per ray; rays that start near each other and point the same way (e.g., a fan of AI sight rays) share the most work
+	//  - if hits is not null, hits[i] gets the walkpoint hit by ray i (or WalkPoint() on a miss)
+	//  - if ts is not null, ts[i] gets the ray parameter of ray i's hit (or infinity on a miss)
+	//  - returns the number of rays that hit
+	size_t raycast_batch(
+		size_t count,
+		glm::vec3 const *origins,
+		glm::vec3 const *directions,
+		float max_t,
+		WalkPoint *hits,
+		float *ts
+	) const;
+
+	//unit vector along the triangle, perpendicular to edge wp.indices.xy, pointing into the triangle:
+	// (useful for sliding along walls)
+	glm::vec3 edge_inward(WalkPoint const &wp) const;
+
 	//used to read back results of walking:
 	glm::vec3 to_world_point(WalkPoint const &wp) const {
 		//if you were looking here for the lesson solution, well, here you go:
@@ -84,6 +224,7 @@ struct WalkMesh {
 
 	//read back a triangle normal at a walkpoint:
 	glm::vec3 to_world_triangle_normal(WalkPoint const &wp) const {
+		if (!cache.normal.empty()) return cache.normal[triangle_index(wp)];
 		glm::vec3 const &a = vertices[wp.indices.x];
 		glm::vec3 const &b = vertices[wp.indices.y];
 		glm::vec3 const &c = vertices[wp.indices.z];
@@ -95,10 +236,17 @@ struct WalkMesh {
 struct WalkMeshes {
 	//load a list of named WalkMeshes from a file:
 	WalkMeshes(std::string const &filename);
+	//...or from the walkmesh section of a packed level (see Level.hpp):
+	WalkMeshes(Level const &level);
 
 	//retrieve a WalkMesh by name:
 	WalkMesh const &lookup(std::string const &name) const;
 
 	//internals:
 	std::unordered_map< std::string, WalkMesh > meshes;
+	std::shared_ptr< MappedFile > storage; //mapped file; vertex and normal (and, if remapped in place, triangle) data of all meshes point into this
+	//(used by constructors) read meshes from [begin,end), inside 'storage':
+	// triangles are made relative to their mesh's first vertex; with in_place this is done in the mapping (so it must not be read by anything else),
+	// otherwise in per-mesh copies owned by the meshes (as for a Level, whose mapping is shared; meshes may then share triangles)
+	void load(char *begin, char *end, std::string const &filename, bool in_place);
 };
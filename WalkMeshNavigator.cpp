@@ -0,0 +1,260 @@
+#include "WalkMeshNavigator.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <functional>
+#include <limits>
+#include <queue>
+
+WalkMeshNavigator::WalkMeshNavigator(WalkMesh const &walkmesh_, size_t cache_capacity_) : walkmesh(walkmesh_), cache_capacity(cache_capacity_) {
+	centroids.reserve(walkmesh.triangles.size());
+	for (auto const &tri : walkmesh.triangles) {
+		centroids.emplace_back((walkmesh.vertices[tri.x] + walkmesh.vertices[tri.y] + walkmesh.vertices[tri.z]) / 3.0f);
+	}
+}
+
+void WalkMeshNavigator::clear_cache() {
+	std::lock_guard< std::mutex > lock(cache_mutex);
+	cache.clear();
+	cache_order.clear();
+}
+
+std::shared_ptr< WalkMeshNavigator::Corridor const > WalkMeshNavigator::find_corridor(uint32_t start, uint32_t goal) const {
+	assert(start < walkmesh.triangles.size());
+	assert(goal < walkmesh.triangles.size());
+
+	auto corridor = std::make_shared< Corridor >();
+	if (start == goal) {
+		corridor->reachable = true;
+		return corridor;
+	}
+
+	//per-thread search state, reused between queries:
+	// 'visited' holds a query stamp, so state doesn't need to be cleared between searches
+	struct Scratch {
+		std::vector< uint32_t > visited;
+		std::vector< float > cost; //best known cost from start
+		std::vector< uint32_t > from; //edge (3*t+e) used to enter each triangle
+		std::vector< bool > closed;
+		uint32_t stamp = 0;
+	};
+	static thread_local Scratch scratch;
+
+	size_t count = walkmesh.triangles.size();
+	if (scratch.visited.size() < count) {
+		scratch.visited.assign(count, 0);
+		scratch.cost.resize(count);
+		scratch.from.resize(count);
+		scratch.closed.resize(count);
+		scratch.stamp = 0;
+	}
+	scratch.stamp += 1;
+	if (scratch.stamp == 0) {
+		//stamp wrapped around; reset:
+		std::fill(scratch.visited.begin(), scratch.visited.end(), 0);
+		scratch.stamp = 1;
+	}
+
+	auto visit = [&](uint32_t t) {
+		if (scratch.visited[t] != scratch.stamp) {
+			scratch.visited[t] = scratch.stamp;
+			scratch.cost[t] = std::numeric_limits< float >::infinity();
+			scratch.from[t] = -1U;
+			scratch.closed[t] = false;
+		}
+	};
+
+	glm::vec3 const &target = centroids[goal];
+
+	//open list as a heap of (estimated total cost, triangle); stale entries are skipped when popped:
+	typedef std::pair< float, uint32_t > Open;
+	std::priority_queue< Open, std::vector< Open >, std::greater< Open > > open;
+
+	visit(start);
+	scratch.cost[start] = 0.0f;
+	open.emplace(glm::length(target - centroids[start]), start);
+
+	while (!open.empty()) {
+		uint32_t t = open.top().second;
+		open.pop();
+		if (scratch.closed[t]) continue;
+		scratch.closed[t] = true;
+
+		if (t == goal) break;
+
+		for (uint32_t e = 0; e < 3; ++e) {
+			uint32_t twin = walkmesh.twins[3*t+e];
+			if (twin == -1U) continue;
+			uint32_t n = twin / 3;
+			visit(n);
+			if (scratch.closed[n]) continue;
+			float cost = scratch.cost[t] + glm::length(centroids[n] - centroids[t]);
+			if (cost < scratch.cost[n]) {
+				scratch.cost[n] = cost;
+				scratch.from[n] = 3*t+e;
+				open.emplace(cost + glm::length(target - centroids[n]), n);
+			}
+		}
+	}
+
+	if (scratch.visited[goal] != scratch.stamp || !scratch.closed[goal]) {
+		return corridor; //unreachable
+	}
+
+	//walk back from goal to build the list of portals:
+	for (uint32_t t = goal; t != start; t = scratch.from[t] / 3) {
+		corridor->portals.emplace_back(scratch.from[t]);
+	}
+	std::reverse(corridor->portals.begin(), corridor->portals.end());
+	corridor->reachable = true;
+	return corridor;
+}
+
+bool WalkMeshNavigator::find_path(WalkPoint const &start, WalkPoint const &goal, std::vector< WalkPoint > *path_) const {
+	assert(path_);
+	auto &path = *path_;
+	path.clear();
+
+	if (walkmesh.triangles.empty()) return false;
+
+	uint32_t start_triangle = walkmesh.triangle_index(start);
+	uint32_t goal_triangle = walkmesh.triangle_index(goal);
+
+	//look up corridor in cache, or search for it:
+	uint64_t key = (uint64_t(start_triangle) << 32) | uint64_t(goal_triangle);
+	std::shared_ptr< Corridor const > corridor;
+	{
+		std::lock_guard< std::mutex > lock(cache_mutex);
+		auto f = cache.find(key);
+		if (f != cache.end()) {
+			cache_order.splice(cache_order.begin(), cache_order, f->second.order);
+			corridor = f->second.corridor;
+			++cache_hits;
+		} else {
+			++cache_misses;
+		}
+	}
+
+	if (!corridor) {
+		//search without holding the lock, so other threads can keep going:
+		corridor = find_corridor(start_triangle, goal_triangle);
+
+		std::lock_guard< std::mutex > lock(cache_mutex);
+		if (cache_capacity > 0 && cache.find(key) == cache.end()) {
+			while (cache.size() >= cache_capacity) {
+				cache.erase(cache_order.back());
+				cache_order.pop_back();
+			}
+			cache_order.emplace_front(key);
+			cache.emplace(key, CacheEntry{corridor, cache_order.begin()});
+		}
+	}
+
+	if (!corridor->reachable) return false;
+
+	//----- funnel -----
+	//portal i is crossed from triangle portals[i]/3; seen from that triangle, the edge
+	// runs from the right-hand vertex to the left-hand vertex (triangles are CCW).
+	// Portals are bracketed by degenerate portals at the start and goal points.
+	std::vector< uint32_t > const &portals = corridor->portals;
+	size_t count = portals.size() + 2;
+
+	glm::vec3 start_point = walkmesh.to_world_point(start);
+	glm::vec3 goal_point = walkmesh.to_world_point(goal);
+
+	//portal endpoints, as vertex indices (-1U for the start/goal points):
+	auto left_vertex = [&](size_t i) -> uint32_t {
+		if (i == 0 || i + 1 == count) return -1U;
+		uint32_t h = portals[i-1];
+		return walkmesh.triangles[h/3][(h%3+1)%3];
+	};
+	auto right_vertex = [&](size_t i) -> uint32_t {
+		if (i == 0 || i + 1 == count) return -1U;
+		uint32_t h = portals[i-1];
+		return walkmesh.triangles[h/3][h%3];
+	};
+	auto position = [&](size_t i, uint32_t v) -> glm::vec3 {
+		if (i == 0) return start_point;
+		if (i + 1 == count) return goal_point;
+		return walkmesh.vertices[v];
+	};
+	//'up' direction used to decide left/right at portal i (the normal of the triangle being left):
+	auto up = [&](size_t i) -> glm::vec3 {
+		uint32_t t = (i == 0 ? start_triangle : (i + 1 == count ? goal_triangle : portals[i-1] / 3));
+		glm::uvec3 const &tri = walkmesh.triangles[t];
+		glm::vec3 const &a = walkmesh.vertices[tri.x];
+		return glm::cross(walkmesh.vertices[tri.y] - a, walkmesh.vertices[tri.z] - a);
+	};
+	//positive if c is to the left of the ray a->b:
+	auto area = [](glm::vec3 const &a, glm::vec3 const &b, glm::vec3 const &c, glm::vec3 const &n) {
+		return glm::dot(glm::cross(b - a, c - a), n);
+	};
+
+	//corner at vertex v, reached through portal i (placed on the triangle before the portal):
+	auto corner = [&](size_t i, uint32_t v) {
+		assert(i > 0 && i + 1 < count);
+		uint32_t t = portals[i-1] / 3;
+		glm::uvec3 const &tri = walkmesh.triangles[t];
+		uint32_t r = (tri.x == v ? 0 : (tri.y == v ? 1 : 2));
+		return WalkPoint(glm::uvec3(tri[r], tri[(r+1)%3], tri[(r+2)%3]), glm::vec3(1.0f, 0.0f, 0.0f), t);
+	};
+
+	path.emplace_back(start);
+
+	glm::vec3 apex = start_point;
+	uint32_t apex_vertex = -1U;
+	size_t apex_index = 0;
+	glm::vec3 funnel_left = apex, funnel_right = apex;
+	uint32_t funnel_left_vertex = -1U, funnel_right_vertex = -1U;
+	size_t left_index = 0, right_index = 0;
+
+	for (size_t i = 1; i < count; ++i) {
+		uint32_t lv = left_vertex(i), rv = right_vertex(i);
+		glm::vec3 left = position(i, lv), right = position(i, rv);
+		glm::vec3 n = up(i);
+
+		//try to narrow the right side of the funnel:
+		// (a new point equal to the other side -- e.g., the goal -- always narrows)
+		if (area(apex, funnel_right, right, n) >= 0.0f) {
+			if (funnel_right == apex || right == funnel_left || area(apex, funnel_left, right, n) < 0.0f) {
+				funnel_right = right;
+				funnel_right_vertex = rv;
+				right_index = i;
+			} else {
+				//right crossed over left; left becomes a corner:
+				if (funnel_left_vertex != apex_vertex) path.emplace_back(corner(left_index, funnel_left_vertex));
+				apex = funnel_left;
+				apex_vertex = funnel_left_vertex;
+				apex_index = left_index;
+				funnel_right = funnel_left = apex;
+				funnel_right_vertex = funnel_left_vertex = apex_vertex;
+				right_index = left_index = apex_index;
+				i = apex_index;
+				continue;
+			}
+		}
+
+		//try to narrow the left side of the funnel:
+		if (area(apex, funnel_left, left, n) <= 0.0f) {
+			if (funnel_left == apex || left == funnel_right || area(apex, funnel_right, left, n) > 0.0f) {
+				funnel_left = left;
+				funnel_left_vertex = lv;
+				left_index = i;
+			} else {
+				//left crossed over right; right becomes a corner:
+				if (funnel_right_vertex != apex_vertex) path.emplace_back(corner(right_index, funnel_right_vertex));
+				apex = funnel_right;
+				apex_vertex = funnel_right_vertex;
+				apex_index = right_index;
+				funnel_left = funnel_right = apex;
+				funnel_left_vertex = funnel_right_vertex = apex_vertex;
+				left_index = right_index = apex_index;
+				i = apex_index;
+				continue;
+			}
+		}
+	}
+
+	path.emplace_back(goal);
+	return true;
+}
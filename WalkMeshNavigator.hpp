@@ -0,0 +1,66 @@
+#pragma once
+
+#include "WalkMesh.hpp"
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+//WalkMeshNavigator finds routes across a WalkMesh:
+// - A* over the triangle adjacency graph (WalkMesh::twins) picks a corridor of triangles
+// - the "simple stupid funnel" algorithm pulls a path through the corridor's portal edges
+//
+//Corridors depend only on the (start triangle, goal triangle) pair, so they are kept in a small LRU cache;
+// the funnel pass is cheap and is always run with the actual start/goal points.
+//
+//find_path() may be called concurrently from several threads.
+
+struct WalkMeshNavigator {
+	WalkMeshNavigator(WalkMesh const &walkmesh, size_t cache_capacity = 256);
+
+	//find a path from start to goal:
+	//  if goal is reachable:
+	//    - *path gets start, each corner the path bends around, and finally goal
+	//    - function returns true
+	//  otherwise:
+	//    - *path is cleared
+	//    - function returns false
+	bool find_path(
+		WalkPoint const &start,       //[in] starting location
+		WalkPoint const &goal,        //[in] destination
+		std::vector< WalkPoint > *path //[out] path
+	) const;
+
+	//mesh being navigated over (must outlive the navigator):
+	WalkMesh const &walkmesh;
+
+	//precomputed per-triangle centroids (used for A* costs and heuristic):
+	std::vector< glm::vec3 > centroids;
+
+	//corridor through the triangle graph; empty if start and goal triangles are the same:
+	struct Corridor {
+		bool reachable = false;
+		std::vector< uint32_t > portals; //edges (3*t+e, on the near-side triangle t) crossed, in order
+	};
+
+	//run A* from triangle 'start' to triangle 'goal' (does not use the cache):
+	std::shared_ptr< Corridor const > find_corridor(uint32_t start, uint32_t goal) const;
+
+	//corridor cache, keyed by (start triangle << 32 | goal triangle):
+	size_t cache_capacity;
+	mutable std::mutex cache_mutex; //guards all of the members below
+	mutable std::list< uint64_t > cache_order; //most recently used first
+	struct CacheEntry {
+		std::shared_ptr< Corridor const > corridor;
+		std::list< uint64_t >::iterator order;
+	};
+	mutable std::unordered_map< uint64_t, CacheEntry > cache;
+	mutable uint64_t cache_hits = 0;
+	mutable uint64_t cache_misses = 0;
+
+	//drop all cached corridors (e.g., if the mesh has been edited):
+	void clear_cache();
+};
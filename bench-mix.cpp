@@ -0,0 +1,163 @@
+//Headless benchmark for the mix_audio inner loop.
+//
+//Mixes looping mono voices into a stereo block the way Sound.cpp's mix_audio does,
+// and reports how many voices fit in the time one MIX_SAMPLES block takes to play.
+//
+//Output is CSV:
+//  kernel,ns_per_voice_block,stddev_ns,voices_per_block,max_error
+// where 'max_error' is the largest difference from the per-sample reference output.
+
+#include "mix_mono.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+//should match Sound.cpp:
+constexpr uint32_t const AUDIO_RATE = 48000;
+constexpr uint32_t const MIX_SAMPLES = 256;
+
+struct Voice {
+	std::vector< float > const *data;
+	uint32_t i = 0;
+	float pan_l = 0.0f, pan_r = 0.0f;
+	float step_l = 0.0f, step_r = 0.0f;
+};
+
+//the loop mix_audio used before the SIMD kernel: one frame at a time, with a wrap check per frame:
+void mix_voice_per_sample(float *buffer, Voice &voice) {
+	std::vector< float > const &data = *voice.data;
+	float pan_l = voice.pan_l, pan_r = voice.pan_r;
+	for (uint32_t i = 0; i < MIX_SAMPLES; ++i) {
+		buffer[2*i+0] += pan_l * data[voice.i];
+		buffer[2*i+1] += pan_r * data[voice.i];
+		voice.i += 1;
+		if (voice.i == data.size()) voice.i = 0;
+		pan_l += voice.step_l;
+		pan_r += voice.step_r;
+	}
+}
+
+//the loop mix_audio uses now: runs split at the end of the data, each handed to a kernel:
+template< void (*Kernel)(float *, float const *, uint32_t, float, float, float, float) >
+void mix_voice_runs(float *buffer, Voice &voice) {
+	std::vector< float > const &data = *voice.data;
+	uint32_t mixed = 0;
+	while (mixed < MIX_SAMPLES) {
+		uint32_t count = std::min(MIX_SAMPLES - mixed, uint32_t(data.size()) - voice.i);
+		Kernel(buffer + 2 * mixed, data.data() + voice.i, count,
+			voice.pan_l + mixed * voice.step_l, voice.pan_r + mixed * voice.step_r,
+			voice.step_l, voice.step_r);
+		mixed += count;
+		voice.i += count;
+		if (voice.i == data.size()) voice.i = 0;
+	}
+}
+
+int main(int argc, char **argv) {
+	uint32_t voice_count = 64;
+	uint32_t blocks = 200;
+	uint32_t trials = 15;
+	if (argc > 1) voice_count = std::max(1, std::atoi(argv[1]));
+	if (argc > 2) blocks = std::max(1, std::atoi(argv[2]));
+
+	std::mt19937 mt(0x15466);
+	std::uniform_real_distribution< float > noise(-1.0f, 1.0f);
+
+	//a few samples with lengths that aren't multiples of the block (or SIMD) size, so runs get split:
+	std::vector< std::vector< float > > samples;
+	for (uint32_t length : { 4801U, 12347U, 48000U + 37U, 3U * MIX_SAMPLES + 1U }) {
+		samples.emplace_back(length);
+		for (auto &s : samples.back()) s = noise(mt);
+	}
+
+	std::vector< Voice > initial;
+	for (uint32_t v = 0; v < voice_count; ++v) {
+		Voice voice;
+		voice.data = &samples[v % samples.size()];
+		voice.i = mt() % uint32_t(voice.data->size());
+		voice.pan_l = 0.5f + 0.5f * noise(mt);
+		voice.pan_r = 0.5f + 0.5f * noise(mt);
+		voice.step_l = noise(mt) * 1e-4f;
+		voice.step_r = noise(mt) * 1e-4f;
+		initial.emplace_back(voice);
+	}
+
+	std::vector< float > buffer(2 * MIX_SAMPLES);
+
+	//mix a block with every voice (result is left in 'buffer'):
+	auto run = [&](std::function< void(float *, Voice &) > const &mix, std::vector< Voice > &voices) {
+		std::fill(buffer.begin(), buffer.end(), 0.0f);
+		for (auto &voice : voices) mix(buffer.data(), voice);
+	};
+
+	std::vector< float > reference;
+	{
+		std::vector< Voice > voices = initial;
+		run(mix_voice_per_sample, voices);
+		reference = buffer;
+	}
+
+	struct Kernel {
+		std::string name;
+		std::function< void(float *, Voice &) > mix;
+	};
+	std::vector< Kernel > kernels{
+		{"per-sample", mix_voice_per_sample},
+		{"runs-scalar", mix_voice_runs< mix_mono_scalar >},
+		{"runs-simd", mix_voice_runs< mix_mono >},
+	};
+
+	double block_ns = 1e9 * double(MIX_SAMPLES) / double(AUDIO_RATE);
+
+	std::cout << "kernel,ns_per_voice_block,stddev_ns,voices_per_block,max_error\n";
+	for (auto const &kernel : kernels) {
+		float max_error = 0.0f;
+		{
+			std::vector< Voice > voices = initial;
+			run(kernel.mix, voices);
+			for (uint32_t i = 0; i < buffer.size(); ++i) {
+				max_error = std::max(max_error, std::abs(buffer[i] - reference[i]));
+			}
+		}
+
+		std::vector< double > per_voice; //ns per voice per block, one per trial
+		for (uint32_t t = 0; t < trials; ++t) {
+			std::vector< Voice > voices = initial;
+			auto before = std::chrono::steady_clock::now();
+			for (uint32_t b = 0; b < blocks; ++b) {
+				run(kernel.mix, voices);
+			}
+			auto after = std::chrono::steady_clock::now();
+			double ns = std::chrono::duration< double, std::nano >(after - before).count();
+			per_voice.emplace_back(ns / double(blocks) / double(voice_count));
+		}
+
+		double mean = 0.0;
+		for (double ns : per_voice) mean += ns;
+		mean /= double(per_voice.size());
+		double variance = 0.0;
+		for (double ns : per_voice) variance += (ns - mean) * (ns - mean);
+		variance /= double(per_voice.size());
+
+		std::cout << kernel.name << ','
+			<< mean << ','
+			<< std::sqrt(variance) << ','
+			<< uint64_t(block_ns / mean) << ','
+			<< max_error << '\n';
+	}
+
+	//keep the optimizer from discarding the mixing:
+	float sum = 0.0f;
+	for (float s : buffer) sum += s;
+	std::cerr << "(checksum " << sum << ")" << std::endl;
+
+	return 0;
+}
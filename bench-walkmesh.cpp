@@ -0,0 +1,237 @@
+//Headless benchmark for WalkMesh loading and queries.
+//
+//Loads dist/wood.w and dist/phone-bank.w, then times -- for every walkmesh in each file --
+// nearest_walk_point on random points around the mesh, and random walks built from
+// walk_in_triangle + cross_edge (the loop WalkMesh::walk runs, with the same wall bounce),
+// downward raycast_batch rays from random points, and line_of_sight_batch between random walker starts.
+//
+//It also checks line_of_sight between consecutive corners of WalkMeshNavigator paths (which start and end
+// on mesh vertices), both ways, and reports how many of those lines are visible on stderr.
+//
+//Output is CSV, one row per (file, mesh, operation):
+//  file,mesh,operation,triangles,ops,ns_per_op,stddev_ns
+// where 'ops' is operations per trial and ns_per_op / stddev_ns are the mean / standard deviation over trials.
+// (for 'load', mesh is '*' and an op is one WalkMeshes construction; for 'walk-step', an op is one walk_in_triangle call)
+
+#include "WalkMesh.hpp"
+#include "WalkMeshNavigator.hpp"
+#include "data_path.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+struct Stats {
+	double mean = 0.0;
+	double stddev = 0.0;
+};
+
+//run 'trial' several times; it returns the number of operations it did; result is ns per operation:
+Stats time_trials(uint32_t trials, std::function< uint64_t() > const &trial, uint64_t *ops) {
+	std::vector< double > per_op;
+	for (uint32_t t = 0; t < trials; ++t) {
+		auto before = std::chrono::steady_clock::now();
+		uint64_t count = trial();
+		auto after = std::chrono::steady_clock::now();
+		double ns = std::chrono::duration< double, std::nano >(after - before).count();
+		per_op.emplace_back(ns / double(std::max< uint64_t >(count, 1)));
+		*ops = count;
+	}
+
+	Stats stats;
+	for (double ns : per_op) stats.mean += ns;
+	stats.mean /= double(per_op.size());
+	for (double ns : per_op) stats.stddev += (ns - stats.mean) * (ns - stats.mean);
+	stats.stddev = std::sqrt(stats.stddev / double(per_op.size()));
+	return stats;
+}
+
+int main(int argc, char **argv) {
+	uint32_t queries = 10000; //nearest_walk_point calls per trial
+	uint32_t walkers = 1000; //random walkers per trial
+	uint32_t steps = 100; //steps per walker
+	uint32_t trials = 15;
+	if (argc > 1) queries = std::max(1, std::atoi(argv[1]));
+	if (argc > 2) walkers = std::max(1, std::atoi(argv[2]));
+	if (argc > 3) steps = std::max(1, std::atoi(argv[3]));
+
+	//keeps the optimizer from discarding results:
+	double checksum = 0.0;
+
+	std::cout << "file,mesh,operation,triangles,ops,ns_per_op,stddev_ns\n";
+	auto report = [](std::string const &file, std::string const &mesh, std::string const &operation, size_t triangles, uint64_t ops, Stats const &stats) {
+		std::cout << file << ',' << mesh << ',' << operation << ',' << triangles << ',' << ops << ',' << stats.mean << ',' << stats.stddev << '\n';
+	};
+
+	for (std::string file : { "wood.w", "phone-bank.w" }) {
+		std::string path = cooked_path(data_path("../dist/" + file));
+
+		uint64_t ops = 0;
+		Stats load = time_trials(trials, [&]() -> uint64_t {
+			WalkMeshes meshes(path);
+			checksum += double(meshes.meshes.size());
+			return 1;
+		}, &ops);
+
+		WalkMeshes walkmeshes(path);
+		size_t total_triangles = 0;
+		for (auto const &[name, mesh] : walkmeshes.meshes) total_triangles += mesh.triangles.size();
+		report(file, "*", "load", total_triangles, ops, load);
+
+		//(sorted, so output order is stable)
+		std::map< std::string, WalkMesh const * > sorted;
+		for (auto const &[name, mesh] : walkmeshes.meshes) sorted.emplace(name, &mesh);
+
+		for (auto const &[name, mesh_ptr] : sorted) {
+			WalkMesh const &mesh = *mesh_ptr;
+			if (mesh.triangles.empty()) continue;
+
+			//random points in (slightly enlarged) mesh bounds:
+			glm::vec3 min = mesh.bvh_nodes[0].min;
+			glm::vec3 max = mesh.bvh_nodes[0].max;
+			glm::vec3 pad = 0.1f * (max - min) + glm::vec3(0.1f);
+			min -= pad;
+			max += pad;
+
+			std::mt19937 mt(0x15466);
+			std::uniform_real_distribution< float > unit(0.0f, 1.0f);
+			auto random_point = [&]() {
+				return glm::vec3(
+					min.x + unit(mt) * (max.x - min.x),
+					min.y + unit(mt) * (max.y - min.y),
+					min.z + unit(mt) * (max.z - min.z)
+				);
+			};
+
+			std::vector< glm::vec3 > points(queries);
+			for (auto &p : points) p = random_point();
+
+			Stats nearest = time_trials(trials, [&]() -> uint64_t {
+				for (auto const &p : points) {
+					WalkPoint wp = mesh.nearest_walk_point(p);
+					checksum += double(wp.weights.x);
+				}
+				return points.size();
+			}, &ops);
+			report(file, name, "nearest_walk_point", mesh.triangles.size(), ops, nearest);
+
+			//random walks: each walker takes 'steps' steps of 2% of the mesh size, in random directions:
+			//(walkers start strictly inside random triangles, since walk_in_triangle can't step outward from a boundary point)
+			std::vector< WalkPoint > starts(walkers);
+			for (auto &wp : starts) {
+				uint32_t t = mt() % uint32_t(mesh.triangles.size());
+				glm::vec3 weights = glm::vec3(0.1f) + 0.7f * glm::vec3(unit(mt), unit(mt), unit(mt));
+				wp = WalkPoint(mesh.triangles[t], weights / (weights.x + weights.y + weights.z), t);
+			}
+			float stride = 0.02f * glm::length(mesh.bvh_nodes[0].max - mesh.bvh_nodes[0].min);
+			std::vector< glm::vec3 > directions(size_t(walkers) * steps);
+			std::uniform_real_distribution< float > angle(0.0f, 6.2831853f);
+			for (auto &d : directions) {
+				float a = angle(mt);
+				d = stride * glm::vec3(std::cos(a), std::sin(a), 0.0f);
+			}
+
+			uint64_t crossings = 0;
+			uint64_t restarts = 0;
+			Stats walk = time_trials(trials, [&]() -> uint64_t {
+				uint64_t calls = 0;
+				crossings = 0;
+				restarts = 0;
+				for (uint32_t w = 0; w < walkers; ++w) {
+					WalkPoint at = starts[w];
+					for (uint32_t s = 0; s < steps; ++s) {
+						glm::vec3 remain = directions[size_t(w) * steps + s];
+						bool finished = false;
+						for (uint32_t iter = 0; iter < 10; ++iter) {
+							WalkPoint end;
+							float time;
+							mesh.walk_in_triangle(at, remain, &end, &time);
+							calls += 1;
+							at = end;
+							if (time == 1.0f) {
+								finished = true;
+								break;
+							}
+							remain *= (1.0f - time);
+							glm::quat rotation;
+							if (mesh.cross_edge(at, &end, &rotation)) {
+								crossings += 1;
+								at = end;
+								remain = rotation * remain;
+							} else {
+								//same wall bounce / slide as WalkMesh::walk:
+								glm::vec3 in = mesh.edge_inward(at);
+								float d = glm::dot(remain, in);
+								if (d < 0.0f) remain += (-1.25f * d) * in;
+								else remain += 0.01f * d * in;
+							}
+						}
+						//out of iterations means 'at' is on an edge, where a new step pointing out of the triangle isn't allowed, so start over:
+						if (!finished) {
+							restarts += 1;
+							at = starts[w];
+						}
+					}
+					checksum += double(mesh.to_world_point(at).x);
+				}
+				return calls;
+			}, &ops);
+			report(file, name, "walk-step", mesh.triangles.size(), ops, walk);
+			std::cerr << "(" << file << " " << name << ": " << crossings << " edge crossings and " << restarts << " restarts per walk trial)" << std::endl;
+
+			//rays from random points, pointing mostly down (as when dropping something onto the mesh):
+			std::vector< glm::vec3 > ray_directions(points.size());
+			for (auto &d : ray_directions) {
+				d = glm::vec3(unit(mt) - 0.5f, unit(mt) - 0.5f, -1.0f) * (max.z - min.z);
+			}
+			std::vector< float > ts(points.size());
+			size_t ray_hits = 0;
+			Stats raycast = time_trials(trials, [&]() -> uint64_t {
+				ray_hits = mesh.raycast_batch(points.size(), points.data(), ray_directions.data(), 1.0f, nullptr, ts.data());
+				checksum += double(ray_hits);
+				return points.size();
+			}, &ops);
+			report(file, name, "raycast", mesh.triangles.size(), ops, raycast);
+
+			//lines between pairs of walker starts:
+			std::vector< WalkPoint > line_ends(starts.size());
+			for (size_t i = 0; i < starts.size(); ++i) line_ends[i] = starts[(i * 7 + 1) % starts.size()];
+			std::vector< uint8_t > visible(starts.size());
+			size_t seen = 0;
+			Stats sight = time_trials(trials, [&]() -> uint64_t {
+				seen = mesh.line_of_sight_batch(starts.size(), starts.data(), line_ends.data(), visible.data());
+				checksum += double(seen);
+				return starts.size();
+			}, &ops);
+			report(file, name, "line_of_sight", mesh.triangles.size(), ops, sight);
+			std::cerr << "(" << file << " " << name << ": " << ray_hits << " of " << points.size() << " rays hit, " << seen << " of " << starts.size() << " lines visible)" << std::endl;
+
+			//path corners sit on vertices, which line_of_sight must be able to start (and end) on:
+			// (nearly all of these lines should be visible -- the funnel only bends a path at corners it can't see past)
+			WalkMeshNavigator navigator(mesh);
+			size_t corner_lines = 0, corner_seen = 0;
+			std::vector< WalkPoint > path;
+			for (size_t i = 0; i < std::min< size_t >(starts.size(), 200); ++i) {
+				if (!navigator.find_path(starts[i], line_ends[i], &path)) continue;
+				for (size_t c = 0; c + 1 < path.size(); ++c) {
+					corner_lines += 2;
+					if (mesh.line_of_sight(path[c], path[c+1])) corner_seen += 1;
+					if (mesh.line_of_sight(path[c+1], path[c])) corner_seen += 1;
+				}
+			}
+			std::cerr << "(" << file << " " << name << ": " << corner_seen << " of " << corner_lines << " path corner-to-corner lines visible)" << std::endl;
+		}
+	}
+
+	std::cerr << "(checksum " << checksum << ")" << std::endl;
+
+	return 0;
+}
@@ -0,0 +1,322 @@
+//cook-assets: rewrite the game's assets into forms that load with no processing.
+//
+//Usage:
+//  cook-assets [--force] [directory]
+//    directory defaults to the 'dist' folder next to this program's folder
+//    --force cooks everything, even assets the manifest says are unchanged
+//
+//Cooks into 'cooked' folders next to the sources (which are left alone, so scenes/Makefile and pack-level.py
+// keep working from them); loaders pick up cooked copies through cooked_path() in data_path.hpp:
+//  *.pnct  -> de-duplicated, vertex-cache ordered, indexed meshes (see MeshBuffer::write_cooked)
+//  *.w     -> walkmeshes with precomputed adjacency ('adj0' chunk)
+//  *.level -> both of the above, for the level's mesh (or cell mesh) and walkmesh sections
+//  *.wav   -> 48kHz mono float cache next to files that need conversion ('.48k', see resample.hpp)
+//
+//The content hash of each cooked asset's source is kept in 'cooked/cook-manifest.txt' in the directory,
+// so re-running skips assets that haven't changed since they were cooked.
+
+#include "Mesh.hpp"
+#include "WalkMesh.hpp"
+#include "Level.hpp"
+#include "MappedFile.hpp"
+#include "read_write_chunk.hpp"
+#include "load_wav.hpp"
+#include "resample.hpp"
+#include "data_path.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+//FNV-1a over a file's contents:
+static uint64_t hash_file(std::string const &filename) {
+	if (std::filesystem::file_size(filename) == 0) return 14695981039346656037ULL;
+	MappedFile file(filename);
+	uint64_t hash = 14695981039346656037ULL;
+	for (char const *c = file.begin(); c != file.end(); ++c) {
+		hash = (hash ^ uint8_t(*c)) * 1099511628211ULL;
+	}
+	return hash;
+}
+
+//write 'data' to 'filename' via a temporary file, after checking that 'validate' can load the temporary file:
+template< typename Validate >
+static void replace_file(std::string const &filename, std::string const &data, Validate const &validate) {
+	//(temporary file keeps the extension, since loaders go by it)
+	std::string temp = filename + ".cook-tmp" + std::filesystem::path(filename).extension().string();
+	{
+		std::ofstream out(temp, std::ios::binary);
+		out.write(data.data(), data.size());
+		if (!out) throw std::runtime_error("failed to write '" + temp + "'");
+	}
+	try {
+		validate(temp);
+	} catch (std::exception &e) {
+		std::filesystem::remove(temp);
+		throw std::runtime_error("cooked file failed to load (" + std::string(e.what()) + ")");
+	}
+	std::filesystem::rename(temp, filename);
+}
+
+//walkmesh file data [begin,end) with an 'adj0' chunk (returns the data unchanged if it already has one):
+static std::string cook_walkmeshes(char *begin, char *end, std::string const &filename) {
+	char *at = begin;
+	std::vector< glm::vec3 > vertices, normals;
+	std::vector< glm::uvec3 > triangles;
+	std::vector< char > names;
+	read_chunk(&at, end, "p...", &vertices);
+	read_chunk(&at, end, "n...", &normals);
+	read_chunk(&at, end, "tri0", &triangles);
+	read_chunk(&at, end, "str0", &names);
+
+	struct IndexEntry {
+		uint32_t name_begin, name_end;
+		uint32_t vertex_begin, vertex_end;
+		uint32_t triangle_begin, triangle_end;
+	};
+	std::vector< IndexEntry > index;
+	read_chunk(&at, end, "idxA", &index);
+
+	if (at != end) {
+		if (end - at >= 4 && std::string(at, 4) == "adj0") return std::string(begin, end);
+		throw std::runtime_error("unexpected data after index in walkmesh data from '" + filename + "'");
+	}
+
+	//adjacency over all triangles in the file, built mesh-by-mesh (meshes don't share edges):
+	std::vector< uint32_t > twins(3 * triangles.size(), -1U);
+	for (auto const &e : index) {
+		if (!(e.triangle_begin <= e.triangle_end && e.triangle_end <= triangles.size())) {
+			throw std::runtime_error("invalid triangle indices in index of '" + filename + "'");
+		}
+		std::vector< uint32_t > mesh_twins = WalkMesh::build_twins(ChunkView< glm::uvec3 const >(triangles.data() + e.triangle_begin, e.triangle_end - e.triangle_begin));
+		for (uint32_t h = 0; h < mesh_twins.size(); ++h) {
+			twins[3 * e.triangle_begin + h] = (mesh_twins[h] == -1U ? -1U : 3 * e.triangle_begin + mesh_twins[h]);
+		}
+	}
+
+	std::ostringstream out;
+	out.write(begin, end - begin);
+	write_chunk("adj0", twins, &out);
+	return out.str();
+}
+
+//a MeshBuffer in cooked form:
+static std::string cook_meshes(MeshBuffer const &buffer) {
+	std::ostringstream out;
+	buffer.write_cooked(&out);
+	return out.str();
+}
+
+//level file with the given sections (same layout as scenes/pack-level.py):
+static std::string pack_level(std::vector< std::pair< std::string, std::string > > const &sections) {
+	struct TOCEntry {
+		char kind[4];
+		uint32_t offset;
+		uint32_t size;
+		uint32_t reserved;
+	};
+	static_assert(sizeof(TOCEntry) == 16, "TOCEntry is packed.");
+	auto align = [](size_t offset) { return (offset + 15) & ~size_t(15); };
+
+	std::vector< TOCEntry > toc;
+	size_t offset = align(8 + sizeof(TOCEntry) * sections.size());
+	for (auto const &section : sections) {
+		TOCEntry entry;
+		std::memcpy(entry.kind, section.first.data(), 4);
+		entry.offset = uint32_t(offset);
+		entry.size = uint32_t(section.second.size());
+		entry.reserved = 0;
+		toc.emplace_back(entry);
+		offset = align(offset + section.second.size());
+	}
+
+	std::ostringstream out;
+	write_chunk("lvl0", toc, &out);
+	for (auto const &section : sections) {
+		std::string padding(align(size_t(out.tellp())) - size_t(out.tellp()), '\0');
+		out.write(padding.data(), padding.size());
+		out.write(section.second.data(), section.second.size());
+	}
+	return out.str();
+}
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+	try {
+#endif
+	bool force = false;
+	std::string dir;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--force") {
+			force = true;
+		} else if (dir.empty() && arg.substr(0, 2) != "--") {
+			dir = arg;
+		} else {
+			std::cerr << "Usage:\n\t" << argv[0] << " [--force] [directory]" << std::endl;
+			return 1;
+		}
+	}
+	if (dir.empty()) dir = data_path("../dist");
+
+	std::string cooked_dir = dir + "/cooked";
+
+	//manifest of content hashes of cooked assets' sources (relative path -> hash):
+	std::string manifest_filename = cooked_dir + "/cook-manifest.txt";
+	std::map< std::string, uint64_t > manifest;
+	{
+		std::ifstream in(manifest_filename);
+		std::string line;
+		while (std::getline(in, line)) {
+			std::istringstream str(line);
+			std::string hash, path;
+			if (!(str >> hash) || !std::getline(str >> std::ws, path)) continue;
+			manifest[path] = std::stoull(hash, nullptr, 16);
+		}
+	}
+
+	std::vector< std::string > assets;
+	for (auto entry = std::filesystem::recursive_directory_iterator(dir); entry != std::filesystem::recursive_directory_iterator(); ++entry) {
+		if (entry->is_directory() && entry->path().filename() == "cooked") {
+			entry.disable_recursion_pending(); //(don't cook the cooked copies)
+			continue;
+		}
+		if (!entry->is_regular_file()) continue;
+		std::string ext = entry->path().extension().string();
+		if (ext == ".pnct" || ext == ".w" || ext == ".level" || ext == ".wav") {
+			assets.emplace_back(std::filesystem::relative(entry->path(), dir).generic_string());
+		}
+	}
+	std::sort(assets.begin(), assets.end());
+
+	uint32_t cooked = 0, skipped = 0, failed = 0;
+	for (auto const &asset : assets) {
+		std::string filename = dir + "/" + asset;
+		std::string cooked_file = (std::filesystem::path(filename).parent_path() / "cooked" / std::filesystem::path(filename).filename()).string(); //(where cooked_path() looks)
+		std::string ext = std::filesystem::path(asset).extension().string();
+
+		uint64_t hash = hash_file(filename);
+		auto f = manifest.find(asset);
+		//(cooked copies are also checked, since they're only used while at least as new as their sources -- see cooked_path();
+		// and wav caches go stale when the source's modification time changes)
+		if (!force && f != manifest.end() && f->second == hash) {
+			std::vector< float > data;
+			bool fresh = (ext == ".wav" ? (!std::filesystem::exists(filename + ".48k") || load_converted(filename, &data)) : cooked_path(filename) == cooked_file);
+			if (fresh) {
+				++skipped;
+				continue;
+			}
+		}
+
+		try {
+			if (ext != ".wav") std::filesystem::create_directories(std::filesystem::path(cooked_file).parent_path());
+			if (ext == ".pnct") {
+				MeshBuffer buffer(filename, MeshBuffer::Deferred);
+				replace_file(cooked_file, cook_meshes(buffer), [](std::string const &temp) {
+					MeshBuffer check(temp, MeshBuffer::Deferred);
+				});
+			} else if (ext == ".w") {
+				std::string data;
+				{
+					MappedFile file(filename);
+					data = cook_walkmeshes(file.begin(), file.end(), filename);
+				}
+				replace_file(cooked_file, data, [](std::string const &temp) {
+					WalkMeshes check(temp);
+				});
+			} else if (ext == ".level") {
+				std::string data;
+				{
+					Level level(filename);
+					std::string walk = cook_walkmeshes(level.walkmeshes.begin, level.walkmeshes.end, filename);
+					if (level.streamed()) {
+						//cook each cell's meshes, and re-point the cells at them:
+						std::vector< Level::Cell > cells(level.cells, level.cells + level.cells_count);
+						std::string cell_meshes;
+						for (auto &cell : cells) {
+							MeshBuffer buffer(level.file, level.cell_meshes.begin + cell.mesh_begin, level.cell_meshes.begin + cell.mesh_end, filename, MeshBuffer::Deferred);
+							std::string meshes = cook_meshes(buffer);
+							cell.mesh_begin = uint32_t(cell_meshes.size());
+							cell.mesh_end = uint32_t(cell_meshes.size() + meshes.size());
+							cell_meshes += meshes;
+							cell_meshes.resize((cell_meshes.size() + 15) & ~size_t(15), '\0');
+						}
+						data = pack_level({
+							{"scen", std::string(level.scene.begin, level.scene.end)},
+							{"walk", walk},
+							{"cell", std::string(reinterpret_cast< char const * >(cells.data()), cells.size() * sizeof(Level::Cell))},
+							{"cdrw", std::string(reinterpret_cast< char const * >(level.cell_drawables), level.cell_drawables_count * sizeof(Level::CellDrawable))},
+							{"cmsh", cell_meshes},
+						});
+					} else {
+						std::string meshes = cook_meshes(MeshBuffer(level, MeshBuffer::Deferred));
+						data = pack_level({
+							{"mesh", meshes},
+							{"scen", std::string(level.scene.begin, level.scene.end)},
+							{"walk", walk},
+							{"mref", std::string(reinterpret_cast< char const * >(level.mesh_refs), level.mesh_refs_count * 4)},
+						});
+					}
+				}
+				replace_file(cooked_file, data, [](std::string const &temp) {
+					Level check(temp);
+					if (check.streamed()) {
+						for (size_t c = 0; c < check.cells_count; ++c) {
+							Level::Cell const &cell = check.cells[c];
+							MeshBuffer check_meshes(check.file, check.cell_meshes.begin + cell.mesh_begin, check.cell_meshes.begin + cell.mesh_end, temp, MeshBuffer::Deferred);
+						}
+					} else {
+						MeshBuffer check_meshes(check, MeshBuffer::Deferred);
+					}
+					WalkMeshes check_walkmeshes(check);
+				});
+			} else if (ext == ".wav") {
+				std::vector< float > data;
+				//(load_wav writes the .48k cache if the file needs conversion)
+				if (!load_converted(filename, &data)) load_wav(filename, &data);
+			}
+		} catch (std::exception &e) {
+			std::cerr << "ERROR cooking '" << asset << "': " << e.what() << std::endl;
+			++failed;
+			continue;
+		}
+
+		manifest[asset] = hash;
+		std::cout << "Cooked '" << asset << "'." << std::endl;
+		++cooked;
+	}
+
+	{ //write updated manifest:
+		std::error_code ec;
+		std::filesystem::create_directories(cooked_dir, ec);
+		std::ofstream out(manifest_filename);
+		for (auto const &entry : manifest) {
+			char hash[17];
+			std::snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)entry.second);
+			out << hash << ' ' << entry.first << '\n';
+		}
+		if (!out) {
+			std::cerr << "WARNING: failed to write '" << manifest_filename << "'." << std::endl;
+		}
+	}
+
+	std::cout << "Cooked " << cooked << ", skipped " << skipped << " unchanged, " << failed << " failed." << std::endl;
+	return (failed ? 1 : 0);
+
+#ifdef _WIN32
+	} catch (std::exception const &e) {
+		std::cerr << "Unhandled exception:\n" << e.what() << std::endl;
+		return 1;
+	} catch (...) {
+		std::cerr << "Unhandled exception (unknown type)." << std::endl;
+		throw;
+	}
+#endif
+}
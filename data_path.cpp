@@ -1,5 +1,6 @@
 #include "data_path.hpp"
 
+#include <filesystem>
 #include <iostream>
 #include <vector>
 #include <sstream>
@@ -62,6 +63,17 @@ std::string data_path(std::string const &suffix) {
 	return path + "/" + suffix;
 }
 
+std::string cooked_path(std::string const &filename) {
+	std::filesystem::path source(filename);
+	std::filesystem::path cooked = source.parent_path() / "cooked" / source.filename();
+	std::error_code ec;
+	auto cooked_time = std::filesystem::last_write_time(cooked, ec);
+	if (ec) return filename; //(not cooked)
+	auto source_time = std::filesystem::last_write_time(source, ec);
+	if (!ec && cooked_time < source_time) return filename; //(stale: re-run cook-assets)
+	return cooked.string();
+}
+
 /* From Rktcr; to be used eventually!
 static std::string make_user_dir(std::string const &app_name) {
 	std::string ret = "";
@@ -5,3 +5,8 @@
 //construct a path based on the location of the currently-running executable:
 // (e.g. if running /home/ix/game0/game.exe will return '/home/ix/game0/' + suffix)
 std::string data_path(std::string const &suffix);
+
+//path of the cooked copy of a data file (written to a 'cooked' folder next to it by cook-assets), if that copy is
+// at least as new as the file itself; otherwise the file's own path:
+// (e.g., cooked_path(data_path("wood.level")) is '.../cooked/wood.level' once cook-assets has cooked it)
+std::string cooked_path(std::string const &filename);
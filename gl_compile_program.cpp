@@ -1,9 +1,100 @@
 #include "gl_compile_program.hpp"
+#include "read_write_chunk.hpp"
 
+#include <SDL.h>
+
+#include <filesystem>
 #include <vector>
 #include <string>
 #include <stdexcept>
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstdint>
+
+//program binary support (core in GL 4.1, so not part of GL.hpp):
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH          0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS     0x87FE
+
+namespace {
+	struct ProgramBinaryCache {
+		void (APIENTRY *GetProgramBinary)(GLuint program, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat, void *binary) = nullptr;
+		void (APIENTRY *ProgramBinary)(GLuint program, GLenum binaryFormat, const void *binary, GLsizei length) = nullptr;
+		void (APIENTRY *ProgramParameteri)(GLuint program, GLenum pname, GLint value) = nullptr;
+		std::string path; //directory (with trailing separator) to store binaries in; empty if caching is disabled
+		std::string driver; //vendor/renderer/version strings (part of the cache key)
+	};
+
+	//set up on first use (needs a current GL context):
+	ProgramBinaryCache const &get_program_binary_cache() {
+		static ProgramBinaryCache cache;
+		static bool initialized = false;
+		if (initialized) return cache;
+		initialized = true;
+
+		GLint major = 0, minor = 0;
+		glGetIntegerv(GL_MAJOR_VERSION, &major);
+		glGetIntegerv(GL_MINOR_VERSION, &minor);
+		if (!((major > 4 || (major == 4 && minor >= 1)) || SDL_GL_ExtensionSupported("GL_ARB_get_program_binary"))) return cache;
+
+		GLint formats = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		if (formats <= 0) return cache; //(some drivers support the api but no formats)
+
+		cache.GetProgramBinary = (decltype(cache.GetProgramBinary))SDL_GL_GetProcAddress("glGetProgramBinary");
+		cache.ProgramBinary = (decltype(cache.ProgramBinary))SDL_GL_GetProcAddress("glProgramBinary");
+		cache.ProgramParameteri = (decltype(cache.ProgramParameteri))SDL_GL_GetProcAddress("glProgramParameteri");
+		if (!cache.GetProgramBinary || !cache.ProgramBinary || !cache.ProgramParameteri) return cache;
+
+		char *pref_path = SDL_GetPrefPath("15-466", "program-cache");
+		if (!pref_path) return cache;
+		cache.path = pref_path;
+		SDL_free(pref_path);
+
+		for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+			GLubyte const *str = glGetString(name);
+			if (str) cache.driver += reinterpret_cast< char const * >(str);
+			cache.driver += '\n';
+		}
+		return cache;
+	}
+
+	//FNV-1a, continuing from 'hash':
+	uint64_t fnv1a(uint64_t hash, char const *begin, char const *end) {
+		for (char const *c = begin; c != end; ++c) {
+			hash = (hash ^ uint8_t(*c)) * 1099511628211ULL;
+		}
+		return hash;
+	}
+	constexpr uint64_t FNV1aBasis = 14695981039346656037ULL;
+
+	//cache files are a 'phdr' chunk holding one of these, then a 'pbin' chunk with the binary itself:
+	// (length and checksum catch files that were cut short or otherwise damaged)
+	struct ProgramBinaryHeader {
+		GLenum format = 0;
+		uint32_t length = 0; //bytes in the binary
+		uint64_t checksum = 0; //FNV-1a of the binary
+	};
+	static_assert(sizeof(ProgramBinaryHeader) == 16, "ProgramBinaryHeader is packed.");
+
+	//cache file name for a given program:
+	std::string program_binary_filename(ProgramBinaryCache const &cache, std::string const &vertex_shader_source, std::string const &fragment_shader_source) {
+		uint64_t hash = FNV1aBasis;
+		auto add = [&hash](std::string const &str) {
+			hash = fnv1a(hash, str.data(), str.data() + str.size());
+			hash = (hash ^ 0xff) * 1099511628211ULL; //(separator, so "ab"+"c" != "a"+"bc")
+		};
+		add(vertex_shader_source);
+		add(fragment_shader_source);
+		add(cache.driver);
+
+		std::ostringstream name;
+		name << cache.path << std::hex << std::setw(16) << std::setfill('0') << hash << ".program";
+		return name.str();
+	}
+}
 
 static GLuint gl_compile_shader(GLenum type, std::string const &source) {
 	GLuint shader = glCreateShader(type);
@@ -32,6 +123,37 @@ GLuint gl_compile_program(
 	std::string const &fragment_shader_source
 	) {
 
+	ProgramBinaryCache const &cache = get_program_binary_cache();
+	std::string cache_filename;
+
+	//try to load the program from the binary cache:
+	if (!cache.path.empty()) {
+		cache_filename = program_binary_filename(cache, vertex_shader_source, fragment_shader_source);
+		std::ifstream file(cache_filename, std::ios::binary);
+		if (file) {
+			try {
+				std::vector< ProgramBinaryHeader > header;
+				read_chunk(file, "phdr", &header);
+				std::vector< char > binary;
+				read_chunk(file, "pbin", &binary);
+				if (header.size() != 1) throw std::runtime_error("expecting exactly one header");
+				if (header[0].length != binary.size()) throw std::runtime_error("binary length mismatch");
+				if (header[0].checksum != fnv1a(FNV1aBasis, binary.data(), binary.data() + binary.size())) throw std::runtime_error("binary checksum mismatch");
+				if (file.peek() != std::ifstream::traits_type::eof()) throw std::runtime_error("trailing data");
+
+				GLuint program = glCreateProgram();
+				cache.ProgramBinary(program, header[0].format, binary.data(), GLsizei(binary.size()));
+				GLint link_status = GL_FALSE;
+				glGetProgramiv(program, GL_LINK_STATUS, &link_status);
+				if (link_status == GL_TRUE) return program;
+				//rejected (e.g., driver was updated in a way the key didn't catch):
+				glDeleteProgram(program);
+			} catch (std::exception const &) {
+				//corrupt cache file; will be overwritten below
+			}
+		}
+	}
+
 	GLuint vertex_shader = gl_compile_shader(GL_VERTEX_SHADER, vertex_shader_source);
 	GLuint fragment_shader = gl_compile_shader(GL_FRAGMENT_SHADER, fragment_shader_source);
 
@@ -44,6 +166,7 @@ GLuint gl_compile_program(
 	glDeleteShader(fragment_shader);
 
 	//link the shader program and throw errors if linking fails:
+	if (!cache_filename.empty()) cache.ProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 	glLinkProgram(program);
 	GLint link_status = GL_FALSE;
 	glGetProgramiv(program, GL_LINK_STATUS, &link_status);
@@ -58,5 +181,37 @@ GLuint gl_compile_program(
 		throw std::runtime_error("failed to link program");
 	}
 
+	//store the linked program in the binary cache:
+	if (!cache_filename.empty()) {
+		GLint length = 0;
+		glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+		if (length > 0) {
+			std::vector< char > binary(length);
+			std::vector< ProgramBinaryHeader > header(1);
+			GLsizei got = 0;
+			cache.GetProgramBinary(program, length, &got, &header[0].format, binary.data());
+			binary.resize(got);
+			header[0].length = uint32_t(binary.size());
+			header[0].checksum = fnv1a(FNV1aBasis, binary.data(), binary.data() + binary.size());
+
+			//write to a temporary file, then move it into place, so a crash (or another instance) never sees a partial file:
+			std::string temp = cache_filename + ".tmp";
+			bool written = false;
+			{
+				std::ofstream file(temp, std::ios::binary);
+				write_chunk("phdr", header, &file);
+				write_chunk("pbin", binary, &file);
+				file.close();
+				written = bool(file);
+			}
+			std::error_code ec;
+			if (written) std::filesystem::rename(temp, cache_filename, ec);
+			if (!written || ec) {
+				std::filesystem::remove(temp, ec);
+				std::cerr << "WARNING: failed to write program binary cache file '" << cache_filename << "'." << std::endl;
+			}
+		}
+	}
+
 	return program;
 }
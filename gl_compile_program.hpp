@@ -6,6 +6,9 @@
 
 //compiles+links an OpenGL shader program from source.
 // throws on compilation error.
+// if the driver supports program binaries (GL 4.1 / ARB_get_program_binary), linked programs are
+//  cached on disk (in SDL_GetPrefPath), keyed by the sources and GL vendor/renderer/version;
+//  cached binaries the driver rejects are ignored and replaced.
 GLuint gl_compile_program(
 	std::string const &vertex_shader_source,
 	std::string const &fragment_shader_source);
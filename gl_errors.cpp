@@ -0,0 +1,158 @@
+#include "gl_errors.hpp"
+
+#include <SDL.h>
+
+#include <atomic>
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+
+//debug output (KHR_debug is core in GL 4.3, so not part of GL.hpp; ARB_debug_output uses the same values):
+#define GL_DEBUG_OUTPUT_SYNCHRONOUS       0x8242
+#define GL_DEBUG_SOURCE_API               0x8246
+#define GL_DEBUG_SOURCE_WINDOW_SYSTEM     0x8247
+#define GL_DEBUG_SOURCE_SHADER_COMPILER   0x8248
+#define GL_DEBUG_SOURCE_THIRD_PARTY       0x8249
+#define GL_DEBUG_SOURCE_APPLICATION       0x824A
+#define GL_DEBUG_TYPE_ERROR               0x824C
+#define GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR 0x824D
+#define GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR  0x824E
+#define GL_DEBUG_TYPE_PORTABILITY         0x824F
+#define GL_DEBUG_TYPE_PERFORMANCE         0x8250
+#define GL_DEBUG_SEVERITY_HIGH            0x9146
+#define GL_DEBUG_SEVERITY_MEDIUM          0x9147
+#define GL_DEBUG_SEVERITY_LOW             0x9148
+#define GL_DEBUG_SEVERITY_NOTIFICATION    0x826B
+#define GL_DEBUG_OUTPUT                   0x92E0
+#define GL_DONT_CARE                      0x1100
+
+GLDiagnostics gl_diagnostics = GLDiagnostics::Off;
+
+namespace {
+	typedef void (APIENTRY *DebugProc)(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, GLchar const *message, void const *user);
+
+	bool have_callback = false; //is a debug callback installed?
+
+	//the callback may be called from a driver thread (at Async level), so it only uses stdio, and stops after a while:
+	constexpr uint32_t MaxMessages = 200;
+	std::atomic< uint32_t > messages{0};
+
+	void APIENTRY debug_callback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, GLchar const *message, void const *) {
+		uint32_t count = messages.fetch_add(1);
+		if (count >= MaxMessages) {
+			if (count == MaxMessages) std::fprintf(stderr, "WARNING: more than %u GL debug messages; ignoring the rest.\n", MaxMessages);
+			return;
+		}
+
+		char const *source_name = "other";
+		if (source == GL_DEBUG_SOURCE_API) source_name = "api";
+		else if (source == GL_DEBUG_SOURCE_WINDOW_SYSTEM) source_name = "window system";
+		else if (source == GL_DEBUG_SOURCE_SHADER_COMPILER) source_name = "shader compiler";
+		else if (source == GL_DEBUG_SOURCE_THIRD_PARTY) source_name = "third party";
+		else if (source == GL_DEBUG_SOURCE_APPLICATION) source_name = "application";
+
+		char const *type_name = "other";
+		if (type == GL_DEBUG_TYPE_ERROR) type_name = "error";
+		else if (type == GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR) type_name = "deprecated";
+		else if (type == GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR) type_name = "undefined behavior";
+		else if (type == GL_DEBUG_TYPE_PORTABILITY) type_name = "portability";
+		else if (type == GL_DEBUG_TYPE_PERFORMANCE) type_name = "performance";
+
+		char const *severity_name = "low";
+		if (severity == GL_DEBUG_SEVERITY_HIGH) severity_name = "high";
+		else if (severity == GL_DEBUG_SEVERITY_MEDIUM) severity_name = "medium";
+		else if (severity == GL_DEBUG_SEVERITY_NOTIFICATION) severity_name = "notification";
+
+		//(length may be negative, meaning 'message' is null-terminated)
+		std::fprintf(stderr, "WARNING: GL %s (%s, %s severity, id %u): %.*s\n", type_name, source_name, severity_name, id,
+			(length < 0 ? int(std::char_traits< char >::length(message)) : int(length)), message);
+	}
+}
+
+GLDiagnostics gl_diagnostics_from_string(std::string const &name) {
+	if (name == "off") return GLDiagnostics::Off;
+	if (name == "async") return GLDiagnostics::Async;
+	if (name == "sync") return GLDiagnostics::Sync;
+	throw std::runtime_error("GL diagnostics level should be 'off', 'async', or 'sync' (not '" + name + "').");
+}
+
+int gl_diagnostics_context_flags(GLDiagnostics level) {
+	return (level == GLDiagnostics::Off ? 0 : int(SDL_GL_CONTEXT_DEBUG_FLAG));
+}
+
+void gl_diagnostics_init(GLDiagnostics level) {
+	#if !GL_DIAGNOSTICS
+	if (level == GLDiagnostics::Sync) {
+		std::cerr << "NOTE: GL_ERRORS() checks are compiled out of this build, so using 'async' GL diagnostics instead of 'sync'." << std::endl;
+		level = GLDiagnostics::Async;
+	}
+	#endif
+	gl_diagnostics = level;
+	if (level == GLDiagnostics::Off) return;
+
+	//look for a debug callback -- KHR_debug (core in 4.3) or, failing that, ARB_debug_output:
+	void (APIENTRY *DebugMessageCallback)(DebugProc callback, void const *user) = nullptr;
+	void (APIENTRY *DebugMessageControl)(GLenum source, GLenum type, GLenum severity, GLsizei count, GLuint const *ids, GLboolean enabled) = nullptr;
+	bool khr = false;
+
+	GLint major = 0, minor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+	if ((major > 4 || (major == 4 && minor >= 3)) || SDL_GL_ExtensionSupported("GL_KHR_debug")) {
+		DebugMessageCallback = (decltype(DebugMessageCallback))SDL_GL_GetProcAddress("glDebugMessageCallback");
+		DebugMessageControl = (decltype(DebugMessageControl))SDL_GL_GetProcAddress("glDebugMessageControl");
+		khr = true;
+	}
+	if ((!DebugMessageCallback || !DebugMessageControl) && SDL_GL_ExtensionSupported("GL_ARB_debug_output")) {
+		DebugMessageCallback = (decltype(DebugMessageCallback))SDL_GL_GetProcAddress("glDebugMessageCallbackARB");
+		DebugMessageControl = (decltype(DebugMessageControl))SDL_GL_GetProcAddress("glDebugMessageControlARB");
+		khr = false;
+	}
+
+	if (!DebugMessageCallback || !DebugMessageControl) {
+		std::cerr << "NOTE: no GL debug output (KHR_debug / ARB_debug_output) available";
+		if (level == GLDiagnostics::Async) std::cerr << "; checking for GL errors once per frame instead";
+		std::cerr << "." << std::endl;
+		have_callback = false;
+		return;
+	}
+
+	DebugMessageCallback(debug_callback, nullptr);
+	//(notifications are things like "buffer will use video memory" -- far too chatty)
+	DebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_NOTIFICATION, 0, nullptr, GL_FALSE);
+	if (khr) glEnable(GL_DEBUG_OUTPUT); //(ARB_debug_output is always on in a debug context)
+	if (level == GLDiagnostics::Sync) {
+		glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+	} else {
+		glDisable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+	}
+	have_callback = true;
+
+	gl_errors("gl_diagnostics_init"); //(clear any errors from probing)
+}
+
+void gl_diagnostics_end_frame() {
+	if (gl_diagnostics == GLDiagnostics::Async && !have_callback) gl_errors("end of frame");
+}
+
+void gl_errors(char const *where) {
+	GLenum err = 0;
+	while ((err = glGetError()) != GL_NO_ERROR) {
+		#define CHECK( ERR ) \
+			if (err == ERR) { \
+				std::cerr << "WARNING: gl error '" #ERR "' at " << where << std::endl; \
+			} else
+
+		CHECK( GL_INVALID_ENUM )
+		CHECK( GL_INVALID_VALUE )
+		CHECK( GL_INVALID_OPERATION )
+		CHECK( GL_INVALID_FRAMEBUFFER_OPERATION )
+		CHECK( GL_OUT_OF_MEMORY )
+		CHECK( GL_STACK_UNDERFLOW )
+		CHECK( GL_STACK_OVERFLOW )
+		{
+			std::cerr << "WARNING: gl error '" << err << "'" << std::endl;
+		}
+		#undef CHECK
+	}
+}
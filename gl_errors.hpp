@@ -1,31 +1,62 @@
 #pragma once
 
 #include "GL.hpp"
-#include <iostream>
+
+#include <cstdint>
+#include <string>
+
+/*
+ * GL diagnostics, at one of three levels (chosen at startup; main.cpp takes '--gl-debug off|async|sync'):
+ *  - Off:   nothing is checked; the context is created without the debug flag
+ *  - Async: a debug context reports problems through a KHR_debug (or ARB_debug_output) callback, whenever
+ *           the driver gets around to it -- nothing waits on the GPU. Without either extension (e.g., on macOS),
+ *           errors are instead collected with one glGetError sweep per frame (see gl_diagnostics_end_frame).
+ *  - Sync:  the callback runs synchronously, inside the offending GL call (so a debugger's stack shows the culprit),
+ *           and every GL_ERRORS() checks glGetError. This stalls the driver, so it's only for tracking problems down.
+ *
+ * Build with -DGL_DIAGNOSTICS=0 (release) to compile GL_ERRORS() to nothing and default to Off;
+ *  Async is still available at runtime, as a debug channel for problems that only show up in release builds.
+ */
+
+#ifndef GL_DIAGNOSTICS
+#define GL_DIAGNOSTICS 1
+#endif
+
+enum class GLDiagnostics : uint8_t {
+	Off,
+	Async,
+	Sync,
+};
+
+#if GL_DIAGNOSTICS
+constexpr GLDiagnostics GLDiagnosticsDefault = GLDiagnostics::Async;
+#else
+constexpr GLDiagnostics GLDiagnosticsDefault = GLDiagnostics::Off;
+#endif
+
+//current level (set by gl_diagnostics_init):
+extern GLDiagnostics gl_diagnostics;
+
+//parse "off", "async", or "sync" (throws on anything else):
+GLDiagnostics gl_diagnostics_from_string(std::string const &name);
+
+//flags to pass as SDL_GL_CONTEXT_FLAGS when creating the context for 'level':
+int gl_diagnostics_context_flags(GLDiagnostics level);
+
+//set up reporting for 'level' (call once the context is current and init_GL() has run):
+void gl_diagnostics_init(GLDiagnostics level);
+
+//call once per frame (only does work at Async level when there is no debug callback):
+void gl_diagnostics_end_frame();
+
+//report (and clear) all pending glGetError errors; 'where' is included in the message:
+void gl_errors(char const *where);
 
 #define STR2(X) # X
 #define STR(X) STR2(X)
 
-inline void gl_errors(std::string const &where) {
-	GLenum err = 0;
-	while ((err = glGetError()) != GL_NO_ERROR) {
-		#define CHECK( ERR ) \
-			if (err == ERR) { \
-				std::cerr << "WARNING: gl error '" #ERR "' at " << where << std::endl; \
-			} else
-
-		CHECK( GL_INVALID_ENUM )
-		CHECK( GL_INVALID_VALUE )
-		CHECK( GL_INVALID_OPERATION )
-		CHECK( GL_INVALID_FRAMEBUFFER_OPERATION )
-		CHECK( GL_OUT_OF_MEMORY )
-		CHECK( GL_STACK_UNDERFLOW )
-		CHECK( GL_STACK_OVERFLOW )
-		{
-			std::cerr << "WARNING: gl error '" << err << "'" << std::endl;
-		}
-		#undef CHECK
-	}
-}
-#define GL_ERRORS() gl_errors(__FILE__  ":" STR(__LINE__) )
-
+#if GL_DIAGNOSTICS
+#define GL_ERRORS() do { if (gl_diagnostics == GLDiagnostics::Sync) gl_errors(__FILE__  ":" STR(__LINE__)); } while (0)
+#else
+#define GL_ERRORS() do { } while (0)
+#endif
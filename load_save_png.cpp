@@ -1,4 +1,5 @@
 #include "load_save_png.hpp"
+#include "parallel_for.hpp"
 
 #include <png.h>
 
@@ -11,6 +12,7 @@
 
 using std::vector;
 
+static bool load_png(std::istream &from, unsigned int *width, unsigned int *height, PNGDestination const &destination, OriginLocation origin);
 bool load_png(std::istream &from, unsigned int *width, unsigned int *height, vector< glm::u8vec4 > *data, OriginLocation origin);
 void save_png(std::ostream &to, unsigned int width, unsigned int height, glm::u8vec4 const *data, OriginLocation origin);
 
@@ -31,6 +33,37 @@ void save_png(std::string filename, glm::uvec2 size, glm::u8vec4 const *data, Or
 	save_png(file, size.x, size.y, data, origin);
 }
 
+void load_pngs(std::vector< PNGDecode > &batch) {
+	std::vector< uint8_t > failed(batch.size(), 0); //(not vector< bool >, since jobs write elements concurrently)
+
+	//one image per job (decoding an image takes far longer than starting a job):
+	parallel_for(batch.size(), 1, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			PNGDecode &item = batch[i];
+			std::ifstream file(item.filename.c_str(), std::ios::binary);
+			bool ok = false;
+			if (file) {
+				if (item.destination) {
+					item.data.clear();
+					ok = load_png(file, &item.size.x, &item.size.y, item.destination, item.origin);
+				} else {
+					ok = load_png(file, &item.size.x, &item.size.y, &item.data, item.origin);
+				}
+			}
+			if (!ok) {
+				item.size = glm::uvec2(0);
+				failed[i] = 1;
+			}
+		}
+	});
+
+	for (size_t i = 0; i < batch.size(); ++i) {
+		if (failed[i]) {
+			throw std::runtime_error("Failed to read PNG image from '" + batch[i].filename + "'.");
+		}
+	}
+}
+
 
 static void user_read_data(png_structp png_ptr, png_bytep data, png_size_t length) {
 	std::istream *from = reinterpret_cast< std::istream * >(png_get_io_ptr(png_ptr));
@@ -59,11 +92,21 @@ static void user_flush_data(png_structp png_ptr) {
 
 bool load_png(std::istream &from, unsigned int *width, unsigned int *height, vector< glm::u8vec4 > *data, OriginLocation origin) {
 	assert(data);
+	data->clear();
+	bool ok = load_png(from, width, height, [data](glm::uvec2 size) {
+		data->resize(size_t(size.x) * size_t(size.y));
+		return data->data();
+	}, origin);
+	if (!ok) data->clear();
+	return ok;
+}
+
+static bool load_png(std::istream &from, unsigned int *width, unsigned int *height, PNGDestination const &destination, OriginLocation origin) {
+	assert(destination);
 	uint32_t local_width, local_height;
 	if (width == nullptr) width = &local_width;
 	if (height == nullptr) height = &local_height;
 	*width = *height = 0;
-	data->clear();
 	//..... load file ......
 	//Load a png file, as per the libpng docs:
 	png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, (png_voidp)NULL, (png_error_ptr)NULL, (png_error_ptr)NULL);
@@ -85,7 +128,6 @@ bool load_png(std::istream &from, unsigned int *width, unsigned int *height, vec
 		LOG_ERROR("  png interal error.");
 		png_destroy_read_struct(&png, &info, (png_infopp)NULL);
 		if (row_pointers != NULL) delete[] row_pointers;
-		data->clear();
 		return false;
 	}
 	//not needed with custom read/write functions: png_init_io(png, NULL);
@@ -109,13 +151,25 @@ bool load_png(std::istream &from, unsigned int *width, unsigned int *height, vec
 	//Make sure it's the format we think it is...
 	assert(rowbytes == w*sizeof(uint32_t));
 
-	data->resize(w*h);
+	glm::u8vec4 *pixels = nullptr;
+	try {
+		pixels = destination(glm::uvec2(w, h));
+	} catch (...) {
+		png_destroy_read_struct(&png, &info, NULL);
+		throw;
+	}
+	if (pixels == nullptr) {
+		LOG_ERROR("  no space for " << w << "x" << h << " image.");
+		png_destroy_read_struct(&png, &info, NULL);
+		return false;
+	}
+	//point rows directly at their final (flipped, if needed) locations:
 	row_pointers = new png_bytep[h];
 	for (unsigned int r = 0; r < h; ++r) {
 		if (origin == LowerLeftOrigin) {
-			row_pointers[h-1-r] = (png_bytep)(&(*data)[r*w]);
+			row_pointers[h-1-r] = (png_bytep)(&pixels[size_t(r)*w]);
 		} else {
-			row_pointers[r] = (png_bytep)(&(*data)[r*w]);
+			row_pointers[r] = (png_bytep)(&pixels[size_t(r)*w]);
 		}
 	}
 	png_read_image(png, row_pointers);
@@ -2,6 +2,7 @@
 
 #include <glm/glm.hpp>
 
+#include <functional>
 #include <string>
 #include <vector>
 #include <stdint.h>
@@ -18,3 +19,43 @@ enum OriginLocation {
 //NOTE: load_png will throw on error
 void load_png(std::string filename, glm::uvec2 *size, std::vector< glm::u8vec4 > *data, OriginLocation origin);
 void save_png(std::string filename, glm::uvec2 size, glm::u8vec4 const *data, OriginLocation origin);
+
+/*
+ * Batch decoding: many PNGs at once, as jobs (see parallel_for.hpp).
+ *
+ * Rows are decoded straight into their final place (already flipped for 'origin'; there is no separate flip pass),
+ *  either in 'data' or -- if 'destination' is set -- in memory the caller provides.
+ *
+ * Since the decode runs as jobs, a batch can be decoded in the 'prepare' stage of a split Load<> (see Load.hpp):
+ *
+ * Load< Textures > textures(LoadTagDefault, []() -> std::vector< PNGDecode > * {
+ *     auto batch = new std::vector< PNGDecode >(filenames.size());
+ *     for (size_t i = 0; i < filenames.size(); ++i) (*batch)[i].filename = data_path(filenames[i]);
+ *     load_pngs(*batch);
+ *     return batch;
+ * }, [](std::vector< PNGDecode > *batch) -> Textures const * {
+ *     //glTexImage2D(..., (*batch)[i].size.x, (*batch)[i].size.y, ..., (*batch)[i].data.data()) for each, then delete batch
+ * });
+ *
+ * To decode into a pixel unpack buffer, map it on the main thread first (e.g., in a loading function with an
+ *  earlier tag) and have 'destination' hand out pieces of it.
+ */
+
+//called with an image's size once it is known; returns space for size.x * size.y pixels (or nullptr to fail the image):
+// (in a batch, called from any job thread, possibly at the same time as other items' calls; must not throw)
+typedef std::function< glm::u8vec4 *(glm::uvec2 size) > PNGDestination;
+
+struct PNGDecode {
+	//in:
+	std::string filename;
+	OriginLocation origin = LowerLeftOrigin;
+	PNGDestination destination; //(if not set, pixels go in 'data')
+
+	//out:
+	glm::uvec2 size = glm::uvec2(0);
+	std::vector< glm::u8vec4 > data; //(left empty when 'destination' is set)
+};
+
+//decode every item in 'batch' (returns once all are done):
+// if any item fails, throws an error naming the first failed file.
+void load_pngs(std::vector< PNGDecode > &batch);
@@ -1,4 +1,5 @@
 #include "load_wav.hpp"
+#include "resample.hpp"
 
 #include <SDL.h>
 
@@ -12,6 +13,9 @@ void load_wav(std::string const &filename, std::vector< float > *data_) {
 	assert(data_);
 	auto &data = *data_;
 
+	//files that need conversion are converted once, and the result cached:
+	if (load_converted(filename, &data)) return;
+
 	SDL_AudioSpec audio_spec;
 	Uint8 *audio_buf = nullptr;
 	Uint32 audio_len = 0;
@@ -21,22 +25,33 @@ void load_wav(std::string const &filename, std::vector< float > *data_) {
 		throw std::runtime_error("Failed to load WAV file '" + filename + "'; SDL says \"" + std::string(SDL_GetError()) + "\"");
 	}
 
-	//based on the SDL_AudioCVT example in the docs: https://wiki.libsdl.org/SDL_AudioCVT
-	SDL_AudioCVT cvt;
-	SDL_BuildAudioCVT(&cvt, have->format, have->channels, have->freq, AUDIO_F32SYS, 1, AUDIO_RATE);
-	if (cvt.needed) {
-		std::cout << "WAV file '" + filename + "' didn't load as " + std::to_string(AUDIO_RATE) + " Hz, float32, mono; converting." << std::endl;
-		cvt.len = audio_len;
-		cvt.buf = (Uint8 *)SDL_malloc(cvt.len * cvt.len_mult);
-		SDL_memcpy(cvt.buf, audio_buf, audio_len);
-		SDL_ConvertAudio(&cvt);
-		int final_size = cvt.len_cvt;
-		assert(final_size >= 0 && final_size <= cvt.len * cvt.len_mult && "Converted audio should fit in buffer.");
-		assert(final_size % 4 == 0 && "Converted audio should consist of 4-byte elements.");
-		data.assign(reinterpret_cast< float * >(cvt.buf), reinterpret_cast< float * >(cvt.buf + final_size));
-		SDL_free(cvt.buf);
-	} else {
+	if (have->format == AUDIO_F32SYS && have->channels == 1 && have->freq == int(AUDIO_RATE)) {
 		data.assign(reinterpret_cast< float * >(audio_buf), reinterpret_cast< float * >(audio_buf + audio_len));
+	} else {
+		std::cout << "WAV file '" + filename + "' didn't load as " + std::to_string(AUDIO_RATE) + " Hz, float32, mono; converting." << std::endl;
+
+		//convert sample format with SDL (based on the SDL_AudioCVT example in the docs: https://wiki.libsdl.org/SDL_AudioCVT)...
+		std::vector< float > interleaved;
+		SDL_AudioCVT cvt;
+		SDL_BuildAudioCVT(&cvt, have->format, have->channels, have->freq, AUDIO_F32SYS, have->channels, have->freq);
+		if (cvt.needed) {
+			cvt.len = audio_len;
+			cvt.buf = (Uint8 *)SDL_malloc(cvt.len * cvt.len_mult);
+			SDL_memcpy(cvt.buf, audio_buf, audio_len);
+			SDL_ConvertAudio(&cvt);
+			int final_size = cvt.len_cvt;
+			assert(final_size >= 0 && final_size <= cvt.len * cvt.len_mult && "Converted audio should fit in buffer.");
+			assert(final_size % 4 == 0 && "Converted audio should consist of 4-byte elements.");
+			interleaved.assign(reinterpret_cast< float * >(cvt.buf), reinterpret_cast< float * >(cvt.buf + final_size));
+			SDL_free(cvt.buf);
+		} else {
+			interleaved.assign(reinterpret_cast< float * >(audio_buf), reinterpret_cast< float * >(audio_buf + audio_len));
+		}
+
+		//...then downmix and resample ourselves:
+		uint32_t channels = std::max< uint32_t >(1, have->channels);
+		resample_to_48k_mono(interleaved.data(), uint32_t(interleaved.size() / channels), channels, uint32_t(have->freq), &data);
+		save_converted(filename, data);
 	}
 	SDL_FreeWAV(audio_buf);
 
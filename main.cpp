@@ -14,7 +14,23 @@
 #include "GL.hpp"
 
 //for screenshots:
-#include "load_save_png.hpp"
+#include "FrameCapture.hpp"
+
+//for frame timing overlay:
+#include "Profiler.hpp"
+
+//for frame timing capture:
+#include "FrameTimes.hpp"
+
+//worker threads for parallel work (scene drawing, agents):
+#include "Jobs.hpp"
+
+//per-frame temporaries, and (in instrumentation builds) counting heap allocations per frame:
+#include "FrameArena.hpp"
+#include "AllocTracking.hpp"
+
+//GL error / debug output reporting:
+#include "gl_errors.hpp"
 
 //Includes for libSDL:
 #include <SDL.h>
@@ -24,6 +40,7 @@
 #include <iostream>
 #include <stdexcept>
 #include <memory>
+#include <string>
 #include <algorithm>
 
 #ifdef _WIN32
@@ -45,12 +62,65 @@ int main(int argc, char **argv) {
 	try {
 #endif
 
+	//------------  command line ------------
+
+	//'--frame-times file.csv' writes frame timings to file.csv on exit:
+	std::string frame_times_csv;
+	//'--tick-rate N' runs the simulation (Mode::update_fixed) N times per second:
+	float tick_rate = 120.0f;
+	//'--record-path file' saves the player's path through the level to file on exit:
+	std::string record_path;
+	//'--replay-path file' replays a recorded path (vsync off, one tick per frame) and writes a report to '--replay-report file' (default 'replay.csv'):
+	std::string replay_path;
+	std::string replay_report = "replay.csv";
+	//'--agents N' adds N wandering agents; '--job-threads N' runs jobs on N worker threads (default: one per core, less one):
+	uint32_t agents = 0;
+	uint32_t job_threads = 0;
+	//'--gl-debug off|async|sync' picks how GL problems are reported (see gl_errors.hpp):
+	GLDiagnostics gl_debug = GLDiagnosticsDefault;
+	//'--scene-lights' lights the level with the scene's lamps as well as the echo (toggle in-game with F8):
+	bool scene_lights = false;
+	for (int argi = 1; argi < argc; ++argi) {
+		std::string arg = argv[argi];
+		if (arg == "--frame-times" && argi + 1 < argc) {
+			frame_times_csv = argv[argi+1];
+			argi += 1;
+		} else if (arg == "--tick-rate" && argi + 1 < argc) {
+			tick_rate = std::stof(argv[argi+1]);
+			if (!(tick_rate > 0.0f)) throw std::runtime_error("--tick-rate should be positive.");
+			argi += 1;
+		} else if (arg == "--record-path" && argi + 1 < argc) {
+			record_path = argv[argi+1];
+			argi += 1;
+		} else if (arg == "--replay-path" && argi + 1 < argc) {
+			replay_path = argv[argi+1];
+			argi += 1;
+		} else if (arg == "--replay-report" && argi + 1 < argc) {
+			replay_report = argv[argi+1];
+			argi += 1;
+		} else if (arg == "--agents" && argi + 1 < argc) {
+			agents = uint32_t(std::stoul(argv[argi+1]));
+			argi += 1;
+		} else if (arg == "--job-threads" && argi + 1 < argc) {
+			job_threads = uint32_t(std::stoul(argv[argi+1]));
+			if (job_threads == 0) throw std::runtime_error("--job-threads should be positive.");
+			argi += 1;
+		} else if (arg == "--gl-debug" && argi + 1 < argc) {
+			gl_debug = gl_diagnostics_from_string(argv[argi+1]);
+			argi += 1;
+		} else if (arg == "--scene-lights") {
+			scene_lights = true;
+		} else {
+			std::cerr << "WARNING: ignoring unrecognized argument '" << arg << "'." << std::endl;
+		}
+	}
+
 	//------------  initialization ------------
 
 	//Initialize SDL library:
 	SDL_Init(SDL_INIT_VIDEO);
 
-	//Ask for an OpenGL context version 3.3, core profile, enable debug:
+	//Ask for an OpenGL context version 3.3, core profile, debug if diagnostics are on:
 	SDL_GL_ResetAttributes();
 	SDL_GL_SetAttribute(SDL_GL_RED_SIZE, 8);
 	SDL_GL_SetAttribute(SDL_GL_GREEN_SIZE, 8);
@@ -60,7 +130,7 @@ int main(int argc, char **argv) {
 	SDL_GL_SetAttribute(SDL_GL_STENCIL_SIZE, 8);
 	SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
-	SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, SDL_GL_CONTEXT_DEBUG_FLAG);
+	SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, gl_diagnostics_context_flags(gl_debug));
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
 
@@ -94,8 +164,16 @@ int main(int argc, char **argv) {
 	//On windows, load OpenGL entrypoints: (does nothing on other platforms)
 	init_GL();
 
+	//Hook up GL debug output (or not):
+	gl_diagnostics_init(gl_debug);
+
 	//Set VSYNC + Late Swap (prevents crazy FPS):
-	if (SDL_GL_SetSwapInterval(-1) != 0) {
+	// (except when replaying, which should run as fast as possible)
+	if (!replay_path.empty()) {
+		if (SDL_GL_SetSwapInterval(0) != 0) {
+			std::cerr << "NOTE: couldn't turn off vsync for replay (" << SDL_GetError() << ")." << std::endl;
+		}
+	} else if (SDL_GL_SetSwapInterval(-1) != 0) {
 		std::cerr << "NOTE: couldn't set vsync + late swap tearing (" << SDL_GetError() << ")." << std::endl;
 		if (SDL_GL_SetSwapInterval(1) != 0) {
 			std::cerr << "NOTE: couldn't set vsync (" << SDL_GetError() << ")." << std::endl;
@@ -106,13 +184,27 @@ int main(int argc, char **argv) {
 	//SDL_ShowCursor(SDL_DISABLE);
 
 	//------------ init sound --------------
-	Sound::init();
+	//(small buffers, so footsteps land close to the frame that triggered them)
+	Sound::init(Sound::LowLatency);
+
+	//------------ start job workers --------------
+	Jobs::init(job_threads);
 
 	//------------ load assets --------------
 	call_load_functions();
 
 	//------------ create game mode + make current --------------
-	Mode::set_current(std::make_shared< PlayMode >());
+	{
+		auto play = std::make_shared< PlayMode >();
+		if (agents) play->spawn_agents(agents);
+		play->frame_uniforms.scene_lights = scene_lights;
+		if (!record_path.empty()) play->record_path(record_path);
+		if (!replay_path.empty()) {
+			play->replay_path(replay_path, replay_report);
+			tick_rate = 1.0f / play->replay.path.tick; //(replay at the rate the path was recorded)
+		}
+		Mode::set_current(play);
+	}
 
 	//------------ main loop ------------
 
@@ -131,12 +223,20 @@ int main(int argc, char **argv) {
 	};
 	on_resize();
 
+	//screenshots (print screen) and frame recording (F7):
+	FrameCapture frame_capture;
+
+	//per-phase timing of every frame (F6 writes it to 'frame-times.csv'):
+	static FrameTimes frame_times; //(static because it is fairly large)
+
 	//This will loop until the current mode is set to null:
 	while (Mode::current) {
 		//every pass through the game loop creates one frame of output
 		//  by performing three steps:
+		frame_times.begin_frame();
 
 		{ //(1) process any events that are pending
+			ALLOC_SCOPE("events");
 			static SDL_Event evt;
 			while (SDL_PollEvent(&evt) == 1) {
 				//handle resizing:
@@ -153,19 +253,31 @@ int main(int argc, char **argv) {
 					// --- screenshot key ---
 					std::string filename = "screenshot.png";
 					std::cout << "Saving screenshot to '" << filename << "'." << std::endl;
-					glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
-					glReadBuffer(GL_FRONT);
-					int w,h;
-					SDL_GL_GetDrawableSize(window, &w, &h);
-					std::vector< glm::u8vec4 > data(w*h);
-					glReadPixels(0,0,w,h, GL_RGBA, GL_UNSIGNED_BYTE, data.data());
-					for (auto &px : data) {
-						px.a = 0xff;
+					frame_capture.request(filename);
+				} else if (evt.type == SDL_KEYDOWN && evt.key.keysym.sym == SDLK_F7) {
+					// --- toggle frame recording ---
+					if (frame_capture.recording()) {
+						frame_capture.stop_recording();
+					} else {
+						std::cout << "Recording frames to 'capture-*.png' (F7 again to stop)." << std::endl;
+						frame_capture.start_recording("capture");
+					}
+				} else if (evt.type == SDL_KEYDOWN && evt.key.keysym.sym == SDLK_F3) {
+					// --- toggle timing overlay ---
+					Profiler::toggle();
+				} else if (evt.type == SDL_KEYDOWN && evt.key.keysym.sym == SDLK_F6) {
+					// --- save frame timings ---
+					std::string filename = "frame-times.csv";
+					std::cout << "Saving " << frame_times.size() << " frame times to '" << filename << "'." << std::endl;
+					try {
+						frame_times.write_csv(filename);
+					} catch (std::exception &e) {
+						std::cerr << "WARNING: " << e.what() << std::endl;
 					}
-					save_png(filename, glm::uvec2(w,h), data.data(), LowerLeftOrigin);
 				}
 			}
 			if (!Mode::current) break;
+			frame_times.end_phase(FrameTimes::Events);
 		}
 
 		{ //(2) call the current mode's "update" function to deal with elapsed time:
@@ -178,22 +290,71 @@ int main(int argc, char **argv) {
 			//lag to avoid spiral of death:
 			elapsed = std::min(0.1f, elapsed);
 
-			Mode::current->update(elapsed);
+			//replays advance exactly one tick per frame, however long frames take:
+			if (!replay_path.empty()) elapsed = 1.0f / tick_rate;
+
+			{
+				PROFILE_CPU("update");
+				ALLOC_SCOPE("update");
+
+				//run as many fixed simulation ticks as have come due:
+				float const tick = 1.0f / tick_rate;
+				static float tick_time = 0.0f; //time not yet simulated
+				tick_time += elapsed;
+				while (tick_time >= tick && Mode::current) {
+					Mode::current->update_fixed(tick);
+					tick_time -= tick;
+				}
+
+				if (Mode::current) Mode::current->update_frame(elapsed, tick_time / tick);
+			}
 			if (!Mode::current) break;
+			frame_times.end_phase(FrameTimes::Update);
 		}
 
 		{ //(3) call the current mode's "draw" function to produce output:
-		
-			Mode::current->draw(drawable_size);
+			ALLOC_SCOPE("draw");
+			{
+				PROFILE_CPU("draw");
+				Mode::current->draw(drawable_size);
+			}
+			Profiler::draw_overlay(drawable_size);
+			frame_capture.capture(drawable_size);
+			frame_times.end_phase(FrameTimes::Draw);
+		}
+
+		{ //Wait until the recently-drawn frame is shown before doing it all again:
+			PROFILE_CPU("swap");
+			ALLOC_SCOPE("swap");
+			SDL_GL_SwapWindow(window);
+			frame_times.end_phase(FrameTimes::Swap);
 		}
+		Profiler::end_frame();
+		frame_times.end_frame();
+		AllocTracking::end_frame();
+		gl_diagnostics_end_frame();
 
-		//Wait until the recently-drawn frame is shown before doing it all again:
-		SDL_GL_SwapWindow(window);
+		//everything from this frame is done, so its temporaries can go:
+		FrameArena::reset();
+	}
+
+	AllocTracking::write_report(std::cout);
+
+	if (!frame_times_csv.empty()) {
+		std::cout << "Saving " << frame_times.size() << " frame times to '" << frame_times_csv << "'." << std::endl;
+		try {
+			frame_times.write_csv(frame_times_csv);
+		} catch (std::exception &e) {
+			std::cerr << "WARNING: " << e.what() << std::endl;
+		}
 	}
 
 
 	//------------  teardown ------------
+	frame_capture.shutdown();
+	Profiler::shutdown();
 	Sound::shutdown();
+	Jobs::shutdown();
 
 	SDL_GL_DeleteContext(context);
 	context = 0;
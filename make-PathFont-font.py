@@ -514,6 +514,33 @@ for m in range(0x20, 0x7f):
 		missing.append(c)
 print("Font misses: " + ", ".join(map(lambda x: "'" + x + "'", missing)))
 
+#prefix trie over glyph strings (node 0 is the root), so PathFont::match needs no runtime setup:
+trie_glyphs = [0xffffffff]
+trie_children = [dict()]
+for g in range(0, out_glyphs):
+	node = 0
+	for byte in out_chars[out_glyph_char_starts[g]:(out_glyph_char_starts[g+1] if g + 1 < out_glyphs else len(out_chars))]:
+		if byte not in trie_children[node]:
+			trie_children[node][byte] = len(trie_glyphs)
+			trie_glyphs.append(0xffffffff)
+			trie_children.append(dict())
+		node = trie_children[node][byte]
+	if trie_glyphs[node] != 0xffffffff: print("WARNING: duplicate glyph #" + str(g) + ".")
+	trie_glyphs[node] = g
+
+out_root_children = [ trie_children[0].get(byte, 0) for byte in range(0, 256) ]
+out_trie_child_starts = []
+out_trie_child_bytes = []
+out_trie_child_nodes = []
+for children in trie_children:
+	out_trie_child_starts.append(len(out_trie_child_bytes))
+	for byte in sorted(children.keys()):
+		out_trie_child_bytes.append(byte)
+		out_trie_child_nodes.append(children[byte])
+out_trie_child_starts.append(len(out_trie_child_bytes))
+
+print("Glyph trie has " + str(len(trie_glyphs)) + " nodes.")
+
 print("Writing PathFont '" + fontname + "' to '" + cppname + "'")
 
 cppfile = open(cppname, 'wb')
@@ -553,8 +580,41 @@ w('\tconstexpr const float font_coords[' + str(len(out_coords)) + '] = {\n')
 wd(out_coords, "{:.6f}f", 6)
 w('\t};\n')
 
+w('\tconstexpr const uint32_t font_trie_nodes = ' + str(len(trie_glyphs)) + ';\n')
+w('\tconstexpr const uint32_t font_root_children[256] = {\n')
+wd(out_root_children, "{}", 16)
+w('\t};\n')
+
+w('\tconstexpr const uint32_t font_trie_glyphs[font_trie_nodes] = {\n')
+wd(list(map(lambda g: "-1U" if g == 0xffffffff else str(g), trie_glyphs)), "{}", 12)
+w('\t};\n')
+
+w('\tconstexpr const uint32_t font_trie_child_starts[font_trie_nodes+1] = {\n')
+wd(out_trie_child_starts, "{}", 12)
+w('\t};\n')
+
+w('\tconstexpr const uint8_t font_trie_child_bytes[' + str(max(1, len(out_trie_child_bytes))) + '] = {\n')
+wd(out_trie_child_bytes if len(out_trie_child_bytes) else [0], "{}", 12)
+w('\t};\n')
+
+w('\tconstexpr const uint32_t font_trie_child_nodes[' + str(max(1, len(out_trie_child_nodes))) + '] = {\n')
+wd(out_trie_child_nodes if len(out_trie_child_nodes) else [0], "{}", 12)
+w('\t};\n')
 
+w('\tconstexpr const PathFont font_tables(font_glyphs, font_glyph_widths, font_glyph_char_starts, font_chars, font_glyph_coord_starts, font_coords,\n')
+w('\t\tfont_root_children, font_trie_glyphs, font_trie_child_starts, font_trie_child_bytes, font_trie_child_nodes);\n')
+w('\n')
+w('\t//every glyph\'s string must match exactly that glyph (checked at compile time):\n')
+w('\tconstexpr bool check_tables() {\n')
+w('\t\tfor (uint32_t g = 0; g < font_glyphs; ++g) {\n')
+w('\t\t\tsize_t length = 0;\n')
+w('\t\t\tsize_t size = font_glyph_char_starts[g+1] - font_glyph_char_starts[g];\n')
+w('\t\t\tif (font_tables.match(font_chars + font_glyph_char_starts[g], size, &length) != g || length != size) return false;\n')
+w('\t\t}\n')
+w('\t\treturn true;\n')
+w('\t}\n')
+w('\tstatic_assert(check_tables(), "PathFont glyph trie does not match glyph strings");\n')
 w('}\n')
-w('PathFont PathFont::font(font_glyphs, font_glyph_widths, font_glyph_char_starts, font_chars, font_glyph_coord_starts, font_coords);\n')
+w('const PathFont PathFont::font = font_tables;\n')
 
 cppfile.close()
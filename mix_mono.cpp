@@ -0,0 +1,66 @@
+#include "mix_mono.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MIX_MONO_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define MIX_MONO_NEON 1
+#endif
+
+void mix_mono_scalar(float *out, float const *in, uint32_t count, float pan_l, float pan_r, float step_l, float step_r) {
+	for (uint32_t i = 0; i < count; ++i) {
+		out[2*i+0] += pan_l * in[i];
+		out[2*i+1] += pan_r * in[i];
+		pan_l += step_l;
+		pan_r += step_r;
+	}
+}
+
+void mix_mono(float *out, float const *in, uint32_t count, float pan_l, float pan_r, float step_l, float step_r) {
+	uint32_t i = 0;
+
+#if defined(MIX_MONO_SSE2)
+	//gains for frames i+0 .. i+3:
+	__m128 frame = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+	__m128 l = _mm_add_ps(_mm_set1_ps(pan_l), _mm_mul_ps(frame, _mm_set1_ps(step_l)));
+	__m128 r = _mm_add_ps(_mm_set1_ps(pan_r), _mm_mul_ps(frame, _mm_set1_ps(step_r)));
+	__m128 l_step = _mm_set1_ps(4.0f * step_l);
+	__m128 r_step = _mm_set1_ps(4.0f * step_r);
+	for (; i + 4 <= count; i += 4) {
+		__m128 x = _mm_loadu_ps(in + i);
+		__m128 xl = _mm_mul_ps(x, l);
+		__m128 xr = _mm_mul_ps(x, r);
+		//interleave back to L,R pairs:
+		__m128 lo = _mm_unpacklo_ps(xl, xr); //l0 r0 l1 r1
+		__m128 hi = _mm_unpackhi_ps(xl, xr); //l2 r2 l3 r3
+		float *o = out + 2*i;
+		_mm_storeu_ps(o + 0, _mm_add_ps(_mm_loadu_ps(o + 0), lo));
+		_mm_storeu_ps(o + 4, _mm_add_ps(_mm_loadu_ps(o + 4), hi));
+		l = _mm_add_ps(l, l_step);
+		r = _mm_add_ps(r, r_step);
+	}
+#elif defined(MIX_MONO_NEON)
+	float const frame_init[4] = { 0.0f, 1.0f, 2.0f, 3.0f };
+	float32x4_t frame = vld1q_f32(frame_init);
+	float32x4_t l = vmlaq_f32(vdupq_n_f32(pan_l), frame, vdupq_n_f32(step_l));
+	float32x4_t r = vmlaq_f32(vdupq_n_f32(pan_r), frame, vdupq_n_f32(step_r));
+	float32x4_t l_step = vdupq_n_f32(4.0f * step_l);
+	float32x4_t r_step = vdupq_n_f32(4.0f * step_r);
+	for (; i + 4 <= count; i += 4) {
+		float32x4_t x = vld1q_f32(in + i);
+		//vld2/vst2 de-interleave and re-interleave the L,R pairs:
+		float32x4x2_t o = vld2q_f32(out + 2*i);
+		o.val[0] = vmlaq_f32(o.val[0], x, l);
+		o.val[1] = vmlaq_f32(o.val[1], x, r);
+		vst2q_f32(out + 2*i, o);
+		l = vaddq_f32(l, l_step);
+		r = vaddq_f32(r, r_step);
+	}
+#endif
+
+	//leftover frames (or everything, without SIMD):
+	if (i < count) {
+		mix_mono_scalar(out + 2*i, in + i, count - i, pan_l + float(i) * step_l, pan_r + float(i) * step_r, step_l, step_r);
+	}
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstdint>
+
+//Mix 'count' frames of mono sample data into an interleaved stereo (L,R,L,R,...) buffer:
+//  out[2*i+0] += in[i] * (pan_l + i * step_l)
+//  out[2*i+1] += in[i] * (pan_r + i * step_r)
+//(i.e., the left/right gains ramp linearly over the block)
+//
+//mix_mono uses SSE2 or NEON when available (four frames per iteration);
+// mix_mono_scalar is the plain one-frame-at-a-time reference version.
+void mix_mono(float *out, float const *in, uint32_t count, float pan_l, float pan_r, float step_l, float step_r);
+void mix_mono_scalar(float *out, float const *in, uint32_t count, float pan_l, float pan_r, float step_l, float step_r);
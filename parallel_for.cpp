@@ -0,0 +1,28 @@
+#include "parallel_for.hpp"
+
+#include "Jobs.hpp"
+
+#include <algorithm>
+
+void parallel_for(size_t count, size_t grain, void (*fn)(void *data, size_t begin, size_t end), void *data) {
+	if (count == 0) return;
+	grain = std::max< size_t >(grain, 1);
+
+	if (count <= grain || Jobs::thread_count() == 1) {
+		for (size_t begin = 0; begin < count; begin += grain) {
+			fn(data, begin, std::min(begin + grain, count));
+		}
+		return;
+	}
+
+	//one job per range (waiting runs jobs too, so this thread helps):
+	Jobs::Counter counter;
+	for (size_t begin = 0; begin < count; begin += grain) {
+		Jobs::run(&counter, fn, data, begin, std::min(begin + grain, count));
+	}
+	Jobs::wait(&counter);
+}
+
+uint32_t parallel_for_threads() {
+	return Jobs::thread_count();
+}
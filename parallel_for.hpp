@@ -0,0 +1,38 @@
+#pragma once
+
+/*
+ * parallel_for -- runs a function over ranges of indices as jobs (see Jobs.hpp).
+ *
+ * Usage:
+ *   parallel_for(items.size(), 256, [&](size_t begin, size_t end) {
+ *     for (size_t i = begin; i < end; ++i) process(items[i]);
+ *   });
+ *
+ * [0,count) is cut into ranges [k*grain, min((k+1)*grain, count)), so 'begin / grain' numbers a range
+ *  (handy for per-range outputs). Ranges run in any order on any thread -- the calling thread works on
+ *  ranges too -- and parallel_for returns once all of them are done.
+ *
+ * Notes:
+ *  - 'fn' must only write outputs that are disjoint between ranges
+ *  - if count <= grain, 'fn' is called once, on the calling thread, with no synchronization at all
+ *  - calls may come from several threads at once, or from inside 'fn' (waiting threads run other jobs)
+ *  - exceptions thrown by 'fn' are not supported (std::terminate)
+ *  - 'fn' is passed by pointer to the jobs, never copied, so calling parallel_for doesn't allocate
+ *    (however much the lambda captures)
+ */
+
+#include <cstddef>
+#include <cstdint>
+
+//underlying (untyped) version: calls fn(data, begin, end) for each range:
+void parallel_for(size_t count, size_t grain, void (*fn)(void *data, size_t begin, size_t end), void *data);
+
+template< typename F >
+void parallel_for(size_t count, size_t grain, F const &fn) {
+	parallel_for(count, grain, [](void *data, size_t begin, size_t end) {
+		(*static_cast< F const * >(data))(begin, end);
+	}, const_cast< void * >(static_cast< void const * >(&fn)));
+}
+
+//number of threads parallel_for runs ranges on (workers plus the calling thread):
+uint32_t parallel_for_threads();
@@ -4,6 +4,9 @@
 #include <vector>
 #include <stdexcept>
 #include <cassert>
+#include <cstring>
+#include <cstdint>
+#include <type_traits>
 
 //helper function that reads an array of structures preceded by a simple header:
 //Expected format:
@@ -63,3 +66,89 @@ void write_chunk(std::string const &magic, std::vector< T > const &from, std::os
 	to.write(reinterpret_cast< const char * >(&header), sizeof(header));
 	to.write(reinterpret_cast< const char * >(from.data()), from.size() * sizeof(T));
 }
+
+//helper function that finds a chunk (same format as read_chunk) in an in-memory buffer, without copying:
+// - *at_ is advanced past the chunk
+// - returns a pointer to the chunk's data, and sets *count_ to the number of T structures in the chunk
+// - throws if the chunk data is not suitably aligned for T (so only use for chunks at known-aligned offsets)
+template< typename T >
+T *view_chunk(char **at_, char *end, std::string const &magic, size_t *count_) {
+	assert(at_);
+	auto &at = *at_;
+	assert(count_);
+	auto &count = *count_;
+
+	struct ChunkHeader {
+		char magic[4] = {'\0', '\0', '\0', '\0'};
+		uint32_t size = 0;
+	};
+	static_assert(sizeof(ChunkHeader) == 8, "header is packed");
+
+	ChunkHeader header;
+	if (size_t(end - at) < sizeof(header)) {
+		throw std::runtime_error("Failed to read chunk header");
+	}
+	std::memcpy(&header, at, sizeof(header));
+	if (std::string(header.magic,4) != magic) {
+		throw std::runtime_error("Unexpected magic number in chunk");
+	}
+
+	if (header.size % sizeof(T) != 0) {
+		throw std::runtime_error("Size of chunk not divisible by element size");
+	}
+	if (size_t(end - at) - sizeof(header) < header.size) {
+		throw std::runtime_error("Failed to read chunk data.");
+	}
+
+	char *data = at + sizeof(header);
+	if (reinterpret_cast< uintptr_t >(data) % alignof(T) != 0) {
+		throw std::runtime_error("Chunk data is not aligned for element type");
+	}
+
+	at = data + header.size;
+	count = header.size / sizeof(T);
+	return reinterpret_cast< T * >(data);
+}
+
+//typed (pointer, count) view of chunk data (e.g., in a MappedFile) or any other contiguous array:
+// (the storage it points to is owned elsewhere; use ChunkView< T const > for read-only views)
+template< typename T >
+struct ChunkView {
+	T *data = nullptr;
+	size_t count = 0;
+
+	ChunkView() = default;
+	ChunkView(T *data_, size_t count_) : data(data_), count(count_) { }
+	//(only usable for read-only views:)
+	ChunkView(std::vector< std::remove_const_t< T > > const &from) : data(from.data()), count(from.size()) { }
+
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+	T &operator[](size_t i) const { return data[i]; }
+	T *begin() const { return data; }
+	T *end() const { return data + count; }
+};
+
+//view_chunk, returning a ChunkView:
+template< typename T >
+ChunkView< T > view_chunk(char **at, char *end, std::string const &magic) {
+	ChunkView< T > ret;
+	ret.data = view_chunk< T >(at, end, magic, &ret.count);
+	return ret;
+}
+
+//helper function that copies a chunk out of an in-memory buffer:
+// (for chunks that may not be aligned for T -- e.g., those following a string table)
+template< typename T >
+void read_chunk(char **at, char *end, std::string const &magic, std::vector< T > *to_) {
+	assert(to_);
+	auto &to = *to_;
+
+	size_t size = 0;
+	char const *data = view_chunk< char >(at, end, magic, &size);
+	if (size % sizeof(T) != 0) {
+		throw std::runtime_error("Size of chunk not divisible by element size");
+	}
+	to.resize(size / sizeof(T));
+	if (size) std::memcpy(to.data(), data, size);
+}
@@ -0,0 +1,185 @@
+#include "resample.hpp"
+
+#include "read_write_chunk.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define RESAMPLE_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define RESAMPLE_NEON 1
+#endif
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+
+constexpr uint32_t AUDIO_RATE = 48000;
+constexpr double const PI = 3.14159265358979323846;
+
+bool save_converted_audio = true;
+
+//filter shape:
+constexpr uint32_t const ZERO_CROSSINGS = 16; //zero crossings of the sinc on each side of the center (at the cutoff frequency)
+constexpr uint32_t const MAX_PHASES = 1024; //rate ratios needing more phases than this use the nearest of MAX_PHASES phases
+
+//sum of a[i] * b[i] for 'count' (a multiple of four) values:
+static float dot(float const *a, float const *b, uint32_t count) {
+	assert(count % 4 == 0);
+#if defined(RESAMPLE_SSE2)
+	__m128 sum = _mm_setzero_ps();
+	for (uint32_t i = 0; i < count; i += 4) {
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+	}
+	//horizontal add:
+	sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+	sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+	return _mm_cvtss_f32(sum);
+#elif defined(RESAMPLE_NEON)
+	float32x4_t sum = vdupq_n_f32(0.0f);
+	for (uint32_t i = 0; i < count; i += 4) {
+		sum = vmlaq_f32(sum, vld1q_f32(a + i), vld1q_f32(b + i));
+	}
+	float32x2_t half = vadd_f32(vget_low_f32(sum), vget_high_f32(sum));
+	return vget_lane_f32(vpadd_f32(half, half), 0);
+#else
+	float sum = 0.0f;
+	for (uint32_t i = 0; i < count; ++i) {
+		sum += a[i] * b[i];
+	}
+	return sum;
+#endif
+}
+
+void resample_to_48k_mono(float const *in, uint32_t frames, uint32_t channels, uint32_t rate, std::vector< float > *out_) {
+	assert(in || frames == 0);
+	assert(channels > 0);
+	assert(rate > 0);
+	assert(out_);
+	auto &out = *out_;
+
+	if (rate == AUDIO_RATE) {
+		//just downmix:
+		out.resize(frames);
+		for (uint32_t f = 0; f < frames; ++f) {
+			float sum = 0.0f;
+			for (uint32_t c = 0; c < channels; ++c) sum += in[f * channels + c];
+			out[f] = sum / float(channels);
+		}
+		return;
+	}
+
+	//output sample n is at input position n * M / L:
+	uint32_t divisor = std::gcd(AUDIO_RATE, rate);
+	uint32_t const L = AUDIO_RATE / divisor;
+	uint32_t const M = rate / divisor;
+
+	//when downsampling, the cutoff drops to the output's Nyquist frequency (and the filter gets wider):
+	double cutoff = std::min(1.0, double(L) / double(M)); //relative to the input's Nyquist frequency
+	uint32_t taps = uint32_t(std::ceil(2.0 * ZERO_CROSSINGS / cutoff));
+	taps = (taps + 3) & ~3U; //(multiple of four, for dot())
+	uint32_t const half = taps / 2;
+
+	//filter for each phase; a phase-'p' output sits between input[base] and input[base+1] at base + p / phases,
+	// and uses input[base - half + 1 .. base + half]:
+	uint32_t const phases = std::min(L, MAX_PHASES);
+	std::vector< float > filters(size_t(phases) * taps);
+	for (uint32_t p = 0; p < phases; ++p) {
+		double frac = double(p) / double(phases);
+		float *filter = filters.data() + size_t(p) * taps;
+		double total = 0.0;
+		for (uint32_t k = 0; k < taps; ++k) {
+			double d = double(k) - double(half - 1) - frac; //distance from output position, in input samples
+			double x = PI * cutoff * d;
+			double sinc = (std::abs(x) < 1e-9 ? 1.0 : std::sin(x) / x);
+			double w = d / double(half); //in [-1,1]
+			double blackman = 0.42 + 0.5 * std::cos(PI * w) + 0.08 * std::cos(2.0 * PI * w);
+			filter[k] = float(sinc * blackman);
+			total += filter[k];
+		}
+		//normalize so every phase passes DC unchanged:
+		for (uint32_t k = 0; k < taps; ++k) {
+			filter[k] = float(filter[k] / total);
+		}
+	}
+
+	//downmix into a zero-padded buffer, so the filter never reads out of bounds:
+	std::vector< float > mono(size_t(frames) + 2 * taps, 0.0f);
+	for (uint32_t f = 0; f < frames; ++f) {
+		float sum = 0.0f;
+		for (uint32_t c = 0; c < channels; ++c) sum += in[f * channels + c];
+		mono[taps + f] = sum / float(channels);
+	}
+
+	out.resize(size_t((uint64_t(frames) * L + M - 1) / M));
+	for (size_t n = 0; n < out.size(); ++n) {
+		uint64_t position = uint64_t(n) * M; //in units of 1/L input samples
+		uint64_t base = position / L;
+		uint64_t phase = (position % L) * phases / L;
+		float const *window = mono.data() + taps + base - (half - 1);
+		out[n] = dot(window, filters.data() + phase * taps, taps);
+	}
+}
+
+//------------ converted-audio cache ------------
+
+namespace {
+	struct SourceInfo {
+		uint64_t size = 0;
+		int64_t time = 0;
+	};
+	static_assert(sizeof(SourceInfo) == 16, "SourceInfo is packed");
+
+	SourceInfo source_info(std::string const &source) {
+		SourceInfo info;
+		info.size = uint64_t(std::filesystem::file_size(source));
+		info.time = int64_t(std::filesystem::last_write_time(source).time_since_epoch().count());
+		return info;
+	}
+}
+
+bool load_converted(std::string const &source, std::vector< float > *data) {
+	assert(data);
+	std::string cache = source + ".48k";
+	std::ifstream file(cache, std::ios::binary);
+	if (!file) return false;
+
+	try {
+		std::vector< SourceInfo > recorded;
+		read_chunk(file, "src0", &recorded);
+		SourceInfo current = source_info(source);
+		if (recorded.size() != 1 || recorded[0].size != current.size || recorded[0].time != current.time) {
+			return false; //stale
+		}
+		std::vector< float > converted;
+		read_chunk(file, "f32m", &converted);
+		*data = std::move(converted);
+	} catch (std::exception &e) {
+		std::cerr << "WARNING: ignoring converted-audio cache '" << cache << "': " << e.what() << std::endl;
+		return false;
+	}
+	return true;
+}
+
+void save_converted(std::string const &source, std::vector< float > const &data) {
+	if (!save_converted_audio) return;
+	std::string cache = source + ".48k";
+	try {
+		std::vector< SourceInfo > recorded{ source_info(source) };
+		//write to a temporary file first, so a half-written cache is never loaded:
+		std::string temp = cache + ".tmp";
+		{
+			std::ofstream file(temp, std::ios::binary);
+			write_chunk("src0", recorded, &file);
+			write_chunk("f32m", data, &file);
+			if (!file) throw std::runtime_error("failed to write '" + temp + "'");
+		}
+		std::filesystem::rename(temp, cache);
+	} catch (std::exception &e) {
+		std::cerr << "WARNING: couldn't save converted-audio cache '" << cache << "': " << e.what() << std::endl;
+	}
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//Convert 'frames' frames of interleaved 'channels'-channel audio at 'rate' Hz to 48kHz mono:
+// channels are averaged, then resampled with a polyphase windowed-sinc filter
+// (whose inner loop uses SSE2 or NEON when available)
+void resample_to_48k_mono(float const *in, uint32_t frames, uint32_t channels, uint32_t rate, std::vector< float > *out);
+
+//Converted-audio cache, so assets that need conversion only get converted once:
+// the cache for "foo.wav" is "foo.wav.48k", and records the size and modification time of the source
+// - load_converted returns false (without touching *data) if there is no up-to-date cache for 'source'
+// - save_converted warns (doesn't throw) if the cache can't be written; does nothing if !save_converted_audio
+bool load_converted(std::string const &source, std::vector< float > *data);
+void save_converted(std::string const &source, std::vector< float > const &data);
+extern bool save_converted_audio; //(default true)
@@ -14,8 +14,13 @@ for i in range(0,len(sys.argv)):
 	if sys.argv[i] == '--':
 		args = sys.argv[i+1:]
 
+compact = False
+if len(args) == 3 and args[2] == '--compact':
+	compact = True
+	args = args[0:2]
+
 if len(args) != 2:
-	print("\n\nUsage:\nblender --background --python export-meshes.py -- <infile.blend[:collection]> <outfile.pnct>\nExports the meshes referenced by all objects in the specified collection(s) (default: all objects) to a binary blob.\n")
+	print("\n\nUsage:\nblender --background --python export-meshes.py -- <infile.blend[:collection]> <outfile.pnct> [--compact]\nExports the meshes referenced by all objects in the specified collection(s) (default: all objects) to a binary blob.\n --compact stores half-float positions and texcoords and 10-bit normals (20 bytes per vertex instead of 36).\n")
 	exit(1)
 
 import bpy
@@ -39,6 +44,14 @@ print(" of '" + infile + "' to '" + outfile + "'.")
 
 import struct
 
+#compact vertex format helpers:
+def pack_snorm10(x):
+	v = int(round(max(-1.0, min(1.0, x)) * 511.0))
+	return v & 0x3ff
+
+def pack_normal(n):
+	return struct.pack('I', pack_snorm10(n[0]) | (pack_snorm10(n[1]) << 10) | (pack_snorm10(n[2]) << 20))
+
 bpy.ops.wm.open_mainfile(filepath=infile)
 
 if collection_name:
@@ -168,10 +181,14 @@ for obj in bpy.data.objects:
 			assert(mesh.loops[poly.loop_indices[i]].vertex_index == poly.vertices[i])
 			loop = mesh.loops[poly.loop_indices[i]]
 			vertex = mesh.vertices[loop.vertex_index]
-			for x in vertex.co:
-				local_data += struct.pack('f', x)
-			for x in loop.normal:
-				local_data += struct.pack('f', x)
+			if compact:
+				local_data += struct.pack('eeee', vertex.co.x, vertex.co.y, vertex.co.z, 1.0)
+				local_data += pack_normal(loop.normal)
+			else:
+				for x in vertex.co:
+					local_data += struct.pack('f', x)
+				for x in loop.normal:
+					local_data += struct.pack('f', x)
 			if colors != None:
 				col = colors[poly.loop_indices[i]].color
 				local_data += struct.pack('BBBB', int(col[0] * 255), int(col[1] * 255), int(col[2] * 255), 255)
@@ -179,9 +196,9 @@ for obj in bpy.data.objects:
 				local_data += struct.pack('BBBB', 255, 255, 255, 255)
 			if uvs != None:
 				uv = uvs[poly.loop_indices[i]].uv
-				local_data += struct.pack('ff', uv.x, uv.y)
+				local_data += struct.pack('ee' if compact else 'ff', uv.x, uv.y)
 			else:
-				local_data += struct.pack('ff', 0, 0)
+				local_data += struct.pack('ee' if compact else 'ff', 0, 0)
 		if len(local_data) > 1000:
 			data.append(local_data)
 			local_data = b''
@@ -194,12 +211,15 @@ for obj in bpy.data.objects:
 data = b''.join(data)
 
 #check that code created as much data as anticipated:
-assert(vertex_count * (4*3+4*3+1*4+4*2) == len(data))
+if compact:
+	assert(vertex_count * (2*4+4+1*4+2*2) == len(data))
+else:
+	assert(vertex_count * (4*3+4*3+1*4+4*2) == len(data))
 
 #write the data chunk and index chunk to an output blob:
 blob = open(outfile, 'wb')
 #first chunk: the data
-blob.write(struct.pack('4s',b'pnct')) #type
+blob.write(struct.pack('4s',b'pnch' if compact else b'pnct')) #type
 blob.write(struct.pack('I', len(data))) #length
 blob.write(data)
 #second chunk: the strings
@@ -104,6 +104,9 @@ position_count = 0
 normal_count = 0
 triangle_count = 0
 
+#triangle_list holds (global) vertex indices of the triangles, used to compute adjacency:
+triangle_list = []
+
 for obj in bpy.data.objects:
 	if obj.data in to_write:
 		to_write.remove(obj.data)
@@ -168,9 +171,12 @@ for obj in bpy.data.objects:
 		d = poly.normal.dot(out)
 		assert(d > 0.9)
 
+		tri = []
 		for i in range(0,3):
 			assert(mesh.loops[poly.loop_indices[i]].vertex_index == poly.vertices[i])
 			triangles += write_vertex(poly.vertices[i], mesh.loops[poly.loop_indices[i]].normal)
+			tri.append(vertex_begin + vertex_inds[poly.vertices[i]])
+		triangle_list.append(tri)
 		triangle_count += 1
 	
 	#write (and possibly average) the normals:
@@ -203,6 +209,17 @@ for obj in bpy.data.objects:
 	index += struct.pack('II', triangle_begin, triangle_end)
 
 
+#adjacency gives, for each triangle edge, the matching (reversed) edge in the neighboring triangle:
+# (edge e of triangle t is stored as 3*t+e; boundary edges are stored as 0xffffffff)
+halfedges = dict()
+for t, tri in enumerate(triangle_list):
+	for e in range(0,3):
+		halfedges[(tri[e], tri[(e+1)%3])] = 3*t+e
+adjacency = b''
+for t, tri in enumerate(triangle_list):
+	for e in range(0,3):
+		adjacency += struct.pack('I', halfedges.get((tri[(e+1)%3], tri[e]), 0xffffffff))
+
 #check that we wrote as much data as anticipated:
 assert(position_count * 3*4 == len(positions))
 assert(normal_count * 3*4 == len(normals))
@@ -221,6 +238,7 @@ write_chunk(b'n...', normals)
 write_chunk(b'tri0', triangles)
 write_chunk(b'str0', strings)
 write_chunk(b'idxA', index)
+write_chunk(b'adj0', adjacency)
 wrote = blob.tell()
 blob.close()
 
@@ -229,4 +247,5 @@ print("Wrote " + str(wrote) + " bytes [== " +
 	str(len(normals)+8) + " bytes of normals + " +
 	str(len(triangles)+8) + " bytes of triangles + " +
 	str(len(strings)+8) + " bytes of strings + " +
-	str(len(index)+8) + " bytes of index] to '" + outfile + "'")
+	str(len(index)+8) + " bytes of index + " +
+	str(len(adjacency)+8) + " bytes of adjacency] to '" + outfile + "'")
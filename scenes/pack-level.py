@@ -0,0 +1,226 @@
+#!/usr/bin/env python3
+
+#Packs a level's exported mesh (.pnct), scene (.scene), and walkmesh (.w) files into one '.level' file.
+#(plain python; no blender needed)
+#
+#Usage:
+#python3 pack-level.py [--cell-size <size>] <level.pnct> <level.scene> <level.w> <outfile.level>
+#
+#Format (see Level.hpp):
+# - a 'lvl0' chunk (table of contents) of 16-byte entries: kind (4 chars), offset, size, reserved (0)
+# - each section, at a 16-byte aligned offset from the start of the file:
+#    'mesh' - the .pnct file, unchanged
+#    'scen' - the .scene file, unchanged
+#    'walk' - the .w file, unchanged
+#    'mref' - one uint32 per scene 'msh0' entry: index (in 'idx0' order) of the mesh with that name, or 0xffffffff
+#
+#With --cell-size, writes a streamed level instead (see LevelStream.hpp): drawables are grouped into
+# a grid of cells (cell-size units on a side, in world x/y) and, in place of 'mesh' and 'mref':
+#    'cell' - per cell: world min, max (3 floats each), mesh_begin, mesh_end (offsets in 'cmsh'), drawable_begin, drawable_end (in 'cdrw')
+#    'cdrw' - per drawable (grouped by cell): scene transform index, mesh index in its cell's meshes
+#    'cmsh' - per cell (16-byte aligned): a .pnct file with just the meshes that cell's drawables use
+
+import sys
+import struct
+import math
+
+args = sys.argv[1:]
+cell_size = None
+if len(args) >= 2 and args[0] == '--cell-size':
+	cell_size = float(args[1])
+	args = args[2:]
+
+if len(args) != 4 or (cell_size is not None and not cell_size > 0.0):
+	print("\n\nUsage:\npython3 pack-level.py [--cell-size <size>] <level.pnct> <level.scene> <level.w> <outfile.level>\nPacks a level's mesh, scene, and walkmesh files into one file.\n")
+	exit(1)
+
+mesh_file, scene_file, walk_file, outfile = args
+
+def read(filename):
+	with open(filename, 'rb') as f:
+		return f.read()
+
+def chunks(data, filename):
+	#split a file into (magic, payload) chunks:
+	ret = []
+	at = 0
+	while at < len(data):
+		if at + 8 > len(data):
+			raise Exception("Truncated chunk header in '" + filename + "'")
+		magic, size = struct.unpack('4sI', data[at:at+8])
+		if at + 8 + size > len(data):
+			raise Exception("Truncated chunk '" + magic.decode('utf8', 'replace') + "' in '" + filename + "'")
+		ret.append((magic, data[at+8:at+8+size]))
+		at += 8 + size
+	return ret
+
+def find_chunk(chunk_list, magic, filename):
+	for m, payload in chunk_list:
+		if m == magic:
+			return payload
+	raise Exception("No '" + magic.decode('utf8') + "' chunk in '" + filename + "'")
+
+mesh_data = read(mesh_file)
+scene_data = read(scene_file)
+walk_data = read(walk_file)
+
+#mesh names, in index order:
+mesh_chunks = chunks(mesh_data, mesh_file)
+mesh_strings = find_chunk(mesh_chunks, b'str0', mesh_file)
+mesh_index = find_chunk(mesh_chunks, b'idx0', mesh_file)
+mesh_names = {}
+for i in range(0, len(mesh_index), 16):
+	name_begin, name_end, vertex_begin, vertex_end = struct.unpack('IIII', mesh_index[i:i+16])
+	name = mesh_strings[name_begin:name_end]
+	if name not in mesh_names: #(first mesh with a name wins, as in MeshBuffer)
+		mesh_names[name] = i // 16
+
+#scene mesh references -> mesh indices:
+scene_chunks = chunks(scene_data, scene_file)
+scene_strings = find_chunk(scene_chunks, b'str0', scene_file)
+scene_meshes = find_chunk(scene_chunks, b'msh0', scene_file)
+mref = b''
+missing = 0
+for i in range(0, len(scene_meshes), 12):
+	transform, name_begin, name_end = struct.unpack('III', scene_meshes[i:i+12])
+	name = scene_strings[name_begin:name_end]
+	if name in mesh_names:
+		mref += struct.pack('I', mesh_names[name])
+	else:
+		mref += struct.pack('I', 0xffffffff)
+		missing += 1
+if missing:
+	print("WARNING: " + str(missing) + " scene mesh references have no matching mesh in '" + mesh_file + "'.")
+
+def align(offset):
+	return (offset + 15) & ~15
+
+def pad(data):
+	return data + b'\0' * (align(len(data)) - len(data))
+
+def chunk(magic, payload):
+	return struct.pack('4sI', magic, len(payload)) + payload
+
+if cell_size is None:
+	sections = [(b'mesh', mesh_data), (b'scen', scene_data), (b'walk', walk_data), (b'mref', mref)]
+else:
+	#--- streamed level ---
+	vertex_magic, vertex_data = mesh_chunks[0]
+	vertex_size = {b'pnct':36, b'pnch':20}[vertex_magic]
+	entries = [struct.unpack('IIII', mesh_index[i:i+16]) for i in range(0, len(mesh_index), 16)]
+	names = [mesh_strings[e[0]:e[1]] for e in entries]
+
+	#object-space bounds of each mesh (by index):
+	def position(v):
+		at = v * vertex_size
+		if vertex_magic == b'pnct':
+			return struct.unpack('fff', vertex_data[at:at+12])
+		else:
+			return struct.unpack('eee', vertex_data[at:at+6])
+	bounds = []
+	for name_begin, name_end, vertex_begin, vertex_end in entries:
+		ps = [position(v) for v in range(vertex_begin, vertex_end)]
+		if ps:
+			bounds.append(([min(p[k] for p in ps) for k in range(3)], [max(p[k] for p in ps) for k in range(3)]))
+		else:
+			bounds.append(None)
+
+	#local-to-world matrices (3x4, row-major) of the scene's transforms:
+	hierarchy = find_chunk(scene_chunks, b'xfh0', scene_file)
+	def local_to_parent(px, py, pz, qx, qy, qz, qw, sx, sy, sz):
+		rot = [
+			[1 - 2*(qy*qy + qz*qz), 2*(qx*qy - qz*qw), 2*(qx*qz + qy*qw)],
+			[2*(qx*qy + qz*qw), 1 - 2*(qx*qx + qz*qz), 2*(qy*qz - qx*qw)],
+			[2*(qx*qz - qy*qw), 2*(qy*qz + qx*qw), 1 - 2*(qx*qx + qy*qy)],
+		]
+		return [[rot[r][0]*sx, rot[r][1]*sy, rot[r][2]*sz, (px, py, pz)[r]] for r in range(3)]
+	def compose(a, b):
+		return [[sum(a[r][k] * b[k][c] for k in range(3)) + (a[r][3] if c == 3 else 0.0) for c in range(4)] for r in range(3)]
+	world = []
+	for i in range(0, len(hierarchy), 52):
+		#(scene stores rotation as x,y,z,w)
+		parent, name_begin, name_end, px, py, pz, qx, qy, qz, qw, sx, sy, sz = struct.unpack('III3f4f3f', hierarchy[i:i+52])
+		m = local_to_parent(px, py, pz, qx, qy, qz, qw, sx, sy, sz)
+		if parent != 0xffffffff:
+			m = compose(world[parent], m)
+		world.append(m)
+
+	#meshes each mesh depends on (itself and its levels of detail):
+	lods = {}
+	for i, name in enumerate(names):
+		dot = name.rfind(b'.lod')
+		if dot != -1 and name[dot+4:].isdigit() and name[:dot] in mesh_names:
+			lods.setdefault(mesh_names[name[:dot]], []).append(i)
+
+	#assign drawables to cells by world-space bounds center:
+	cell_drawables = {}
+	cell_bounds = {}
+	for i in range(0, len(scene_meshes), 12):
+		transform = struct.unpack('I', scene_meshes[i:i+4])[0]
+		mesh = struct.unpack('I', mref[i//12*4:i//12*4+4])[0]
+		if mesh == 0xffffffff or bounds[mesh] is None: continue
+		m = world[transform]
+		lo, hi = bounds[mesh]
+		corners = [[m[r][0]*x + m[r][1]*y + m[r][2]*z + m[r][3] for r in range(3)] for x in (lo[0], hi[0]) for y in (lo[1], hi[1]) for z in (lo[2], hi[2])]
+		wmin = [min(c[k] for c in corners) for k in range(3)]
+		wmax = [max(c[k] for c in corners) for k in range(3)]
+		key = (math.floor(0.5 * (wmin[0] + wmax[0]) / cell_size), math.floor(0.5 * (wmin[1] + wmax[1]) / cell_size))
+		cell_drawables.setdefault(key, []).append((transform, mesh))
+		if key in cell_bounds:
+			cmin, cmax = cell_bounds[key]
+			cell_bounds[key] = ([min(cmin[k], wmin[k]) for k in range(3)], [max(cmax[k], wmax[k]) for k in range(3)])
+		else:
+			cell_bounds[key] = (wmin, wmax)
+
+	cell = b''
+	cdrw = b''
+	cmsh = b''
+	for key in sorted(cell_drawables.keys()):
+		drawables = cell_drawables[key]
+		#the cell's meshes (in file order), with vertices copied into a new vertex chunk:
+		used = set()
+		for transform, mesh in drawables:
+			used.add(mesh)
+			used.update(lods.get(mesh, []))
+		used = sorted(used)
+		remap = {}
+		vertices = b''
+		strings = b''
+		index = b''
+		for i in used:
+			name_begin, name_end, vertex_begin, vertex_end = entries[i]
+			remap[i] = len(index) // 16
+			begin = len(vertices) // vertex_size
+			vertices += vertex_data[vertex_begin*vertex_size:vertex_end*vertex_size]
+			index += struct.pack('IIII', len(strings), len(strings) + len(names[i]), begin, begin + (vertex_end - vertex_begin))
+			strings += names[i]
+		blob = chunk(vertex_magic, vertices) + chunk(b'str0', strings) + chunk(b'idx0', index)
+
+		cmin, cmax = cell_bounds[key]
+		drawable_begin = len(cdrw) // 8
+		for transform, mesh in drawables:
+			cdrw += struct.pack('II', transform, remap[mesh])
+		cell += struct.pack('3f3fIIII', *cmin, *cmax, len(cmsh), len(cmsh) + len(blob), drawable_begin, len(cdrw) // 8)
+		cmsh = pad(cmsh + blob)
+
+	print("Split into " + str(len(cell_drawables)) + " cells of size " + str(cell_size) + ".")
+	sections = [(b'scen', scene_data), (b'walk', walk_data), (b'cell', cell), (b'cdrw', cdrw), (b'cmsh', cmsh)]
+
+#lay out sections:
+
+toc_size = 8 + 16 * len(sections)
+offset = align(toc_size)
+toc = b''
+for kind, data in sections:
+	toc += struct.pack('4sIII', kind, offset, len(data), 0)
+	offset = align(offset + len(data))
+
+blob = open(outfile, 'wb')
+blob.write(struct.pack('4sI', b'lvl0', len(toc)))
+blob.write(toc)
+for kind, data in sections:
+	blob.write(b'\0' * (align(blob.tell()) - blob.tell()))
+	blob.write(data)
+blob.close()
+
+print("Wrote " + outfile + " (" + str(len(mesh_names)) + " meshes, " + str(len(mref) // 4) + " scene mesh references).")
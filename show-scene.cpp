@@ -4,6 +4,8 @@
 #include "GL.hpp"
 #include "load_save_png.hpp"
 #include "ShowSceneProgram.hpp"
+#include "gl_errors.hpp"
+#include "HotReload.hpp"
 
 #include <SDL.h>
 
@@ -24,7 +26,7 @@ int main(int argc, char **argv) {
 	//Initialize SDL library:
 	SDL_Init(SDL_INIT_VIDEO);
 
-	//Ask for an OpenGL context version 3.3, core profile, enable debug:
+	//Ask for an OpenGL context version 3.3, core profile, debug if diagnostics are on:
 	SDL_GL_ResetAttributes();
 	SDL_GL_SetAttribute(SDL_GL_RED_SIZE, 8);
 	SDL_GL_SetAttribute(SDL_GL_GREEN_SIZE, 8);
@@ -34,7 +36,7 @@ int main(int argc, char **argv) {
 	SDL_GL_SetAttribute(SDL_GL_STENCIL_SIZE, 8);
 	SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
-	SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, SDL_GL_CONTEXT_DEBUG_FLAG);
+	SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, gl_diagnostics_context_flags(GLDiagnosticsDefault));
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
 
@@ -68,6 +70,8 @@ int main(int argc, char **argv) {
 	//On windows, load OpenGL entrypoints: (does nothing on other platforms)
 	init_GL();
 
+	gl_diagnostics_init(GLDiagnosticsDefault);
+
 	//Set VSYNC + Late Swap (prevents crazy FPS):
 	if (SDL_GL_SetSwapInterval(-1) != 0) {
 		std::cerr << "NOTE: couldn't set vsync + late swap tearing (" << SDL_GetError() << ")." << std::endl;
@@ -95,7 +99,7 @@ int main(int argc, char **argv) {
 	GLuint buffer_vao = 0;
 	if (meshes_file != "") {
 		try {
-			buffer = new MeshBuffer(meshes_file);
+			buffer = new MeshBuffer(meshes_file, MeshBuffer::Reloadable); //(so changes to the file show up -- see below)
 			buffer_vao = buffer->make_vao_for_program(show_scene_program->program);
 		} catch (std::exception &e) {
 			std::cerr << "ERROR loading mesh buffer '" << meshes_file << "': " << e.what() << std::endl;
@@ -103,25 +107,32 @@ int main(int argc, char **argv) {
 			buffer = nullptr;
 		}
 	}
+	auto on_drawable = [&buffer,&buffer_vao](Scene &scene, Scene::Transform *transform, std::string const &mesh_name){
+		if (!buffer_vao) return;
+		Mesh const &mesh = buffer->lookup(mesh_name);
+
+		scene.drawables.emplace_back(transform);
+		Scene::Drawable &drawable = scene.drawables.back();
+
+		drawable.pipeline = show_scene_program_pipeline;
+
+		drawable.pipeline.vao = buffer_vao;
+		drawable.pipeline.type = mesh.type;
+		drawable.pipeline.start = mesh.start;
+		drawable.pipeline.count = mesh.count;
+		drawable.pipeline.index_type = mesh.index_type;
+		drawable.pipeline.base_vertex = mesh.base_vertex;
+
+		//bounds for culling and level-of-detail selection:
+		drawable.min = mesh.min;
+		drawable.max = mesh.max;
+		drawable.lod_mesh = &mesh;
+	};
 	Scene *scene = nullptr;
 	if (scene_file != "") {
 		try {
 			scene = new Scene();
-			scene->load(scene_file, [&buffer,&buffer_vao](Scene &scene, Scene::Transform *transform, std::string const &mesh_name){
-				if (!buffer_vao) return;
-				Mesh const &mesh = buffer->lookup(mesh_name);
-
-				scene.drawables.emplace_back(transform);
-				Scene::Drawable &drawable = scene.drawables.back();
-
-				drawable.pipeline = show_scene_program_pipeline;
-
-				drawable.pipeline.vao = buffer_vao;
-				drawable.pipeline.type = mesh.type;
-				drawable.pipeline.start = mesh.start;
-				drawable.pipeline.count = mesh.count;
-
-			});
+			scene->load(scene_file, on_drawable);
 		} catch (std::exception &e) {
 			std::cerr << "ERROR loading scene '" << scene_file << "': " << e.what() << std::endl;
 			usage = true;
@@ -141,7 +152,30 @@ int main(int argc, char **argv) {
 	} else {
 		std::cout << " no meshes -- consider passing a '.pnct' file as the second argument." << std::endl;
 	}
-	Mode::set_current(std::make_shared< ShowSceneMode >(*scene));
+	auto mode = std::make_shared< ShowSceneMode >(*scene, buffer);
+	Mode::set_current(mode);
+
+	//------------ hot reloading ------------
+	//re-exported files are picked up while the viewer runs:
+	HotReload hot_reload;
+	//the scene is small (just transforms and names), so is loaded again in full:
+	// (into a fresh scene first, so a bad file leaves the old one in place)
+	hot_reload.watch(scene_file, [&]() {
+		Scene fresh;
+		fresh.load(scene_file, on_drawable);
+		*scene = fresh;
+		std::cout << "Reloaded scene '" << scene_file << "' (" << scene->drawables.size() << " drawables)." << std::endl;
+		mode->update_mesh_stats();
+	});
+	//meshes are diffed, and only changed meshes are re-uploaded (see MeshBuffer::reload):
+	if (buffer) hot_reload.watch(meshes_file, [&]() {
+		auto before = std::chrono::high_resolution_clock::now();
+		std::vector< Mesh const * > changed = buffer->reload();
+		uint32_t patched = HotReload::patch_drawables(scene, changed);
+		float ms = std::chrono::duration< float, std::milli >(std::chrono::high_resolution_clock::now() - before).count();
+		std::cout << "Reloaded " << changed.size() << " changed meshes from '" << meshes_file << "' (" << patched << " drawables patched) in " << ms << "ms." << std::endl;
+		if (!changed.empty()) mode->update_mesh_stats();
+	});
 
 	//------------ main loop ------------
 
@@ -209,6 +243,8 @@ int main(int argc, char **argv) {
 
 			Mode::current->update(elapsed);
 			if (!Mode::current) break;
+
+			hot_reload.update(elapsed);
 		}
 
 		{ //(3) call the current mode's "draw" function to produce output:
@@ -218,6 +254,7 @@ int main(int argc, char **argv) {
 
 		//Wait until the recently-drawn frame is shown before doing it all again:
 		SDL_GL_SwapWindow(window);
+		gl_diagnostics_end_frame();
 	}
 
 